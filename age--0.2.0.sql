@@ -44,7 +44,8 @@ CREATE TABLE ag_label (
   graph oid NOT NULL,
   id label_id,
   kind label_kind,
-  relation regclass NOT NULL
+  relation regclass NOT NULL,
+  hash_partitions int NOT NULL
 ) WITH (OIDS);
 
 CREATE UNIQUE INDEX ag_label_oid_index ON ag_label USING btree (oid);
@@ -74,7 +75,9 @@ AS 'MODULE_PATHNAME';
 -- utility functions
 --
 
-CREATE FUNCTION create_graph(graph_name name)
+CREATE FUNCTION create_graph(graph_name name,
+                             partition_labels boolean = false,
+                             hash_partitions int = 0)
 RETURNS void
 LANGUAGE c
 AS 'MODULE_PATHNAME';
@@ -95,6 +98,40 @@ RETURNS void
 LANGUAGE c
 AS 'MODULE_PATHNAME';
 
+CREATE FUNCTION enable_degree_counters(graph_name name)
+RETURNS void
+LANGUAGE c
+AS 'MODULE_PATHNAME';
+
+CREATE FUNCTION _ag_degree_trigger()
+RETURNS trigger
+LANGUAGE c
+AS 'MODULE_PATHNAME';
+
+CREATE FUNCTION analyze_graph(graph_name name)
+RETURNS void
+LANGUAGE c
+AS 'MODULE_PATHNAME';
+
+CREATE FUNCTION build_csr_snapshot(graph_name name, edge_labels name[] = NULL)
+RETURNS void
+LANGUAGE c
+AS 'MODULE_PATHNAME';
+
+CREATE FUNCTION drop_csr_snapshot(graph_name name)
+RETURNS void
+LANGUAGE c
+AS 'MODULE_PATHNAME';
+
+CREATE FUNCTION csr_snapshot_info(graph_name name,
+                                  OUT edge_labels name[],
+                                  OUT vertices bigint,
+                                  OUT edges bigint,
+                                  OUT size bigint)
+RETURNS record
+LANGUAGE c
+AS 'MODULE_PATHNAME';
+
 --
 -- graphid type
 --
@@ -139,6 +176,13 @@ RETURNS NULL ON NULL INPUT
 PARALLEL SAFE
 AS 'MODULE_PATHNAME';
 
+CREATE FUNCTION graphid_eqjoinsel(internal, oid, internal, smallint, internal)
+RETURNS float8
+LANGUAGE c
+STABLE
+PARALLEL SAFE
+AS 'MODULE_PATHNAME';
+
 CREATE OPERATOR = (
   FUNCTION = graphid_eq,
   LEFTARG = graphid,
@@ -146,7 +190,9 @@ CREATE OPERATOR = (
   COMMUTATOR = =,
   NEGATOR = <>,
   RESTRICT = eqsel,
-  JOIN = eqjoinsel
+  JOIN = graphid_eqjoinsel,
+  HASHES,
+  MERGES
 );
 
 CREATE FUNCTION graphid_ne(graphid, graphid)
@@ -261,6 +307,26 @@ RETURNS NULL ON NULL INPUT
 PARALLEL SAFE
 AS 'MODULE_PATHNAME';
 
+--
+-- graphid - hash support functions
+--
+
+CREATE FUNCTION graphid_hash(graphid)
+RETURNS int
+LANGUAGE c
+IMMUTABLE
+RETURNS NULL ON NULL INPUT
+PARALLEL SAFE
+AS 'MODULE_PATHNAME';
+
+CREATE FUNCTION graphid_hash_extended(graphid, bigint)
+RETURNS bigint
+LANGUAGE c
+IMMUTABLE
+RETURNS NULL ON NULL INPUT
+PARALLEL SAFE
+AS 'MODULE_PATHNAME';
+
 --
 -- define operator classes for graphid
 --
@@ -288,6 +354,18 @@ CREATE OPERATOR CLASS graphid_ops DEFAULT FOR TYPE graphid USING btree AS
   FUNCTION 1 graphid_btree_cmp (graphid, graphid),
   FUNCTION 2 graphid_btree_sort (internal);
 
+-- hash strategies
+--   1: equal
+--
+-- hash support functions
+--   1: compute the 32-bit hash value of a key
+--   2: compute the 64-bit hash value of a key given a 64-bit salt, it is
+--      needed for hash partitioning
+CREATE OPERATOR CLASS graphid_ops DEFAULT FOR TYPE graphid USING hash AS
+  OPERATOR 1 =,
+  FUNCTION 1 graphid_hash (graphid),
+  FUNCTION 2 graphid_hash_extended (graphid, bigint);
+
 --
 -- graphid functions
 --
@@ -313,6 +391,121 @@ STABLE
 PARALLEL SAFE
 AS 'MODULE_PATHNAME';
 
+--
+-- graph analytics functions
+--
+
+CREATE FUNCTION csr_neighbors(graph_name name, id graphid,
+                              outgoing boolean = true)
+RETURNS SETOF graphid
+LANGUAGE c
+STABLE
+AS 'MODULE_PATHNAME';
+
+CREATE FUNCTION pagerank(graph_name name,
+                         edge_labels name[] = NULL,
+                         iterations int = 20,
+                         damping float8 = 0.85,
+                         tolerance float8 = 0.000001,
+                         OUT id graphid,
+                         OUT score float8)
+RETURNS SETOF record
+LANGUAGE c
+STABLE
+AS 'MODULE_PATHNAME';
+
+CREATE FUNCTION degree_centrality(graph_name name,
+                                  edge_labels name[] = NULL,
+                                  OUT id graphid,
+                                  OUT out_degree bigint,
+                                  OUT in_degree bigint,
+                                  OUT centrality float8)
+RETURNS SETOF record
+LANGUAGE c
+STABLE
+AS 'MODULE_PATHNAME';
+
+CREATE FUNCTION betweenness_centrality(graph_name name,
+                                       edge_labels name[] = NULL,
+                                       OUT id graphid,
+                                       OUT score float8)
+RETURNS SETOF record
+LANGUAGE c
+STABLE
+AS 'MODULE_PATHNAME';
+
+CREATE FUNCTION connected_components(graph_name name,
+                                     edge_labels name[] = NULL,
+                                     mode text = 'weak',
+                                     OUT id graphid,
+                                     OUT component bigint)
+RETURNS SETOF record
+LANGUAGE c
+STABLE
+AS 'MODULE_PATHNAME';
+
+CREATE FUNCTION louvain(graph_name name,
+                        edge_labels name[] = NULL,
+                        weight_key text = NULL,
+                        OUT id graphid,
+                        OUT community bigint)
+RETURNS SETOF record
+LANGUAGE c
+STABLE
+AS 'MODULE_PATHNAME';
+
+CREATE FUNCTION label_propagation(graph_name name,
+                                  edge_labels name[] = NULL,
+                                  iterations int = 20,
+                                  OUT id graphid,
+                                  OUT community bigint)
+RETURNS SETOF record
+LANGUAGE c
+STABLE
+AS 'MODULE_PATHNAME';
+
+CREATE FUNCTION extract_subgraph(graph_name name,
+                                 seeds graphid[],
+                                 k int,
+                                 edge_labels name[] = NULL,
+                                 direction text = 'both',
+                                 OUT id graphid,
+                                 OUT start_id graphid,
+                                 OUT end_id graphid,
+                                 OUT depth int)
+RETURNS SETOF record
+LANGUAGE c
+STABLE
+AS 'MODULE_PATHNAME';
+
+CREATE FUNCTION reachable(graph_name name,
+                          seeds graphid[],
+                          max_depth int = NULL,
+                          edge_labels name[] = NULL,
+                          direction text = 'out',
+                          OUT id graphid,
+                          OUT depth int)
+RETURNS SETOF record
+LANGUAGE c
+STABLE
+AS 'MODULE_PATHNAME';
+
+CREATE FUNCTION triangle_count(graph_name name, edge_labels name[] = NULL)
+RETURNS bigint
+LANGUAGE c
+STABLE
+AS 'MODULE_PATHNAME';
+
+CREATE FUNCTION clustering_coefficient(graph_name name,
+                                       edge_labels name[] = NULL,
+                                       OUT id graphid,
+                                       OUT triangles bigint,
+                                       OUT coefficient float8)
+RETURNS SETOF record
+LANGUAGE c
+STABLE
+AS 'MODULE_PATHNAME';
+
 --
 -- agtype type and its support functions
 --
@@ -336,9 +529,16 @@ RETURNS NULL ON NULL INPUT
 PARALLEL SAFE
 AS 'MODULE_PATHNAME';
 
+CREATE FUNCTION agtype_typanalyze(internal)
+RETURNS boolean
+LANGUAGE c
+RETURNS NULL ON NULL INPUT
+AS 'MODULE_PATHNAME';
+
 CREATE TYPE agtype (
   INPUT = agtype_in,
   OUTPUT = agtype_out,
+  ANALYZE = agtype_typanalyze,
   LIKE = jsonb
 );
 
@@ -445,6 +645,58 @@ CREATE OPERATOR ^ (
   RIGHTARG = agtype
 );
 
+--
+-- agtype - selectivity estimation for comparison operators
+--
+
+CREATE FUNCTION agtype_eqsel(internal, oid, internal, integer)
+RETURNS float8
+LANGUAGE c
+STABLE
+RETURNS NULL ON NULL INPUT
+PARALLEL SAFE
+AS 'MODULE_PATHNAME';
+
+CREATE FUNCTION agtype_neqsel(internal, oid, internal, integer)
+RETURNS float8
+LANGUAGE c
+STABLE
+RETURNS NULL ON NULL INPUT
+PARALLEL SAFE
+AS 'MODULE_PATHNAME';
+
+CREATE FUNCTION agtype_ltsel(internal, oid, internal, integer)
+RETURNS float8
+LANGUAGE c
+STABLE
+RETURNS NULL ON NULL INPUT
+PARALLEL SAFE
+AS 'MODULE_PATHNAME';
+
+CREATE FUNCTION agtype_lesel(internal, oid, internal, integer)
+RETURNS float8
+LANGUAGE c
+STABLE
+RETURNS NULL ON NULL INPUT
+PARALLEL SAFE
+AS 'MODULE_PATHNAME';
+
+CREATE FUNCTION agtype_gtsel(internal, oid, internal, integer)
+RETURNS float8
+LANGUAGE c
+STABLE
+RETURNS NULL ON NULL INPUT
+PARALLEL SAFE
+AS 'MODULE_PATHNAME';
+
+CREATE FUNCTION agtype_gesel(internal, oid, internal, integer)
+RETURNS float8
+LANGUAGE c
+STABLE
+RETURNS NULL ON NULL INPUT
+PARALLEL SAFE
+AS 'MODULE_PATHNAME';
+
 --
 -- agtype - comparison operators (=, <>, <, >, <=, >=)
 --
@@ -463,7 +715,7 @@ CREATE OPERATOR = (
   RIGHTARG = agtype,
   COMMUTATOR = =,
   NEGATOR = <>,
-  RESTRICT = eqsel,
+  RESTRICT = agtype_eqsel,
   JOIN = eqjoinsel
 );
 
@@ -481,7 +733,7 @@ CREATE OPERATOR <> (
   RIGHTARG = agtype,
   COMMUTATOR = <>,
   NEGATOR = =,
-  RESTRICT = neqsel,
+  RESTRICT = agtype_neqsel,
   JOIN = neqjoinsel
 );
 
@@ -499,7 +751,7 @@ CREATE OPERATOR < (
   RIGHTARG = agtype,
   COMMUTATOR = >,
   NEGATOR = >=,
-  RESTRICT = scalarltsel,
+  RESTRICT = agtype_ltsel,
   JOIN = scalarltjoinsel
 );
 
@@ -517,7 +769,7 @@ CREATE OPERATOR > (
   RIGHTARG = agtype,
   COMMUTATOR = <,
   NEGATOR = <=,
-  RESTRICT = scalargtsel,
+  RESTRICT = agtype_gtsel,
   JOIN = scalargtjoinsel
 );
 
@@ -535,7 +787,7 @@ CREATE OPERATOR <= (
   RIGHTARG = agtype,
   COMMUTATOR = >=,
   NEGATOR = >,
-  RESTRICT = scalarlesel,
+  RESTRICT = agtype_lesel,
   JOIN = scalarlejoinsel
 );
 
@@ -553,7 +805,7 @@ CREATE OPERATOR >= (
   RIGHTARG = agtype,
   COMMUTATOR = <=,
   NEGATOR = <,
-  RESTRICT = scalargesel,
+  RESTRICT = agtype_gesel,
   JOIN = scalargejoinsel
 );
 
@@ -568,6 +820,14 @@ RETURNS NULL ON NULL INPUT
 PARALLEL SAFE
 AS 'MODULE_PATHNAME';
 
+CREATE FUNCTION agtype_to_graphid(agtype)
+RETURNS graphid
+LANGUAGE c
+IMMUTABLE
+RETURNS NULL ON NULL INPUT
+PARALLEL SAFE
+AS 'MODULE_PATHNAME';
+
 --
 -- agtype - path
 --
@@ -694,6 +954,27 @@ AS 'MODULE_PATHNAME';
 CREATE CAST (boolean AS agtype)
 WITH FUNCTION bool_to_agtype(boolean);
 
+-- bigint -> agtype (explicit)
+
+CREATE FUNCTION int8_to_agtype(bigint)
+RETURNS agtype
+LANGUAGE c
+STABLE
+RETURNS NULL ON NULL INPUT
+PARALLEL SAFE
+AS 'MODULE_PATHNAME';
+
+CREATE CAST (bigint AS agtype)
+WITH FUNCTION int8_to_agtype(bigint);
+
+CREATE FUNCTION _estimate_label_count(regclass)
+RETURNS agtype
+LANGUAGE c
+STABLE
+RETURNS NULL ON NULL INPUT
+PARALLEL SAFE
+AS 'MODULE_PATHNAME';
+
 --
 -- agtype - access operators
 --
@@ -780,6 +1061,42 @@ COST 10
 ROWS 60
 AS 'MODULE_PATHNAME';
 
+--
+-- query statistics
+--
+CREATE FUNCTION ag_stat_cypher(OUT userid oid,
+                               OUT dbid oid,
+                               OUT queryid bigint,
+                               OUT query text,
+                               OUT calls bigint,
+                               OUT total_time float8,
+                               OUT min_time float8,
+                               OUT max_time float8,
+                               OUT mean_time float8,
+                               OUT stddev_time float8,
+                               OUT rows bigint,
+                               OUT shared_blks_hit bigint,
+                               OUT shared_blks_read bigint,
+                               OUT parse_time float8,
+                               OUT analyze_time float8,
+                               OUT plan_time float8)
+RETURNS SETOF record
+LANGUAGE c
+PARALLEL SAFE
+AS 'MODULE_PATHNAME';
+
+CREATE VIEW ag_stat_cypher AS SELECT * FROM ag_stat_cypher();
+
+GRANT SELECT ON ag_stat_cypher TO PUBLIC;
+
+CREATE FUNCTION ag_stat_cypher_reset()
+RETURNS void
+LANGUAGE c
+PARALLEL SAFE
+AS 'MODULE_PATHNAME';
+
+REVOKE ALL ON FUNCTION ag_stat_cypher_reset() FROM PUBLIC;
+
 --
 -- Scalar Functions
 --
@@ -847,6 +1164,22 @@ RETURNS NULL ON NULL INPUT
 PARALLEL SAFE
 AS 'MODULE_PATHNAME';
 
+CREATE FUNCTION out_degree(agtype, agtype)
+RETURNS agtype
+LANGUAGE c
+STABLE
+RETURNS NULL ON NULL INPUT
+PARALLEL SAFE
+AS 'MODULE_PATHNAME';
+
+CREATE FUNCTION in_degree(agtype, agtype)
+RETURNS agtype
+LANGUAGE c
+STABLE
+RETURNS NULL ON NULL INPUT
+PARALLEL SAFE
+AS 'MODULE_PATHNAME';
+
 CREATE FUNCTION length(agtype)
 RETURNS agtype
 LANGUAGE c
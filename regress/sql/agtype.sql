@@ -307,6 +307,16 @@ SELECT bool_to_agtype(null);
 SELECT bool_to_agtype(true) = bool_to_agtype(true);
 SELECT bool_to_agtype(true) <> bool_to_agtype(false);
 
+--
+-- Test agtype to graphid cast
+--
+SELECT agtype_to_graphid(agtype_in('1'));
+-- These should all fail
+SELECT agtype_to_graphid(agtype_in('null'));
+SELECT agtype_to_graphid(agtype_in('"string"'));
+SELECT agtype_to_graphid(agtype_in('[1,2,3]'));
+SELECT agtype_to_graphid(agtype_in('{"id":1}'));
+
 --
 -- Map Literal
 --
@@ -515,10 +525,54 @@ SELECT agtype_string_match_starts_with('"abcdefghijklmnopqrstuvwxyz"', '"bcde"')
 SELECT agtype_string_match_ends_with('"abcdefghijklmnopqrstuvwxyz"', '"vwxy"');
 SELECT agtype_string_match_contains('"abcdefghijklmnopqrstuvwxyz"', '"hijl"');
 
+--
+-- Per-key statistics and selectivity estimation
+--
+CREATE TABLE agtype_stats (properties agtype);
+INSERT INTO agtype_stats
+SELECT ('{"id": ' || i || ', "kind": "' ||
+        CASE WHEN i % 10 = 0 THEN 'rare' ELSE 'common' END || '"}')::agtype
+FROM generate_series(1, 100) AS i;
+ANALYZE agtype_stats;
+
+SELECT agtype_access_operator(s, '"key"') AS key,
+       agtype_access_operator(s, '"null_frac"') AS null_frac,
+       agtype_access_operator(s, '"n_distinct"') AS n_distinct,
+       agtype_access_operator(s, '"mcv"') AS mcv,
+       agtype_access_operator(s, '"mcv_freqs"') AS mcv_freqs
+FROM pg_statistic,
+     unnest((CASE 8300 WHEN stakind1 THEN stavalues1::text
+                       WHEN stakind2 THEN stavalues2::text
+                       WHEN stakind3 THEN stavalues3::text
+                       WHEN stakind4 THEN stavalues4::text
+                       WHEN stakind5 THEN stavalues5::text
+             END)::agtype[]) AS s
+WHERE starelid = 'agtype_stats'::regclass;
+
+CREATE FUNCTION plan_rows(query text) RETURNS integer AS $$
+DECLARE
+    plan json;
+BEGIN
+    EXECUTE 'EXPLAIN (FORMAT JSON) ' || query INTO plan;
+    RETURN (plan->0->'Plan'->>'Plan Rows')::integer;
+END;
+$$ LANGUAGE plpgsql;
+
+SELECT plan_rows('SELECT * FROM agtype_stats
+ WHERE agtype_access_operator(properties, ''"kind"'') = ''"rare"''');
+SELECT plan_rows('SELECT * FROM agtype_stats
+ WHERE agtype_access_operator(properties, ''"kind"'') = ''"common"''');
+SELECT plan_rows('SELECT * FROM agtype_stats
+ WHERE agtype_access_operator(properties, ''"id"'') = ''5''');
+SELECT plan_rows('SELECT * FROM agtype_stats
+ WHERE agtype_access_operator(properties, ''"id"'') < ''11''');
+
 --
 -- Cleanup
 --
 DROP TABLE agtype_table;
+DROP TABLE agtype_stats;
+DROP FUNCTION plan_rows(text);
 
 --
 -- End of AGTYPE data type regression tests
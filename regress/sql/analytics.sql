@@ -0,0 +1,313 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+LOAD 'age';
+SET search_path TO ag_catalog;
+
+SELECT create_graph('analytics');
+
+SELECT * FROM cypher('analytics', $$
+	CREATE (a:v {name:'a'})-[:e]->(:v {name:'b'})-[:e]->(c:v {name:'c'})-[:e]->(a)
+$$) AS (a agtype);
+
+SELECT * FROM cypher('analytics', $$
+	MATCH (a:v), (c:v)
+	WHERE a.name = 'a' AND c.name = 'c'
+	CREATE (a)-[:e]->(c)
+$$) AS (a agtype);
+
+SELECT * FROM cypher('analytics', $$
+	CREATE (:v {name:'d'})-[:f]->(:v {name:'e'})
+$$) AS (a agtype);
+
+--
+-- CSR snapshots
+--
+SELECT build_csr_snapshot('analytics');
+
+SELECT edge_labels, vertices, edges FROM csr_snapshot_info('analytics');
+
+SELECT v.properties
+FROM csr_neighbors('analytics',
+                   (SELECT id FROM analytics.v ORDER BY id LIMIT 1)) AS n(id)
+JOIN analytics.v AS v ON v.id = n.id
+ORDER BY v.id;
+
+SELECT v.properties
+FROM csr_neighbors('analytics',
+                   (SELECT id FROM analytics.v ORDER BY id LIMIT 1),
+                   false) AS n(id)
+JOIN analytics.v AS v ON v.id = n.id
+ORDER BY v.id;
+
+SELECT build_csr_snapshot('analytics', ARRAY['f']::name[]);
+
+SELECT edge_labels, vertices, edges FROM csr_snapshot_info('analytics');
+
+SELECT build_csr_snapshot('analytics', ARRAY['v']::name[]);
+
+CREATE ROLE regress_analytics_reader;
+SET ROLE regress_analytics_reader;
+
+SELECT build_csr_snapshot('analytics');
+
+SELECT drop_csr_snapshot('analytics');
+
+SELECT edge_labels, vertices, edges FROM csr_snapshot_info('analytics');
+
+SELECT * FROM pagerank('analytics');
+
+RESET ROLE;
+DROP ROLE regress_analytics_reader;
+
+SELECT drop_csr_snapshot('analytics');
+
+SELECT edge_labels, vertices, edges FROM csr_snapshot_info('analytics');
+
+SELECT * FROM csr_neighbors('analytics', '1'::graphid);
+
+--
+-- Centrality
+--
+SELECT v.properties, round(p.score::numeric, 4) AS score
+FROM pagerank('analytics', ARRAY['e']::name[]) AS p
+JOIN analytics.v AS v ON v.id = p.id
+ORDER BY v.id;
+
+SELECT v.properties, d.out_degree, d.in_degree, d.centrality
+FROM degree_centrality('analytics') AS d
+JOIN analytics.v AS v ON v.id = d.id
+ORDER BY v.id;
+
+SELECT v.properties, b.score
+FROM betweenness_centrality('analytics') AS b
+JOIN analytics.v AS v ON v.id = b.id
+ORDER BY v.id;
+
+-- the traversal workers compute the same scores
+SET age.traversal_parallel_threshold = 0;
+SET age.max_traversal_workers = 2;
+
+SELECT v.properties, round(p.score::numeric, 4) AS score
+FROM pagerank('analytics', ARRAY['e']::name[]) AS p
+JOIN analytics.v AS v ON v.id = p.id
+ORDER BY v.id;
+
+SELECT v.properties, b.score
+FROM betweenness_centrality('analytics') AS b
+JOIN analytics.v AS v ON v.id = b.id
+ORDER BY v.id;
+
+RESET age.max_traversal_workers;
+RESET age.traversal_parallel_threshold;
+
+SELECT * FROM pagerank('analytics', NULL, 20, 2);
+
+--
+-- Connected components
+--
+SELECT v.properties, c.component
+FROM connected_components('analytics') AS c
+JOIN analytics.v AS v ON v.id = c.id
+ORDER BY v.id;
+
+SELECT v.properties, c.component
+FROM connected_components('analytics', NULL, 'strong') AS c
+JOIN analytics.v AS v ON v.id = c.id
+ORDER BY v.id;
+
+-- the traversal workers find the same components
+SET age.traversal_parallel_threshold = 0;
+SET age.max_traversal_workers = 2;
+
+SELECT v.properties, c.component
+FROM connected_components('analytics') AS c
+JOIN analytics.v AS v ON v.id = c.id
+ORDER BY v.id;
+
+SELECT v.properties, c.component
+FROM connected_components('analytics', NULL, 'strong') AS c
+JOIN analytics.v AS v ON v.id = c.id
+ORDER BY v.id;
+
+RESET age.max_traversal_workers;
+RESET age.traversal_parallel_threshold;
+
+SELECT * FROM connected_components('analytics', NULL, 'both');
+
+--
+-- Triangles
+--
+SELECT triangle_count('analytics');
+
+SELECT triangle_count('analytics', ARRAY['f']::name[]);
+
+SELECT v.properties, c.triangles, c.coefficient
+FROM clustering_coefficient('analytics') AS c
+JOIN analytics.v AS v ON v.id = c.id
+ORDER BY v.id;
+
+-- the traversal workers count the same triangles
+SET age.traversal_parallel_threshold = 0;
+SET age.max_traversal_workers = 2;
+
+SELECT triangle_count('analytics');
+
+SELECT triangle_count('analytics', ARRAY['f']::name[]);
+
+SELECT v.properties, c.triangles, c.coefficient
+FROM clustering_coefficient('analytics') AS c
+JOIN analytics.v AS v ON v.id = c.id
+ORDER BY v.id;
+
+RESET age.max_traversal_workers;
+RESET age.traversal_parallel_threshold;
+
+--
+-- Communities
+--
+SELECT v.properties, c.community
+FROM louvain('analytics') AS c
+JOIN analytics.v AS v ON v.id = c.id
+ORDER BY v.id;
+
+SELECT v.properties, c.community
+FROM louvain('analytics', ARRAY['e']::name[], 'weight') AS c
+JOIN analytics.v AS v ON v.id = c.id
+ORDER BY v.id;
+
+SELECT v.properties, c.community
+FROM label_propagation('analytics') AS c
+JOIN analytics.v AS v ON v.id = c.id
+ORDER BY v.id;
+
+-- the traversal workers find the same communities, but Louvain's
+-- depend on how their moves interleave
+SET age.traversal_parallel_threshold = 0;
+SET age.max_traversal_workers = 2;
+
+SELECT v.properties, c.community
+FROM label_propagation('analytics') AS c
+JOIN analytics.v AS v ON v.id = c.id
+ORDER BY v.id;
+
+SELECT count(*) = (SELECT count(*) FROM analytics.v) AS every_vertex,
+       count(DISTINCT c.id) = count(*) AS once,
+       max(c.community) = count(DISTINCT c.community) AS numbered
+FROM louvain('analytics') AS c
+JOIN analytics.v AS v ON v.id = c.id;
+
+RESET age.max_traversal_workers;
+RESET age.traversal_parallel_threshold;
+
+--
+-- Subgraphs
+--
+SELECT v.properties, s.depth
+FROM extract_subgraph('analytics',
+                      ARRAY(SELECT id FROM analytics.v ORDER BY id
+                            OFFSET 1 LIMIT 1),
+                      1, NULL, 'out') AS s
+JOIN analytics.v AS v ON v.id = s.id
+ORDER BY v.id;
+
+SELECT v.properties, s.depth
+FROM extract_subgraph('analytics',
+                      ARRAY(SELECT id FROM analytics.v ORDER BY id
+                            OFFSET 1 LIMIT 1),
+                      2) AS s
+JOIN analytics.v AS v ON v.id = s.id
+ORDER BY v.id;
+
+SELECT s.depth, a.properties, b.properties
+FROM extract_subgraph('analytics',
+                      ARRAY(SELECT id FROM analytics.v ORDER BY id
+                            OFFSET 1 LIMIT 1),
+                      2) AS s
+JOIN analytics.v AS a ON a.id = s.start_id
+JOIN analytics.v AS b ON b.id = s.end_id
+ORDER BY s.depth, a.id, b.id;
+
+SELECT v.properties, s.depth
+FROM extract_subgraph('analytics',
+                      ARRAY(SELECT id FROM analytics.v ORDER BY id
+                            OFFSET 3 LIMIT 1),
+                      5, ARRAY['e']::name[]) AS s
+JOIN analytics.v AS v ON v.id = s.id
+ORDER BY v.id;
+
+-- an edge, a vertex that does not exist, and an id of no label
+SELECT *
+FROM extract_subgraph('analytics',
+                      ARRAY[(SELECT id FROM analytics.e ORDER BY id LIMIT 1),
+                            ((SELECT max(id) FROM analytics.v)::text::bigint
+                             + 1)::text::graphid,
+                            '1'::graphid],
+                      1);
+
+SELECT * FROM extract_subgraph('analytics', ARRAY[]::graphid[], 1, NULL,
+                               'sideways');
+
+--
+-- Reachability
+--
+SELECT v.properties, r.depth
+FROM reachable('analytics',
+               ARRAY(SELECT id FROM analytics.v ORDER BY id LIMIT 1)) AS r
+JOIN analytics.v AS v ON v.id = r.id
+ORDER BY v.id;
+
+SELECT v.properties, r.depth
+FROM reachable('analytics',
+               ARRAY(SELECT id FROM analytics.v ORDER BY id LIMIT 1),
+               0) AS r
+JOIN analytics.v AS v ON v.id = r.id
+ORDER BY v.id;
+
+SELECT v.properties, r.depth
+FROM reachable('analytics',
+               ARRAY(SELECT id FROM analytics.v ORDER BY id DESC LIMIT 1),
+               NULL, NULL, 'in') AS r
+JOIN analytics.v AS v ON v.id = r.id
+ORDER BY v.id;
+
+SET age.traversal_parallel_threshold = 0;
+SET age.max_traversal_workers = 2;
+
+SELECT v.properties, r.depth
+FROM reachable('analytics',
+               ARRAY(SELECT id FROM analytics.v ORDER BY id OFFSET 2 LIMIT 1),
+               NULL, NULL, 'both') AS r
+JOIN analytics.v AS v ON v.id = r.id
+ORDER BY v.id;
+
+RESET age.max_traversal_workers;
+RESET age.traversal_parallel_threshold;
+
+SELECT * FROM reachable('analytics', ARRAY[]::graphid[], -1);
+
+--
+-- Clean up
+--
+SELECT build_csr_snapshot('analytics');
+
+BEGIN;
+SELECT drop_graph('analytics', true);
+ROLLBACK;
+
+SELECT edge_labels, vertices, edges FROM csr_snapshot_info('analytics');
+
+SELECT drop_graph('analytics', true);
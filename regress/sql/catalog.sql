@@ -97,6 +97,65 @@ SELECT alter_graph('GraphB', 'RENAME', NULL);
 -- Verify invalid input check for operation parameter.
 SELECT alter_graph('GraphB', 'DUMMY', 'GraphA');
 
+--
+-- partitioned label tables
+--
+
+SELECT create_graph('p', true);
+
+SELECT * FROM cypher('p', $$CREATE (:v)-[:e]->()$$) AS r(a agtype);
+
+-- the table of every other label is a partition of a default label table
+SELECT c.relname, c.relkind, p.relname AS parent,
+       pg_get_expr(c.relpartbound, c.oid) AS bound
+FROM pg_inherits i
+     JOIN pg_class c ON c.oid = i.inhrelid
+     JOIN pg_class p ON p.oid = i.inhparent
+WHERE c.relnamespace = 'p'::regnamespace
+ORDER BY c.relname;
+
+SELECT * FROM cypher('p', $$MATCH (a)-[e]->(b) RETURN a, e, b$$)
+AS (a agtype, e agtype, b agtype);
+
+SET client_min_messages = warning;
+SELECT drop_graph('p', true);
+RESET client_min_messages;
+
+--
+-- hash partitioned label tables
+--
+
+SELECT create_graph('h', hash_partitions => 2);
+
+SELECT * FROM cypher('h', $$CREATE (:v)-[:e]->()$$) AS r(a agtype);
+
+SELECT name, id, kind, hash_partitions FROM ag_label;
+
+-- vertices are hashed on id and edges on start_id
+SELECT c.relname, c.relkind, p.relname AS parent,
+       pg_get_expr(c.relpartbound, c.oid) AS bound
+FROM pg_inherits i
+     JOIN pg_class c ON c.oid = i.inhrelid
+     JOIN pg_class p ON p.oid = i.inhparent
+WHERE c.relnamespace = 'h'::regnamespace
+ORDER BY c.relname;
+
+-- an edge is stored in the partition of its start vertex
+SELECT count(*)
+FROM h._ag_label_edge e
+     JOIN h._ag_label_vertex v ON v.id = e.start_id
+WHERE right(e.tableoid::regclass::text, 3) =
+      right(v.tableoid::regclass::text, 3);
+
+SELECT * FROM cypher('h', $$MATCH (a)-[e]->(b) RETURN a, e, b$$)
+AS (a agtype, e agtype, b agtype);
+
+SELECT create_graph('h2', hash_partitions => -1);
+
+SET client_min_messages = warning;
+SELECT drop_graph('h', true);
+RESET client_min_messages;
+
 --
 -- label id test
 --
@@ -177,7 +177,7 @@ SELECT * FROM cypher_create.n_var;
 SELECT * FROM cypher_create.e_var;
 
 --Check every label has been created
-SELECT * FROM ag_label;
+SELECT name, id, kind, relation, hash_partitions FROM ag_label;
 
 --Validate every vertex has the correct label
 SELECT * FROM cypher('cypher_create', $$MATCH (n) RETURN n$$) AS (n agtype);
@@ -227,5 +227,65 @@ $$) as t(b agtype);
 SELECT * FROM cypher('cypher_create', $$CREATE ()$$) AS (a int);
 SELECT * FROM cypher('cypher_create', $$CREATE ()$$) AS (a agtype, b int);
 
+-- degree counters
+SELECT create_graph('degree');
+SELECT * FROM cypher('degree', $$
+	CREATE (:p {name: 'a'})-[:r]->(:p {name: 'b'})
+$$) as (a agtype);
+SELECT * FROM cypher('degree', $$
+	MATCH (a:p)
+	WHERE a.name = 'a'
+	CREATE (a)-[:r]->(:p {name: 'c'})
+$$) as (a agtype);
+-- without degree counters, the edges of the vertices are counted
+SELECT * FROM cypher('degree', $$
+	MATCH (v:p)
+	RETURN v.name, outDegree(v), inDegree(v)
+$$) as (name agtype, out_degree agtype, in_degree agtype);
+SELECT enable_degree_counters('degree');
+SELECT enable_degree_counters('degree');
+SELECT * FROM cypher('degree', $$
+	MATCH (v:p)
+	WHERE v.name = 'c'
+	CREATE (v)-[:r]->(v)
+$$) as (a agtype);
+-- the edges of a statement are added to the counters of a vertex at once
+SELECT * FROM cypher('degree', $$
+	MATCH (v:p)
+	WHERE v.name = 'a'
+	CREATE (v)-[:r]->(:p {name: 'd'}), (v)-[:r]->(:p {name: 'e'})
+$$) as (a agtype);
+SELECT * FROM cypher('degree', $$
+	MATCH (v:p)
+	RETURN v.name, outDegree(v), inDegree(v)
+$$) as (name agtype, out_degree agtype, in_degree agtype);
+-- SQL statements on the edge tables keep the counters up to date
+DELETE FROM degree.r WHERE start_id = end_id;
+UPDATE degree.r SET end_id = start_id
+WHERE id = (SELECT id FROM degree.r ORDER BY end_id DESC LIMIT 1);
+SELECT * FROM cypher('degree', $$
+	MATCH (v:p)
+	RETURN v.name, outDegree(v), inDegree(v)
+$$) as (name agtype, out_degree agtype, in_degree agtype);
+-- so do they on the tables of the edge labels created later
+SELECT * FROM cypher('degree', $$
+	MATCH (a:p), (b:p)
+	WHERE a.name = 'a' AND b.name = 'b'
+	CREATE (a)-[:q]->(b)
+$$) as (a agtype);
+INSERT INTO degree.q (start_id, end_id) SELECT end_id, start_id FROM degree.q;
+TRUNCATE degree.r;
+SELECT * FROM cypher('degree', $$
+	MATCH (v:p)
+	RETURN v.name, outDegree(v), inDegree(v)
+$$) as (name agtype, out_degree agtype, in_degree agtype);
+-- the counters of a dropped label are removed
+SELECT drop_label('degree', 'q');
+SELECT * FROM cypher('degree', $$
+	MATCH (v:p)
+	RETURN v.name, outDegree(v), inDegree(v)
+$$) as (name agtype, out_degree agtype, in_degree agtype);
+SELECT drop_graph('degree', true);
+
 -- intial and last vertex point to the middle vertex
 SELECT drop_graph('cypher_create', true);
@@ -213,6 +213,63 @@ SELECT * FROM cypher('cypher_match', $$
 	RETURN a.i, b.id, c.id
 $$) AS (i agtype, b agtype, c agtype);
 
+-- the WHERE of a WITH in between MATCH clauses
+SELECT * FROM cypher('cypher_match', $$
+	MATCH (a:v1)-[:e1]->(b:v1)
+	WITH a, b WHERE b.id = 'middle'
+	MATCH (b)-[:e1]->(c:v1)
+	MATCH (d:v1)-[:e1]->(c)
+	RETURN a.id, c.id, d.id
+$$) AS (a agtype, c agtype, d agtype);
+
+-- the relations that a plan scans, parenthesized as the plan joins them
+CREATE FUNCTION plan_tree(node json) RETURNS text AS $$
+DECLARE
+    children text[] := '{}';
+    child json;
+BEGIN
+    FOR child IN SELECT json_array_elements(node->'Plans') LOOP
+        IF child->>'Parent Relationship' NOT IN ('InitPlan', 'SubPlan') THEN
+            children := children || plan_tree(child);
+        END IF;
+    END LOOP;
+
+    IF array_length(children, 1) IS NULL THEN
+        RETURN coalesce(node->>'Alias', node->>'Node Type');
+    ELSIF node->>'Node Type' = 'Custom Scan' THEN
+        RETURN (node->>'Custom Plan Provider') ||
+               (SELECT '(' || string_agg(c, ' ' ORDER BY c COLLATE "C") || ')'
+                FROM unnest(children) AS c);
+    ELSIF array_length(children, 1) = 1 THEN
+        RETURN children[1];
+    END IF;
+
+    RETURN (SELECT '(' || string_agg(c, ' ' ORDER BY c COLLATE "C") || ')'
+            FROM unnest(children) AS c);
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE FUNCTION explain_tree(query text) RETURNS text AS $$
+DECLARE
+    plan json;
+BEGIN
+    EXECUTE 'EXPLAIN (COSTS OFF, FORMAT JSON) ' || query INTO plan;
+    RETURN plan_tree(plan->0->'Plan');
+END;
+$$ LANGUAGE plpgsql;
+
+-- quals are pushed down across the MATCH clauses, which are planned as one
+SET from_collapse_limit = 1;
+
+SELECT explain_tree($q$SELECT * FROM cypher('cypher_match', $$
+	MATCH (a:v1)
+	MATCH (b:v1)
+	MATCH (c:v1) WHERE a.id = c.id
+	RETURN a.id, b.id, c.id
+$$) AS (a agtype, b agtype, c agtype)$q$) AS plan;
+
+RESET from_collapse_limit;
+
 -- need a following RETURN clause (should fail)
 SELECT * FROM cypher('cypher_match', $$MATCH (n:v)$$) AS (a agtype);
 
@@ -295,6 +352,207 @@ SELECT * FROM cypher('cypher_match',
  $$MATCH (u)-[e]->(v) WHERE EXISTS((u)-[e]->(u)) AND EXISTS((v)-[e]->(v)) RETURN u, e, v $$)
 AS (u agtype, e agtype, v agtype);
 
+-- Sub-patterns are semi-joins, so each path is returned once
+SELECT * FROM cypher('cypher_match',
+ $$MATCH (u:v2) WHERE EXISTS((u)-[]-()) RETURN u.id $$)
+AS (id agtype);
+
+-- NOT EXISTS keeps the paths the sub-pattern does not match
+SELECT * FROM cypher('cypher_match',
+ $$MATCH (u:v1) WHERE NOT EXISTS((u)-[]->()) RETURN u.id $$)
+AS (id agtype);
+
+-- Anonymous vertices with a label filter the edges on their label id range
+SELECT * FROM cypher('cypher_match',
+ $$MATCH (:loop)-[e]->() RETURN e $$)
+AS (e agtype);
+
+SELECT * FROM cypher('cypher_match',
+ $$MATCH ()-[e]->(:v1) RETURN e $$)
+AS (e agtype);
+
+-- Vertices are looked up by id in the label table the id belongs to
+SET enable_hashjoin = off;
+SET enable_mergejoin = off;
+
+SELECT * FROM cypher('cypher_match',
+ $$MATCH (a)-[:e1]->(b) WHERE b.id = 'end' RETURN a.id $$)
+AS (a agtype);
+
+CREATE FUNCTION explain_json(query text) RETURNS text AS $$
+DECLARE
+    plan json;
+BEGIN
+    EXECUTE 'EXPLAIN (COSTS OFF, FORMAT JSON) ' || query INTO plan;
+    RETURN plan::text;
+END;
+$$ LANGUAGE plpgsql;
+
+-- instead of an Append of the tables of all the vertex labels
+SELECT position('"Cypher Label Scan"' IN plan) > 0 AS label_scan,
+       position('"Append"' IN plan) = 0 AS no_append
+FROM explain_json($q$SELECT * FROM cypher('cypher_match',
+ $$MATCH (a)-[:e1]->(b) WHERE b.id = 'end' RETURN a.id $$)
+AS (a agtype)$q$) AS plan;
+
+DROP FUNCTION explain_json(text);
+
+RESET enable_hashjoin;
+RESET enable_mergejoin;
+
+-- Label counts are answered from the label table
+SELECT * FROM cypher('cypher_match',
+ $$MATCH (u:v1) RETURN count(u) $$)
+AS (c agtype);
+
+SELECT * FROM cypher('cypher_match',
+ $$MATCH ()-[e:e1]->() RETURN count(e) $$)
+AS (c agtype);
+
+ANALYZE cypher_match.v1;
+SET age.approximate_count = on;
+
+SELECT * FROM cypher('cypher_match',
+ $$MATCH (u:v1) RETURN count(u) $$)
+AS (c agtype);
+
+RESET age.approximate_count;
+
+-- Graph statistics
+ANALYZE cypher_match.v1, cypher_match.v2, cypher_match.e1,
+        cypher_match._ag_label_edge;
+
+CREATE FUNCTION plan_rows(query text) RETURNS integer AS $$
+DECLARE
+    plan json;
+BEGIN
+    EXECUTE 'EXPLAIN (FORMAT JSON) ' || query INTO plan;
+    RETURN (plan->0->'Plan'->>'Plan Rows')::integer;
+END;
+$$ LANGUAGE plpgsql;
+
+-- without them, the joins are estimated from the ids alone
+SELECT plan_rows('SELECT * FROM cypher_match.e1 AS e
+ JOIN cypher_match.v2 AS v ON e.start_id = v.id');
+SELECT plan_rows('SELECT * FROM cypher_match.v1 AS v
+ WHERE EXISTS (SELECT 1 FROM cypher_match._ag_label_edge AS e
+               WHERE e.start_id = v.id)');
+
+SELECT analyze_graph('cypher_match');
+
+SELECT e.name AS label, s.name AS start_label, t.name AS end_label, p.edges
+FROM cypher_match._ag_edge_label_pairs AS p
+JOIN ag_graph AS g ON g.name = 'cypher_match'
+JOIN ag_label AS e ON e.graph = g.oid AND e.id = p.label_id
+JOIN ag_label AS s ON s.graph = g.oid AND s.id = p.start_label_id
+JOIN ag_label AS t ON t.graph = g.oid AND t.id = p.end_label_id
+ORDER BY label;
+
+SELECT l.name AS label, d.edges, d.start_vertices, d.avg_out_degree,
+       d.max_out_degree, d.end_vertices, d.avg_in_degree, d.max_in_degree
+FROM cypher_match._ag_edge_label_degrees AS d
+JOIN ag_graph AS g ON g.name = 'cypher_match'
+JOIN ag_label AS l ON l.graph = g.oid AND l.id = d.label_id
+ORDER BY label;
+
+-- no edge of e1 starts at a vertex of v2
+SELECT plan_rows('SELECT * FROM cypher_match.e1 AS e
+ JOIN cypher_match.v2 AS v ON e.start_id = v.id');
+-- only the vertices that have outgoing edges match
+SELECT plan_rows('SELECT * FROM cypher_match.v1 AS v
+ WHERE EXISTS (SELECT 1 FROM cypher_match._ag_label_edge AS e
+               WHERE e.start_id = v.id)');
+
+DROP FUNCTION plan_rows(text);
+
+-- Long patterns are joined along the pattern
+SET geqo_threshold = 2;
+
+SELECT * FROM cypher('cypher_match', $$
+	MATCH (a:v1)-[:e1]->(b:v1)-[:e1]->(c:v1) RETURN a.id, b.id, c.id
+$$) AS (a agtype, b agtype, c agtype);
+
+-- it starts from the most selective relation and walks to its neighbors
+SELECT explain_tree($q$SELECT * FROM cypher('cypher_match', $$
+	MATCH (a:v1)-[x:e1]->(b:v1)-[y:e1]->(c:v1) WHERE c.id = 'end'
+	RETURN a.id, b.id, c.id
+$$) AS (a agtype, b agtype, c agtype)$q$) LIKE '((((c y) %' AS along_pattern;
+
+RESET geqo_threshold;
+
+-- One hop from bound vertices is expanded through an index on the edges
+CREATE INDEX e1_start_id_idx ON cypher_match.e1 (start_id);
+SET enable_hashjoin = off;
+SET enable_mergejoin = off;
+
+SELECT * FROM cypher('cypher_match', $$
+	MATCH (a:v1)-[:e1]->(b) RETURN a.id, b.id
+$$) AS (a agtype, b agtype)
+ORDER BY a::text;
+
+-- with the other joins disabled, the plan must use the index
+SET enable_nestloop = off;
+SELECT position('Cypher Expand' IN explain_tree($q$
+SELECT * FROM cypher('cypher_match', $$
+	MATCH (a:v1)-[:e1]->(b) RETURN a.id, b.id
+$$) AS (a agtype, b agtype)$q$)) > 0 AS expanded;
+
+RESET enable_hashjoin;
+RESET enable_mergejoin;
+RESET enable_nestloop;
+DROP INDEX cypher_match.e1_start_id_idx;
+
+-- without the index, there is no Expand
+SELECT position('Cypher Expand' IN explain_tree($q$
+SELECT * FROM cypher('cypher_match', $$
+	MATCH (a:v1)-[:e1]->(b) RETURN a.id, b.id
+$$) AS (a agtype, b agtype)$q$)) > 0 AS expanded;
+
+-- Cyclic patterns are joined by a multiway join
+SELECT create_graph('cypher_cycle');
+
+SELECT * FROM cypher('cypher_cycle', $$
+	CREATE (a:v {id:'a'})-[:e]->(:v {id:'b'})-[:e]->(:v {id:'c'})-[:e]->(a)
+$$) AS (a agtype);
+
+SELECT * FROM cypher('cypher_cycle', $$
+	CREATE (:v {id:'d'})-[:e]->(:v {id:'e'})
+$$) AS (a agtype);
+
+SET enable_hashjoin = off;
+SET enable_mergejoin = off;
+SET enable_nestloop = off;
+
+SELECT * FROM cypher('cypher_cycle', $$
+	MATCH (a)-[:e]->(b)-[:e]->(c)-[:e]->(a) RETURN a.id, b.id, c.id
+$$) AS (a agtype, b agtype, c agtype)
+ORDER BY a::text;
+
+SELECT position('Cypher Multiway Join' IN explain_tree($q$
+SELECT * FROM cypher('cypher_cycle', $$
+	MATCH (a)-[:e]->(b)-[:e]->(c)-[:e]->(a) RETURN a.id, b.id, c.id
+$$) AS (a agtype, b agtype, c agtype)$q$)) > 0 AS multiway;
+
+RESET enable_hashjoin;
+RESET enable_mergejoin;
+RESET enable_nestloop;
+
+SET age.enable_multiway_join = off;
+
+SELECT * FROM cypher('cypher_cycle', $$
+	MATCH (a)-[:e]->(b)-[:e]->(c)-[:e]->(a) RETURN a.id, b.id, c.id
+$$) AS (a agtype, b agtype, c agtype)
+ORDER BY a::text;
+
+SELECT position('Cypher Multiway Join' IN explain_tree($q$
+SELECT * FROM cypher('cypher_cycle', $$
+	MATCH (a)-[:e]->(b)-[:e]->(c)-[:e]->(a) RETURN a.id, b.id, c.id
+$$) AS (a agtype, b agtype, c agtype)$q$)) > 0 AS multiway;
+
+RESET age.enable_multiway_join;
+
+SELECT drop_graph('cypher_cycle', true);
+
 -- These should error
 -- Bad pattern
 SELECT * FROM cypher('cypher_match',
@@ -342,6 +600,9 @@ AS (u agtype);
 -- Clean up
 --
 
+DROP FUNCTION explain_tree(text);
+DROP FUNCTION plan_tree(json);
+
 SELECT drop_graph('cypher_match', true);
 
 --
@@ -0,0 +1,74 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+LOAD 'age';
+SET search_path TO ag_catalog;
+
+--
+-- result cache tests (the cache is allocated in age.conf)
+--
+
+SHOW age.result_cache_size;
+SET age.enable_result_cache = on;
+
+SELECT create_graph('result_cache');
+SELECT * FROM cypher('result_cache', $$CREATE (:v {n: 1})$$) AS r(a agtype);
+
+-- a function declared immutable whose result changes
+CREATE TABLE public.result_cache_value (i int);
+INSERT INTO public.result_cache_value VALUES (1);
+CREATE FUNCTION public.result_cache_value(agtype) RETURNS int
+LANGUAGE sql IMMUTABLE AS $$SELECT i FROM public.result_cache_value$$;
+
+-- the result is stored here
+SELECT n, public.result_cache_value(n)
+FROM cypher('result_cache', $$MATCH (u:v) RETURN u.n$$) AS r(n agtype);
+
+-- and found here, since the function is trusted
+UPDATE public.result_cache_value SET i = 2;
+SELECT n, public.result_cache_value(n)
+FROM cypher('result_cache', $$MATCH (u:v) RETURN u.n$$) AS r(n agtype);
+
+-- unless the cache is bypassed
+SET age.enable_result_cache = off;
+SELECT n, public.result_cache_value(n)
+FROM cypher('result_cache', $$MATCH (u:v) RETURN u.n$$) AS r(n agtype);
+SET age.enable_result_cache = on;
+
+-- a transaction that has modified the graph neither finds nor stores results
+BEGIN;
+SELECT * FROM cypher('result_cache', $$CREATE (:v {n: 2})$$) AS r(a agtype);
+SELECT n, public.result_cache_value(n)
+FROM cypher('result_cache', $$MATCH (u:v) RETURN u.n$$) AS r(n agtype);
+ROLLBACK;
+SELECT n, public.result_cache_value(n)
+FROM cypher('result_cache', $$MATCH (u:v) RETURN u.n$$) AS r(n agtype);
+
+-- the result is no longer found once the graph is modified
+SELECT * FROM cypher('result_cache', $$CREATE (:v {n: 2})$$) AS r(a agtype);
+SELECT n, public.result_cache_value(n)
+FROM cypher('result_cache', $$MATCH (u:v) RETURN u.n$$) AS r(n agtype);
+
+-- queries that call functions that are not immutable are not cached
+ALTER FUNCTION public.result_cache_value(agtype) STABLE;
+UPDATE public.result_cache_value SET i = 3;
+SELECT n, public.result_cache_value(n)
+FROM cypher('result_cache', $$MATCH (u:v) RETURN u.n$$) AS r(n agtype);
+
+DROP FUNCTION public.result_cache_value(agtype);
+DROP TABLE public.result_cache_value;
+SELECT drop_graph('result_cache', true);
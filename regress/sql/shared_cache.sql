@@ -0,0 +1,76 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+LOAD 'age';
+SET search_path TO ag_catalog;
+
+--
+-- shared catalog cache tests (the library is preloaded, see age.conf)
+--
+
+SHOW shared_preload_libraries;
+
+SELECT create_graph('shared_cache');
+SELECT * FROM cypher('shared_cache', $$CREATE (:v {name: 'a'})$$) AS r(a agtype);
+
+-- the graph and the label are stored in the shared cache here
+SELECT * FROM cypher('shared_cache', $$MATCH (n:v) RETURN n.name$$) AS r(a agtype);
+
+-- and found there by the next session
+\c
+LOAD 'age';
+SET search_path TO ag_catalog;
+SELECT * FROM cypher('shared_cache', $$MATCH (n:v) RETURN n.name$$) AS r(a agtype);
+
+-- a label dropped in one session and created again in another one
+SELECT drop_label('shared_cache', 'v');
+\c
+LOAD 'age';
+SET search_path TO ag_catalog;
+SELECT * FROM cypher('shared_cache', $$CREATE (:v {name: 'b'})$$) AS r(a agtype);
+\c
+LOAD 'age';
+SET search_path TO ag_catalog;
+SELECT * FROM cypher('shared_cache', $$MATCH (n:v) RETURN n.name$$) AS r(a agtype);
+
+-- a graph dropped and created again
+SELECT drop_graph('shared_cache', true);
+SELECT create_graph('shared_cache');
+\c
+LOAD 'age';
+SET search_path TO ag_catalog;
+SELECT * FROM cypher('shared_cache', $$MATCH (n) RETURN n.name$$) AS r(a agtype);
+SELECT * FROM cypher('shared_cache', $$CREATE (:v {name: 'c'})$$) AS r(a agtype);
+\c
+LOAD 'age';
+SET search_path TO ag_catalog;
+SELECT * FROM cypher('shared_cache', $$MATCH (n:v) RETURN n.name$$) AS r(a agtype);
+
+-- a drop that is rolled back leaves the graph in place
+BEGIN;
+SELECT drop_graph('shared_cache', true);
+ROLLBACK;
+\c
+LOAD 'age';
+SET search_path TO ag_catalog;
+SELECT * FROM cypher('shared_cache', $$MATCH (n:v) RETURN n.name$$) AS r(a agtype);
+
+-- a dropped graph is not found by the next session
+SELECT drop_graph('shared_cache', true);
+\c
+LOAD 'age';
+SET search_path TO ag_catalog;
+SELECT * FROM cypher('shared_cache', $$RETURN 0$$) AS r(a agtype);
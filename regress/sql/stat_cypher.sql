@@ -0,0 +1,55 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+LOAD 'age';
+SET search_path TO ag_catalog;
+
+--
+-- ag_stat_cypher tests (the library is preloaded, see age.conf)
+--
+
+SELECT ag_stat_cypher_reset();
+
+SELECT create_graph('stat_cypher');
+
+-- queries that differ only in their literals, spacing and keyword case
+SELECT * FROM cypher('stat_cypher', $$CREATE (:v {n: 1})$$) AS r(a agtype);
+SELECT * FROM cypher('stat_cypher', $$CREATE (:v {n: 2})$$) AS r(a agtype);
+SELECT * FROM cypher('stat_cypher', $$MATCH (u:v) WHERE u.n > 0 RETURN u.n$$)
+AS r(n agtype);
+
+-- a query that fails to be analyzed is not counted
+SELECT * FROM cypher('stat_cypher', $$MATCH (u:missing) RETURN u$$) AS r(n agtype);
+SELECT * FROM cypher('stat_cypher', $$match (u:v)  where u.n > 1 return u.n$$)
+AS r(n agtype);
+
+-- nor are the queries run while the statistics are not tracked
+SET age.track_cypher = off;
+SELECT * FROM cypher('stat_cypher', $$MATCH (u:v) WHERE u.n > 0 RETURN u.n$$)
+AS r(n agtype);
+SET age.track_cypher = on;
+
+SELECT query, calls, rows, queryid <> 0 AS queryid, total_time >= 0 AS time,
+       parse_time >= 0 AS parse_time, plan_time >= 0 AS plan_time
+FROM ag_stat_cypher
+WHERE query LIKE 'stat_cypher:%'
+ORDER BY query;
+
+SELECT ag_stat_cypher_reset();
+SELECT count(*) FROM ag_stat_cypher WHERE query LIKE 'stat_cypher:%';
+
+SELECT drop_graph('stat_cypher', true);
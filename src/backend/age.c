@@ -17,11 +17,18 @@
 #include "postgres.h"
 
 #include "fmgr.h"
+#include "postmaster/bgworker_internals.h"
+#include "utils/guc.h"
 
 #include "catalog/ag_catalog.h"
 #include "nodes/ag_nodes.h"
 #include "optimizer/cypher_paths.h"
 #include "parser/cypher_analyze.h"
+#include "parser/cypher_clause.h"
+#include "utils/ag_result_cache.h"
+#include "utils/ag_shared_cache.h"
+#include "utils/ag_stat_cypher.h"
+#include "utils/csr_traversal.h"
 
 PG_MODULE_MAGIC;
 
@@ -31,9 +38,105 @@ void _PG_init(void)
 {
     register_ag_nodes();
     set_rel_pathlist_init();
+    join_search_init();
+    set_join_pathlist_init();
     object_access_hook_init();
     process_utility_hook_init();
     post_parse_analyze_init();
+
+    DefineCustomBoolVariable("age.approximate_count",
+                             "Estimates label counts from table statistics.",
+                             "If on, MATCH ... RETURN count(var) over a "
+                             "single label is answered from the statistics "
+                             "of the label table instead of counting its "
+                             "rows.",
+                             &approximate_label_count, false, PGC_USERSET, 0,
+                             NULL, NULL, NULL);
+
+    DefineCustomBoolVariable("age.enable_pattern_join_search",
+                             "Orders large MATCH joins along the pattern.",
+                             "If on, the joins of MATCH clauses with at "
+                             "least geqo_threshold label tables are ordered "
+                             "by walking the pattern from its most "
+                             "selective entity instead of by GEQO.",
+                             &enable_pattern_join_search, true, PGC_USERSET,
+                             0, NULL, NULL, NULL);
+
+    DefineCustomBoolVariable("age.enable_multiway_join",
+                             "Joins the edges of cyclic patterns at once.",
+                             "If on, the planner considers joining the edges "
+                             "of a cyclic MATCH pattern, such as a triangle, "
+                             "with a single multiway join instead of "
+                             "pairwise joins.",
+                             &enable_multiway_join, true, PGC_USERSET, 0,
+                             NULL, NULL, NULL);
+
+    DefineCustomBoolVariable("age.enable_expand",
+                             "Joins edges to bound vertices by Cypher Expand.",
+                             "If on, the planner considers probing the "
+                             "indexes on start_id or end_id of the edges "
+                             "with sorted batches of the bound graphids.",
+                             &enable_expand, true, PGC_USERSET, 0, NULL, NULL,
+                             NULL);
+
+    DefineCustomIntVariable("age.max_traversal_workers",
+                            "Sets the maximum number of traversal workers.",
+                            "Traversals and analytics of CSR graphs start "
+                            "up to this many background workers to share "
+                            "their work with the backend.",
+                            &max_traversal_workers, 4, 0,
+                            MAX_PARALLEL_WORKER_LIMIT, PGC_USERSET, 0, NULL,
+                            NULL, NULL);
+
+    DefineCustomIntVariable("age.traversal_parallel_threshold",
+                            "Sets the number of edges for parallel traversal.",
+                            "Traversals and analytics of CSR graphs with "
+                            "fewer edges than this run in the backend "
+                            "alone.",
+                            &traversal_parallel_threshold, 65536, 0, INT_MAX,
+                            PGC_USERSET, 0, NULL, NULL, NULL);
+
+    DefineCustomIntVariable("age.shared_cache_size",
+                            "Sets the number of graphs and labels in the "
+                            "shared catalog cache.",
+                            "If the library is preloaded, the graphs and the "
+                            "labels read by a backend are shared with the "
+                            "other backends through a cache in shared "
+                            "memory. 0 disables the cache.",
+                            &shared_cache_size, 1024, 0, INT_MAX / 4,
+                            PGC_POSTMASTER, 0, NULL, NULL, NULL);
+
+    DefineCustomIntVariable("age.result_cache_size",
+                            "Sets the number of results in the result cache.",
+                            "If the library is preloaded, the results of "
+                            "read-only queries of graphs are cached in "
+                            "shared memory, in slots of 32kB. 0 disables "
+                            "the cache.",
+                            &result_cache_size, 0, 0,
+                            INT_MAX / RESULT_CACHE_SLOT_SIZE, PGC_POSTMASTER,
+                            0, NULL, NULL, NULL);
+
+    DefineCustomBoolVariable("age.enable_result_cache",
+                             "Enables the use of the result cache.", NULL,
+                             &enable_result_cache, true, PGC_USERSET, 0, NULL,
+                             NULL, NULL);
+
+    DefineCustomIntVariable("age.stat_cypher_max",
+                            "Sets the number of queries in ag_stat_cypher.",
+                            "If the library is preloaded, the statistics of "
+                            "the queries that call cypher() are gathered in "
+                            "shared memory. 0 disables them.",
+                            &stat_cypher_max, 1000, 0, INT_MAX / 2,
+                            PGC_POSTMASTER, 0, NULL, NULL, NULL);
+
+    DefineCustomBoolVariable("age.track_cypher",
+                             "Collects the statistics of Cypher queries.",
+                             NULL, &track_cypher, true, PGC_SUSET, 0, NULL,
+                             NULL, NULL);
+
+    shared_cache_init();
+    result_cache_init();
+    stat_cypher_init();
 }
 
 void _PG_fini(void);
@@ -43,5 +146,7 @@ void _PG_fini(void)
     post_parse_analyze_fini();
     process_utility_hook_fini();
     object_access_hook_fini();
+    set_join_pathlist_fini();
+    join_search_fini();
     set_rel_pathlist_fini();
 }
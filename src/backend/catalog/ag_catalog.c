@@ -29,6 +29,7 @@
 #include "catalog/ag_label.h"
 #include "catalog/ag_namespace.h"
 #include "utils/ag_cache.h"
+#include "utils/ag_result_cache.h"
 
 static object_access_hook_type prev_object_access_hook;
 static ProcessUtility_hook_type prev_process_utility_hook;
@@ -88,6 +89,8 @@ void ag_ProcessUtility_hook(PlannedStmt *pstmt, const char *queryString,
                              QueryEnvironment *queryEnv, DestReceiver *dest,
                              char *completionTag)
 {
+    result_cache_note_utility(pstmt->utilityStmt);
+
     if (is_age_drop(pstmt))
         drop_age_extension((DropStmt *)pstmt->utilityStmt);
     else if (prev_process_utility_hook)
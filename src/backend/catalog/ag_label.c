@@ -28,6 +28,7 @@
 #include "storage/lockdefs.h"
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
+#include "utils/inval.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
 #include "utils/relcache.h"
@@ -41,7 +42,7 @@
 // INSERT INTO ag_catalog.ag_label
 // VALUES (label_name, label_graph, label_id, label_kind, label_relation)
 Oid insert_label(const char *label_name, Oid label_graph, int32 label_id,
-                 char label_kind, Oid label_relation)
+                 char label_kind, Oid label_relation, int32 hash_partitions)
 {
     NameData label_name_data;
     Datum values[Natts_ag_label];
@@ -60,6 +61,7 @@ Oid insert_label(const char *label_name, Oid label_graph, int32 label_id,
     AssertArg(label_kind == LABEL_KIND_VERTEX ||
               label_kind == LABEL_KIND_EDGE);
     AssertArg(OidIsValid(label_relation));
+    AssertArg(hash_partitions >= 0);
 
     namestrcpy(&label_name_data, label_name);
     values[Anum_ag_label_name - 1] = NameGetDatum(&label_name_data);
@@ -77,6 +79,9 @@ Oid insert_label(const char *label_name, Oid label_graph, int32 label_id,
     values[Anum_ag_label_relation - 1] = ObjectIdGetDatum(label_relation);
     nulls[Anum_ag_label_relation - 1] = false;
 
+    values[Anum_ag_label_hash_partitions - 1] = Int32GetDatum(hash_partitions);
+    nulls[Anum_ag_label_hash_partitions - 1] = false;
+
     ag_label = heap_open(ag_label_relation_id(), RowExclusiveLock);
 
     tuple = heap_form_tuple(RelationGetDescr(ag_label), values, nulls);
@@ -89,6 +94,9 @@ Oid insert_label(const char *label_name, Oid label_graph, int32 label_id,
 
     heap_close(ag_label, RowExclusiveLock);
 
+    // the label caches might remember that the relation is not a label
+    CacheInvalidateRelcacheByRelid(label_relation);
+
     return label_oid;
 }
 
@@ -16,11 +16,10 @@
 
 #include "postgres.h"
 
-#include "catalog/namespace.h"
-
 #include "catalog/ag_namespace.h"
+#include "utils/ag_oid_cache.h"
 
 Oid ag_catalog_namespace_id(void)
 {
-    return get_namespace_oid("ag_catalog", false);
+    return search_namespace_oid_cache();
 }
@@ -0,0 +1,288 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "postgres.h"
+
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "utils/acl.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+
+#include "utils/ag_cache.h"
+#include "utils/csr_graph.h"
+#include "utils/csr_traversal.h"
+#include "utils/graphid.h"
+
+typedef struct csr_neighbors_state
+{
+    csr_graph *csr;
+    csr_neighbor_iterator it;
+} csr_neighbors_state;
+
+static void check_graph_owner(graph_cache_data *cache);
+static csr_graph *open_csr_snapshot_or_error(graph_cache_data *cache);
+
+PG_FUNCTION_INFO_V1(build_csr_snapshot);
+
+/*
+ * Builds the CSR graph of the graph from the label tables and writes it to
+ * the snapshot file of the graph, replacing the old snapshot. Only the owner
+ * of the graph can do this.
+ */
+Datum build_csr_snapshot(PG_FUNCTION_ARGS)
+{
+    graph_cache_data *cache;
+    List *label_ids;
+    csr_graph *csr;
+
+    cache = get_graph_cache_arg(fcinfo, 0);
+    check_graph_owner(cache);
+
+    label_ids = get_csr_label_ids(
+        cache, PG_ARGISNULL(1) ? NULL : PG_GETARG_ARRAYTYPE_P(1));
+
+    csr = build_csr_graph(cache, label_ids);
+    write_csr_snapshot(csr);
+    release_csr_graph(csr);
+
+    PG_RETURN_VOID();
+}
+
+PG_FUNCTION_INFO_V1(drop_csr_snapshot);
+
+Datum drop_csr_snapshot(PG_FUNCTION_ARGS)
+{
+    graph_cache_data *cache;
+
+    cache = get_graph_cache_arg(fcinfo, 0);
+    check_graph_owner(cache);
+
+    remove_csr_snapshot(cache->oid);
+
+    PG_RETURN_VOID();
+}
+
+PG_FUNCTION_INFO_V1(csr_snapshot_info);
+
+// returns NULL if the graph has no snapshot
+Datum csr_snapshot_info(PG_FUNCTION_ARGS)
+{
+    graph_cache_data *cache;
+    csr_graph *csr;
+    TupleDesc tupdesc;
+    Datum values[4];
+    bool nulls[4] = {false, false, false, false};
+    HeapTuple tuple;
+
+    cache = get_graph_cache_arg(fcinfo, 0);
+
+    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+        elog(ERROR, "return type must be a row type");
+
+    csr = open_csr_snapshot(cache);
+    if (!csr)
+        PG_RETURN_NULL();
+
+    if (csr->label_ids == NIL)
+    {
+        nulls[0] = true;
+    }
+    else
+    {
+        Datum *labels;
+        ListCell *lc;
+        int i = 0;
+
+        labels = palloc(sizeof(Datum) * list_length(csr->label_ids));
+        foreach (lc, csr->label_ids)
+        {
+            label_cache_data *lcd;
+
+            lcd = search_label_graph_id_cache(cache->oid, lfirst_int(lc));
+
+            // the label has been dropped since the snapshot was built
+            if (!lcd)
+                continue;
+
+            labels[i++] = NameGetDatum(&lcd->name);
+        }
+
+        values[0] = PointerGetDatum(construct_array(labels, i, NAMEOID,
+                                                    NAMEDATALEN, false, 'c'));
+    }
+
+    values[1] = Int64GetDatum(csr->nvertices);
+    values[2] = Int64GetDatum(csr->nedges);
+    values[3] = Int64GetDatum(csr->size);
+
+    tuple = heap_form_tuple(BlessTupleDesc(tupdesc), values, nulls);
+
+    release_csr_graph(csr);
+
+    PG_RETURN_DATUM(HeapTupleGetDatum(tuple));
+}
+
+PG_FUNCTION_INFO_V1(csr_neighbors);
+
+// returns the vertices the edges of the vertex go to (or come from)
+Datum csr_neighbors(PG_FUNCTION_ARGS)
+{
+    FuncCallContext *func_ctx;
+    csr_neighbors_state *state;
+    csr_vertex v;
+
+    if (SRF_IS_FIRSTCALL())
+    {
+        MemoryContext old_mem_ctx;
+        graph_cache_data *cache;
+        graphid id;
+        bool outgoing;
+        int64 index;
+
+        func_ctx = SRF_FIRSTCALL_INIT();
+        old_mem_ctx = MemoryContextSwitchTo(func_ctx->multi_call_memory_ctx);
+
+        cache = get_graph_cache_arg(fcinfo, 0);
+
+        if (PG_ARGISNULL(1))
+        {
+            ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                            errmsg("vertex id must not be NULL")));
+        }
+        id = AG_GETARG_GRAPHID(1);
+        outgoing = PG_ARGISNULL(2) ? true : PG_GETARG_BOOL(2);
+
+        state = palloc0(sizeof(csr_neighbors_state));
+        state->csr = open_csr_snapshot_or_error(cache);
+
+        // a vertex that is not in the snapshot has no edges in it
+        index = csr_vertex_index(state->csr, id);
+        if (index >= 0)
+        {
+            csr_begin_neighbors(outgoing ? &state->csr->out : &state->csr->in,
+                                (csr_vertex)index, &state->it);
+        }
+
+        func_ctx->user_fctx = state;
+
+        MemoryContextSwitchTo(old_mem_ctx);
+    }
+
+    func_ctx = SRF_PERCALL_SETUP();
+    state = func_ctx->user_fctx;
+
+    if (csr_next_neighbor(&state->it, &v))
+        SRF_RETURN_NEXT(func_ctx, GRAPHID_GET_DATUM(state->csr->vertex_ids[v]));
+
+    SRF_RETURN_DONE(func_ctx);
+}
+
+PG_FUNCTION_INFO_V1(reachable);
+
+/*
+ * Returns the vertices that can be reached from the seeds, and how many hops
+ * away from the nearest seed they are, by a breadth-first search on the CSR
+ * graph.
+ */
+Datum reachable(PG_FUNCTION_ARGS)
+{
+    csr_graph *csr;
+    graphid *seeds;
+    int64 nseeds;
+    int32 max_depth;
+    traversal_direction direction;
+    csr_vertex *sources;
+    uint64 nsources = 0;
+    int32 *depth;
+    Tuplestorestate *tupstore;
+    TupleDesc tupdesc;
+    uint64 v;
+    int64 i;
+
+    // no limit if NULL
+    max_depth = PG_ARGISNULL(2) ? -1 : PG_GETARG_INT32(2);
+    if (!PG_ARGISNULL(2) && max_depth < 0)
+    {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                        errmsg("max_depth must not be negative")));
+    }
+    direction = get_traversal_direction_arg(fcinfo, 4, TRAVERSAL_OUT);
+
+    tupstore = begin_csr_result(fcinfo, &tupdesc);
+    seeds = get_seeds_arg(fcinfo, 1, &nseeds);
+    csr = get_csr_graph_arg(fcinfo, 0, 3);
+
+    // the seeds that are not vertices of the graph reach nothing
+    sources = alloc_csr_array(nseeds, sizeof(csr_vertex));
+    for (i = 0; i < nseeds; i++)
+    {
+        int64 index = csr_vertex_index(csr, seeds[i]);
+
+        if (index >= 0)
+            sources[nsources++] = (csr_vertex)index;
+    }
+
+    depth = csr_bfs(csr, sources, nsources, direction, max_depth);
+
+    for (v = 0; v < csr->nvertices; v++)
+    {
+        Datum values[2];
+        bool nulls[2] = {false, false};
+
+        if (depth[v] < 0)
+            continue;
+
+        values[0] = GRAPHID_GET_DATUM(csr->vertex_ids[v]);
+        values[1] = Int32GetDatum(depth[v]);
+
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+
+    release_csr_graph(csr);
+
+    return (Datum)0;
+}
+
+// the owner of the graph is the owner of its schema
+static void check_graph_owner(graph_cache_data *cache)
+{
+    if (!pg_namespace_ownercheck(cache->namespace, GetUserId()))
+    {
+        aclcheck_error(ACLCHECK_NOT_OWNER, OBJECT_SCHEMA,
+                       NameStr(cache->name));
+    }
+}
+
+static csr_graph *open_csr_snapshot_or_error(graph_cache_data *cache)
+{
+    csr_graph *csr;
+
+    csr = open_csr_snapshot(cache);
+    if (!csr)
+    {
+        ereport(ERROR,
+                (errcode(ERRCODE_UNDEFINED_OBJECT),
+                 errmsg("graph \"%s\" has no CSR snapshot",
+                        NameStr(cache->name)),
+                 errhint("Build one with build_csr_snapshot().")));
+    }
+
+    return csr;
+}
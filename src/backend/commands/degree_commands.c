@@ -0,0 +1,772 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "postgres.h"
+
+#include "access/genam.h"
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "access/skey.h"
+#include "access/stratnum.h"
+#include "catalog/partition.h"
+#include "catalog/pg_class_d.h"
+#include "catalog/pg_inherits.h"
+#include "catalog/pg_type.h"
+#include "commands/trigger.h"
+#include "executor/spi.h"
+#include "fmgr.h"
+#include "lib/stringinfo.h"
+#include "miscadmin.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/relcache.h"
+#include "utils/snapmgr.h"
+
+#include "catalog/ag_label.h"
+#include "commands/degree_commands.h"
+#include "commands/label_commands.h"
+#include "utils/ag_cache.h"
+#include "utils/ag_func.h"
+#include "utils/graphid.h"
+
+/*
+ * The degree counters of a graph hold, for each vertex and edge label, the
+ * number of edges of the label that start and end at the vertex. With them,
+ * the degree of a vertex is an index lookup instead of a count of its edges,
+ * which costs O(degree) and is very slow for vertices with many edges.
+ *
+ * The counters are optional. enable_degree_counters() creates the side table
+ * for them and fills it in from the existing edges. From then on, CREATE
+ * keeps the counters up to date, and so do the triggers on the tables that
+ * store the edges for the edges that SQL statements insert, update, delete
+ * and truncate. The tables of the edge labels created later get the triggers
+ * as well.
+ *
+ * The edges that a statement creates are summed up per vertex and label in
+ * memory, and the sums are added to the counters by a single upsert when the
+ * statement ends, instead of one upsert per edge endpoint.
+ */
+typedef struct degree_delta_key
+{
+    graphid vertex_id;
+    int32 label_id;
+} degree_delta_key;
+
+typedef struct degree_delta
+{
+    degree_delta_key key; // hash key
+    int64 out_degree;
+    int64 in_degree;
+} degree_delta;
+
+struct degree_counters
+{
+    /*
+     * INSERT ... ON CONFLICT DO UPDATE that adds arrays of deltas to the
+     * counters of their vertices
+     */
+    SPIPlanPtr upsert_plan;
+    // degree_delta entries that have not been added to the counters yet
+    HTAB *deltas;
+};
+
+// the upsert of the counters of a graph, prepared once per backend
+typedef struct degree_upsert_plan
+{
+    Oid graph_namespace; // hash key
+    NameData schema_name;
+    SPIPlanPtr plan;
+} degree_upsert_plan;
+
+static HTAB *upsert_plans = NULL;
+
+static void create_degree_triggers(const char *schema, Oid relid);
+static void recount_degree_counters(Oid graph_namespace, Oid relid);
+static void count_edge_tuple(degree_counters *counters, Relation rel,
+                             HeapTuple tuple, int64 n);
+static void count_edge(degree_counters *counters, graphid start_id,
+                       graphid end_id, int32 label_id, int64 n);
+static SPIPlanPtr get_upsert_plan(Oid graph_namespace);
+static void execute_degree_sql(const char *sql, int expected);
+static void add_to_degree_counters(degree_counters *counters,
+                                   graphid vertex_id, int32 label_id,
+                                   int64 out_degree, int64 in_degree);
+static void flush_degree_counters(degree_counters *counters);
+static int compare_degree_deltas(const void *a, const void *b);
+static int64 read_degree_counters(Oid relid, graphid vertex_id,
+                                  bool outgoing);
+static int64 count_vertex_edges(graph_cache_data *cache, graphid vertex_id,
+                                bool outgoing);
+
+PG_FUNCTION_INFO_V1(enable_degree_counters);
+
+Datum enable_degree_counters(PG_FUNCTION_ARGS)
+{
+    Name graph_name;
+    graph_cache_data *cache;
+    const char *schema;
+    const char *edges;
+    StringInfoData sql;
+
+    if (PG_ARGISNULL(0))
+    {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                        errmsg("graph name must not be NULL")));
+    }
+    graph_name = PG_GETARG_NAME(0);
+
+    cache = search_graph_name_cache(NameStr(*graph_name));
+    if (!cache)
+    {
+        ereport(ERROR,
+                (errcode(ERRCODE_UNDEFINED_SCHEMA),
+                 errmsg("graph \"%s\" does not exist", NameStr(*graph_name))));
+    }
+
+    if (OidIsValid(get_degree_relation(cache->namespace)))
+    {
+        ereport(ERROR,
+                (errcode(ERRCODE_DUPLICATE_OBJECT),
+                 errmsg("degree counters are already enabled for graph \"%s\"",
+                        NameStr(*graph_name))));
+    }
+
+    schema = quote_identifier(get_namespace_name(cache->namespace));
+    edges = quote_identifier(
+        get_label_relation_name(AG_DEFAULT_LABEL_EDGE, cache->oid));
+
+    initStringInfo(&sql);
+
+    SPI_connect();
+
+    /*
+     * The tables of all edge labels inherit the default edge label table, so
+     * this locks all of them. No edge can be created until the counters have
+     * been filled in and are visible to the transactions that create edges.
+     */
+    appendStringInfo(&sql, "LOCK TABLE %s.%s IN SHARE MODE", schema, edges);
+    execute_degree_sql(sql.data, SPI_OK_UTILITY);
+
+    resetStringInfo(&sql);
+    appendStringInfo(&sql,
+                     "CREATE TABLE %s.%s ("
+                     "id ag_catalog.graphid NOT NULL, "
+                     "label_id int NOT NULL, "
+                     "out_degree bigint NOT NULL, "
+                     "in_degree bigint NOT NULL, "
+                     "PRIMARY KEY (id, label_id))",
+                     schema, AG_DEGREE_RELATION_NAME);
+    execute_degree_sql(sql.data, SPI_OK_UTILITY);
+
+    resetStringInfo(&sql);
+    appendStringInfo(&sql,
+                     "INSERT INTO %s.%s "
+                     "SELECT id, label_id, sum(out_degree), sum(in_degree) "
+                     "FROM (SELECT %s, ag_catalog._extract_label_id(%s), 1, 0 "
+                     "FROM %s.%s "
+                     "UNION ALL "
+                     "SELECT %s, ag_catalog._extract_label_id(%s), 0, 1 "
+                     "FROM %s.%s) AS e(id, label_id, out_degree, in_degree) "
+                     "GROUP BY id, label_id",
+                     schema, AG_DEGREE_RELATION_NAME,
+                     AG_EDGE_COLNAME_START_ID, AG_EDGE_COLNAME_ID, schema,
+                     edges, AG_EDGE_COLNAME_END_ID, AG_EDGE_COLNAME_ID, schema,
+                     edges);
+    execute_degree_sql(sql.data, SPI_OK_INSERT);
+
+    create_degree_triggers(schema, get_relname_relid(
+        get_label_relation_name(AG_DEFAULT_LABEL_EDGE, cache->oid),
+        cache->namespace));
+
+    SPI_finish();
+
+    PG_RETURN_VOID();
+}
+
+// called when a new edge label has been created
+void add_degree_triggers(Oid graph_namespace, Oid relid)
+{
+    if (!OidIsValid(get_degree_relation(graph_namespace)))
+        return;
+
+    SPI_connect();
+
+    create_degree_triggers(
+        quote_identifier(get_namespace_name(graph_namespace)), relid);
+
+    SPI_finish();
+}
+
+// called when an edge label has been dropped
+void remove_degree_counters(Oid graph_namespace, int32 label_id)
+{
+    StringInfoData sql;
+
+    if (!OidIsValid(get_degree_relation(graph_namespace)))
+        return;
+
+    initStringInfo(&sql);
+    appendStringInfo(&sql, "DELETE FROM %s.%s WHERE label_id = %d",
+                     quote_identifier(get_namespace_name(graph_namespace)),
+                     AG_DEGREE_RELATION_NAME, label_id);
+
+    SPI_connect();
+    execute_degree_sql(sql.data, SPI_OK_DELETE);
+    SPI_finish();
+}
+
+/*
+ * The triggers are created on the tables that store the edges, which are the
+ * given table and all the tables that inherit it or are partitions of it. The
+ * triggers of a partitioned table would be cloned to its partitions, which
+ * have their own.
+ */
+static void create_degree_triggers(const char *schema, Oid relid)
+{
+    StringInfoData sql;
+    List *relids;
+    ListCell *lc;
+
+    initStringInfo(&sql);
+
+    relids = find_all_inheritors(relid, NoLock, NULL);
+    foreach (lc, relids)
+    {
+        const char *rel_name;
+
+        if (get_rel_relkind(lfirst_oid(lc)) != RELKIND_RELATION)
+            continue;
+
+        rel_name = quote_identifier(get_rel_name(lfirst_oid(lc)));
+
+        resetStringInfo(&sql);
+        appendStringInfo(&sql,
+                         "CREATE TRIGGER %s AFTER INSERT OR DELETE "
+                         "OR UPDATE OF %s, %s, %s ON %s.%s FOR EACH ROW "
+                         "EXECUTE PROCEDURE ag_catalog._ag_degree_trigger()",
+                         AG_DEGREE_RELATION_NAME, AG_EDGE_COLNAME_ID,
+                         AG_EDGE_COLNAME_START_ID, AG_EDGE_COLNAME_END_ID,
+                         schema, rel_name);
+        execute_degree_sql(sql.data, SPI_OK_UTILITY);
+
+        resetStringInfo(&sql);
+        appendStringInfo(&sql,
+                         "CREATE TRIGGER %s_truncate AFTER TRUNCATE "
+                         "ON %s.%s FOR EACH STATEMENT "
+                         "EXECUTE PROCEDURE ag_catalog._ag_degree_trigger()",
+                         AG_DEGREE_RELATION_NAME, schema, rel_name);
+        execute_degree_sql(sql.data, SPI_OK_UTILITY);
+    }
+}
+
+PG_FUNCTION_INFO_V1(_ag_degree_trigger);
+
+// counts the edges that SQL statements modify in the degree counters
+Datum _ag_degree_trigger(PG_FUNCTION_ARGS)
+{
+    TriggerData *trigdata = (TriggerData *)fcinfo->context;
+    Relation rel;
+    degree_counters *counters;
+
+    if (!CALLED_AS_TRIGGER(fcinfo))
+    {
+        ereport(ERROR,
+                (errcode(ERRCODE_E_R_I_E_TRIGGER_PROTOCOL_VIOLATED),
+                 errmsg("_ag_degree_trigger() must be called as a trigger")));
+    }
+    rel = trigdata->tg_relation;
+
+    if (TRIGGER_FIRED_BY_TRUNCATE(trigdata->tg_event))
+    {
+        recount_degree_counters(RelationGetNamespace(rel),
+                                RelationGetRelid(rel));
+        return PointerGetDatum(NULL);
+    }
+
+    // the counters might have been dropped
+    counters = begin_degree_counters(RelationGetNamespace(rel));
+    if (!counters)
+        return PointerGetDatum(NULL);
+
+    if (TRIGGER_FIRED_BY_INSERT(trigdata->tg_event))
+    {
+        count_edge_tuple(counters, rel, trigdata->tg_trigtuple, 1);
+    }
+    else if (TRIGGER_FIRED_BY_DELETE(trigdata->tg_event))
+    {
+        count_edge_tuple(counters, rel, trigdata->tg_trigtuple, -1);
+    }
+    else
+    {
+        count_edge_tuple(counters, rel, trigdata->tg_trigtuple, -1);
+        count_edge_tuple(counters, rel, trigdata->tg_newtuple, 1);
+    }
+
+    end_degree_counters(counters);
+
+    return PointerGetDatum(NULL);
+}
+
+/*
+ * The edges of a truncated table are not known, so the counters of its label
+ * are counted again from the edges of the label that are left.
+ */
+static void recount_degree_counters(Oid graph_namespace, Oid relid)
+{
+    graph_cache_data *graph;
+    label_cache_data *label;
+    const char *schema;
+    const char *label_rel;
+    StringInfoData sql;
+
+    if (!OidIsValid(get_degree_relation(graph_namespace)))
+        return;
+
+    // the partitions of a label table store the edges of the label
+    while (!(label = search_label_relation_cache(relid)))
+        relid = get_partition_parent(relid);
+
+    graph = search_graph_namespace_cache(graph_namespace);
+    Assert(graph);
+    schema = quote_identifier(get_namespace_name(graph_namespace));
+    label_rel = quote_identifier(get_label_relation_name(NameStr(label->name),
+                                                         graph->oid));
+
+    initStringInfo(&sql);
+
+    SPI_connect();
+
+    appendStringInfo(&sql, "DELETE FROM %s.%s WHERE label_id = %d", schema,
+                     AG_DEGREE_RELATION_NAME, label->id);
+    execute_degree_sql(sql.data, SPI_OK_DELETE);
+
+    // the tables of the labels that inherit the label are read as well
+    resetStringInfo(&sql);
+    appendStringInfo(&sql,
+                     "INSERT INTO %s.%s "
+                     "SELECT id, %d, sum(out_degree), sum(in_degree) "
+                     "FROM (SELECT %s, 1, 0 FROM %s.%s "
+                     "WHERE ag_catalog._extract_label_id(%s) = %d "
+                     "UNION ALL "
+                     "SELECT %s, 0, 1 FROM %s.%s "
+                     "WHERE ag_catalog._extract_label_id(%s) = %d) "
+                     "AS e(id, out_degree, in_degree) "
+                     "GROUP BY id",
+                     schema, AG_DEGREE_RELATION_NAME, label->id,
+                     AG_EDGE_COLNAME_START_ID, schema, label_rel,
+                     AG_EDGE_COLNAME_ID, label->id, AG_EDGE_COLNAME_END_ID,
+                     schema, label_rel, AG_EDGE_COLNAME_ID, label->id);
+    execute_degree_sql(sql.data, SPI_OK_INSERT);
+
+    SPI_finish();
+}
+
+// counts the edge in the tuple n times, n may be negative
+static void count_edge_tuple(degree_counters *counters, Relation rel,
+                             HeapTuple tuple, int64 n)
+{
+    TupleDesc tupdesc = RelationGetDescr(rel);
+    graphid ids[3];
+    const char *names[3] = {AG_EDGE_COLNAME_ID, AG_EDGE_COLNAME_START_ID,
+                            AG_EDGE_COLNAME_END_ID};
+    int i;
+
+    // the columns of a partition may be in another order than its parent's
+    for (i = 0; i < 3; i++)
+    {
+        AttrNumber attnum;
+        bool is_null;
+
+        attnum = SPI_fnumber(tupdesc, names[i]);
+        if (attnum <= 0)
+            elog(ERROR, "column \"%s\" of an edge is missing", names[i]);
+
+        ids[i] = DATUM_GET_GRAPHID(heap_getattr(tuple, attnum, tupdesc,
+                                                &is_null));
+        Assert(!is_null);
+    }
+
+    count_edge(counters, ids[1], ids[2], get_graphid_label_id(ids[0]), n);
+}
+
+// returns the OID of the degree counter table of the graph, if it has one
+Oid get_degree_relation(Oid graph_namespace)
+{
+    return get_relname_relid(AG_DEGREE_RELATION_NAME, graph_namespace);
+}
+
+/*
+ * Prepares the degree counters of the graph to be updated. NULL is returned
+ * if the graph has no degree counters.
+ */
+degree_counters *begin_degree_counters(Oid graph_namespace)
+{
+    degree_counters *counters;
+    HASHCTL hash_ctl;
+
+    if (!OidIsValid(get_degree_relation(graph_namespace)))
+        return NULL;
+
+    counters = palloc(sizeof(degree_counters));
+    counters->upsert_plan = get_upsert_plan(graph_namespace);
+
+    MemSet(&hash_ctl, 0, sizeof(hash_ctl));
+    hash_ctl.keysize = sizeof(degree_delta_key);
+    hash_ctl.entrysize = sizeof(degree_delta);
+    hash_ctl.hcxt = CurrentMemoryContext;
+    counters->deltas = hash_create("degree counter deltas", 256, &hash_ctl,
+                                   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+    return counters;
+}
+
+// counts a new edge of the label from start_id to end_id
+void increment_degree_counters(degree_counters *counters, graphid start_id,
+                               graphid end_id, int32 label_id)
+{
+    count_edge(counters, start_id, end_id, label_id, 1);
+}
+
+static void count_edge(degree_counters *counters, graphid start_id,
+                       graphid end_id, int32 label_id, int64 n)
+{
+    if (start_id == end_id)
+    {
+        add_to_degree_counters(counters, start_id, label_id, n, n);
+        return;
+    }
+
+    add_to_degree_counters(counters, start_id, label_id, n, 0);
+    add_to_degree_counters(counters, end_id, label_id, 0, n);
+}
+
+// adds the edges counted so far to the counters
+void end_degree_counters(degree_counters *counters)
+{
+    flush_degree_counters(counters);
+
+    hash_destroy(counters->deltas);
+    pfree(counters);
+}
+
+/*
+ * The plan is kept for the rest of the session, and it is prepared again if
+ * the schema of the graph has been renamed or its OID reused.
+ */
+static SPIPlanPtr get_upsert_plan(Oid graph_namespace)
+{
+    degree_upsert_plan *entry;
+    char *schema_name;
+    bool found;
+    StringInfoData sql;
+    Oid argtypes[4];
+
+    if (!upsert_plans)
+    {
+        HASHCTL hash_ctl;
+
+        MemSet(&hash_ctl, 0, sizeof(hash_ctl));
+        hash_ctl.keysize = sizeof(Oid);
+        hash_ctl.entrysize = sizeof(degree_upsert_plan);
+        upsert_plans = hash_create("degree counter upserts", 16, &hash_ctl,
+                                   HASH_ELEM | HASH_BLOBS);
+    }
+
+    schema_name = get_namespace_name(graph_namespace);
+
+    entry = hash_search(upsert_plans, &graph_namespace, HASH_ENTER, &found);
+    if (found)
+    {
+        if (strcmp(NameStr(entry->schema_name), schema_name) == 0)
+            return entry->plan;
+
+        SPI_freeplan(entry->plan);
+    }
+    namestrcpy(&entry->schema_name, schema_name);
+    entry->plan = NULL;
+
+    initStringInfo(&sql);
+    appendStringInfo(&sql,
+                     "INSERT INTO %s.%s AS d "
+                     "SELECT * FROM unnest($1, $2, $3, $4) "
+                     "ON CONFLICT (id, label_id) DO UPDATE "
+                     "SET out_degree = d.out_degree + excluded.out_degree, "
+                     "in_degree = d.in_degree + excluded.in_degree",
+                     quote_identifier(schema_name), AG_DEGREE_RELATION_NAME);
+
+    argtypes[Anum_ag_degree_id - 1] = GRAPHIDARRAYOID;
+    argtypes[Anum_ag_degree_label_id - 1] = INT4ARRAYOID;
+    argtypes[Anum_ag_degree_out_degree - 1] = get_array_type(INT8OID);
+    argtypes[Anum_ag_degree_in_degree - 1] = get_array_type(INT8OID);
+
+    SPI_connect();
+
+    entry->plan = SPI_prepare(sql.data, 4, argtypes);
+    if (entry->plan == NULL)
+    {
+        hash_search(upsert_plans, &graph_namespace, HASH_REMOVE, NULL);
+        elog(ERROR, "SPI_prepare failed: %s",
+             SPI_result_code_string(SPI_result));
+    }
+    SPI_keepplan(entry->plan);
+
+    SPI_finish();
+
+    return entry->plan;
+}
+
+/*
+ * Returns the number of edges that start (outgoing) or end at the vertex.
+ * Without degree counters, the edges of the vertex are counted.
+ */
+int64 get_vertex_degree(const char *graph_name, graphid vertex_id,
+                        bool outgoing)
+{
+    graph_cache_data *cache;
+    Oid relid;
+
+    cache = search_graph_name_cache(graph_name);
+    if (!cache)
+    {
+        ereport(ERROR, (errcode(ERRCODE_UNDEFINED_SCHEMA),
+                        errmsg("graph \"%s\" does not exist", graph_name)));
+    }
+
+    relid = get_degree_relation(cache->namespace);
+    if (OidIsValid(relid))
+        return read_degree_counters(relid, vertex_id, outgoing);
+
+    return count_vertex_edges(cache, vertex_id, outgoing);
+}
+
+static void execute_degree_sql(const char *sql, int expected)
+{
+    int ret;
+
+    ret = SPI_execute(sql, false, 0);
+    if (ret != expected)
+        elog(ERROR, "SPI_execute failed: %s", SPI_result_code_string(ret));
+}
+
+/*
+ * The deltas are kept in memory until the statement ends. So that a statement
+ * that creates a lot of edges does not take too much memory, they are added
+ * to the counters once they take more than work_mem.
+ */
+static void add_to_degree_counters(degree_counters *counters,
+                                   graphid vertex_id, int32 label_id,
+                                   int64 out_degree, int64 in_degree)
+{
+    degree_delta_key key;
+    degree_delta *delta;
+    bool found;
+
+    // the padding of the key is hashed as well
+    MemSet(&key, 0, sizeof(key));
+    key.vertex_id = vertex_id;
+    key.label_id = label_id;
+
+    delta = hash_search(counters->deltas, &key, HASH_ENTER, &found);
+    if (!found)
+    {
+        delta->out_degree = 0;
+        delta->in_degree = 0;
+    }
+
+    delta->out_degree += out_degree;
+    delta->in_degree += in_degree;
+
+    if (hash_get_num_entries(counters->deltas) >=
+        work_mem * 1024L / sizeof(degree_delta))
+        flush_degree_counters(counters);
+}
+
+/*
+ * Adds all the deltas to the counters with a single upsert. The conflict on
+ * the primary key serializes concurrent updates of the counters of a vertex,
+ * instead of failing them. The deltas are sorted, so that concurrent
+ * statements lock the counters in the same order and do not deadlock.
+ */
+static void flush_degree_counters(degree_counters *counters)
+{
+    HASH_SEQ_STATUS seq;
+    degree_delta **deltas;
+    degree_delta *delta;
+    Datum *ids;
+    Datum *label_ids;
+    Datum *out_degrees;
+    Datum *in_degrees;
+    Datum values[4];
+    long n;
+    long i;
+    int ret;
+
+    n = hash_get_num_entries(counters->deltas);
+    if (n == 0)
+        return;
+
+    deltas = palloc(sizeof(*deltas) * n);
+
+    i = 0;
+    hash_seq_init(&seq, counters->deltas);
+    while ((delta = hash_seq_search(&seq)) != NULL)
+        deltas[i++] = delta;
+
+    qsort(deltas, n, sizeof(*deltas), compare_degree_deltas);
+
+    ids = palloc(sizeof(Datum) * n);
+    label_ids = palloc(sizeof(Datum) * n);
+    out_degrees = palloc(sizeof(Datum) * n);
+    in_degrees = palloc(sizeof(Datum) * n);
+
+    for (i = 0; i < n; i++)
+    {
+        ids[i] = GRAPHID_GET_DATUM(deltas[i]->key.vertex_id);
+        label_ids[i] = Int32GetDatum(deltas[i]->key.label_id);
+        out_degrees[i] = Int64GetDatum(deltas[i]->out_degree);
+        in_degrees[i] = Int64GetDatum(deltas[i]->in_degree);
+    }
+
+    values[Anum_ag_degree_id - 1] = PointerGetDatum(
+        construct_array(ids, n, GRAPHIDOID, sizeof(graphid), true, 'd'));
+    values[Anum_ag_degree_label_id - 1] = PointerGetDatum(
+        construct_array(label_ids, n, INT4OID, sizeof(int32), true, 'i'));
+    values[Anum_ag_degree_out_degree - 1] = PointerGetDatum(construct_array(
+        out_degrees, n, INT8OID, sizeof(int64), FLOAT8PASSBYVAL, 'd'));
+    values[Anum_ag_degree_in_degree - 1] = PointerGetDatum(construct_array(
+        in_degrees, n, INT8OID, sizeof(int64), FLOAT8PASSBYVAL, 'd'));
+
+    SPI_connect();
+
+    ret = SPI_execute_plan(counters->upsert_plan, values, NULL, false, 0);
+    if (ret != SPI_OK_INSERT)
+    {
+        elog(ERROR, "SPI_execute_plan failed: %s",
+             SPI_result_code_string(ret));
+    }
+
+    SPI_finish();
+
+    for (i = 0; i < 4; i++)
+        pfree(DatumGetPointer(values[i]));
+    pfree(ids);
+    pfree(label_ids);
+    pfree(out_degrees);
+    pfree(in_degrees);
+    pfree(deltas);
+
+    // the entries are not used anymore, so the table can be emptied
+    hash_seq_init(&seq, counters->deltas);
+    while ((delta = hash_seq_search(&seq)) != NULL)
+        hash_search(counters->deltas, &delta->key, HASH_REMOVE, NULL);
+}
+
+static int compare_degree_deltas(const void *a, const void *b)
+{
+    const degree_delta *da = *(const degree_delta *const *)a;
+    const degree_delta *db = *(const degree_delta *const *)b;
+
+    if (da->key.vertex_id != db->key.vertex_id)
+        return (da->key.vertex_id < db->key.vertex_id) ? -1 : 1;
+    if (da->key.label_id != db->key.label_id)
+        return (da->key.label_id < db->key.label_id) ? -1 : 1;
+    return 0;
+}
+
+// sums the counters of the vertex over all edge labels
+static int64 read_degree_counters(Oid relid, graphid vertex_id, bool outgoing)
+{
+    ScanKeyData scan_keys[1];
+    Relation rel;
+    SysScanDesc scan_desc;
+    HeapTuple tuple;
+    AttrNumber attnum;
+    Oid graphid_oid;
+    int64 degree = 0;
+
+    if (outgoing)
+        attnum = Anum_ag_degree_out_degree;
+    else
+        attnum = Anum_ag_degree_in_degree;
+
+    // the vertex id is the leading column of the primary key
+    graphid_oid = GRAPHIDOID;
+    ScanKeyInit(&scan_keys[0], Anum_ag_degree_id, BTEqualStrategyNumber,
+                get_ag_func_oid("graphid_eq", 2, graphid_oid, graphid_oid),
+                GRAPHID_GET_DATUM(vertex_id));
+
+    rel = heap_open(relid, AccessShareLock);
+    scan_desc = systable_beginscan(rel, RelationGetPrimaryKeyIndex(rel), true,
+                                   GetActiveSnapshot(), 1, scan_keys);
+
+    while (HeapTupleIsValid(tuple = systable_getnext(scan_desc)))
+    {
+        Datum value;
+        bool is_null;
+
+        value = heap_getattr(tuple, attnum, RelationGetDescr(rel), &is_null);
+        Assert(!is_null);
+
+        degree += DatumGetInt64(value);
+    }
+
+    systable_endscan(scan_desc);
+    heap_close(rel, AccessShareLock);
+
+    return degree;
+}
+
+// counts the edges of the vertex in the tables of all edge labels
+static int64 count_vertex_edges(graph_cache_data *cache, graphid vertex_id,
+                                bool outgoing)
+{
+    StringInfoData sql;
+    Oid argtypes[1];
+    Datum values[1];
+    int64 degree;
+    bool is_null;
+    int ret;
+
+    initStringInfo(&sql);
+    appendStringInfo(&sql, "SELECT count(*) FROM %s.%s WHERE %s = $1",
+                     quote_identifier(get_namespace_name(cache->namespace)),
+                     quote_identifier(get_label_relation_name(
+                         AG_DEFAULT_LABEL_EDGE, cache->oid)),
+                     outgoing ? AG_EDGE_COLNAME_START_ID :
+                                AG_EDGE_COLNAME_END_ID);
+
+    argtypes[0] = GRAPHIDOID;
+    values[0] = GRAPHID_GET_DATUM(vertex_id);
+
+    SPI_connect();
+
+    ret = SPI_execute_with_args(sql.data, 1, argtypes, values, NULL, true, 1);
+    if (ret != SPI_OK_SELECT || SPI_processed != 1)
+    {
+        elog(ERROR, "SPI_execute_with_args failed: %s",
+             SPI_result_code_string(ret));
+    }
+
+    degree = DatumGetInt64(SPI_getbinval(SPI_tuptable->vals[0],
+                                         SPI_tuptable->tupdesc, 1, &is_null));
+
+    SPI_finish();
+
+    return degree;
+}
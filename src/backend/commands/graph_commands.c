@@ -39,6 +39,8 @@
 #include "catalog/ag_graph.h"
 #include "catalog/ag_label.h"
 #include "commands/label_commands.h"
+#include "utils/ag_cache.h"
+#include "utils/csr_graph.h"
 #include "utils/graphid.h"
 
 /*
@@ -58,6 +60,8 @@ Datum create_graph(PG_FUNCTION_ARGS)
 {
     char *graph;
     Name graph_name;
+    bool partition_labels;
+    int32 hash_partitions;
     Oid nsp_id;
 
     if (PG_ARGISNULL(0))
@@ -67,6 +71,32 @@ Datum create_graph(PG_FUNCTION_ARGS)
     }
     graph_name = PG_GETARG_NAME(0);
 
+    if (PG_ARGISNULL(1))
+    {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                        errmsg("partition_labels must not be NULL")));
+    }
+    partition_labels = PG_GETARG_BOOL(1);
+
+    if (PG_ARGISNULL(2))
+    {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                        errmsg("hash_partitions must not be NULL")));
+    }
+    hash_partitions = PG_GETARG_INT32(2);
+    if (hash_partitions < 0)
+    {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                        errmsg("hash_partitions must not be negative")));
+    }
+
+    /*
+     * The hash partitioned tables of the labels are partitions of the
+     * default label tables, so the labels must be partitioned as well.
+     */
+    if (hash_partitions > 0)
+        partition_labels = true;
+
     nsp_id = create_schema_for_graph(graph_name);
 
     insert_graph(graph_name, nsp_id);
@@ -74,10 +104,24 @@ Datum create_graph(PG_FUNCTION_ARGS)
     //Increment the Command counter before create the generic labels.
     CommandCounterIncrement();
 
-    //Create the default label tables
+    /*
+     * Create the default label tables. Every other label inherits one of
+     * them, so when they are partitioned, the table of every other label is
+     * one of their partitions.
+     */
     graph = graph_name->data;
-    create_label(graph, AG_DEFAULT_LABEL_VERTEX, LABEL_TYPE_VERTEX, NIL);
-    create_label(graph, AG_DEFAULT_LABEL_EDGE, LABEL_TYPE_EDGE, NIL);
+    if (partition_labels)
+    {
+        create_partitioned_label(graph, AG_DEFAULT_LABEL_VERTEX,
+                                 LABEL_TYPE_VERTEX, hash_partitions);
+        create_partitioned_label(graph, AG_DEFAULT_LABEL_EDGE,
+                                 LABEL_TYPE_EDGE, hash_partitions);
+    }
+    else
+    {
+        create_label(graph, AG_DEFAULT_LABEL_VERTEX, LABEL_TYPE_VERTEX, NIL);
+        create_label(graph, AG_DEFAULT_LABEL_EDGE, LABEL_TYPE_EDGE, NIL);
+    }
 
     ereport(NOTICE,
             (errmsg("graph \"%s\" has been created", NameStr(*graph_name))));
@@ -142,6 +186,7 @@ Datum drop_graph(PG_FUNCTION_ARGS)
     Name graph_name;
     char *graph_name_str;
     bool cascade;
+    Oid graph_oid;
 
     if (PG_ARGISNULL(0))
     {
@@ -159,11 +204,16 @@ Datum drop_graph(PG_FUNCTION_ARGS)
                  errmsg("graph \"%s\" does not exist", graph_name_str)));
     }
 
+    graph_oid = search_graph_name_cache(graph_name_str)->oid;
+
     drop_schema_for_graph(graph_name_str, cascade);
 
     delete_graph(graph_name);
     CommandCounterIncrement();
 
+    // the snapshot is kept if the transaction is rolled back
+    remove_csr_snapshot_at_commit(graph_oid);
+
     ereport(NOTICE, (errmsg("graph \"%s\" has been dropped", graph_name_str)));
 
     PG_RETURN_VOID();
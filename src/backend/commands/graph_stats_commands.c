@@ -0,0 +1,580 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "postgres.h"
+
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "executor/spi.h"
+#include "fmgr.h"
+#include "lib/stringinfo.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+
+#include "catalog/ag_label.h"
+#include "commands/graph_stats_commands.h"
+#include "commands/label_commands.h"
+#include "utils/ag_cache.h"
+
+/*
+ * The graph statistics describe the topology of a graph, which the statistics
+ * of the label tables cannot. analyze_graph() gathers them into two side
+ * tables in the graph schema.
+ *
+ * _ag_edge_label_pairs has the number of edges of each edge label between
+ * each pair of start and end vertex labels. The planner estimates the joins
+ * between edges and their vertices with it, see graphid_eqjoinsel().
+ *
+ * _ag_edge_label_degrees has, for each edge label, the number of vertices
+ * that have edges of the label and the average and maximum number of edges
+ * of the label per vertex, along with an equi-depth histogram of them, for
+ * both directions. The planner estimates the semi-joins between vertices and
+ * their edges with the numbers of vertices.
+ *
+ * The planner reads the statistics of a graph once and keeps them in a cache
+ * until analyze_graph() gathers them again, see get_graph_stats().
+ */
+
+// the columns of the subqueries made by append_degree_stats_sql()
+#define DEGREE_STATS_COLUMNS \
+    "(label_id, edges, vertices, avg_degree, max_degree, histogram)"
+
+typedef struct edge_label_pair_stats
+{
+    int32 label_id;
+    int32 start_label_id;
+    int32 end_label_id;
+    int64 edges;
+} edge_label_pair_stats;
+
+typedef struct edge_label_degree_stats
+{
+    int32 label_id;
+    int64 start_vertices;
+    int64 end_vertices;
+} edge_label_degree_stats;
+
+typedef struct graph_stats_cache_entry
+{
+    Oid graph_namespace; // hash key
+    Oid pairs_relid;
+    Oid degrees_relid;
+    int npairs;
+    edge_label_pair_stats *pairs;
+    int ndegrees;
+    edge_label_degree_stats *degrees;
+} graph_stats_cache_entry;
+
+// graph namespace -> the statistics of the graph
+static HTAB *graph_stats_cache_hash = NULL;
+
+static void create_graph_stats_tables(const char *schema, Oid graph_namespace);
+static void append_degree_stats_sql(StringInfo sql, const char *schema,
+                                    const char *edges, const char *vertex_col);
+static void execute_graph_stats_sql(const char *sql, int expected);
+static void invalidate_graph_stats(Oid graph_namespace);
+static graph_stats_cache_entry *get_graph_stats(Oid graph_namespace);
+static void initialize_graph_stats_cache(void);
+static void invalidate_graph_stats_cache(Datum arg, Oid relid);
+static void free_graph_stats(graph_stats_cache_entry *entry);
+static void read_edge_label_pairs(graph_stats_cache_entry *entry,
+                                  Relation rel, Snapshot snapshot);
+static void read_edge_label_degrees(graph_stats_cache_entry *entry,
+                                    Relation rel, Snapshot snapshot);
+static void get_edge_label_pair_counts(graph_stats_cache_entry *entry,
+                                       int32 label_id, List *vertex_label_ids,
+                                       bool start, double *total,
+                                       double *matched);
+
+PG_FUNCTION_INFO_V1(analyze_graph);
+
+Datum analyze_graph(PG_FUNCTION_ARGS)
+{
+    Name graph_name;
+    graph_cache_data *cache;
+    const char *schema;
+    const char *edges;
+    StringInfoData sql;
+
+    if (PG_ARGISNULL(0))
+    {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                        errmsg("graph name must not be NULL")));
+    }
+    graph_name = PG_GETARG_NAME(0);
+
+    cache = search_graph_name_cache(NameStr(*graph_name));
+    if (!cache)
+    {
+        ereport(ERROR,
+                (errcode(ERRCODE_UNDEFINED_SCHEMA),
+                 errmsg("graph \"%s\" does not exist", NameStr(*graph_name))));
+    }
+
+    schema = quote_identifier(get_namespace_name(cache->namespace));
+    edges = quote_identifier(
+        get_label_relation_name(AG_DEFAULT_LABEL_EDGE, cache->oid));
+
+    initStringInfo(&sql);
+
+    SPI_connect();
+
+    create_graph_stats_tables(schema, cache->namespace);
+
+    /*
+     * The tables of all edge labels inherit the default edge label table and
+     * the label of an edge or a vertex is in its id, so a single scan of the
+     * edges is enough.
+     */
+    appendStringInfo(&sql,
+                     "INSERT INTO %s.%s "
+                     "SELECT ag_catalog._extract_label_id(%s), "
+                     "ag_catalog._extract_label_id(%s), "
+                     "ag_catalog._extract_label_id(%s), count(*) "
+                     "FROM %s.%s GROUP BY 1, 2, 3",
+                     schema, AG_EDGE_LABEL_PAIRS_RELATION_NAME,
+                     AG_EDGE_COLNAME_ID, AG_EDGE_COLNAME_START_ID,
+                     AG_EDGE_COLNAME_END_ID, schema, edges);
+    execute_graph_stats_sql(sql.data, SPI_OK_INSERT);
+
+    resetStringInfo(&sql);
+    appendStringInfo(&sql,
+                     "INSERT INTO %s.%s "
+                     "SELECT label_id, o.edges, "
+                     "o.vertices, o.avg_degree, o.max_degree, o.histogram, "
+                     "i.vertices, i.avg_degree, i.max_degree, i.histogram "
+                     "FROM ",
+                     schema, AG_EDGE_LABEL_DEGREES_RELATION_NAME);
+    append_degree_stats_sql(&sql, schema, edges, AG_EDGE_COLNAME_START_ID);
+    appendStringInfoString(&sql, " AS o" DEGREE_STATS_COLUMNS " JOIN ");
+    append_degree_stats_sql(&sql, schema, edges, AG_EDGE_COLNAME_END_ID);
+    appendStringInfoString(&sql, " AS i" DEGREE_STATS_COLUMNS
+                                 " USING (label_id)");
+    execute_graph_stats_sql(sql.data, SPI_OK_INSERT);
+
+    SPI_finish();
+
+    invalidate_graph_stats(cache->namespace);
+
+    PG_RETURN_VOID();
+}
+
+// creates the side tables if they do not exist, or empties them if they do
+static void create_graph_stats_tables(const char *schema, Oid graph_namespace)
+{
+    StringInfoData sql;
+
+    initStringInfo(&sql);
+
+    if (OidIsValid(get_relname_relid(AG_EDGE_LABEL_PAIRS_RELATION_NAME,
+                                     graph_namespace)))
+    {
+        appendStringInfo(&sql, "DELETE FROM %s.%s", schema,
+                         AG_EDGE_LABEL_PAIRS_RELATION_NAME);
+        execute_graph_stats_sql(sql.data, SPI_OK_DELETE);
+
+        resetStringInfo(&sql);
+        appendStringInfo(&sql, "DELETE FROM %s.%s", schema,
+                         AG_EDGE_LABEL_DEGREES_RELATION_NAME);
+        execute_graph_stats_sql(sql.data, SPI_OK_DELETE);
+
+        return;
+    }
+
+    appendStringInfo(&sql,
+                     "CREATE TABLE %s.%s ("
+                     "label_id int NOT NULL, "
+                     "start_label_id int NOT NULL, "
+                     "end_label_id int NOT NULL, "
+                     "edges bigint NOT NULL, "
+                     "PRIMARY KEY (label_id, start_label_id, end_label_id))",
+                     schema, AG_EDGE_LABEL_PAIRS_RELATION_NAME);
+    execute_graph_stats_sql(sql.data, SPI_OK_UTILITY);
+
+    resetStringInfo(&sql);
+    appendStringInfo(&sql,
+                     "CREATE TABLE %s.%s ("
+                     "label_id int PRIMARY KEY, "
+                     "edges bigint NOT NULL, "
+                     "start_vertices bigint NOT NULL, "
+                     "avg_out_degree float8 NOT NULL, "
+                     "max_out_degree bigint NOT NULL, "
+                     "out_degree_histogram bigint[] NOT NULL, "
+                     "end_vertices bigint NOT NULL, "
+                     "avg_in_degree float8 NOT NULL, "
+                     "max_in_degree bigint NOT NULL, "
+                     "in_degree_histogram bigint[] NOT NULL)",
+                     schema, AG_EDGE_LABEL_DEGREES_RELATION_NAME);
+    execute_graph_stats_sql(sql.data, SPI_OK_UTILITY);
+}
+
+/*
+ * Appends a subquery that computes the degree statistics of each edge label
+ * for the vertices in the given column of the edges.
+ */
+static void append_degree_stats_sql(StringInfo sql, const char *schema,
+                                    const char *edges, const char *vertex_col)
+{
+    int i;
+
+    appendStringInfoString(sql,
+                           "(SELECT label_id, sum(degree), count(*), "
+                           "avg(degree)::float8, max(degree), "
+                           "percentile_disc(ARRAY[");
+    for (i = 0; i <= AG_DEGREE_HISTOGRAM_BUCKETS; i++)
+    {
+        appendStringInfo(sql, "%s%g", (i > 0 ? ", " : ""),
+                         (double)i / AG_DEGREE_HISTOGRAM_BUCKETS);
+    }
+    appendStringInfo(sql,
+                     "]::float8[]) WITHIN GROUP (ORDER BY degree) "
+                     "FROM (SELECT ag_catalog._extract_label_id(%s), %s, "
+                     "count(*) FROM %s.%s GROUP BY 1, 2) "
+                     "AS d(label_id, vertex_id, degree) "
+                     "GROUP BY label_id)",
+                     AG_EDGE_COLNAME_ID, vertex_col, schema, edges);
+}
+
+static void execute_graph_stats_sql(const char *sql, int expected)
+{
+    int ret;
+
+    ret = SPI_execute(sql, false, 0);
+    if (ret != expected)
+        elog(ERROR, "SPI_execute failed: %s", SPI_result_code_string(ret));
+}
+
+/*
+ * Makes all backends, this one included, read the new statistics of the graph
+ * once they are committed. DML on the side tables does not invalidate their
+ * relcache entries by itself.
+ */
+static void invalidate_graph_stats(Oid graph_namespace)
+{
+    CacheInvalidateRelcacheByRelid(
+        get_relname_relid(AG_EDGE_LABEL_PAIRS_RELATION_NAME, graph_namespace));
+    CacheInvalidateRelcacheByRelid(get_relname_relid(
+        AG_EDGE_LABEL_DEGREES_RELATION_NAME, graph_namespace));
+}
+
+/*
+ * Computes the fraction of the edges of the given edge labels that start (or
+ * end) at a vertex of the given vertex labels, as of the last analyze_graph().
+ * Returns false if the graph has not been analyzed or had no such edges.
+ */
+bool get_edge_label_pair_fraction(Oid graph_namespace, List *edge_label_ids,
+                                  List *vertex_label_ids, bool start,
+                                  double *fraction)
+{
+    graph_stats_cache_entry *entry;
+    ListCell *lc;
+    double total = 0;
+    double matched = 0;
+
+    entry = get_graph_stats(graph_namespace);
+    if (!entry)
+        return false;
+
+    foreach (lc, edge_label_ids)
+    {
+        get_edge_label_pair_counts(entry, lfirst_int(lc), vertex_label_ids,
+                                   start, &total, &matched);
+    }
+
+    if (total == 0)
+        return false;
+
+    *fraction = matched / total;
+
+    return true;
+}
+
+/*
+ * Estimates the number of the vertices of the given vertex labels that have
+ * at least one outgoing (start) or incoming edge of the given edge labels, as
+ * of the last analyze_graph(). The vertices that have edges of a label are
+ * assumed to be spread over the vertex labels as the edges are.
+ * Returns false if the graph has not been analyzed or had no such edges.
+ */
+bool get_edge_label_vertices(Oid graph_namespace, List *edge_label_ids,
+                             List *vertex_label_ids, bool start,
+                             double *vertices)
+{
+    graph_stats_cache_entry *entry;
+    bool found = false;
+    int i;
+
+    entry = get_graph_stats(graph_namespace);
+    if (!entry)
+        return false;
+
+    *vertices = 0;
+
+    for (i = 0; i < entry->ndegrees; i++)
+    {
+        edge_label_degree_stats *degree = &entry->degrees[i];
+        double total = 0;
+        double matched = 0;
+
+        if (!list_member_int(edge_label_ids, degree->label_id))
+            continue;
+
+        get_edge_label_pair_counts(entry, degree->label_id, vertex_label_ids,
+                                   start, &total, &matched);
+        if (total == 0)
+            continue;
+
+        if (start)
+            *vertices += degree->start_vertices * (matched / total);
+        else
+            *vertices += degree->end_vertices * (matched / total);
+
+        found = true;
+    }
+
+    return found;
+}
+
+/*
+ * Adds the number of the edges of the label to total, and the number of the
+ * ones among them that start (or end) at a vertex of the given vertex labels
+ * to matched.
+ */
+static void get_edge_label_pair_counts(graph_stats_cache_entry *entry,
+                                       int32 label_id, List *vertex_label_ids,
+                                       bool start, double *total,
+                                       double *matched)
+{
+    int i;
+
+    for (i = 0; i < entry->npairs; i++)
+    {
+        edge_label_pair_stats *pair = &entry->pairs[i];
+        int32 vertex_label_id;
+
+        if (pair->label_id != label_id)
+            continue;
+
+        if (start)
+            vertex_label_id = pair->start_label_id;
+        else
+            vertex_label_id = pair->end_label_id;
+
+        *total += pair->edges;
+        if (list_member_int(vertex_label_ids, vertex_label_id))
+            *matched += pair->edges;
+    }
+}
+
+/*
+ * Returns the statistics of the graph, or NULL if it has not been analyzed.
+ *
+ * The join estimates of a query ask for them for each join clause, so the
+ * side tables are read once and kept until a relcache invalidation of either
+ * of them, which analyze_graph() and DROP send.
+ */
+static graph_stats_cache_entry *get_graph_stats(Oid graph_namespace)
+{
+    graph_stats_cache_entry *entry;
+    graph_stats_cache_entry stats;
+    Relation pairs_rel;
+    Relation degrees_rel;
+    Snapshot snapshot;
+
+    initialize_graph_stats_cache();
+
+    entry = hash_search(graph_stats_cache_hash, &graph_namespace, HASH_FIND,
+                        NULL);
+    if (entry)
+        return entry;
+
+    stats.graph_namespace = graph_namespace;
+    stats.pairs_relid = get_relname_relid(AG_EDGE_LABEL_PAIRS_RELATION_NAME,
+                                          graph_namespace);
+    stats.degrees_relid = get_relname_relid(
+        AG_EDGE_LABEL_DEGREES_RELATION_NAME, graph_namespace);
+    if (!OidIsValid(stats.pairs_relid) || !OidIsValid(stats.degrees_relid))
+        return NULL;
+
+    stats.npairs = 0;
+    stats.pairs = NULL;
+    stats.ndegrees = 0;
+    stats.degrees = NULL;
+
+    /*
+     * Locking the side tables processes the pending invalidations. The
+     * statistics are read with a snapshot taken after that, so any change
+     * that it does not see sends an invalidation that drops the entry later.
+     */
+    pairs_rel = heap_open(stats.pairs_relid, AccessShareLock);
+    degrees_rel = heap_open(stats.degrees_relid, AccessShareLock);
+    snapshot = RegisterSnapshot(GetLatestSnapshot());
+
+    PG_TRY();
+    {
+        read_edge_label_pairs(&stats, pairs_rel, snapshot);
+        read_edge_label_degrees(&stats, degrees_rel, snapshot);
+    }
+    PG_CATCH();
+    {
+        free_graph_stats(&stats);
+        PG_RE_THROW();
+    }
+    PG_END_TRY();
+
+    UnregisterSnapshot(snapshot);
+    heap_close(degrees_rel, AccessShareLock);
+    heap_close(pairs_rel, AccessShareLock);
+
+    entry = hash_search(graph_stats_cache_hash, &graph_namespace, HASH_ENTER,
+                        NULL);
+    *entry = stats;
+
+    return entry;
+}
+
+static void initialize_graph_stats_cache(void)
+{
+    HASHCTL hash_ctl;
+
+    if (graph_stats_cache_hash)
+        return;
+
+    if (!CacheMemoryContext)
+        CreateCacheMemoryContext();
+
+    MemSet(&hash_ctl, 0, sizeof(hash_ctl));
+    hash_ctl.keysize = sizeof(Oid);
+    hash_ctl.entrysize = sizeof(graph_stats_cache_entry);
+
+    graph_stats_cache_hash = hash_create("graph statistics cache", 16,
+                                         &hash_ctl, HASH_ELEM | HASH_BLOBS);
+
+    CacheRegisterRelcacheCallback(invalidate_graph_stats_cache, (Datum)0);
+}
+
+static void invalidate_graph_stats_cache(Datum arg, Oid relid)
+{
+    HASH_SEQ_STATUS hash_seq;
+    graph_stats_cache_entry *entry;
+
+    hash_seq_init(&hash_seq, graph_stats_cache_hash);
+    while ((entry = hash_seq_search(&hash_seq)) != NULL)
+    {
+        // InvalidOid means all relations
+        if (OidIsValid(relid) && entry->pairs_relid != relid &&
+            entry->degrees_relid != relid)
+            continue;
+
+        free_graph_stats(entry);
+        hash_search(graph_stats_cache_hash, &entry->graph_namespace,
+                    HASH_REMOVE, NULL);
+    }
+}
+
+static void free_graph_stats(graph_stats_cache_entry *entry)
+{
+    if (entry->pairs)
+        pfree(entry->pairs);
+    if (entry->degrees)
+        pfree(entry->degrees);
+}
+
+static void read_edge_label_pairs(graph_stats_cache_entry *entry,
+                                  Relation rel, Snapshot snapshot)
+{
+    TupleDesc tupdesc;
+    HeapScanDesc scan_desc;
+    HeapTuple tuple;
+    int size = 16;
+
+    entry->pairs = MemoryContextAlloc(CacheMemoryContext,
+                                      sizeof(edge_label_pair_stats) * size);
+
+    tupdesc = RelationGetDescr(rel);
+    scan_desc = heap_beginscan(rel, snapshot, 0, NULL);
+
+    while ((tuple = heap_getnext(scan_desc, ForwardScanDirection)) != NULL)
+    {
+        edge_label_pair_stats *pair;
+        bool is_null;
+
+        if (entry->npairs == size)
+        {
+            size *= 2;
+            entry->pairs = repalloc(entry->pairs,
+                                    sizeof(edge_label_pair_stats) * size);
+        }
+
+        pair = &entry->pairs[entry->npairs++];
+        pair->label_id = DatumGetInt32(heap_getattr(
+            tuple, Anum_ag_edge_label_pairs_label_id, tupdesc, &is_null));
+        pair->start_label_id = DatumGetInt32(heap_getattr(
+            tuple, Anum_ag_edge_label_pairs_start_label_id, tupdesc,
+            &is_null));
+        pair->end_label_id = DatumGetInt32(heap_getattr(
+            tuple, Anum_ag_edge_label_pairs_end_label_id, tupdesc, &is_null));
+        pair->edges = DatumGetInt64(heap_getattr(
+            tuple, Anum_ag_edge_label_pairs_edges, tupdesc, &is_null));
+    }
+
+    heap_endscan(scan_desc);
+}
+
+static void read_edge_label_degrees(graph_stats_cache_entry *entry,
+                                    Relation rel, Snapshot snapshot)
+{
+    TupleDesc tupdesc;
+    HeapScanDesc scan_desc;
+    HeapTuple tuple;
+    int size = 16;
+
+    entry->degrees = MemoryContextAlloc(
+        CacheMemoryContext, sizeof(edge_label_degree_stats) * size);
+
+    tupdesc = RelationGetDescr(rel);
+    scan_desc = heap_beginscan(rel, snapshot, 0, NULL);
+
+    while ((tuple = heap_getnext(scan_desc, ForwardScanDirection)) != NULL)
+    {
+        edge_label_degree_stats *degree;
+        bool is_null;
+
+        if (entry->ndegrees == size)
+        {
+            size *= 2;
+            entry->degrees = repalloc(entry->degrees,
+                                      sizeof(edge_label_degree_stats) * size);
+        }
+
+        degree = &entry->degrees[entry->ndegrees++];
+        degree->label_id = DatumGetInt32(heap_getattr(
+            tuple, Anum_ag_edge_label_degrees_label_id, tupdesc, &is_null));
+        degree->start_vertices = DatumGetInt64(
+            heap_getattr(tuple, Anum_ag_edge_label_degrees_start_vertices,
+                         tupdesc, &is_null));
+        degree->end_vertices = DatumGetInt64(
+            heap_getattr(tuple, Anum_ag_edge_label_degrees_end_vertices,
+                         tupdesc, &is_null));
+    }
+
+    heap_endscan(scan_desc);
+}
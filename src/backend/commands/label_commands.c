@@ -16,11 +16,15 @@
 
 #include "postgres.h"
 
+#include <math.h>
+
 #include "access/heapam.h"
 #include "access/xact.h"
 #include "catalog/dependency.h"
+#include "catalog/pg_inherits.h"
 #include "catalog/namespace.h"
 #include "catalog/objectaddress.h"
+#include "catalog/partition.h"
 #include "catalog/pg_class_d.h"
 #include "commands/defrem.h"
 #include "commands/sequence.h"
@@ -33,8 +37,10 @@
 #include "nodes/plannodes.h"
 #include "nodes/primnodes.h"
 #include "nodes/value.h"
+#include "optimizer/plancat.h"
 #include "parser/parse_node.h"
 #include "parser/parser.h"
+#include "storage/bufmgr.h"
 #include "storage/lockdefs.h"
 #include "tcop/dest.h"
 #include "tcop/utility.h"
@@ -42,9 +48,12 @@
 #include "utils/builtins.h"
 #include "utils/inval.h"
 #include "utils/lsyscache.h"
+#include "utils/partcache.h"
+#include "utils/rel.h"
 
 #include "catalog/ag_graph.h"
 #include "catalog/ag_label.h"
+#include "commands/degree_commands.h"
 #include "commands/label_commands.h"
 #include "utils/ag_cache.h"
 #include "utils/agtype.h"
@@ -56,15 +65,42 @@
  */
 #define gen_label_relation_name(label_name) (label_name)
 
+/*
+ * The entities of a partitioned label are stored in a partition of its table
+ * that is named after the table with this suffix.
+ */
+#define LABEL_OWN_PARTITION_SUFFIX "own"
+
+static Oid define_label(char *graph_name, char *label_name, char label_type,
+                        List *parents, bool partitioned,
+                        int32 hash_partitions);
 static void create_table_for_label(char *graph_name, char *label_name,
                                    char *schema_name, char *rel_name,
                                    char *seq_name, char label_type,
-                                   List *parents);
+                                   List *parents, int32 label_id,
+                                   bool partitioned, int32 hash_partitions);
+static void create_own_partition_for_label(char *schema_name, char *rel_name,
+                                           Oid nsp_id, int32 label_id,
+                                           char label_type,
+                                           int32 hash_partitions);
+static void create_hash_partitions_for_label(char *schema_name,
+                                             char *rel_name, Oid nsp_id,
+                                             int32 hash_partitions);
+static void create_id_index_for_label(char *schema_name, char *rel_name);
+static void execute_generated_stmt(Node *stmt, const char *query_string);
+static bool is_partitioned_parent(List *parents);
+static int32 get_parent_hash_partitions(List *parents);
+static PartitionSpec *build_label_partition_spec(void);
+static PartitionSpec *build_hash_partition_spec(char label_type);
+static PartitionBoundSpec *build_label_partition_bound(int32 label_id);
+static PartitionBoundSpec *build_hash_partition_bound(int32 modulus,
+                                                      int32 remainder);
+static PartitionRangeDatum *build_graphid_range_datum(graphid gid);
 
 // common
 static List *create_edge_table_elements(char *graph_name, char *label_name,
                                         char *schema_name, char *rel_name,
-                                        char *seq_name);
+                                        char *seq_name, bool id_is_pk);
 static List *create_vertex_table_elements(char *graph_name, char *label_name,
                                           char *schema_name, char *rel_name,
                                           char *seq_name);
@@ -94,9 +130,46 @@ static void range_var_callback_for_remove_relation(const RangeVar *rel,
  * For the new label, create an entry in ag_catalog.ag_label, create a
  * new table and sequence. Returns the oid from the new tuple in
  * ag_catalog.ag_label.
+ *
+ * If the table of the parent label is partitioned, the table of the new label
+ * is attached to it as a partition.
  */
 Oid create_label(char *graph_name, char *label_name, char label_type,
                  List *parents)
+{
+    int32 hash_partitions;
+
+    /*
+     * The labels of a hash partitioned graph are all hash partitioned the
+     * same way, so that their partitions can be joined pairwise.
+     */
+    hash_partitions = get_parent_hash_partitions(parents);
+
+    return define_label(graph_name, label_name, label_type, parents, false,
+                        hash_partitions);
+}
+
+/*
+ * Same as create_label() but the table of the new label is partitioned on
+ * the label id part of "id". The labels that inherit the new label become
+ * its partitions, so scans can be pruned to the partitions of the labels
+ * they are looking for.
+ *
+ * If hash_partitions is greater than zero, the entities of the new label and
+ * the labels that inherit it are further hash partitioned into that many
+ * partitions. Vertices are hashed on "id" and edges on "start_id", so an edge
+ * is stored in the partition with the same remainder as its start vertex.
+ */
+Oid create_partitioned_label(char *graph_name, char *label_name,
+                             char label_type, int32 hash_partitions)
+{
+    return define_label(graph_name, label_name, label_type, NIL, true,
+                        hash_partitions);
+}
+
+static Oid define_label(char *graph_name, char *label_name, char label_type,
+                        List *parents, bool partitioned,
+                        int32 hash_partitions)
 {
     graph_cache_data *cache_data;
     Oid graph_oid;
@@ -125,9 +198,34 @@ Oid create_label(char *graph_name, char *label_name, char label_type,
     seq_range_var = makeRangeVar(schema_name, seq_name, -1);
     create_sequence_for_label(seq_range_var);
 
+    /*
+     * get a new "id" for the new label, it is needed up front for the
+     * partition bound of the new table
+     */
+    label_id = get_new_label_id(graph_oid, nsp_id);
+
     // create a table for the new label
     create_table_for_label(graph_name, label_name, schema_name, rel_name,
-                           seq_name, label_type, parents);
+                           seq_name, label_type, parents, label_id,
+                           partitioned, hash_partitions);
+
+    if (partitioned)
+    {
+        /*
+         * An edge table that is hash partitioned on "start_id" cannot have a
+         * primary key on "id", index "id" without the uniqueness instead.
+         */
+        if (label_type == LABEL_TYPE_EDGE && hash_partitions > 0)
+            create_id_index_for_label(schema_name, rel_name);
+
+        create_own_partition_for_label(schema_name, rel_name, nsp_id,
+                                       label_id, label_type, hash_partitions);
+    }
+    else if (hash_partitions > 0)
+    {
+        create_hash_partitions_for_label(schema_name, rel_name, nsp_id,
+                                         hash_partitions);
+    }
 
     // record the new label in ag_label
     relation_id = get_relname_relid(rel_name, nsp_id);
@@ -140,17 +238,69 @@ Oid create_label(char *graph_name, char *label_name, char label_type,
     // associate the sequence with the "id" column
     alter_sequence_owned_by_for_label(seq_range_var, rel_name);
 
-    // get a new "id" for the new label
-    label_id = get_new_label_id(graph_oid, nsp_id);
-
     label_oid = insert_label(label_name, graph_oid, label_id, label_type,
-                             relation_id);
+                             relation_id, hash_partitions);
 
     CommandCounterIncrement();
 
+    // SQL statements on the new table must keep the degree counters correct
+    if (label_type == LABEL_TYPE_EDGE)
+        add_degree_triggers(nsp_id, relation_id);
+
     return label_oid;
 }
 
+/*
+ * Returns the relation the entities of the label that is backed by the given
+ * relation are stored in. A label table that is partitioned on the label id
+ * has no storage of its own, so its entities are stored in the only
+ * partition of it that does not belong to another label.
+ *
+ * The returned relation may still be hash partitioned, inserts into it are
+ * routed to its partitions.
+ */
+Oid get_label_storage_relation(Oid relid)
+{
+    Relation rel;
+    PartitionDesc partdesc;
+    Oid storage_relid = InvalidOid;
+    int i;
+
+    if (get_rel_relkind(relid) != RELKIND_PARTITIONED_TABLE)
+        return relid;
+
+    // the caller is expected to hold a lock on the relation
+    rel = heap_open(relid, NoLock);
+
+    if (RelationGetPartitionKey(rel)->strategy != PARTITION_STRATEGY_RANGE)
+    {
+        heap_close(rel, NoLock);
+        return relid;
+    }
+
+    partdesc = RelationGetPartitionDesc(rel);
+    for (i = 0; i < partdesc->nparts; i++)
+    {
+        if (!search_label_relation_cache(partdesc->oids[i]))
+        {
+            storage_relid = partdesc->oids[i];
+            break;
+        }
+    }
+
+    heap_close(rel, NoLock);
+
+    if (!OidIsValid(storage_relid))
+    {
+        ereport(ERROR,
+                (errcode(ERRCODE_UNDEFINED_TABLE),
+                 errmsg("partitioned label table \"%s\" has no partition for its own entities",
+                        get_rel_name(relid))));
+    }
+
+    return storage_relid;
+}
+
 // CREATE TABLE `schema_name`.`rel_name` (
 //   "id" graphid PRIMARY KEY DEFAULT "ag_catalog"."_graphid"(...),
 //   "start_id" graphid NOT NULL note: only for edge labels
@@ -160,10 +310,11 @@ Oid create_label(char *graph_name, char *label_name, char label_type,
 static void create_table_for_label(char *graph_name, char *label_name,
                                    char *schema_name, char *rel_name,
                                    char *seq_name, char label_type,
-                                   List *parents)
+                                   List *parents, int32 label_id,
+                                   bool partitioned, int32 hash_partitions)
 {
     CreateStmt *create_stmt;
-    PlannedStmt *wrapper;
+    bool is_partition;
 
     create_stmt = makeNode(CreateStmt);
 
@@ -179,7 +330,8 @@ static void create_table_for_label(char *graph_name, char *label_name,
         create_stmt->tableElts = NIL;
     else if (label_type == LABEL_TYPE_EDGE)
         create_stmt->tableElts = create_edge_table_elements(
-            graph_name, label_name, schema_name, rel_name, seq_name);
+            graph_name, label_name, schema_name, rel_name, seq_name,
+            hash_partitions == 0);
     else if (label_type == LABEL_TYPE_VERTEX)
         create_stmt->tableElts = create_vertex_table_elements(
             graph_name, label_name, schema_name, rel_name, seq_name);
@@ -187,8 +339,68 @@ static void create_table_for_label(char *graph_name, char *label_name,
         ereport(ERROR, (errcode(ERRCODE_INTERNAL_ERROR),
                         errmsg("undefined label type \'%c\'", label_type)));
 
+    is_partition = is_partitioned_parent(parents);
+
     create_stmt->inhRelations = parents;
     create_stmt->partbound = NULL;
+    create_stmt->partspec = NULL;
+    create_stmt->ofTypename = NULL;
+
+    // PARTITION OF `parent` FOR VALUES FROM (...) TO (...)
+    if (is_partition)
+        create_stmt->partbound = build_label_partition_bound(label_id);
+
+    // PARTITION BY RANGE ("id") or PARTITION BY HASH (...)
+    if (partitioned)
+        create_stmt->partspec = build_label_partition_spec();
+    else if (hash_partitions > 0)
+        create_stmt->partspec = build_hash_partition_spec(label_type);
+
+    /*
+     * Indexes are not inherited. Give a child label its own primary key on id
+     * so that a lookup by graphid can probe the index of the label table the
+     * graphid belongs to. A partition gets the primary key of its parent.
+     */
+    if (list_length(parents) != 0 && !is_partition)
+    {
+        Constraint *pk = build_pk_constraint();
+
+        pk->keys = list_make1(makeString(AG_VERTEX_COLNAME_ID));
+        create_stmt->constraints = list_make1(pk);
+    }
+    else
+    {
+        create_stmt->constraints = NIL;
+    }
+    create_stmt->options = NIL;
+    create_stmt->oncommit = ONCOMMIT_NOOP;
+    create_stmt->tablespacename = NULL;
+    create_stmt->if_not_exists = false;
+
+    execute_generated_stmt((Node *)create_stmt,
+                           "(generated CREATE TABLE command)");
+}
+
+// CREATE TABLE `schema_name`.`rel_name`_own
+//   PARTITION OF `schema_name`.`rel_name` FOR VALUES FROM (...) TO (...)
+static void create_own_partition_for_label(char *schema_name, char *rel_name,
+                                           Oid nsp_id, int32 label_id,
+                                           char label_type,
+                                           int32 hash_partitions)
+{
+    CreateStmt *create_stmt;
+    char *part_name;
+
+    part_name = ChooseRelationName(rel_name, NULL, LABEL_OWN_PARTITION_SUFFIX,
+                                   nsp_id, false);
+
+    create_stmt = makeNode(CreateStmt);
+    create_stmt->relation = makeRangeVar(schema_name, part_name, -1);
+    create_stmt->tableElts = NIL;
+    create_stmt->inhRelations = list_make1(
+        makeRangeVar(schema_name, rel_name, -1));
+    create_stmt->partbound = build_label_partition_bound(label_id);
+    create_stmt->partspec = NULL;
     create_stmt->ofTypename = NULL;
     create_stmt->constraints = NIL;
     create_stmt->options = NIL;
@@ -196,19 +408,271 @@ static void create_table_for_label(char *graph_name, char *label_name,
     create_stmt->tablespacename = NULL;
     create_stmt->if_not_exists = false;
 
+    if (hash_partitions > 0)
+        create_stmt->partspec = build_hash_partition_spec(label_type);
+
+    execute_generated_stmt((Node *)create_stmt,
+                           "(generated CREATE TABLE command)");
+
+    if (hash_partitions > 0)
+        create_hash_partitions_for_label(schema_name, part_name, nsp_id,
+                                         hash_partitions);
+}
+
+// CREATE TABLE `schema_name`.`rel_name`_p`remainder`
+//   PARTITION OF `schema_name`.`rel_name`
+//   FOR VALUES WITH (MODULUS `hash_partitions`, REMAINDER `remainder`)
+static void create_hash_partitions_for_label(char *schema_name,
+                                             char *rel_name, Oid nsp_id,
+                                             int32 hash_partitions)
+{
+    int32 remainder;
+
+    for (remainder = 0; remainder < hash_partitions; remainder++)
+    {
+        CreateStmt *create_stmt;
+        char *part_name;
+
+        part_name = ChooseRelationName(rel_name, NULL,
+                                       psprintf("p%d", remainder), nsp_id,
+                                       false);
+
+        create_stmt = makeNode(CreateStmt);
+        create_stmt->relation = makeRangeVar(schema_name, part_name, -1);
+        create_stmt->tableElts = NIL;
+        create_stmt->inhRelations = list_make1(
+            makeRangeVar(schema_name, rel_name, -1));
+        create_stmt->partbound = build_hash_partition_bound(hash_partitions,
+                                                            remainder);
+        create_stmt->partspec = NULL;
+        create_stmt->ofTypename = NULL;
+        create_stmt->constraints = NIL;
+        create_stmt->options = NIL;
+        create_stmt->oncommit = ONCOMMIT_NOOP;
+        create_stmt->tablespacename = NULL;
+        create_stmt->if_not_exists = false;
+
+        execute_generated_stmt((Node *)create_stmt,
+                               "(generated CREATE TABLE command)");
+    }
+}
+
+// CREATE INDEX ON `schema_name`.`rel_name` USING btree ("id")
+static void create_id_index_for_label(char *schema_name, char *rel_name)
+{
+    IndexStmt *index_stmt;
+    IndexElem *id;
+
+    id = makeNode(IndexElem);
+    id->name = AG_EDGE_COLNAME_ID;
+    id->expr = NULL;
+    id->indexcolname = NULL;
+    id->collation = NIL;
+    id->opclass = NIL;
+    id->ordering = SORTBY_DEFAULT;
+    id->nulls_ordering = SORTBY_NULLS_DEFAULT;
+
+    index_stmt = makeNode(IndexStmt);
+    index_stmt->idxname = NULL;
+    index_stmt->relation = makeRangeVar(schema_name, rel_name, -1);
+    index_stmt->accessMethod = "btree";
+    index_stmt->tableSpace = NULL;
+    index_stmt->indexParams = list_make1(id);
+    index_stmt->options = NIL;
+    index_stmt->whereClause = NULL;
+    index_stmt->excludeOpNames = NIL;
+    index_stmt->idxcomment = NULL;
+    index_stmt->indexOid = InvalidOid;
+    index_stmt->unique = false;
+    index_stmt->primary = false;
+    index_stmt->isconstraint = false;
+    index_stmt->concurrent = false;
+    index_stmt->if_not_exists = false;
+
+    execute_generated_stmt((Node *)index_stmt,
+                           "(generated CREATE INDEX command)");
+}
+
+static void execute_generated_stmt(Node *stmt, const char *query_string)
+{
+    PlannedStmt *wrapper;
+
     wrapper = makeNode(PlannedStmt);
     wrapper->commandType = CMD_UTILITY;
     wrapper->canSetTag = false;
-    wrapper->utilityStmt = (Node *)create_stmt;
+    wrapper->utilityStmt = stmt;
     wrapper->stmt_location = -1;
     wrapper->stmt_len = 0;
 
-    ProcessUtility(wrapper, "(generated CREATE TABLE command)",
-                   PROCESS_UTILITY_SUBCOMMAND, NULL, NULL, None_Receiver,
-                   NULL);
+    ProcessUtility(wrapper, query_string, PROCESS_UTILITY_SUBCOMMAND, NULL,
+                   NULL, None_Receiver, NULL);
     // CommandCounterIncrement() is called in ProcessUtility()
 }
 
+/*
+ * Check to see if the new label table must be created as a partition. A table
+ * can only be a partition of a single partitioned table.
+ */
+static bool is_partitioned_parent(List *parents)
+{
+    ListCell *lc;
+    bool partitioned = false;
+
+    foreach (lc, parents)
+    {
+        RangeVar *rv = lfirst(lc);
+        Oid relid = RangeVarGetRelid(rv, NoLock, false);
+
+        if (get_rel_relkind(relid) == RELKIND_PARTITIONED_TABLE)
+            partitioned = true;
+    }
+
+    if (partitioned && list_length(parents) > 1)
+    {
+        ereport(ERROR,
+                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                 errmsg("a label cannot inherit a partitioned label and another label")));
+    }
+
+    return partitioned;
+}
+
+// returns the number of hash partitions of the labels the new label inherits
+static int32 get_parent_hash_partitions(List *parents)
+{
+    ListCell *lc;
+
+    foreach (lc, parents)
+    {
+        RangeVar *rv = lfirst(lc);
+        Oid relid = RangeVarGetRelid(rv, NoLock, false);
+        label_cache_data *cache_data;
+
+        cache_data = search_label_relation_cache(relid);
+        if (cache_data && cache_data->hash_partitions > 0)
+            return cache_data->hash_partitions;
+    }
+
+    return 0;
+}
+
+/*
+ * The label id is stored in the upper bits of a graphid, so the graphids of a
+ * label form a single range. Partitioning on the range of "id" is the same as
+ * partitioning on the label id, but it keeps "id" usable as the primary key
+ * of the partitioned table and lets range quals on "id" prune partitions.
+ */
+static PartitionSpec *build_label_partition_spec(void)
+{
+    PartitionSpec *partspec;
+    PartitionElem *id;
+
+    id = makeNode(PartitionElem);
+    id->name = AG_VERTEX_COLNAME_ID;
+    id->expr = NULL;
+    id->collation = NIL;
+    id->opclass = NIL;
+    id->location = -1;
+
+    partspec = makeNode(PartitionSpec);
+    partspec->strategy = "range";
+    partspec->partParams = list_make1(id);
+    partspec->location = -1;
+
+    return partspec;
+}
+
+// PARTITION BY HASH ("id") or PARTITION BY HASH ("start_id") for edges
+static PartitionSpec *build_hash_partition_spec(char label_type)
+{
+    PartitionSpec *partspec;
+    PartitionElem *key;
+
+    key = makeNode(PartitionElem);
+    if (label_type == LABEL_TYPE_EDGE)
+        key->name = AG_EDGE_COLNAME_START_ID;
+    else
+        key->name = AG_VERTEX_COLNAME_ID;
+    key->expr = NULL;
+    key->collation = NIL;
+    key->opclass = NIL;
+    key->location = -1;
+
+    partspec = makeNode(PartitionSpec);
+    partspec->strategy = "hash";
+    partspec->partParams = list_make1(key);
+    partspec->location = -1;
+
+    return partspec;
+}
+
+// FOR VALUES FROM (`first graphid`) TO (`last graphid` + 1)
+static PartitionBoundSpec *build_label_partition_bound(int32 label_id)
+{
+    PartitionBoundSpec *bound;
+    graphid min_id, max_id;
+    PartitionRangeDatum *upper;
+
+    min_id = make_graphid(label_id, ENTRY_ID_MIN);
+    max_id = make_graphid(label_id, ENTRY_ID_MAX);
+
+    // the last graphid of the last positive label id has no successor
+    if (max_id == PG_INT64_MAX)
+    {
+        upper = makeNode(PartitionRangeDatum);
+        upper->kind = PARTITION_RANGE_DATUM_MAXVALUE;
+        upper->value = NULL;
+        upper->location = -1;
+    }
+    else
+    {
+        upper = build_graphid_range_datum(max_id + 1);
+    }
+
+    bound = makeNode(PartitionBoundSpec);
+    bound->strategy = PARTITION_STRATEGY_RANGE;
+    bound->is_default = false;
+    bound->lowerdatums = list_make1(build_graphid_range_datum(min_id));
+    bound->upperdatums = list_make1(upper);
+    bound->location = -1;
+
+    return bound;
+}
+
+// FOR VALUES WITH (MODULUS `modulus`, REMAINDER `remainder`)
+static PartitionBoundSpec *build_hash_partition_bound(int32 modulus,
+                                                      int32 remainder)
+{
+    PartitionBoundSpec *bound;
+
+    bound = makeNode(PartitionBoundSpec);
+    bound->strategy = PARTITION_STRATEGY_HASH;
+    bound->is_default = false;
+    bound->modulus = modulus;
+    bound->remainder = remainder;
+    bound->location = -1;
+
+    return bound;
+}
+
+static PartitionRangeDatum *build_graphid_range_datum(graphid gid)
+{
+    PartitionRangeDatum *datum;
+    A_Const *value;
+
+    value = makeNode(A_Const);
+    value->val.type = T_String;
+    value->val.val.str = psprintf(INT64_FORMAT, gid);
+    value->location = -1;
+
+    datum = makeNode(PartitionRangeDatum);
+    datum->kind = PARTITION_RANGE_DATUM_VALUE;
+    datum->value = (Node *)value;
+    datum->location = -1;
+
+    return datum;
+}
+
 // CREATE TABLE `schema_name`.`rel_name` (
 //   "id" graphid PRIMARY KEY DEFAULT "ag_catalog"."_graphid"(...),
 //   "start_id" graphid NOT NULL
@@ -217,7 +681,7 @@ static void create_table_for_label(char *graph_name, char *label_name,
 // )
 static List *create_edge_table_elements(char *graph_name, char *label_name,
                                         char *schema_name, char *rel_name,
-                                        char *seq_name)
+                                        char *seq_name, bool id_is_pk)
 {
     ColumnDef *id;
     ColumnDef *start_id;
@@ -226,9 +690,10 @@ static List *create_edge_table_elements(char *graph_name, char *label_name,
 
     // "id" graphid PRIMARY KEY DEFAULT "ag_catalog"."_graphid"(...)
     id = makeColumnDef(AG_EDGE_COLNAME_ID, GRAPHIDOID, -1, InvalidOid);
-    id->constraints = list_make2(build_pk_constraint(),
-                                 build_id_default(graph_name, label_name,
+    id->constraints = list_make1(build_id_default(graph_name, label_name,
                                                   schema_name, seq_name));
+    if (id_is_pk)
+        id->constraints = lcons(build_pk_constraint(), id->constraints);
 
     // "start_id" graphid NOT NULL
     start_id = makeColumnDef(AG_EDGE_COLNAME_START_ID, GRAPHIDOID, -1,
@@ -542,6 +1007,7 @@ Datum drop_label(PG_FUNCTION_ARGS)
     Oid nsp_id;
     char *label_name_str;
     Oid label_relation;
+    label_cache_data *label_cache;
     char *schema_name;
     char *rel_name;
     List *qname;
@@ -586,6 +1052,11 @@ Datum drop_label(PG_FUNCTION_ARGS)
                         errmsg("force option is not supported yet")));
     }
 
+    // the counters of the edges of the label go away with the edges
+    label_cache = search_label_relation_cache(label_relation);
+    if (label_cache->kind == LABEL_KIND_EDGE)
+        remove_degree_counters(nsp_id, label_cache->id);
+
     schema_name = get_namespace_name(nsp_id);
     rel_name = get_rel_name(label_relation);
     qname = list_make2(makeString(schema_name), makeString(rel_name));
@@ -601,6 +1072,47 @@ Datum drop_label(PG_FUNCTION_ARGS)
     PG_RETURN_VOID();
 }
 
+PG_FUNCTION_INFO_V1(_estimate_label_count);
+
+/*
+ * Estimates the number of entities in the given label table, including the
+ * entities of its child labels, from the statistics of the tables.
+ */
+Datum _estimate_label_count(PG_FUNCTION_ARGS)
+{
+    Oid relid = PG_GETARG_OID(0);
+    List *relids;
+    ListCell *lc;
+    double count = 0;
+
+    relids = find_all_inheritors(relid, AccessShareLock, NULL);
+    foreach (lc, relids)
+    {
+        Relation rel;
+        BlockNumber pages;
+        double tuples;
+        double allvisfrac;
+
+        rel = heap_open(lfirst_oid(lc), NoLock);
+
+        /*
+         * Partitioned tables have no storage, and estimate_rel_size() assumes
+         * a few pages for tables that have never been vacuumed even if they
+         * are empty.
+         */
+        if (rel->rd_rel->relkind == RELKIND_RELATION &&
+            RelationGetNumberOfBlocks(rel) > 0)
+        {
+            estimate_rel_size(rel, NULL, &pages, &tuples, &allvisfrac);
+            count += tuples;
+        }
+
+        heap_close(rel, NoLock);
+    }
+
+    PG_RETURN_DATUM(integer_to_agtype((int64)rint(count)));
+}
+
 // See RemoveRelations() for more details.
 static void remove_relation(List *qname)
 {
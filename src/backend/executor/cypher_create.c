@@ -17,6 +17,9 @@
 #include "postgres.h"
 
 #include "access/htup_details.h"
+#include "catalog/pg_class_d.h"
+#include "executor/execPartition.h"
+#include "executor/executor.h"
 #include "executor/tuptable.h"
 #include "nodes/execnodes.h"
 #include "nodes/extensible.h"
@@ -24,11 +27,14 @@
 #include "nodes/plannodes.h"
 #include "parser/parse_relation.h"
 #include "rewrite/rewriteHandler.h"
+#include "utils/lsyscache.h"
 #include "utils/rel.h"
 
 #include "catalog/ag_label.h"
+#include "commands/degree_commands.h"
 #include "executor/cypher_executor.h"
 #include "nodes/cypher_nodes.h"
+#include "utils/ag_result_cache.h"
 #include "utils/agtype.h"
 #include "utils/graphid.h"
 
@@ -40,6 +46,8 @@ typedef struct cypher_create_custom_scan_state
     List *path_values;
     uint32 flags;
     TupleTableSlot *slot;
+    // NULL when the graph has no degree counters
+    degree_counters *degree_counters;
 } cypher_create_custom_scan_state;
 
 static void begin_cypher_create(CustomScanState *node, EState *estate,
@@ -54,8 +62,13 @@ static void create_edge(cypher_create_custom_scan_state *css,
 
 static Datum create_vertex(cypher_create_custom_scan_state *css,
                            cypher_target_node *node, ListCell *next);
-static void insert_entity_tuple(ResultRelInfo *resultRelInfo,
-                                TupleTableSlot *elemTupleSlot, EState *estate);
+static void insert_entity_tuple(cypher_target_node *node, EState *estate);
+static ResultRelInfo *route_entity_tuple(cypher_target_node *node,
+                                         TupleTableSlot **elemTupleSlot,
+                                         EState *estate);
+static ModifyTableState *setup_tuple_routing(Relation rel,
+                                             ResultRelInfo *resultRelInfo,
+                                             EState *estate);
 static void process_pattern(cypher_create_custom_scan_state *css);
 static void process_all_tuples(CustomScanState *node, EState *estate);
 
@@ -80,6 +93,7 @@ static void begin_cypher_create(CustomScanState *node, EState *estate,
         (cypher_create_custom_scan_state *)node;
     ListCell *lc;
     Plan *subplan;
+    Oid edge_relid = InvalidOid;
 
     Assert(list_length(css->cs->custom_plans) == 1);
 
@@ -114,6 +128,10 @@ static void begin_cypher_create(CustomScanState *node, EState *estate,
 
             // Open relation and aquire a row exclusive lock.
             rel = heap_open(cypher_node->relid, RowExclusiveLock);
+            result_cache_note_write(cypher_node->relid);
+
+            if (cypher_node->type == LABEL_KIND_EDGE)
+                edge_relid = cypher_node->relid;
 
             // Initialize resultRelInfo for the vertex
             cypher_node->resultRelInfo = palloc(sizeof(ResultRelInfo));
@@ -121,8 +139,21 @@ static void begin_cypher_create(CustomScanState *node, EState *estate,
                               list_length(estate->es_range_table), NULL,
                               estate->es_instrument);
 
-            // Open all indexes for the relation
-            ExecOpenIndices(cypher_node->resultRelInfo, false);
+            /*
+             * A partitioned table has no storage, the tuples are routed to
+             * its leaf partitions which get their indexes opened on demand.
+             * Otherwise, open all indexes for the relation.
+             */
+            if (rel->rd_rel->relkind == RELKIND_PARTITIONED_TABLE)
+            {
+                cypher_node->modifyTableState = setup_tuple_routing(
+                    rel, cypher_node->resultRelInfo, estate);
+            }
+            else
+            {
+                cypher_node->modifyTableState = NULL;
+                ExecOpenIndices(cypher_node->resultRelInfo, false);
+            }
 
             // Setup the relation's tuple slot
             cypher_node->elemTupleSlot = ExecInitExtraTupleSlot(
@@ -140,6 +171,20 @@ static void begin_cypher_create(CustomScanState *node, EState *estate,
             }
         }
     }
+
+    /*
+     * The edge tables are locked by now, so the degree counters cannot be
+     * enabled for the graph while the edges are created.
+     */
+    if (OidIsValid(edge_relid))
+    {
+        css->degree_counters =
+            begin_degree_counters(get_rel_namespace(edge_relid));
+    }
+    else
+    {
+        css->degree_counters = NULL;
+    }
 }
 
 /*
@@ -276,6 +321,15 @@ static void end_cypher_create(CustomScanState *node)
             if (!CYPHER_TARGET_NODE_INSERT_ENTITY(cypher_node->flags))
                 continue;
 
+            // close the partitions the tuples have been routed to
+            if (cypher_node->modifyTableState != NULL)
+            {
+                ModifyTableState *mtstate = cypher_node->modifyTableState;
+
+                ExecCleanupTupleRouting(mtstate,
+                                        mtstate->mt_partition_tuple_routing);
+            }
+
             // close all indices for the node
             ExecCloseIndices(cypher_node->resultRelInfo);
 
@@ -284,6 +338,9 @@ static void end_cypher_create(CustomScanState *node)
                        RowExclusiveLock);
         }
     }
+
+    if (css->degree_counters != NULL)
+        end_degree_counters(css->degree_counters);
 }
 
 static void rescan_cypher_create(CustomScanState *node)
@@ -387,7 +444,18 @@ static void create_edge(cypher_create_custom_scan_state *css,
         scanTupleSlot->tts_isnull[node->prop_var_no];
 
     // Insert the new edge
-    insert_entity_tuple(resultRelInfo, elemTupleSlot, estate);
+    insert_entity_tuple(node, estate);
+
+    // Count the new edge in the degrees of its vertices
+    if (css->degree_counters != NULL)
+    {
+        graphid edge_id = DATUM_GET_GRAPHID(id);
+
+        increment_degree_counters(css->degree_counters,
+                                  DATUM_GET_GRAPHID(start_id),
+                                  DATUM_GET_GRAPHID(end_id),
+                                  get_graphid_label_id(edge_id));
+    }
 
     /*
      * When the edge is used by clauses higher in the execution tree
@@ -464,7 +532,7 @@ static Datum create_vertex(cypher_create_custom_scan_state *css,
             scanTupleSlot->tts_isnull[node->prop_var_no];
 
         // Insert the new vertex
-        insert_entity_tuple(resultRelInfo, elemTupleSlot, estate);
+        insert_entity_tuple(node, estate);
 
         /*
          * When the vertex is used by clauses higher in the execution tree
@@ -543,12 +611,18 @@ static Datum create_vertex(cypher_create_custom_scan_state *css,
  * Insert the edge/vertex tuple into the table and indices. If the table's
  * constraints have not been violated.
  */
-static void insert_entity_tuple(ResultRelInfo *resultRelInfo,
-                                TupleTableSlot *elemTupleSlot, EState *estate)
+static void insert_entity_tuple(cypher_target_node *node, EState *estate)
 {
+    ResultRelInfo *resultRelInfo = node->resultRelInfo;
+    TupleTableSlot *elemTupleSlot = node->elemTupleSlot;
     HeapTuple tuple;
 
     ExecStoreVirtualTuple(elemTupleSlot);
+
+    // Find the partition to insert the tuple into
+    if (node->modifyTableState != NULL)
+        resultRelInfo = route_entity_tuple(node, &elemTupleSlot, estate);
+
     tuple = ExecMaterializeSlot(elemTupleSlot);
 
     // Check the constraints of the tuple
@@ -565,3 +639,68 @@ static void insert_entity_tuple(ResultRelInfo *resultRelInfo,
         ExecInsertIndexTuples(elemTupleSlot, &(tuple->t_self), estate, false,
                               NULL, NIL);
 }
+
+/*
+ * Routes the tuple in the slot to the leaf partition of the partitioned label
+ * table it belongs to. The slot is replaced when the tuple has to be
+ * converted to the rowtype of the partition.
+ */
+static ResultRelInfo *route_entity_tuple(cypher_target_node *node,
+                                         TupleTableSlot **elemTupleSlot,
+                                         EState *estate)
+{
+    ModifyTableState *mtstate = node->modifyTableState;
+    PartitionTupleRouting *proute = mtstate->mt_partition_tuple_routing;
+    ResultRelInfo *resultRelInfo;
+    int leaf_part_index;
+
+    leaf_part_index = ExecFindPartition(node->resultRelInfo,
+                                        proute->partition_dispatch_info,
+                                        *elemTupleSlot, estate);
+
+    resultRelInfo = proute->partitions[leaf_part_index];
+    if (resultRelInfo == NULL)
+    {
+        resultRelInfo = ExecInitPartitionInfo(mtstate, node->resultRelInfo,
+                                              proute, estate,
+                                              leaf_part_index);
+    }
+
+    // the indexes of the partition are updated through the result relation
+    estate->es_result_relation_info = resultRelInfo;
+
+    if (proute->parent_child_tupconv_maps != NULL)
+    {
+        TupleConversionMap *map;
+
+        map = proute->parent_child_tupconv_maps[leaf_part_index];
+        ConvertPartitionTupleSlot(map, ExecMaterializeSlot(*elemTupleSlot),
+                                  proute->partition_tuple_slot,
+                                  elemTupleSlot);
+    }
+
+    return resultRelInfo;
+}
+
+/*
+ * Sets up tuple routing for a partitioned label table. The routing code of
+ * the executor expects a ModifyTableState, so an INSERT one without a plan
+ * is made for it, the same way COPY does.
+ */
+static ModifyTableState *setup_tuple_routing(Relation rel,
+                                             ResultRelInfo *resultRelInfo,
+                                             EState *estate)
+{
+    ModifyTableState *mtstate;
+
+    mtstate = makeNode(ModifyTableState);
+    mtstate->ps.plan = NULL;
+    mtstate->ps.state = estate;
+    mtstate->operation = CMD_INSERT;
+    mtstate->resultRelInfo = resultRelInfo;
+
+    mtstate->mt_partition_tuple_routing =
+        ExecSetupPartitionTupleRouting(mtstate, rel);
+
+    return mtstate;
+}
@@ -0,0 +1,539 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "postgres.h"
+
+#include "access/genam.h"
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "access/relscan.h"
+#include "access/skey.h"
+#include "access/stratnum.h"
+#include "access/tupconvert.h"
+#include "catalog/pg_am_d.h"
+#include "catalog/pg_class_d.h"
+#include "catalog/pg_index.h"
+#include "catalog/pg_inherits.h"
+#include "executor/executor.h"
+#include "executor/tuptable.h"
+#include "nodes/execnodes.h"
+#include "nodes/extensible.h"
+#include "nodes/nodes.h"
+#include "nodes/pg_list.h"
+#include "nodes/plannodes.h"
+#include "utils/datum.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/relcache.h"
+
+#include "executor/cypher_executor.h"
+#include "utils/ag_func.h"
+#include "utils/graphid.h"
+
+/*
+ * Cypher Expand joins the rows of the bound side of a hop with the edges that
+ * start (or end) at them. It reads the bound side a batch at a time, sorts
+ * the batch by graphid, and probes the indexes on start_id (or end_id) of the
+ * edge label tables in that order. So the probes walk the indexes and the
+ * edge tables forward instead of jumping around, and the edges of a vertex
+ * that is bound more than once in a batch are fetched only once.
+ */
+
+// an edge label table and the scan on its index on start_id (or end_id)
+typedef struct expand_table
+{
+    Relation rel;
+    Relation index;
+    IndexScanDesc index_scan;
+    // converts the tuples of the table to the scanned label's rowtype
+    TupleConversionMap *map;
+} expand_table;
+
+typedef struct expand_key
+{
+    graphid key;
+    int tuple;
+} expand_key;
+
+typedef struct cypher_expand_state
+{
+    CustomScanState css;
+    CustomScan *cs;
+    PlanState *outer;
+    // the column of the bound graphids in the outer tuples
+    AttrNumber key_col;
+    // the column of the edges the bound graphids are looked up with
+    AttrNumber probe_attno;
+    int outer_natts;
+    // the columns of the edges that are in the scan tuple
+    AttrNumber *inner_attnos;
+    int inner_natts;
+    Relation parent;
+    expand_table *tables;
+    int ntables;
+    Oid eq_func_oid;
+    // the current batch of the outer tuples
+    MemoryContext batch_mcxt;
+    Datum *outer_values;
+    bool *outer_nulls;
+    expand_key *keys;
+    int nkeys;
+    bool outer_done;
+    // the outer tuples with the same key and their edges
+    MemoryContext run_mcxt;
+    int run_end;
+    int outer_pos;
+    Datum *inner_values;
+    bool *inner_nulls;
+    int ninner;
+    int inner_pos;
+} cypher_expand_state;
+
+static void begin_cypher_expand(CustomScanState *node, EState *estate,
+                                int eflags);
+static TupleTableSlot *exec_cypher_expand(CustomScanState *node);
+static void end_cypher_expand(CustomScanState *node);
+static void rescan_cypher_expand(CustomScanState *node);
+
+static TupleTableSlot *expand_next(ScanState *node);
+static bool expand_recheck(ScanState *node, TupleTableSlot *slot);
+static void load_batch(cypher_expand_state *es);
+static void start_run(cypher_expand_state *es);
+static void fetch_edges(cypher_expand_state *es, graphid key);
+static int compare_expand_keys(const void *a, const void *b);
+
+const CustomExecMethods cypher_expand_exec_methods = {
+    "Cypher Expand",
+    begin_cypher_expand,
+    exec_cypher_expand,
+    end_cypher_expand,
+    rescan_cypher_expand,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL};
+
+static void begin_cypher_expand(CustomScanState *node, EState *estate,
+                                int eflags)
+{
+    cypher_expand_state *es = (cypher_expand_state *)node;
+    Oid relid = linitial_oid(linitial(es->cs->custom_private));
+    List *probe_info = lsecond(es->cs->custom_private);
+    List *inner_attnos = lthird(es->cs->custom_private);
+    List *relids;
+    ListCell *lc;
+    Oid graphid_oid;
+    int i;
+
+    es->outer = ExecInitNode(linitial(es->cs->custom_plans), estate, eflags);
+    node->custom_ps = list_make1(es->outer);
+
+    es->key_col = linitial_int(probe_info);
+    es->probe_attno = lsecond_int(probe_info);
+    es->outer_natts = ExecGetResultType(es->outer)->natts;
+
+    es->inner_natts = list_length(inner_attnos);
+    es->inner_attnos = palloc(sizeof(AttrNumber) * (es->inner_natts + 1));
+    i = 0;
+    foreach (lc, inner_attnos)
+        es->inner_attnos[i++] = lfirst_int(lc);
+
+    // the planner has already locked the label tables in the hierarchy
+    es->parent = heap_open(relid, NoLock);
+
+    relids = find_all_inheritors(relid, NoLock, NULL);
+    es->tables = palloc0(sizeof(expand_table) * list_length(relids));
+    es->ntables = 0;
+    foreach (lc, relids)
+    {
+        expand_table *table = &es->tables[es->ntables];
+        Oid index_oid;
+
+        // the rows of a partitioned table are in its partitions
+        if (get_rel_relkind(lfirst_oid(lc)) == RELKIND_PARTITIONED_TABLE)
+            continue;
+
+        table->rel = heap_open(lfirst_oid(lc), NoLock);
+
+        index_oid = get_adjacency_index(table->rel, es->probe_attno);
+        if (!OidIsValid(index_oid))
+        {
+            ereport(ERROR,
+                    (errcode(ERRCODE_UNDEFINED_OBJECT),
+                     errmsg("relation \"%s\" has no index on \"%s\"",
+                            RelationGetRelationName(table->rel),
+                            get_attname(lfirst_oid(lc), es->probe_attno,
+                                        false))));
+        }
+
+        table->index = index_open(index_oid, AccessShareLock);
+        table->index_scan = index_beginscan(table->rel, table->index,
+                                            estate->es_snapshot, 1, 0);
+        table->map = convert_tuples_by_name(
+            RelationGetDescr(table->rel), RelationGetDescr(es->parent),
+            gettext_noop("could not convert row type"));
+
+        es->ntables++;
+    }
+
+    graphid_oid = GRAPHIDOID;
+    es->eq_func_oid = get_ag_func_oid("graphid_eq", 2, graphid_oid,
+                                      graphid_oid);
+
+    es->batch_mcxt = AllocSetContextCreate(CurrentMemoryContext,
+                                           "Cypher Expand Batch",
+                                           ALLOCSET_DEFAULT_SIZES);
+    es->run_mcxt = AllocSetContextCreate(CurrentMemoryContext,
+                                         "Cypher Expand Edges",
+                                         ALLOCSET_DEFAULT_SIZES);
+    es->nkeys = 0;
+    es->outer_done = false;
+    es->run_end = 0;
+    es->outer_pos = 0;
+    es->ninner = 0;
+    es->inner_pos = 0;
+}
+
+static TupleTableSlot *exec_cypher_expand(CustomScanState *node)
+{
+    return ExecScan(&node->ss, (ExecScanAccessMtd)expand_next,
+                    (ExecScanRecheckMtd)expand_recheck);
+}
+
+static void end_cypher_expand(CustomScanState *node)
+{
+    cypher_expand_state *es = (cypher_expand_state *)node;
+    int i;
+
+    for (i = 0; i < es->ntables; i++)
+    {
+        index_endscan(es->tables[i].index_scan);
+        index_close(es->tables[i].index, AccessShareLock);
+        heap_close(es->tables[i].rel, NoLock);
+    }
+    heap_close(es->parent, NoLock);
+
+    ExecEndNode(es->outer);
+
+    MemoryContextDelete(es->run_mcxt);
+    MemoryContextDelete(es->batch_mcxt);
+}
+
+static void rescan_cypher_expand(CustomScanState *node)
+{
+    cypher_expand_state *es = (cypher_expand_state *)node;
+
+    if (node->ss.ps.chgParam != NULL)
+        UpdateChangedParamSet(es->outer, node->ss.ps.chgParam);
+
+    // otherwise, ExecProcNode() rescans it when it is read again
+    if (es->outer->chgParam == NULL)
+        ExecReScan(es->outer);
+
+    MemoryContextReset(es->run_mcxt);
+    MemoryContextReset(es->batch_mcxt);
+    es->nkeys = 0;
+    es->outer_done = false;
+    es->run_end = 0;
+    es->outer_pos = 0;
+    es->ninner = 0;
+    es->inner_pos = 0;
+
+    ExecScanReScan(&node->ss);
+}
+
+static TupleTableSlot *expand_next(ScanState *node)
+{
+    cypher_expand_state *es = (cypher_expand_state *)node;
+    TupleTableSlot *slot = node->ss_ScanTupleSlot;
+
+    for (;;)
+    {
+        // the current run pairs each of its outer tuples with each edge
+        if (es->outer_pos < es->run_end)
+        {
+            int tuple;
+
+            if (es->inner_pos >= es->ninner)
+            {
+                es->outer_pos++;
+                es->inner_pos = 0;
+                continue;
+            }
+
+            tuple = es->keys[es->outer_pos].tuple;
+
+            ExecClearTuple(slot);
+            memcpy(slot->tts_values,
+                   &es->outer_values[tuple * es->outer_natts],
+                   sizeof(Datum) * es->outer_natts);
+            memcpy(slot->tts_isnull,
+                   &es->outer_nulls[tuple * es->outer_natts],
+                   sizeof(bool) * es->outer_natts);
+            memcpy(&slot->tts_values[es->outer_natts],
+                   &es->inner_values[es->inner_pos * es->inner_natts],
+                   sizeof(Datum) * es->inner_natts);
+            memcpy(&slot->tts_isnull[es->outer_natts],
+                   &es->inner_nulls[es->inner_pos * es->inner_natts],
+                   sizeof(bool) * es->inner_natts);
+            ExecStoreVirtualTuple(slot);
+
+            es->inner_pos++;
+
+            return slot;
+        }
+
+        if (es->run_end < es->nkeys)
+        {
+            start_run(es);
+            continue;
+        }
+
+        if (es->outer_done)
+            return ExecClearTuple(slot);
+
+        load_batch(es);
+    }
+}
+
+// the scan qual holds the join clauses, which is all there is to recheck
+static bool expand_recheck(ScanState *node, TupleTableSlot *slot)
+{
+    return true;
+}
+
+// reads the next batch of the outer tuples and sorts it by their keys
+static void load_batch(cypher_expand_state *es)
+{
+    MemoryContext old_mcxt;
+
+    MemoryContextReset(es->run_mcxt);
+    es->ninner = 0;
+    es->inner_pos = 0;
+
+    MemoryContextReset(es->batch_mcxt);
+    old_mcxt = MemoryContextSwitchTo(es->batch_mcxt);
+
+    es->outer_values = palloc(sizeof(Datum) * es->outer_natts *
+                              CYPHER_EXPAND_BATCH_SIZE);
+    es->outer_nulls = palloc(sizeof(bool) * es->outer_natts *
+                             CYPHER_EXPAND_BATCH_SIZE);
+    es->keys = palloc(sizeof(expand_key) * CYPHER_EXPAND_BATCH_SIZE);
+    es->nkeys = 0;
+
+    while (es->nkeys < CYPHER_EXPAND_BATCH_SIZE)
+    {
+        TupleTableSlot *slot;
+        TupleDesc tupdesc;
+        Datum *values;
+        bool *nulls;
+        int i;
+
+        MemoryContextSwitchTo(old_mcxt);
+        slot = ExecProcNode(es->outer);
+        MemoryContextSwitchTo(es->batch_mcxt);
+
+        if (TupIsNull(slot))
+        {
+            es->outer_done = true;
+            break;
+        }
+
+        slot_getallattrs(slot);
+
+        // a NULL is not equal to any edge's start_id (or end_id)
+        if (slot->tts_isnull[es->key_col - 1])
+            continue;
+
+        tupdesc = slot->tts_tupleDescriptor;
+        values = &es->outer_values[es->nkeys * es->outer_natts];
+        nulls = &es->outer_nulls[es->nkeys * es->outer_natts];
+        for (i = 0; i < es->outer_natts; i++)
+        {
+            Form_pg_attribute attr = TupleDescAttr(tupdesc, i);
+
+            nulls[i] = slot->tts_isnull[i];
+            if (nulls[i])
+                values[i] = (Datum)0;
+            else
+                values[i] = datumCopy(slot->tts_values[i], attr->attbyval,
+                                      attr->attlen);
+        }
+
+        es->keys[es->nkeys].key = DATUM_GET_GRAPHID(
+            slot->tts_values[es->key_col - 1]);
+        es->keys[es->nkeys].tuple = es->nkeys;
+        es->nkeys++;
+    }
+
+    qsort(es->keys, es->nkeys, sizeof(expand_key), compare_expand_keys);
+
+    es->run_end = 0;
+    es->outer_pos = 0;
+
+    MemoryContextSwitchTo(old_mcxt);
+}
+
+// finds the outer tuples with the next key and fetches their edges
+static void start_run(cypher_expand_state *es)
+{
+    int run_begin = es->run_end;
+    graphid key = es->keys[run_begin].key;
+
+    es->run_end = run_begin + 1;
+    while (es->run_end < es->nkeys && es->keys[es->run_end].key == key)
+        es->run_end++;
+
+    fetch_edges(es, key);
+
+    // the outer tuples of the run are skipped if there are no edges
+    es->outer_pos = (es->ninner > 0 ? run_begin : es->run_end);
+    es->inner_pos = 0;
+}
+
+static void fetch_edges(cypher_expand_state *es, graphid key)
+{
+    TupleDesc tupdesc = RelationGetDescr(es->parent);
+    MemoryContext old_mcxt;
+    int capacity = 16;
+    int i;
+
+    MemoryContextReset(es->run_mcxt);
+    old_mcxt = MemoryContextSwitchTo(es->run_mcxt);
+
+    es->inner_values = palloc(sizeof(Datum) *
+                              (es->inner_natts * capacity + 1));
+    es->inner_nulls = palloc(sizeof(bool) *
+                             (es->inner_natts * capacity + 1));
+    es->ninner = 0;
+
+    for (i = 0; i < es->ntables; i++)
+    {
+        expand_table *table = &es->tables[i];
+        ScanKeyData scan_key;
+        HeapTuple tuple;
+
+        // the column is the first one of the index
+        ScanKeyInit(&scan_key, 1, BTEqualStrategyNumber, es->eq_func_oid,
+                    GRAPHID_GET_DATUM(key));
+        index_rescan(table->index_scan, &scan_key, 1, NULL, 0);
+
+        while ((tuple = index_getnext(table->index_scan,
+                                      ForwardScanDirection)) != NULL)
+        {
+            int j;
+
+            if (table->map != NULL)
+                tuple = do_convert_tuple(tuple, table->map);
+
+            if (es->ninner == capacity)
+            {
+                capacity *= 2;
+                es->inner_values = repalloc(
+                    es->inner_values,
+                    sizeof(Datum) * (es->inner_natts * capacity + 1));
+                es->inner_nulls = repalloc(
+                    es->inner_nulls,
+                    sizeof(bool) * (es->inner_natts * capacity + 1));
+            }
+
+            for (j = 0; j < es->inner_natts; j++)
+            {
+                int pos = es->ninner * es->inner_natts + j;
+                Form_pg_attribute attr =
+                    TupleDescAttr(tupdesc, es->inner_attnos[j] - 1);
+                Datum value;
+                bool is_null;
+
+                value = heap_getattr(tuple, es->inner_attnos[j], tupdesc,
+                                     &is_null);
+                es->inner_nulls[pos] = is_null;
+                if (is_null)
+                    es->inner_values[pos] = (Datum)0;
+                else
+                    es->inner_values[pos] = datumCopy(value, attr->attbyval,
+                                                      attr->attlen);
+            }
+
+            es->ninner++;
+        }
+    }
+
+    MemoryContextSwitchTo(old_mcxt);
+}
+
+static int compare_expand_keys(const void *a, const void *b)
+{
+    const expand_key *ka = a;
+    const expand_key *kb = b;
+
+    if (ka->key != kb->key)
+        return (ka->key < kb->key ? -1 : 1);
+
+    return ka->tuple - kb->tuple;
+}
+
+/*
+ * Returns the OID of a valid btree index of rel whose first column is attnum,
+ * or InvalidOid. Partial and expression indexes are not taken.
+ */
+Oid get_adjacency_index(Relation rel, AttrNumber attnum)
+{
+    List *index_oids;
+    ListCell *lc;
+    Oid result = InvalidOid;
+
+    index_oids = RelationGetIndexList(rel);
+    foreach (lc, index_oids)
+    {
+        Relation index = index_open(lfirst_oid(lc), AccessShareLock);
+        Form_pg_index form = index->rd_index;
+
+        if (index->rd_rel->relam == BTREE_AM_OID && form->indisvalid &&
+            form->indkey.values[0] == attnum &&
+            heap_attisnull(index->rd_indextuple, Anum_pg_index_indpred,
+                           NULL) &&
+            heap_attisnull(index->rd_indextuple, Anum_pg_index_indexprs,
+                           NULL))
+            result = lfirst_oid(lc);
+
+        index_close(index, NoLock);
+
+        if (OidIsValid(result))
+            break;
+    }
+
+    list_free(index_oids);
+
+    return result;
+}
+
+Node *create_cypher_expand_plan_state(CustomScan *cscan)
+{
+    cypher_expand_state *es = palloc0(sizeof(cypher_expand_state));
+
+    es->cs = cscan;
+
+    es->css.ss.ps.type = T_CustomScanState;
+    es->css.methods = &cypher_expand_exec_methods;
+
+    return (Node *)es;
+}
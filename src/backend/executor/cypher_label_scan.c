@@ -0,0 +1,333 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "postgres.h"
+
+#include "access/genam.h"
+#include "access/heapam.h"
+#include "access/relscan.h"
+#include "access/skey.h"
+#include "access/stratnum.h"
+#include "access/tupconvert.h"
+#include "catalog/pg_inherits.h"
+#include "executor/executor.h"
+#include "executor/tuptable.h"
+#include "nodes/execnodes.h"
+#include "nodes/extensible.h"
+#include "nodes/nodes.h"
+#include "nodes/plannodes.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/relcache.h"
+
+#include "commands/label_commands.h"
+#include "executor/cypher_executor.h"
+#include "utils/ag_cache.h"
+#include "utils/ag_func.h"
+#include "utils/graphid.h"
+
+/*
+ * A label table that the scan has been routed to. The scan on it is kept open
+ * and rescanned for the following probes that route to the same label.
+ */
+typedef struct label_scan_route
+{
+    Oid relid;
+    Relation rel;
+    // NULL when the label table has no index on id
+    Relation index;
+    IndexScanDesc index_scan;
+    HeapScanDesc heap_scan;
+    AttrNumber id_attnum;
+    // converts the tuples of the label table to the scanned label's rowtype
+    TupleConversionMap *map;
+} label_scan_route;
+
+typedef struct cypher_label_scan_state
+{
+    CustomScanState css;
+    CustomScan *cs;
+    ExprState *probe;
+    Oid graph_oid;
+    Oid eq_func_oid;
+    // the scanned label table and all the label tables that inherit it
+    List *label_relids;
+    List *routes;
+    label_scan_route *current;
+    bool probed;
+} cypher_label_scan_state;
+
+static void begin_cypher_label_scan(CustomScanState *node, EState *estate,
+                                    int eflags);
+static TupleTableSlot *exec_cypher_label_scan(CustomScanState *node);
+static void end_cypher_label_scan(CustomScanState *node);
+static void rescan_cypher_label_scan(CustomScanState *node);
+
+static TupleTableSlot *label_scan_next(ScanState *node);
+static bool label_scan_recheck(ScanState *node, TupleTableSlot *slot);
+static label_scan_route *route_probe(cypher_label_scan_state *lss);
+static label_scan_route *get_label_scan_route(cypher_label_scan_state *lss,
+                                              Oid relid);
+
+const CustomExecMethods cypher_label_scan_exec_methods = {
+    "Cypher Label Scan",
+    begin_cypher_label_scan,
+    exec_cypher_label_scan,
+    end_cypher_label_scan,
+    rescan_cypher_label_scan,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL};
+
+static void begin_cypher_label_scan(CustomScanState *node, EState *estate,
+                                    int eflags)
+{
+    cypher_label_scan_state *lss = (cypher_label_scan_state *)node;
+    Relation rel = node->ss.ss_currentRelation;
+    label_cache_data *lcd;
+    Oid graphid_oid;
+
+    Assert(list_length(lss->cs->custom_exprs) == 1);
+
+    lss->probe = ExecInitExpr(linitial(lss->cs->custom_exprs),
+                              &node->ss.ps);
+
+    lcd = search_label_relation_cache(RelationGetRelid(rel));
+    if (!lcd)
+    {
+        ereport(ERROR,
+                (errcode(ERRCODE_UNDEFINED_TABLE),
+                 errmsg("relation \"%s\" is not a label",
+                        RelationGetRelationName(rel))));
+    }
+    lss->graph_oid = lcd->graph;
+
+    graphid_oid = GRAPHIDOID;
+    lss->eq_func_oid = get_ag_func_oid("graphid_eq", 2, graphid_oid,
+                                       graphid_oid);
+
+    // the planner has already locked the label tables in the hierarchy
+    lss->label_relids = find_all_inheritors(RelationGetRelid(rel), NoLock,
+                                            NULL);
+    lss->routes = NIL;
+    lss->current = NULL;
+    lss->probed = false;
+}
+
+static TupleTableSlot *exec_cypher_label_scan(CustomScanState *node)
+{
+    return ExecScan(&node->ss, (ExecScanAccessMtd)label_scan_next,
+                    (ExecScanRecheckMtd)label_scan_recheck);
+}
+
+static void end_cypher_label_scan(CustomScanState *node)
+{
+    cypher_label_scan_state *lss = (cypher_label_scan_state *)node;
+    ListCell *lc;
+
+    foreach (lc, lss->routes)
+    {
+        label_scan_route *route = lfirst(lc);
+
+        if (route->index != NULL)
+        {
+            index_endscan(route->index_scan);
+            index_close(route->index, AccessShareLock);
+        }
+        else
+        {
+            heap_endscan(route->heap_scan);
+        }
+
+        heap_close(route->rel, NoLock);
+    }
+
+    lss->routes = NIL;
+    lss->current = NULL;
+}
+
+static void rescan_cypher_label_scan(CustomScanState *node)
+{
+    cypher_label_scan_state *lss = (cypher_label_scan_state *)node;
+
+    // the probe is evaluated again with the new parameter values
+    lss->current = NULL;
+    lss->probed = false;
+
+    ExecScanReScan(&node->ss);
+}
+
+static TupleTableSlot *label_scan_next(ScanState *node)
+{
+    cypher_label_scan_state *lss = (cypher_label_scan_state *)node;
+    TupleTableSlot *slot = node->ss_ScanTupleSlot;
+    label_scan_route *route;
+    HeapTuple tuple;
+    Buffer buffer;
+
+    if (!lss->probed)
+    {
+        lss->current = route_probe(lss);
+        lss->probed = true;
+    }
+
+    route = lss->current;
+    if (route == NULL)
+        return ExecClearTuple(slot);
+
+    if (route->index != NULL)
+    {
+        tuple = index_getnext(route->index_scan, ForwardScanDirection);
+        buffer = route->index_scan->xs_cbuf;
+    }
+    else
+    {
+        tuple = heap_getnext(route->heap_scan, ForwardScanDirection);
+        buffer = route->heap_scan->rs_cbuf;
+    }
+
+    if (tuple == NULL)
+    {
+        lss->current = NULL;
+        return ExecClearTuple(slot);
+    }
+
+    if (route->map != NULL)
+    {
+        tuple = do_convert_tuple(tuple, route->map);
+        return ExecStoreTuple(tuple, slot, InvalidBuffer, true);
+    }
+
+    return ExecStoreTuple(tuple, slot, buffer, false);
+}
+
+// the scan qual holds the join clause, which is all there is to recheck
+static bool label_scan_recheck(ScanState *node, TupleTableSlot *slot)
+{
+    return true;
+}
+
+/*
+ * Evaluate the probe and position the scan of the label table the resulting
+ * graphid belongs to. NULL is returned if no label table in the scanned
+ * hierarchy can have an entity with the id.
+ */
+static label_scan_route *route_probe(cypher_label_scan_state *lss)
+{
+    ExprContext *econtext = lss->css.ss.ps.ps_ExprContext;
+    label_scan_route *route;
+    label_cache_data *lcd;
+    ScanKeyData key;
+    Datum value;
+    bool is_null;
+    graphid id;
+
+    value = ExecEvalExprSwitchContext(lss->probe, econtext, &is_null);
+    if (is_null)
+        return NULL;
+
+    id = DATUM_GET_GRAPHID(value);
+
+    lcd = search_label_graph_id_cache(lss->graph_oid,
+                                      get_graphid_label_id(id));
+    if (!lcd || !list_member_oid(lss->label_relids, lcd->relation))
+        return NULL;
+
+    route = get_label_scan_route(lss, lcd->relation);
+
+    if (route->index != NULL)
+    {
+        // the id is the first and only column of the index
+        ScanKeyInit(&key, 1, BTEqualStrategyNumber, lss->eq_func_oid,
+                    GRAPHID_GET_DATUM(id));
+        index_rescan(route->index_scan, &key, 1, NULL, 0);
+    }
+    else
+    {
+        ScanKeyInit(&key, route->id_attnum, BTEqualStrategyNumber,
+                    lss->eq_func_oid, GRAPHID_GET_DATUM(id));
+        heap_rescan(route->heap_scan, &key);
+    }
+
+    return route;
+}
+
+static label_scan_route *get_label_scan_route(cypher_label_scan_state *lss,
+                                              Oid relid)
+{
+    EState *estate = lss->css.ss.ps.state;
+    Relation parent = lss->css.ss.ss_currentRelation;
+    label_scan_route *route;
+    MemoryContext old_mcxt;
+    ListCell *lc;
+    Oid index_oid;
+
+    foreach (lc, lss->routes)
+    {
+        route = lfirst(lc);
+
+        if (route->relid == relid)
+            return route;
+    }
+
+    // the route lives as long as the scan does
+    old_mcxt = MemoryContextSwitchTo(estate->es_query_cxt);
+
+    route = palloc0(sizeof(label_scan_route));
+    route->relid = relid;
+    route->rel = heap_open(relid, NoLock);
+
+    route->map = convert_tuples_by_name(
+        RelationGetDescr(route->rel), RelationGetDescr(parent),
+        gettext_noop("could not convert row type"));
+
+    index_oid = RelationGetPrimaryKeyIndex(route->rel);
+    if (OidIsValid(index_oid))
+    {
+        route->index = index_open(index_oid, AccessShareLock);
+        route->index_scan = index_beginscan(route->rel, route->index,
+                                            estate->es_snapshot, 1, 0);
+    }
+    else
+    {
+        route->id_attnum = get_attnum(relid, AG_VERTEX_COLNAME_ID);
+        route->heap_scan = heap_beginscan(route->rel, estate->es_snapshot, 1,
+                                          NULL);
+    }
+
+    lss->routes = lappend(lss->routes, route);
+
+    MemoryContextSwitchTo(old_mcxt);
+
+    return route;
+}
+
+Node *create_cypher_label_scan_plan_state(CustomScan *cscan)
+{
+    cypher_label_scan_state *lss = palloc0(sizeof(cypher_label_scan_state));
+
+    lss->cs = cscan;
+
+    lss->css.ss.ps.type = T_CustomScanState;
+    lss->css.methods = &cypher_label_scan_exec_methods;
+
+    return (Node *)lss;
+}
@@ -0,0 +1,739 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "postgres.h"
+
+#include "executor/executor.h"
+#include "executor/tuptable.h"
+#include "nodes/execnodes.h"
+#include "nodes/extensible.h"
+#include "nodes/nodes.h"
+#include "nodes/pg_list.h"
+#include "nodes/plannodes.h"
+#include "utils/datum.h"
+#include "utils/memutils.h"
+
+#include "executor/cypher_executor.h"
+#include "utils/graphid.h"
+
+/*
+ * The multiway join joins the edges of a cyclic pattern at once (Generic
+ * Join). The vertices of the pattern are bound one at a time. The candidates
+ * for a vertex are the intersection of the ids of the vertices that each of
+ * its edges can have there, given the vertices bound so far. For example, the
+ * last vertex of a triangle is an end vertex of the edges from the second one
+ * and a start vertex of the edges to the first one. So the join never
+ * enumerates the paths that do not close the cycle, as pairwise joins do.
+ *
+ * Once all the vertices are bound, a row is returned for each combination of
+ * the edges between them, and the join clauses are checked on it.
+ */
+
+typedef struct multiway_join_entry
+{
+    graphid from;
+    graphid to;
+    int tuple;
+} multiway_join_entry;
+
+/*
+ * A run of sorted entries. The entries are ordered by the start ids (or the
+ * end ids if key_to is true) within the run.
+ */
+typedef struct multiway_join_view
+{
+    multiway_join_entry *entries;
+    int begin;
+    int end;
+    bool key_to;
+} multiway_join_view;
+
+typedef struct multiway_join_edge
+{
+    PlanState *plan;
+    // the vertices the edge goes from and to
+    int from_var;
+    int to_var;
+    // the columns of the start_id and the end_id in the tuples of the edge
+    AttrNumber from_col;
+    AttrNumber to_col;
+    // where the tuples of the edge are in the scan tuple
+    int natts;
+    int offset;
+    Datum *values;
+    bool *nulls;
+    int ntuples;
+    // the entries sorted by (from, to) and by (to, from)
+    multiway_join_entry *forward;
+    multiway_join_entry *reverse;
+    int nentries;
+    // the entries between the bound vertices, while returning rows
+    int emit_begin;
+    int emit_end;
+    int emit_pos;
+} multiway_join_edge;
+
+typedef struct multiway_join_level
+{
+    graphid *candidates;
+    int ncandidates;
+    int next;
+} multiway_join_level;
+
+typedef struct cypher_multiway_join_state
+{
+    CustomScanState css;
+    CustomScan *cs;
+    // holds the edges read from the child plans
+    MemoryContext mcxt;
+    multiway_join_edge *edges;
+    int nedges;
+    int *var_order;
+    int *var_depth;
+    int nvars;
+    graphid *binding;
+    multiway_join_level *levels;
+    multiway_join_view *views;
+    bool loaded;
+    int depth;
+    bool emitting;
+    bool emitted;
+} cypher_multiway_join_state;
+
+static void begin_cypher_multiway_join(CustomScanState *node, EState *estate,
+                                       int eflags);
+static TupleTableSlot *exec_cypher_multiway_join(CustomScanState *node);
+static void end_cypher_multiway_join(CustomScanState *node);
+static void rescan_cypher_multiway_join(CustomScanState *node);
+
+static TupleTableSlot *multiway_join_next(ScanState *node);
+static bool multiway_join_recheck(ScanState *node, TupleTableSlot *slot);
+static void load_edges(cypher_multiway_join_state *mjs);
+static void load_edge(cypher_multiway_join_state *mjs,
+                      multiway_join_edge *edge);
+static void restart_bindings(cypher_multiway_join_state *mjs);
+static bool next_binding(cypher_multiway_join_state *mjs);
+static void find_candidates(cypher_multiway_join_state *mjs, int depth);
+static bool start_emit(cypher_multiway_join_state *mjs);
+static bool emit_next(cypher_multiway_join_state *mjs, TupleTableSlot *slot);
+static int intersect_views(multiway_join_view *views, int nviews,
+                           graphid *out);
+static void narrow_view(multiway_join_view *view, graphid key);
+static int seek_view(multiway_join_view *view, int pos, graphid key,
+                     bool strict);
+static int compare_forward(const void *a, const void *b);
+static int compare_reverse(const void *a, const void *b);
+
+const CustomExecMethods cypher_multiway_join_exec_methods = {
+    "Cypher Multiway Join",
+    begin_cypher_multiway_join,
+    exec_cypher_multiway_join,
+    end_cypher_multiway_join,
+    rescan_cypher_multiway_join,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL};
+
+#define VIEW_KEY(view, pos) \
+    ((view)->key_to ? (view)->entries[(pos)].to : (view)->entries[(pos)].from)
+
+static void begin_cypher_multiway_join(CustomScanState *node, EState *estate,
+                                       int eflags)
+{
+    cypher_multiway_join_state *mjs = (cypher_multiway_join_state *)node;
+    List *edge_vars = linitial(mjs->cs->custom_private);
+    List *var_order = lsecond(mjs->cs->custom_private);
+    List *edge_cols = lthird(mjs->cs->custom_private);
+    ListCell *lc;
+    int offset = 0;
+    int i;
+
+    mjs->nedges = list_length(mjs->cs->custom_plans);
+    mjs->edges = palloc0(sizeof(multiway_join_edge) * mjs->nedges);
+
+    i = 0;
+    foreach (lc, mjs->cs->custom_plans)
+    {
+        multiway_join_edge *edge = &mjs->edges[i];
+
+        edge->plan = ExecInitNode(lfirst(lc), estate, eflags);
+        node->custom_ps = lappend(node->custom_ps, edge->plan);
+
+        edge->from_var = list_nth_int(edge_vars, i * 2);
+        edge->to_var = list_nth_int(edge_vars, i * 2 + 1);
+        edge->from_col = list_nth_int(edge_cols, i * 2);
+        edge->to_col = list_nth_int(edge_cols, i * 2 + 1);
+
+        edge->natts = ExecGetResultType(edge->plan)->natts;
+        edge->offset = offset;
+        offset += edge->natts;
+
+        i++;
+    }
+
+    mjs->nvars = list_length(var_order);
+    mjs->var_order = palloc(sizeof(int) * mjs->nvars);
+    mjs->var_depth = palloc(sizeof(int) * mjs->nvars);
+    i = 0;
+    foreach (lc, var_order)
+    {
+        mjs->var_order[i] = lfirst_int(lc);
+        mjs->var_depth[lfirst_int(lc)] = i;
+        i++;
+    }
+
+    mjs->binding = palloc(sizeof(graphid) * mjs->nvars);
+    mjs->views = palloc(sizeof(multiway_join_view) * mjs->nedges);
+
+    mjs->mcxt = AllocSetContextCreate(CurrentMemoryContext,
+                                      "Cypher Multiway Join",
+                                      ALLOCSET_DEFAULT_SIZES);
+    mjs->loaded = false;
+}
+
+static TupleTableSlot *exec_cypher_multiway_join(CustomScanState *node)
+{
+    return ExecScan(&node->ss, (ExecScanAccessMtd)multiway_join_next,
+                    (ExecScanRecheckMtd)multiway_join_recheck);
+}
+
+static void end_cypher_multiway_join(CustomScanState *node)
+{
+    cypher_multiway_join_state *mjs = (cypher_multiway_join_state *)node;
+    int i;
+
+    for (i = 0; i < mjs->nedges; i++)
+        ExecEndNode(mjs->edges[i].plan);
+
+    MemoryContextDelete(mjs->mcxt);
+}
+
+static void rescan_cypher_multiway_join(CustomScanState *node)
+{
+    cypher_multiway_join_state *mjs = (cypher_multiway_join_state *)node;
+    bool reload = false;
+    int i;
+
+    for (i = 0; i < mjs->nedges; i++)
+    {
+        PlanState *plan = mjs->edges[i].plan;
+
+        if (node->ss.ps.chgParam != NULL)
+            UpdateChangedParamSet(plan, node->ss.ps.chgParam);
+
+        // the child plan is rescanned by ExecProcNode() when it is read again
+        if (plan->chgParam != NULL)
+            reload = true;
+    }
+
+    if (reload)
+    {
+        // the edges are read again from the start
+        for (i = 0; i < mjs->nedges; i++)
+        {
+            if (mjs->edges[i].plan->chgParam == NULL)
+                ExecReScan(mjs->edges[i].plan);
+        }
+
+        MemoryContextReset(mjs->mcxt);
+        mjs->loaded = false;
+    }
+    else if (mjs->loaded)
+    {
+        // the edges have not changed; only the bindings start over
+        restart_bindings(mjs);
+    }
+
+    ExecScanReScan(&node->ss);
+}
+
+static TupleTableSlot *multiway_join_next(ScanState *node)
+{
+    cypher_multiway_join_state *mjs = (cypher_multiway_join_state *)node;
+    TupleTableSlot *slot = node->ss_ScanTupleSlot;
+
+    if (!mjs->loaded)
+    {
+        load_edges(mjs);
+        restart_bindings(mjs);
+        mjs->loaded = true;
+    }
+
+    for (;;)
+    {
+        if (mjs->emitting)
+        {
+            if (emit_next(mjs, slot))
+                return slot;
+
+            mjs->emitting = false;
+        }
+
+        if (!next_binding(mjs))
+            return ExecClearTuple(slot);
+
+        mjs->emitting = start_emit(mjs);
+    }
+}
+
+// the scan qual holds the join clauses, which is all there is to recheck
+static bool multiway_join_recheck(ScanState *node, TupleTableSlot *slot)
+{
+    return true;
+}
+
+static void load_edges(cypher_multiway_join_state *mjs)
+{
+    MemoryContext old_mcxt;
+    int max_entries = 0;
+    int i;
+
+    for (i = 0; i < mjs->nedges; i++)
+    {
+        load_edge(mjs, &mjs->edges[i]);
+        max_entries = Max(max_entries, mjs->edges[i].nentries);
+    }
+
+    // no vertex can have more candidates than the entries of any edge
+    old_mcxt = MemoryContextSwitchTo(mjs->mcxt);
+
+    mjs->levels = palloc(sizeof(multiway_join_level) * mjs->nvars);
+    for (i = 0; i < mjs->nvars; i++)
+    {
+        mjs->levels[i].candidates = palloc(sizeof(graphid) *
+                                           (max_entries + 1));
+    }
+
+    MemoryContextSwitchTo(old_mcxt);
+}
+
+// reads all the tuples of the edge and sorts them by their start and end ids
+static void load_edge(cypher_multiway_join_state *mjs,
+                      multiway_join_edge *edge)
+{
+    MemoryContext old_mcxt;
+    int capacity = 64;
+
+    old_mcxt = MemoryContextSwitchTo(mjs->mcxt);
+
+    edge->values = palloc(sizeof(Datum) * edge->natts * capacity);
+    edge->nulls = palloc(sizeof(bool) * edge->natts * capacity);
+    edge->forward = palloc(sizeof(multiway_join_entry) * capacity);
+    edge->ntuples = 0;
+    edge->nentries = 0;
+
+    for (;;)
+    {
+        TupleTableSlot *slot;
+        TupleDesc tupdesc;
+        Datum *values;
+        bool *nulls;
+        int i;
+
+        MemoryContextSwitchTo(old_mcxt);
+        slot = ExecProcNode(edge->plan);
+        MemoryContextSwitchTo(mjs->mcxt);
+
+        if (TupIsNull(slot))
+            break;
+
+        slot_getallattrs(slot);
+
+        // the edge cannot be joined if it has no start or end vertex
+        if (slot->tts_isnull[edge->from_col - 1] ||
+            slot->tts_isnull[edge->to_col - 1])
+            continue;
+
+        if (edge->ntuples == capacity)
+        {
+            capacity *= 2;
+            edge->values = repalloc(edge->values,
+                                    sizeof(Datum) * edge->natts * capacity);
+            edge->nulls = repalloc(edge->nulls,
+                                   sizeof(bool) * edge->natts * capacity);
+            edge->forward = repalloc(edge->forward,
+                                     sizeof(multiway_join_entry) * capacity);
+        }
+
+        tupdesc = slot->tts_tupleDescriptor;
+        values = &edge->values[edge->ntuples * edge->natts];
+        nulls = &edge->nulls[edge->ntuples * edge->natts];
+        for (i = 0; i < edge->natts; i++)
+        {
+            Form_pg_attribute attr = TupleDescAttr(tupdesc, i);
+
+            nulls[i] = slot->tts_isnull[i];
+            if (nulls[i])
+                values[i] = (Datum)0;
+            else
+                values[i] = datumCopy(slot->tts_values[i], attr->attbyval,
+                                      attr->attlen);
+        }
+
+        edge->forward[edge->nentries].from = DATUM_GET_GRAPHID(
+            slot->tts_values[edge->from_col - 1]);
+        edge->forward[edge->nentries].to = DATUM_GET_GRAPHID(
+            slot->tts_values[edge->to_col - 1]);
+        edge->forward[edge->nentries].tuple = edge->ntuples;
+
+        edge->ntuples++;
+        edge->nentries++;
+    }
+
+    edge->reverse = palloc(sizeof(multiway_join_entry) *
+                           (edge->nentries + 1));
+    memcpy(edge->reverse, edge->forward,
+           sizeof(multiway_join_entry) * edge->nentries);
+
+    qsort(edge->forward, edge->nentries, sizeof(multiway_join_entry),
+          compare_forward);
+    qsort(edge->reverse, edge->nentries, sizeof(multiway_join_entry),
+          compare_reverse);
+
+    MemoryContextSwitchTo(old_mcxt);
+}
+
+static void restart_bindings(cypher_multiway_join_state *mjs)
+{
+    mjs->depth = 0;
+    mjs->emitting = false;
+    find_candidates(mjs, 0);
+}
+
+/*
+ * Binds the next candidate of the deepest vertex whose candidates are not
+ * exhausted, and finds the candidates of the vertices after it. Returns true
+ * when all the vertices are bound, and false when there are no bindings left.
+ */
+static bool next_binding(cypher_multiway_join_state *mjs)
+{
+    while (mjs->depth >= 0)
+    {
+        multiway_join_level *level = &mjs->levels[mjs->depth];
+
+        if (level->next >= level->ncandidates)
+        {
+            mjs->depth--;
+            continue;
+        }
+
+        mjs->binding[mjs->var_order[mjs->depth]] =
+            level->candidates[level->next++];
+
+        if (mjs->depth == mjs->nvars - 1)
+            return true;
+
+        mjs->depth++;
+        find_candidates(mjs, mjs->depth);
+    }
+
+    return false;
+}
+
+/*
+ * Each edge of the vertex at depth narrows its candidates down to the ids it
+ * has on that side. If the vertex at the other side is already bound, only
+ * the edges to (or from) it are taken.
+ */
+static void find_candidates(cypher_multiway_join_state *mjs, int depth)
+{
+    multiway_join_level *level = &mjs->levels[depth];
+    int var = mjs->var_order[depth];
+    int nviews = 0;
+    int i;
+
+    for (i = 0; i < mjs->nedges; i++)
+    {
+        multiway_join_edge *edge = &mjs->edges[i];
+        multiway_join_view *view = &mjs->views[nviews];
+
+        if (edge->from_var == var)
+        {
+            view->entries = edge->reverse;
+            view->begin = 0;
+            view->end = edge->nentries;
+            view->key_to = true;
+
+            if (edge->to_var == var)
+            {
+                // a loop is checked when its entries are looked up
+                view->entries = edge->forward;
+                view->key_to = false;
+            }
+            else if (mjs->var_depth[edge->to_var] < depth)
+            {
+                narrow_view(view, mjs->binding[edge->to_var]);
+            }
+            else
+            {
+                view->entries = edge->forward;
+                view->key_to = false;
+            }
+        }
+        else if (edge->to_var == var)
+        {
+            view->entries = edge->forward;
+            view->begin = 0;
+            view->end = edge->nentries;
+            view->key_to = false;
+
+            if (mjs->var_depth[edge->from_var] < depth)
+            {
+                narrow_view(view, mjs->binding[edge->from_var]);
+            }
+            else
+            {
+                view->entries = edge->reverse;
+                view->key_to = true;
+            }
+        }
+        else
+        {
+            continue;
+        }
+
+        nviews++;
+    }
+
+    // every vertex has at least two edges, see add_multiway_join_path()
+    Assert(nviews > 0);
+
+    level->ncandidates = intersect_views(mjs->views, nviews,
+                                         level->candidates);
+    level->next = 0;
+}
+
+// looks up the entries of each edge between the bound vertices
+static bool start_emit(cypher_multiway_join_state *mjs)
+{
+    int i;
+
+    for (i = 0; i < mjs->nedges; i++)
+    {
+        multiway_join_edge *edge = &mjs->edges[i];
+        multiway_join_view view;
+
+        view.entries = edge->forward;
+        view.begin = 0;
+        view.end = edge->nentries;
+        view.key_to = false;
+
+        narrow_view(&view, mjs->binding[edge->from_var]);
+        narrow_view(&view, mjs->binding[edge->to_var]);
+
+        if (view.begin == view.end)
+            return false;
+
+        edge->emit_begin = view.begin;
+        edge->emit_end = view.end;
+        edge->emit_pos = view.begin;
+    }
+
+    mjs->emitted = false;
+
+    return true;
+}
+
+// stores the next combination of the entries of the edges into slot
+static bool emit_next(cypher_multiway_join_state *mjs, TupleTableSlot *slot)
+{
+    int i;
+
+    if (mjs->emitted)
+    {
+        for (i = mjs->nedges - 1; i >= 0; i--)
+        {
+            multiway_join_edge *edge = &mjs->edges[i];
+
+            if (++edge->emit_pos < edge->emit_end)
+                break;
+
+            edge->emit_pos = edge->emit_begin;
+        }
+
+        if (i < 0)
+            return false;
+    }
+    mjs->emitted = true;
+
+    ExecClearTuple(slot);
+
+    for (i = 0; i < mjs->nedges; i++)
+    {
+        multiway_join_edge *edge = &mjs->edges[i];
+        int tuple = edge->forward[edge->emit_pos].tuple;
+
+        memcpy(&slot->tts_values[edge->offset],
+               &edge->values[tuple * edge->natts],
+               sizeof(Datum) * edge->natts);
+        memcpy(&slot->tts_isnull[edge->offset],
+               &edge->nulls[tuple * edge->natts],
+               sizeof(bool) * edge->natts);
+    }
+
+    ExecStoreVirtualTuple(slot);
+
+    return true;
+}
+
+/*
+ * Leapfrog intersection of the keys of the views. The distinct keys that are
+ * in all of them are stored into out in order, and their number is returned.
+ */
+static int intersect_views(multiway_join_view *views, int nviews,
+                           graphid *out)
+{
+    graphid target;
+    int agreed = 0;
+    int nout = 0;
+    int i;
+
+    for (i = 0; i < nviews; i++)
+    {
+        if (views[i].begin >= views[i].end)
+            return 0;
+    }
+
+    target = VIEW_KEY(&views[0], views[0].begin);
+
+    for (i = 0;; i = (i + 1) % nviews)
+    {
+        multiway_join_view *view = &views[i];
+        graphid key;
+
+        view->begin = seek_view(view, view->begin, target, false);
+        if (view->begin >= view->end)
+            break;
+
+        key = VIEW_KEY(view, view->begin);
+        if (key == target)
+        {
+            if (++agreed < nviews)
+                continue;
+
+            out[nout++] = target;
+
+            view->begin = seek_view(view, view->begin, target, true);
+            if (view->begin >= view->end)
+                break;
+
+            key = VIEW_KEY(view, view->begin);
+        }
+
+        target = key;
+        agreed = 1;
+    }
+
+    return nout;
+}
+
+// narrows the view down to the entries with the given key and switches keys
+static void narrow_view(multiway_join_view *view, graphid key)
+{
+    int begin = seek_view(view, view->begin, key, false);
+
+    view->end = seek_view(view, begin, key, true);
+    view->begin = begin;
+    view->key_to = !view->key_to;
+}
+
+/*
+ * Returns the first position from pos on whose key is not less than (or
+ * greater than if strict is true) the given key. It gallops forward and then
+ * searches the last step in binary, so that skipping a few entries is cheap.
+ */
+static int seek_view(multiway_join_view *view, int pos, graphid key,
+                     bool strict)
+{
+    int lo;
+    int hi;
+    int step = 1;
+
+#define BEFORE(p) \
+    (strict ? VIEW_KEY(view, (p)) <= key : VIEW_KEY(view, (p)) < key)
+
+    if (pos >= view->end || !BEFORE(pos))
+        return pos;
+
+    lo = pos;
+    hi = pos + step;
+    while (hi < view->end && BEFORE(hi))
+    {
+        lo = hi;
+        step *= 2;
+        hi = lo + step;
+    }
+    if (hi > view->end)
+        hi = view->end;
+
+    while (hi - lo > 1)
+    {
+        int mid = lo + (hi - lo) / 2;
+
+        if (BEFORE(mid))
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+#undef BEFORE
+
+    return hi;
+}
+
+static int compare_forward(const void *a, const void *b)
+{
+    const multiway_join_entry *ea = a;
+    const multiway_join_entry *eb = b;
+
+    if (ea->from != eb->from)
+        return (ea->from < eb->from ? -1 : 1);
+    if (ea->to != eb->to)
+        return (ea->to < eb->to ? -1 : 1);
+
+    return ea->tuple - eb->tuple;
+}
+
+static int compare_reverse(const void *a, const void *b)
+{
+    const multiway_join_entry *ea = a;
+    const multiway_join_entry *eb = b;
+
+    if (ea->to != eb->to)
+        return (ea->to < eb->to ? -1 : 1);
+    if (ea->from != eb->from)
+        return (ea->from < eb->from ? -1 : 1);
+
+    return ea->tuple - eb->tuple;
+}
+
+Node *create_cypher_multiway_join_plan_state(CustomScan *cscan)
+{
+    cypher_multiway_join_state *mjs =
+        palloc0(sizeof(cypher_multiway_join_state));
+
+    mjs->cs = cscan;
+
+    mjs->css.ss.ps.type = T_CustomScanState;
+    mjs->css.methods = &cypher_multiway_join_exec_methods;
+
+    return (Node *)mjs;
+}
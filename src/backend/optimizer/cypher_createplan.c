@@ -21,12 +21,22 @@
 #include "nodes/pg_list.h"
 #include "nodes/plannodes.h"
 #include "nodes/relation.h"
+#include "optimizer/restrictinfo.h"
+#include "optimizer/var.h"
+#include "parser/parsetree.h"
 
+#include "catalog/ag_label.h"
 #include "executor/cypher_executor.h"
 #include "optimizer/cypher_createplan.h"
 
 const CustomScanMethods cypher_create_plan_methods = {
     "Cypher Create", create_cypher_create_plan_state};
+const CustomScanMethods cypher_label_scan_plan_methods = {
+    "Cypher Label Scan", create_cypher_label_scan_plan_state};
+const CustomScanMethods cypher_multiway_join_plan_methods = {
+    "Cypher Multiway Join", create_cypher_multiway_join_plan_state};
+const CustomScanMethods cypher_expand_plan_methods = {
+    "Cypher Expand", create_cypher_expand_plan_state};
 
 Plan *plan_cypher_create_path(PlannerInfo *root, RelOptInfo *rel,
                               CustomPath *best_path, List *tlist,
@@ -69,3 +79,245 @@ Plan *plan_cypher_create_path(PlannerInfo *root, RelOptInfo *rel,
 
     return (Plan *)cs;
 }
+
+Plan *plan_cypher_label_scan_path(PlannerInfo *root, RelOptInfo *rel,
+                                  CustomPath *best_path, List *tlist,
+                                  List *clauses, List *custom_plans)
+{
+    CustomScan *cs;
+    Expr *probe = linitial(best_path->custom_private);
+
+    cs = makeNode(CustomScan);
+
+    cs->scan.plan.startup_cost = best_path->path.startup_cost;
+    cs->scan.plan.total_cost = best_path->path.total_cost;
+
+    cs->scan.plan.plan_rows = best_path->path.rows;
+    cs->scan.plan.plan_width = best_path->path.pathtarget->width;
+
+    cs->scan.plan.parallel_aware = best_path->path.parallel_aware;
+    cs->scan.plan.parallel_safe = best_path->path.parallel_safe;
+
+    cs->scan.plan.plan_node_id = 0; // Set later in set_plan_refs
+    cs->scan.plan.targetlist = tlist;
+
+    /*
+     * The join clause the probe comes from is rechecked along with the other
+     * clauses, because the probe only narrows the scan down to the rows with
+     * the given id.
+     */
+    cs->scan.plan.qual = extract_actual_clauses(clauses, false);
+    cs->scan.plan.lefttree = NULL;
+    cs->scan.plan.righttree = NULL;
+    cs->scan.plan.initPlan = NIL;
+
+    cs->scan.plan.extParam = NULL;
+    cs->scan.plan.allParam = NULL;
+
+    cs->scan.scanrelid = rel->relid;
+
+    cs->flags = best_path->flags;
+
+    cs->custom_plans = NIL;
+    // outer references in the probe are replaced with nestloop params
+    cs->custom_exprs = list_make1(copyObject(probe));
+    cs->custom_private = NIL;
+    cs->custom_scan_tlist = NIL;
+    cs->custom_relids = NULL;
+    cs->methods = &cypher_label_scan_plan_methods;
+
+    return (Plan *)cs;
+}
+
+Plan *plan_cypher_multiway_join_path(PlannerInfo *root, RelOptInfo *rel,
+                                     CustomPath *best_path, List *tlist,
+                                     List *clauses, List *custom_plans)
+{
+    CustomScan *cs;
+    List *join_clauses = linitial(best_path->custom_private);
+    List *scan_tlist = NIL;
+    List *edge_cols = NIL;
+    ListCell *lc_plan;
+    ListCell *lc_path;
+
+    /*
+     * The scan tuple is the concatenation of the tuples of the edges. Find
+     * where the start_id and the end_id are in each of them.
+     */
+    forboth (lc_plan, custom_plans, lc_path, best_path->custom_paths)
+    {
+        Plan *plan = lfirst(lc_plan);
+        Path *path = lfirst(lc_path);
+        AttrNumber start_col = InvalidAttrNumber;
+        AttrNumber end_col = InvalidAttrNumber;
+        ListCell *lc;
+
+        foreach (lc, plan->targetlist)
+        {
+            TargetEntry *te = lfirst(lc);
+
+            if (IsA(te->expr, Var) &&
+                ((Var *)te->expr)->varno == path->parent->relid)
+            {
+                Var *var = (Var *)te->expr;
+
+                if (var->varattno == Anum_ag_label_edge_table_start_id)
+                    start_col = te->resno;
+                else if (var->varattno == Anum_ag_label_edge_table_end_id)
+                    end_col = te->resno;
+            }
+
+            scan_tlist = lappend(scan_tlist,
+                                 makeTargetEntry((Expr *)copyObject(te->expr),
+                                                 list_length(scan_tlist) + 1,
+                                                 NULL, false));
+        }
+
+        if (start_col == InvalidAttrNumber || end_col == InvalidAttrNumber)
+        {
+            ereport(ERROR, (errmsg_internal(
+                               "start_id and end_id of an edge are missing")));
+        }
+
+        edge_cols = lappend_int(edge_cols, start_col);
+        edge_cols = lappend_int(edge_cols, end_col);
+    }
+
+    cs = makeNode(CustomScan);
+
+    cs->scan.plan.startup_cost = best_path->path.startup_cost;
+    cs->scan.plan.total_cost = best_path->path.total_cost;
+
+    cs->scan.plan.plan_rows = best_path->path.rows;
+    cs->scan.plan.plan_width = best_path->path.pathtarget->width;
+
+    cs->scan.plan.parallel_aware = best_path->path.parallel_aware;
+    cs->scan.plan.parallel_safe = best_path->path.parallel_safe;
+
+    cs->scan.plan.plan_node_id = 0; // Set later in set_plan_refs
+    cs->scan.plan.targetlist = tlist;
+
+    // all the join clauses are checked on the rows of the bindings
+    cs->scan.plan.qual = extract_actual_clauses(join_clauses, false);
+    cs->scan.plan.lefttree = NULL;
+    cs->scan.plan.righttree = NULL;
+    cs->scan.plan.initPlan = NIL;
+
+    cs->scan.plan.extParam = NULL;
+    cs->scan.plan.allParam = NULL;
+
+    cs->scan.scanrelid = 0;
+
+    cs->flags = best_path->flags;
+
+    cs->custom_plans = custom_plans;
+    cs->custom_exprs = NIL;
+    cs->custom_private = list_make3(lsecond(best_path->custom_private),
+                                    lthird(best_path->custom_private),
+                                    edge_cols);
+    cs->custom_scan_tlist = scan_tlist;
+    cs->custom_relids = rel->relids;
+    cs->methods = &cypher_multiway_join_plan_methods;
+
+    return (Plan *)cs;
+}
+
+Plan *plan_cypher_expand_path(PlannerInfo *root, RelOptInfo *rel,
+                              CustomPath *best_path, List *tlist,
+                              List *clauses, List *custom_plans)
+{
+    CustomScan *cs;
+    List *join_clauses = linitial(best_path->custom_private);
+    Var *probe = lsecond(best_path->custom_private);
+    List *inner_info = lthird(best_path->custom_private);
+    Index inner_relid = linitial_int(inner_info);
+    AttrNumber probe_attno = lsecond_int(inner_info);
+    Plan *outer_plan = linitial(custom_plans);
+    List *quals;
+    List *inner_vars;
+    List *inner_attnos = NIL;
+    List *scan_tlist = NIL;
+    AttrNumber key_col = InvalidAttrNumber;
+    ListCell *lc;
+
+    quals = extract_actual_clauses(join_clauses, false);
+
+    // the scan tuple is the outer tuple followed by the columns of the edge
+    foreach (lc, outer_plan->targetlist)
+    {
+        TargetEntry *te = lfirst(lc);
+
+        if (equal(te->expr, probe))
+            key_col = te->resno;
+
+        scan_tlist = lappend(scan_tlist,
+                             makeTargetEntry((Expr *)copyObject(te->expr),
+                                             list_length(scan_tlist) + 1,
+                                             NULL, false));
+    }
+
+    if (key_col == InvalidAttrNumber)
+    {
+        ereport(ERROR, (errmsg_internal(
+                           "the probe of Cypher Expand is missing")));
+    }
+
+    inner_vars = list_concat(
+        list_copy(find_base_rel(root, inner_relid)->reltarget->exprs),
+        pull_var_clause((Node *)quals, PVC_INCLUDE_PLACEHOLDERS));
+    foreach (lc, inner_vars)
+    {
+        Var *var = lfirst(lc);
+
+        if (var->varno != inner_relid ||
+            list_member_int(inner_attnos, var->varattno))
+            continue;
+
+        inner_attnos = lappend_int(inner_attnos, var->varattno);
+        scan_tlist = lappend(scan_tlist,
+                             makeTargetEntry((Expr *)copyObject(var),
+                                             list_length(scan_tlist) + 1,
+                                             NULL, false));
+    }
+
+    cs = makeNode(CustomScan);
+
+    cs->scan.plan.startup_cost = best_path->path.startup_cost;
+    cs->scan.plan.total_cost = best_path->path.total_cost;
+
+    cs->scan.plan.plan_rows = best_path->path.rows;
+    cs->scan.plan.plan_width = best_path->path.pathtarget->width;
+
+    cs->scan.plan.parallel_aware = best_path->path.parallel_aware;
+    cs->scan.plan.parallel_safe = best_path->path.parallel_safe;
+
+    cs->scan.plan.plan_node_id = 0; // Set later in set_plan_refs
+    cs->scan.plan.targetlist = tlist;
+
+    /*
+     * The join clause of the probe is rechecked along with the other clauses
+     * and the quals of the edges, which are not scanned by any other node.
+     */
+    cs->scan.plan.qual = quals;
+    cs->scan.plan.lefttree = NULL;
+    cs->scan.plan.righttree = NULL;
+    cs->scan.plan.initPlan = NIL;
+
+    cs->scan.plan.extParam = NULL;
+    cs->scan.plan.allParam = NULL;
+
+    cs->scan.scanrelid = 0;
+
+    cs->flags = best_path->flags;
+
+    cs->custom_plans = custom_plans;
+    cs->custom_exprs = NIL;
+    cs->custom_private = list_make3(
+        list_make1_oid(planner_rt_fetch(inner_relid, root)->relid),
+        list_make2_int(key_col, probe_attno), inner_attnos);
+    cs->custom_scan_tlist = scan_tlist;
+    cs->custom_relids = rel->relids;
+    cs->methods = &cypher_expand_plan_methods;
+
+    return (Plan *)cs;
+}
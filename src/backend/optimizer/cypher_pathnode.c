@@ -16,16 +16,29 @@
 
 #include "postgres.h"
 
+#include <math.h>
+
 #include "nodes/extensible.h"
 #include "nodes/nodes.h"
 #include "nodes/pg_list.h"
 #include "nodes/relation.h"
+#include "optimizer/cost.h"
+#include "optimizer/restrictinfo.h"
 
+#include "executor/cypher_executor.h"
 #include "optimizer/cypher_createplan.h"
 #include "optimizer/cypher_pathnode.h"
 
 const CustomPathMethods cypher_create_path_methods = {
     "Cypher Create", plan_cypher_create_path, NULL};
+const CustomPathMethods cypher_label_scan_path_methods = {
+    "Cypher Label Scan", plan_cypher_label_scan_path, NULL};
+const CustomPathMethods cypher_multiway_join_path_methods = {
+    "Cypher Multiway Join", plan_cypher_multiway_join_path, NULL};
+const CustomPathMethods cypher_expand_path_methods = {
+    "Cypher Expand", plan_cypher_expand_path, NULL};
+
+#define LOG2(x) (log(x) / 0.693147180559945)
 
 CustomPath *create_cypher_create_path(PlannerInfo *root, RelOptInfo *rel,
                                       List *custom_private)
@@ -62,3 +75,198 @@ CustomPath *create_cypher_create_path(PlannerInfo *root, RelOptInfo *rel,
 
     return cp;
 }
+
+/*
+ * The path looks up the entities whose id is equal to probe, which is an
+ * expression over the relations in param_info. Only the label table the
+ * graphid belongs to is visited.
+ */
+CustomPath *create_cypher_label_scan_path(PlannerInfo *root, RelOptInfo *rel,
+                                          ParamPathInfo *param_info,
+                                          Expr *probe)
+{
+    CustomPath *cp;
+    Cost probe_cost;
+
+    cp = makeNode(CustomPath);
+
+    cp->path.pathtype = T_CustomScan;
+
+    cp->path.parent = rel;
+    cp->path.pathtarget = rel->reltarget;
+
+    cp->path.param_info = param_info;
+
+    // Do not allow parallel methods
+    cp->path.parallel_aware = false;
+    cp->path.parallel_safe = false;
+    cp->path.parallel_workers = 0;
+
+    cp->path.rows = param_info->ppi_rows;
+
+    // one descent of a single id index and a heap fetch per matching row
+    probe_cost = random_page_cost + cpu_index_tuple_cost + cpu_operator_cost;
+
+    cp->path.startup_cost = probe_cost;
+    cp->path.total_cost = probe_cost +
+                          (random_page_cost + cpu_tuple_cost +
+                           cpu_operator_cost *
+                               list_length(param_info->ppi_clauses)) *
+                              cp->path.rows;
+
+    // Entities are returned in no particular order
+    cp->path.pathkeys = NULL;
+
+    cp->flags = 0;
+
+    cp->custom_paths = NIL;
+    cp->custom_private = list_make1(probe);
+    cp->methods = &cypher_label_scan_path_methods;
+
+    return cp;
+}
+
+/*
+ * The path joins the edges in edge_rels at once. edge_vars has the numbers of
+ * the start and end vertices of each edge in the cycle, and var_order is the
+ * order in which the vertices are bound.
+ *
+ * Each edge is read and sorted by its start_id and by its end_id. Then, the
+ * number of the bindings the join goes through is bounded by the product of
+ * the square roots of the sizes of the edges (the AGM bound for a pattern
+ * whose vertices all have two or more edges), and each one costs a galloping
+ * search per edge.
+ */
+CustomPath *create_cypher_multiway_join_path(PlannerInfo *root,
+                                             RelOptInfo *joinrel,
+                                             List *edge_rels, List *clauses,
+                                             List *edge_vars, List *var_order)
+{
+    CustomPath *cp;
+    List *custom_paths = NIL;
+    QualCost qual_cost;
+    Cost startup_cost = 0;
+    double bound = 1;
+    double max_rows = 1;
+    ListCell *lc;
+
+    foreach (lc, edge_rels)
+    {
+        RelOptInfo *rel = lfirst(lc);
+        Path *path = rel->cheapest_total_path;
+        double rows = clamp_row_est(path->rows);
+
+        custom_paths = lappend(custom_paths, path);
+
+        startup_cost += path->total_cost +
+                        2 * cpu_operator_cost * rows * LOG2(rows + 1);
+
+        bound *= sqrt(rows);
+        max_rows = Max(max_rows, rows);
+    }
+
+    cost_qual_eval(&qual_cost, extract_actual_clauses(clauses, false), root);
+
+    cp = makeNode(CustomPath);
+
+    cp->path.pathtype = T_CustomScan;
+
+    cp->path.parent = joinrel;
+    cp->path.pathtarget = joinrel->reltarget;
+
+    cp->path.param_info = NULL;
+
+    // Do not allow parallel methods
+    cp->path.parallel_aware = false;
+    cp->path.parallel_safe = false;
+    cp->path.parallel_workers = 0;
+
+    cp->path.rows = joinrel->rows;
+
+    cp->path.startup_cost = startup_cost + qual_cost.startup;
+    cp->path.total_cost = cp->path.startup_cost +
+                          cpu_operator_cost * list_length(edge_rels) *
+                              bound * LOG2(max_rows + 1) +
+                          (cpu_tuple_cost + qual_cost.per_tuple) *
+                              cp->path.rows;
+
+    // The rows are returned in the order of the bindings
+    cp->path.pathkeys = NULL;
+
+    cp->flags = 0;
+
+    cp->custom_paths = custom_paths;
+    cp->custom_private = list_make3(clauses, edge_vars, var_order);
+    cp->methods = &cypher_multiway_join_path_methods;
+
+    return cp;
+}
+
+/*
+ * The path joins the edges of innerrel whose probe_attno column is equal to
+ * probe with the rows of outer_path. The outer rows are sorted by probe a
+ * batch at a time, and the index of each of the ntables tables of the label
+ * is probed in that order. So the heap pages of the edges are visited mostly
+ * in order, and each page is read about once, as in a bitmap heap scan.
+ */
+CustomPath *create_cypher_expand_path(PlannerInfo *root, RelOptInfo *joinrel,
+                                      Path *outer_path, RelOptInfo *innerrel,
+                                      List *clauses, Var *probe,
+                                      AttrNumber probe_attno, int ntables)
+{
+    CustomPath *cp;
+    QualCost qual_cost;
+    double outer_rows = clamp_row_est(outer_path->rows);
+    double edges = clamp_row_est(joinrel->rows);
+    double pages;
+    Cost probe_cost;
+    Cost run_cost;
+
+    cost_qual_eval(&qual_cost, extract_actual_clauses(clauses, false), root);
+
+    // a descent of each index for every outer row
+    probe_cost = ntables * (cpu_index_tuple_cost +
+                            cpu_operator_cost *
+                                LOG2(Max(innerrel->tuples, 1) + 1));
+
+    pages = index_pages_fetched(edges, Max(innerrel->pages, 1),
+                                Max(innerrel->pages, 1), root);
+
+    run_cost = outer_path->total_cost - outer_path->startup_cost;
+    run_cost += cpu_operator_cost * outer_rows *
+                LOG2(Min(outer_rows, CYPHER_EXPAND_BATCH_SIZE) + 1);
+    run_cost += probe_cost * outer_rows;
+    run_cost += random_page_cost * pages;
+    run_cost += (cpu_tuple_cost + qual_cost.per_tuple) * edges;
+
+    cp = makeNode(CustomPath);
+
+    cp->path.pathtype = T_CustomScan;
+
+    cp->path.parent = joinrel;
+    cp->path.pathtarget = joinrel->reltarget;
+
+    cp->path.param_info = NULL;
+
+    // Do not allow parallel methods
+    cp->path.parallel_aware = false;
+    cp->path.parallel_safe = false;
+    cp->path.parallel_workers = 0;
+
+    cp->path.rows = joinrel->rows;
+
+    cp->path.startup_cost = outer_path->startup_cost + qual_cost.startup;
+    cp->path.total_cost = cp->path.startup_cost + run_cost;
+
+    // The rows are sorted by probe within each batch only
+    cp->path.pathkeys = NULL;
+
+    cp->flags = 0;
+
+    cp->custom_paths = list_make1(outer_path);
+    cp->custom_private = list_make3(
+        clauses, probe, list_make2_int(innerrel->relid, probe_attno));
+    cp->methods = &cypher_expand_path_methods;
+
+    return cp;
+}
@@ -16,15 +16,29 @@
 
 #include "postgres.h"
 
+#include "access/heapam.h"
+#include "catalog/pg_class_d.h"
+#include "catalog/pg_inherits.h"
 #include "catalog/pg_type_d.h"
 #include "nodes/parsenodes.h"
 #include "nodes/primnodes.h"
 #include "nodes/relation.h"
+#include "optimizer/clauses.h"
+#include "optimizer/geqo.h"
+#include "optimizer/joininfo.h"
 #include "optimizer/pathnode.h"
 #include "optimizer/paths.h"
+#include "optimizer/restrictinfo.h"
+#include "optimizer/var.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
 
+#include "catalog/ag_label.h"
+#include "commands/label_commands.h"
+#include "executor/cypher_executor.h"
 #include "optimizer/cypher_pathnode.h"
 #include "optimizer/cypher_paths.h"
+#include "utils/ag_cache.h"
 #include "utils/ag_func.h"
 
 typedef enum cypher_clause_kind
@@ -34,12 +48,52 @@ typedef enum cypher_clause_kind
 } cypher_clause_kind;
 
 static set_rel_pathlist_hook_type prev_set_rel_pathlist_hook;
+static join_search_hook_type prev_join_search_hook;
+static set_join_pathlist_hook_type prev_set_join_pathlist_hook;
+
+bool enable_pattern_join_search = true;
+bool enable_multiway_join = true;
+bool enable_expand = true;
 
 static void set_rel_pathlist(PlannerInfo *root, RelOptInfo *rel, Index rti,
                              RangeTblEntry *rte);
 static cypher_clause_kind get_cypher_clause_kind(RangeTblEntry *rte);
 static void handle_cypher_create_clause(PlannerInfo *root, RelOptInfo *rel,
                                         Index rti, RangeTblEntry *rte);
+static void add_label_scan_paths(PlannerInfo *root, RelOptInfo *rel,
+                                 Index rti, RangeTblEntry *rte);
+static bool is_label_hierarchy(PlannerInfo *root, Index rti,
+                               RangeTblEntry *rte);
+static bool id_var_matches_ec_member(PlannerInfo *root, RelOptInfo *rel,
+                                     EquivalenceClass *ec,
+                                     EquivalenceMember *em, void *arg);
+static Expr *get_id_probe_expr(RelOptInfo *rel, RestrictInfo *rinfo,
+                               AttrNumber id_attnum);
+static RelOptInfo *join_search(PlannerInfo *root, int levels_needed,
+                               List *initial_rels);
+static bool is_graph_pattern(PlannerInfo *root, List *initial_rels);
+static RelOptInfo *pattern_join_search(PlannerInfo *root, int levels_needed,
+                                       List *initial_rels);
+static RelOptInfo *join_next_rel(PlannerInfo *root, RelOptInfo *joinrel,
+                                 List **remaining_rels, bool adjacent_only,
+                                 bool last);
+static void set_join_pathlist(PlannerInfo *root, RelOptInfo *joinrel,
+                              RelOptInfo *outerrel, RelOptInfo *innerrel,
+                              JoinType jointype, JoinPathExtraData *extra);
+static void add_multiway_join_path(PlannerInfo *root, RelOptInfo *joinrel);
+static List *get_cycle_edge_rels(PlannerInfo *root, RelOptInfo *joinrel);
+static List *get_cycle_join_clauses(PlannerInfo *root, RelOptInfo *joinrel,
+                                    List *edge_rels);
+static int get_endpoint_column(RelOptInfo *joinrel, List *edge_rels,
+                               Node *node);
+static int find_endpoint_class(int *classes, int col);
+static void add_expand_path(PlannerInfo *root, RelOptInfo *joinrel,
+                            RelOptInfo *outerrel, RelOptInfo *innerrel,
+                            JoinPathExtraData *extra);
+static Var *get_expand_probe(RelOptInfo *outerrel, RelOptInfo *innerrel,
+                             RestrictInfo *rinfo, AttrNumber *probe_attno);
+static bool is_plain_var_list(List *exprs, Index relid);
+static int count_adjacency_indexes(Oid relid, AttrNumber attnum);
 
 void set_rel_pathlist_init(void)
 {
@@ -52,6 +106,28 @@ void set_rel_pathlist_fini(void)
     set_rel_pathlist_hook = prev_set_rel_pathlist_hook;
 }
 
+void join_search_init(void)
+{
+    prev_join_search_hook = join_search_hook;
+    join_search_hook = join_search;
+}
+
+void join_search_fini(void)
+{
+    join_search_hook = prev_join_search_hook;
+}
+
+void set_join_pathlist_init(void)
+{
+    prev_set_join_pathlist_hook = set_join_pathlist_hook;
+    set_join_pathlist_hook = set_join_pathlist;
+}
+
+void set_join_pathlist_fini(void)
+{
+    set_join_pathlist_hook = prev_set_join_pathlist_hook;
+}
+
 static void set_rel_pathlist(PlannerInfo *root, RelOptInfo *rel, Index rti,
                              RangeTblEntry *rte)
 {
@@ -68,6 +144,9 @@ static void set_rel_pathlist(PlannerInfo *root, RelOptInfo *rel, Index rti,
     default:
         ereport(ERROR, (errmsg_internal("invalid cypher_clause_kind")));
     }
+
+    if (is_label_hierarchy(root, rti, rte))
+        add_label_scan_paths(root, rel, rti, rte);
 }
 
 /*
@@ -127,3 +206,786 @@ static void handle_cypher_create_clause(PlannerInfo *root, RelOptInfo *rel,
 
     add_path(rel, (Path *)cp);
 }
+
+/*
+ * Check to see if the rte is a label table that is scanned together with the
+ * label tables that inherit it.
+ */
+static bool is_label_hierarchy(PlannerInfo *root, Index rti,
+                               RangeTblEntry *rte)
+{
+    ListCell *lc;
+    int children = 0;
+
+    if (rte->rtekind != RTE_RELATION || !rte->inh ||
+        rte->relkind != RELKIND_RELATION)
+        return false;
+
+    foreach (lc, root->append_rel_list)
+    {
+        AppendRelInfo *appinfo = lfirst(lc);
+
+        if (appinfo->parent_relid == rti)
+            children++;
+    }
+
+    // the parent itself is one of the children of its appendrel
+    if (children < 2)
+        return false;
+
+    return search_label_relation_cache(rte->relid) != NULL;
+}
+
+/*
+ * A graphid carries the id of its label, so a lookup of an entity by its id
+ * only needs to visit the label table the id belongs to. Without this, the
+ * lookup is an Append that probes the id index of every label table in the
+ * hierarchy.
+ *
+ * For every join clause of the form "id = <outer expression>", add a
+ * parameterized Cypher Label Scan path that routes each probe to a single
+ * label table at execution time.
+ */
+static void add_label_scan_paths(PlannerInfo *root, RelOptInfo *rel,
+                                 Index rti, RangeTblEntry *rte)
+{
+    AttrNumber id_attnum;
+    List *clauses;
+    ListCell *lc;
+
+    id_attnum = get_attnum(rte->relid, AG_VERTEX_COLNAME_ID);
+    if (id_attnum == InvalidAttrNumber)
+        return;
+
+    clauses = list_copy(rel->joininfo);
+
+    /*
+     * graphid equality is mergejoinable, so most of the join clauses on id
+     * are held by equivalence classes instead of joininfo.
+     */
+    if (rel->has_eclass_joins)
+    {
+        clauses = list_concat(
+            clauses, generate_implied_equalities_for_column(
+                         root, rel, id_var_matches_ec_member, &id_attnum,
+                         NULL));
+    }
+
+    foreach (lc, clauses)
+    {
+        RestrictInfo *rinfo = lfirst(lc);
+        Expr *probe;
+        Relids required_outer;
+        ParamPathInfo *param_info;
+        CustomPath *cp;
+
+        probe = get_id_probe_expr(rel, rinfo, id_attnum);
+        if (probe == NULL)
+            continue;
+
+        if (!join_clause_is_movable_to(rinfo, rel))
+            continue;
+
+        required_outer = bms_difference(rinfo->clause_relids, rel->relids);
+        if (bms_is_empty(required_outer))
+            continue;
+
+        param_info = get_baserel_parampathinfo(root, rel, required_outer);
+
+        cp = create_cypher_label_scan_path(root, rel, param_info, probe);
+
+        add_path(rel, (Path *)cp);
+    }
+}
+
+static bool id_var_matches_ec_member(PlannerInfo *root, RelOptInfo *rel,
+                                     EquivalenceClass *ec,
+                                     EquivalenceMember *em, void *arg)
+{
+    AttrNumber id_attnum = *((AttrNumber *)arg);
+    Var *var;
+
+    if (!IsA(em->em_expr, Var))
+        return false;
+
+    var = (Var *)em->em_expr;
+
+    return (var->varno == rel->relid && var->varattno == id_attnum &&
+            var->varlevelsup == 0);
+}
+
+/*
+ * If the clause compares the id column of rel to an expression over other
+ * relations with graphid equality, return that expression.
+ */
+static Expr *get_id_probe_expr(RelOptInfo *rel, RestrictInfo *rinfo,
+                               AttrNumber id_attnum)
+{
+    OpExpr *op;
+    Expr *id_side;
+    Expr *probe;
+    Relids probe_relids;
+    Var *var;
+
+    if (rinfo->pseudoconstant || !is_opclause(rinfo->clause))
+        return NULL;
+
+    op = (OpExpr *)rinfo->clause;
+
+    if (list_length(op->args) != 2 ||
+        !is_oid_ag_func(get_opcode(op->opno), "graphid_eq"))
+        return NULL;
+
+    if (bms_equal(rinfo->left_relids, rel->relids))
+    {
+        id_side = linitial(op->args);
+        probe = lsecond(op->args);
+        probe_relids = rinfo->right_relids;
+    }
+    else if (bms_equal(rinfo->right_relids, rel->relids))
+    {
+        id_side = lsecond(op->args);
+        probe = linitial(op->args);
+        probe_relids = rinfo->left_relids;
+    }
+    else
+    {
+        return NULL;
+    }
+
+    if (!IsA(id_side, Var))
+        return NULL;
+
+    var = (Var *)id_side;
+    if (var->varno != rel->relid || var->varattno != id_attnum ||
+        var->varlevelsup != 0)
+        return NULL;
+
+    if (bms_is_empty(probe_relids) ||
+        bms_overlap(probe_relids, rel->relids) ||
+        contain_volatile_functions((Node *)probe))
+        return NULL;
+
+    return probe;
+}
+
+/*
+ * A MATCH is planned as a join of the label tables of its entities. If there
+ * are too many of them for the exhaustive search, the planner falls back to
+ * GEQO whose plans for long paths are often far from the best ones. Such
+ * joins are ordered along the pattern instead; see pattern_join_search().
+ */
+static RelOptInfo *join_search(PlannerInfo *root, int levels_needed,
+                               List *initial_rels)
+{
+    if (enable_pattern_join_search && enable_geqo &&
+        levels_needed >= geqo_threshold &&
+        is_graph_pattern(root, initial_rels))
+    {
+        RelOptInfo *rel;
+
+        rel = pattern_join_search(root, levels_needed, initial_rels);
+        if (rel)
+            return rel;
+    }
+
+    if (prev_join_search_hook)
+        return prev_join_search_hook(root, levels_needed, initial_rels);
+    else if (enable_geqo && levels_needed >= geqo_threshold)
+        return geqo(root, levels_needed, initial_rels);
+    else
+        return standard_join_search(root, levels_needed, initial_rels);
+}
+
+// check to see if all the relations to join are label tables
+static bool is_graph_pattern(PlannerInfo *root, List *initial_rels)
+{
+    ListCell *lc;
+
+    foreach (lc, initial_rels)
+    {
+        RelOptInfo *rel = lfirst(lc);
+        RangeTblEntry *rte;
+
+        if (rel->reloptkind != RELOPT_BASEREL)
+            return false;
+
+        rte = planner_rt_fetch(rel->relid, root);
+        if (rte->rtekind != RTE_RELATION ||
+            !search_label_relation_cache(rte->relid))
+            return false;
+    }
+
+    return true;
+}
+
+/*
+ * Builds a left-deep join tree that walks the pattern. It starts from the
+ * relation with the fewest rows, which is the most selective bound entity,
+ * and at each step joins the adjacent relation that yields the fewest rows.
+ * The row estimates of the joins between edges and vertices come from the
+ * edge fan-out (see graphid_eqjoinsel()), so the walk expands the pattern
+ * where it grows the least.
+ *
+ * Returns NULL if there is no valid order along the pattern, for example
+ * because of the restrictions of outer joins. The join relations built so
+ * far are then forgotten, as GEQO does, for the fallback search.
+ */
+static RelOptInfo *pattern_join_search(PlannerInfo *root, int levels_needed,
+                                       List *initial_rels)
+{
+    int savelength = list_length(root->join_rel_list);
+    struct HTAB *savehash = root->join_rel_hash;
+    List **save_join_rel_level = root->join_rel_level;
+    List *remaining_rels;
+    RelOptInfo *joinrel = NULL;
+    ListCell *lc;
+    int lev;
+
+    foreach (lc, initial_rels)
+    {
+        RelOptInfo *rel = lfirst(lc);
+
+        if (!joinrel || rel->rows < joinrel->rows)
+            joinrel = rel;
+    }
+
+    remaining_rels = list_copy(initial_rels);
+    remaining_rels = list_delete_ptr(remaining_rels, joinrel);
+
+    // the join relations are not kept by level, see build_join_rel()
+    root->join_rel_level = NULL;
+
+    for (lev = 2; lev <= levels_needed; lev++)
+    {
+        RelOptInfo *rel;
+        bool last = (lev == levels_needed);
+
+        rel = join_next_rel(root, joinrel, &remaining_rels, true, last);
+
+        // a disconnected pattern, such as MATCH (a), (b)
+        if (!rel)
+            rel = join_next_rel(root, joinrel, &remaining_rels, false, last);
+
+        if (!rel)
+        {
+            root->join_rel_list = list_truncate(root->join_rel_list,
+                                                savelength);
+            root->join_rel_hash = savehash;
+            root->join_rel_level = save_join_rel_level;
+
+            return NULL;
+        }
+
+        joinrel = rel;
+    }
+
+    root->join_rel_level = save_join_rel_level;
+
+    return joinrel;
+}
+
+/*
+ * Joins joinrel with the relation in remaining_rels that yields the fewest
+ * rows (the cheapest join breaks ties) and removes it from remaining_rels. If
+ * adjacent_only is true, only the relations that have join clauses with
+ * joinrel are considered.
+ */
+static RelOptInfo *join_next_rel(PlannerInfo *root, RelOptInfo *joinrel,
+                                 List **remaining_rels, bool adjacent_only,
+                                 bool last)
+{
+    RelOptInfo *best_rel = NULL;
+    RelOptInfo *best_joinrel = NULL;
+    ListCell *lc;
+
+    foreach (lc, *remaining_rels)
+    {
+        RelOptInfo *rel = lfirst(lc);
+        RelOptInfo *new_joinrel;
+
+        if (adjacent_only && !have_relevant_joinclause(root, joinrel, rel) &&
+            !have_join_order_restriction(root, joinrel, rel))
+            continue;
+
+        new_joinrel = make_join_rel(root, joinrel, rel);
+        if (!new_joinrel)
+            continue;
+
+        // the same steps as standard_join_search() takes for each level
+        generate_partitionwise_join_paths(root, new_joinrel);
+        if (!last)
+            generate_gather_paths(root, new_joinrel, false);
+        set_cheapest(new_joinrel);
+
+        if (!best_joinrel || new_joinrel->rows < best_joinrel->rows ||
+            (new_joinrel->rows == best_joinrel->rows &&
+             new_joinrel->cheapest_total_path->total_cost <
+                 best_joinrel->cheapest_total_path->total_cost))
+        {
+            best_rel = rel;
+            best_joinrel = new_joinrel;
+        }
+    }
+
+    if (best_rel)
+        *remaining_rels = list_delete_ptr(*remaining_rels, best_rel);
+
+    return best_joinrel;
+}
+
+static void set_join_pathlist(PlannerInfo *root, RelOptInfo *joinrel,
+                              RelOptInfo *outerrel, RelOptInfo *innerrel,
+                              JoinType jointype, JoinPathExtraData *extra)
+{
+    if (prev_set_join_pathlist_hook)
+    {
+        prev_set_join_pathlist_hook(root, joinrel, outerrel, innerrel,
+                                    jointype, extra);
+    }
+
+    if (jointype != JOIN_INNER)
+        return;
+
+    if (enable_multiway_join)
+        add_multiway_join_path(root, joinrel);
+
+    if (enable_expand)
+        add_expand_path(root, joinrel, outerrel, innerrel, extra);
+}
+
+/*
+ * A cyclic pattern, such as (a)-->(b)-->(c)-->(a), that is joined pairwise
+ * builds intermediate results which can be much larger than its result; the
+ * join of the first two edges of a triangle has a row for every path of
+ * length 2. If joinrel is the join of the edges of a cycle, add a path that
+ * joins all of them at once, binding one vertex of the cycle at a time.
+ *
+ * The vertices of the cycle are the sets of start_id and end_id columns of the
+ * edges that are equal to each other. Every column must be in such a set with
+ * another one, which makes every vertex have at least two edges, and all the
+ * vertices must be connected.
+ */
+static void add_multiway_join_path(PlannerInfo *root, RelOptInfo *joinrel)
+{
+    List *edge_rels;
+    List *clauses;
+    List *edge_vars = NIL;
+    List *var_order = NIL;
+    ListCell *lc;
+    int nedges;
+    int ncols;
+    int nvars = 0;
+    int *classes;
+    int *col_vars;
+    int *class_sizes;
+    bool *ordered;
+    int start;
+    int i;
+
+    foreach (lc, joinrel->pathlist)
+    {
+        Path *path = lfirst(lc);
+
+        // the path has been added for another pair of the input relations
+        if (IsA(path, CustomPath) &&
+            ((CustomPath *)path)->methods ==
+                &cypher_multiway_join_path_methods)
+            return;
+    }
+
+    edge_rels = get_cycle_edge_rels(root, joinrel);
+    if (list_length(edge_rels) < 2)
+        return;
+
+    clauses = get_cycle_join_clauses(root, joinrel, edge_rels);
+
+    // the start_id of the i-th edge is column 2 * i and its end_id is next
+    nedges = list_length(edge_rels);
+    ncols = nedges * 2;
+    classes = palloc(sizeof(int) * ncols);
+    for (i = 0; i < ncols; i++)
+        classes[i] = i;
+
+    foreach (lc, clauses)
+    {
+        RestrictInfo *rinfo = lfirst(lc);
+        OpExpr *op;
+        int left;
+        int right;
+
+        if (!is_opclause(rinfo->clause))
+            continue;
+
+        op = (OpExpr *)rinfo->clause;
+        if (list_length(op->args) != 2 ||
+            !is_oid_ag_func(get_opcode(op->opno), "graphid_eq"))
+            continue;
+
+        left = get_endpoint_column(joinrel, edge_rels, linitial(op->args));
+        right = get_endpoint_column(joinrel, edge_rels, lsecond(op->args));
+        if (left < 0 || right < 0)
+            continue;
+
+        classes[find_endpoint_class(classes, left)] =
+            find_endpoint_class(classes, right);
+    }
+
+    // number the vertices of the cycle
+    col_vars = palloc(sizeof(int) * ncols);
+    class_sizes = palloc0(sizeof(int) * ncols);
+    for (i = 0; i < ncols; i++)
+    {
+        if (find_endpoint_class(classes, i) == i)
+            col_vars[i] = nvars++;
+    }
+    for (i = 0; i < ncols; i++)
+    {
+        col_vars[i] = col_vars[find_endpoint_class(classes, i)];
+        class_sizes[col_vars[i]]++;
+    }
+
+    for (i = 0; i < nvars; i++)
+    {
+        if (class_sizes[i] < 2)
+            return;
+    }
+
+    /*
+     * Bind the vertices in breadth-first order, starting from the one with
+     * the most edges, so that each vertex but the first is adjacent to a bound
+     * one and is narrowed down by the edges to it.
+     */
+    start = 0;
+    for (i = 1; i < nvars; i++)
+    {
+        if (class_sizes[i] > class_sizes[start])
+            start = i;
+    }
+    var_order = list_make1_int(start);
+    ordered = palloc0(sizeof(bool) * nvars);
+    ordered[start] = true;
+
+    foreach (lc, var_order)
+    {
+        int var = lfirst_int(lc);
+
+        for (i = 0; i < nedges; i++)
+        {
+            int from = col_vars[i * 2];
+            int to = col_vars[i * 2 + 1];
+            int next;
+
+            if (from == var)
+                next = to;
+            else if (to == var)
+                next = from;
+            else
+                continue;
+
+            if (!ordered[next])
+            {
+                ordered[next] = true;
+                var_order = lappend_int(var_order, next);
+            }
+        }
+    }
+
+    // the pattern is not connected
+    if (list_length(var_order) != nvars)
+        return;
+
+    for (i = 0; i < ncols; i++)
+        edge_vars = lappend_int(edge_vars, col_vars[i]);
+
+    add_path(joinrel, (Path *)create_cypher_multiway_join_path(
+                          root, joinrel, edge_rels, clauses, edge_vars,
+                          var_order));
+}
+
+/*
+ * Returns the relations of joinrel if they are all edge label tables that the
+ * operator can scan on its own.
+ */
+static List *get_cycle_edge_rels(PlannerInfo *root, RelOptInfo *joinrel)
+{
+    List *edge_rels = NIL;
+    ListCell *lc;
+    int relid;
+
+    if (!bms_is_empty(joinrel->lateral_relids))
+        return NIL;
+
+    // the relations of the nullable side of outer joins are not joined freely
+    foreach (lc, root->join_info_list)
+    {
+        SpecialJoinInfo *sjinfo = lfirst(lc);
+
+        if (bms_overlap(sjinfo->syn_righthand, joinrel->relids))
+            return NIL;
+    }
+
+    relid = -1;
+    while ((relid = bms_next_member(joinrel->relids, relid)) >= 0)
+    {
+        RelOptInfo *rel = find_base_rel(root, relid);
+        RangeTblEntry *rte = planner_rt_fetch(relid, root);
+        label_cache_data *lcd;
+
+        if (rel->reloptkind != RELOPT_BASEREL ||
+            rte->rtekind != RTE_RELATION ||
+            !bms_is_empty(rel->lateral_relids) ||
+            !rel->cheapest_total_path ||
+            rel->cheapest_total_path->param_info)
+            return NIL;
+
+        lcd = search_label_relation_cache(rte->relid);
+        if (!lcd || lcd->kind != LABEL_KIND_EDGE)
+            return NIL;
+
+        edge_rels = lappend(edge_rels, rel);
+    }
+
+    return edge_rels;
+}
+
+/*
+ * Returns the clauses that join the edges to each other. The equalities that
+ * are held by equivalence classes are generated as if the edges were joined
+ * one after another.
+ */
+static List *get_cycle_join_clauses(PlannerInfo *root, RelOptInfo *joinrel,
+                                    List *edge_rels)
+{
+    List *clauses = NIL;
+    Relids joined = NULL;
+    ListCell *lc;
+
+    foreach (lc, edge_rels)
+    {
+        RelOptInfo *rel = lfirst(lc);
+        ListCell *lc2;
+
+        if (joined)
+        {
+            clauses = list_concat(
+                clauses, generate_join_implied_equalities(
+                             root, bms_union(joined, rel->relids), joined,
+                             rel));
+        }
+        joined = bms_union(joined, rel->relids);
+
+        foreach (lc2, rel->joininfo)
+        {
+            RestrictInfo *rinfo = lfirst(lc2);
+
+            if (bms_is_subset(rinfo->required_relids, joinrel->relids))
+                clauses = list_append_unique_ptr(clauses, rinfo);
+        }
+    }
+
+    return clauses;
+}
+
+// returns the column number of an edge's start_id or end_id, or -1
+static int get_endpoint_column(RelOptInfo *joinrel, List *edge_rels,
+                               Node *node)
+{
+    Var *var;
+    ListCell *lc;
+    int i = 0;
+
+    if (!IsA(node, Var))
+        return -1;
+
+    var = (Var *)node;
+    if (var->varlevelsup != 0)
+        return -1;
+
+    foreach (lc, edge_rels)
+    {
+        RelOptInfo *rel = lfirst(lc);
+
+        if (rel->relid == var->varno)
+        {
+            if (var->varattno == Anum_ag_label_edge_table_start_id)
+                return i * 2;
+            else if (var->varattno == Anum_ag_label_edge_table_end_id)
+                return i * 2 + 1;
+            else
+                return -1;
+        }
+
+        i++;
+    }
+
+    return -1;
+}
+
+static int find_endpoint_class(int *classes, int col)
+{
+    while (classes[col] != col)
+        col = classes[col];
+
+    return col;
+}
+
+/*
+ * A hop from the bound side of a pattern to the edges of a label is a join of
+ * the edge table on its start_id (or end_id). If every table of the label has
+ * an index on that column, add a Cypher Expand path, which probes the indexes
+ * with the graphids of the bound side in sorted batches. See cypher_expand.c.
+ */
+static void add_expand_path(PlannerInfo *root, RelOptInfo *joinrel,
+                            RelOptInfo *outerrel, RelOptInfo *innerrel,
+                            JoinPathExtraData *extra)
+{
+    Path *outer_path = outerrel->cheapest_total_path;
+    RangeTblEntry *rte;
+    label_cache_data *lcd;
+    List *clauses;
+    ListCell *lc;
+    Var *probe = NULL;
+    AttrNumber probe_attno = InvalidAttrNumber;
+    int ntables;
+
+    if (innerrel->reloptkind != RELOPT_BASEREL ||
+        !bms_is_empty(innerrel->lateral_relids) || !outer_path ||
+        outer_path->param_info)
+        return;
+
+    // the node reads all the tables of the label, so ONLY is not supported
+    rte = planner_rt_fetch(innerrel->relid, root);
+    if (rte->rtekind != RTE_RELATION || !rte->inh)
+        return;
+
+    lcd = search_label_relation_cache(rte->relid);
+    if (!lcd || lcd->kind != LABEL_KIND_EDGE)
+        return;
+
+    foreach (lc, extra->restrictlist)
+    {
+        probe = get_expand_probe(outerrel, innerrel, lfirst(lc),
+                                 &probe_attno);
+        if (probe)
+            break;
+    }
+    if (!probe)
+        return;
+
+    // the edges are read straight from the tables; check their quals too
+    clauses = list_concat(list_copy(extra->restrictlist),
+                          list_copy(innerrel->baserestrictinfo));
+
+    // the columns of the edges are taken from the tuples by their numbers
+    if (!is_plain_var_list(innerrel->reltarget->exprs, innerrel->relid) ||
+        !is_plain_var_list(
+            pull_var_clause((Node *)extract_actual_clauses(clauses, false),
+                            PVC_INCLUDE_PLACEHOLDERS),
+            innerrel->relid))
+        return;
+
+    ntables = count_adjacency_indexes(rte->relid, probe_attno);
+    if (ntables == 0)
+        return;
+
+    add_path(joinrel, (Path *)create_cypher_expand_path(
+                          root, joinrel, outer_path, innerrel, clauses, probe,
+                          probe_attno, ntables));
+}
+
+/*
+ * If the clause is "start_id = <Var>" (or end_id) with the Var on the outer
+ * side, return the Var.
+ */
+static Var *get_expand_probe(RelOptInfo *outerrel, RelOptInfo *innerrel,
+                             RestrictInfo *rinfo, AttrNumber *probe_attno)
+{
+    OpExpr *op;
+    Var *edge_var;
+    Var *probe;
+
+    if (rinfo->pseudoconstant || !is_opclause(rinfo->clause))
+        return NULL;
+
+    op = (OpExpr *)rinfo->clause;
+    if (list_length(op->args) != 2 ||
+        !is_oid_ag_func(get_opcode(op->opno), "graphid_eq") ||
+        !IsA(linitial(op->args), Var) || !IsA(lsecond(op->args), Var))
+        return NULL;
+
+    if (((Var *)linitial(op->args))->varno == innerrel->relid)
+    {
+        edge_var = linitial(op->args);
+        probe = lsecond(op->args);
+    }
+    else
+    {
+        edge_var = lsecond(op->args);
+        probe = linitial(op->args);
+    }
+
+    if (edge_var->varno != innerrel->relid || edge_var->varlevelsup != 0 ||
+        (edge_var->varattno != Anum_ag_label_edge_table_start_id &&
+         edge_var->varattno != Anum_ag_label_edge_table_end_id))
+        return NULL;
+
+    if (probe->varlevelsup != 0 ||
+        !bms_is_member(probe->varno, outerrel->relids))
+        return NULL;
+
+    *probe_attno = edge_var->varattno;
+
+    return probe;
+}
+
+// check to see if the Vars of relid in exprs are all user columns
+static bool is_plain_var_list(List *exprs, Index relid)
+{
+    ListCell *lc;
+
+    foreach (lc, exprs)
+    {
+        Node *expr = lfirst(lc);
+
+        if (!IsA(expr, Var))
+            return false;
+
+        if (((Var *)expr)->varno == relid && ((Var *)expr)->varattno <= 0)
+            return false;
+    }
+
+    return true;
+}
+
+/*
+ * Returns the number of the tables of the label that have their rows, if all
+ * of them have an index on the given column, or 0.
+ */
+static int count_adjacency_indexes(Oid relid, AttrNumber attnum)
+{
+    List *relids;
+    ListCell *lc;
+    int ntables = 0;
+
+    relids = find_all_inheritors(relid, NoLock, NULL);
+    foreach (lc, relids)
+    {
+        Relation rel;
+        Oid index_oid;
+
+        if (get_rel_relkind(lfirst_oid(lc)) == RELKIND_PARTITIONED_TABLE)
+            continue;
+
+        rel = heap_open(lfirst_oid(lc), NoLock);
+        index_oid = get_adjacency_index(rel, attnum);
+        heap_close(rel, NoLock);
+
+        if (!OidIsValid(index_oid))
+            return 0;
+
+        ntables++;
+    }
+
+    return ntables;
+}
@@ -30,6 +30,7 @@
 #include "parser/parse_relation.h"
 #include "parser/parse_target.h"
 #include "parser/parsetree.h"
+#include "portability/instr_time.h"
 #include "utils/builtins.h"
 
 #include "catalog/ag_graph.h"
@@ -39,6 +40,7 @@
 #include "parser/cypher_parse_node.h"
 #include "parser/cypher_parser.h"
 #include "utils/ag_func.h"
+#include "utils/ag_stat_cypher.h"
 #include "utils/agtype.h"
 
 static post_parse_analyze_hook_type prev_post_parse_analyze_hook;
@@ -73,10 +75,23 @@ void post_parse_analyze_fini(void)
 
 static void post_parse_analyze(ParseState *pstate, Query *query)
 {
+    cypher_stat_state stat_state;
+
     if (prev_post_parse_analyze_hook)
         prev_post_parse_analyze_hook(pstate, query);
 
-    convert_cypher_walker((Node *)query, pstate);
+    begin_cypher_stat(&stat_state);
+    PG_TRY();
+    {
+        convert_cypher_walker((Node *)query, pstate);
+    }
+    PG_CATCH();
+    {
+        cancel_cypher_stat(&stat_state);
+        PG_RE_THROW();
+    }
+    PG_END_TRY();
+    end_cypher_stat(&stat_state, pstate->p_sourcetext, query);
 }
 
 // find cypher() calls in FROM clauses and convert them to SELECT subqueries
@@ -225,6 +240,9 @@ static void convert_cypher_to_subquery(RangeTblEntry *rte, ParseState *pstate)
     errpos_ecb_state ecb_state;
     List *stmt;
     Query *query;
+    instr_time start;
+    instr_time parse_time;
+    instr_time analyze_time;
 
     /*
      * We cannot apply this feature directly to SELECT subquery because the
@@ -313,7 +331,10 @@ static void convert_cypher_to_subquery(RangeTblEntry *rte, ParseState *pstate)
      */
     setup_errpos_ecb(&ecb_state, pstate, query_loc);
 
+    INSTR_TIME_SET_CURRENT(start);
     stmt = parse_cypher(query_str);
+    INSTR_TIME_SET_CURRENT(parse_time);
+    INSTR_TIME_SUBTRACT(parse_time, start);
 
     cancel_errpos_ecb(&ecb_state);
 
@@ -323,6 +344,8 @@ static void convert_cypher_to_subquery(RangeTblEntry *rte, ParseState *pstate)
     // FYI, rte is RTE_FUNCTION and is being converted to RTE_SUBQUERY here.
     pstate->p_lateral_active = true;
 
+    INSTR_TIME_SET_CURRENT(start);
+
     /*
      * Cypher queries that end with CREATE clause do not need to have the
      * coercion logic applied to them because we are forcing the column
@@ -351,9 +374,15 @@ static void convert_cypher_to_subquery(RangeTblEntry *rte, ParseState *pstate)
                                           graph_oid, params);
     }
 
+    INSTR_TIME_SET_CURRENT(analyze_time);
+    INSTR_TIME_SUBTRACT(analyze_time, start);
+
     pstate->p_lateral_active = false;
     pstate->p_expr_kind = EXPR_KIND_NONE;
 
+    note_cypher_stat(NameStr(*graph_name), graph_oid, query_str, parse_time,
+                     analyze_time);
+
     // rte->functions and rte->funcordinality are kept for debugging.
     // rte->alias, rte->eref, and rte->lateral need to be the same.
     // rte->inh is always false for both RTE_FUNCTION and RTE_SUBQUERY.
@@ -519,9 +548,15 @@ static Query *analyze_cypher_and_coerce(List *stmt, RangeTblFunction *rtfunc,
     subquery = analyze_cypher(stmt, pstate, query_str, query_loc, graph_name,
                               graph_oid, (Param *)params);
 
+    INSTR_TIME_SET_CURRENT(analyze_time);
+    INSTR_TIME_SUBTRACT(analyze_time, start);
+
     pstate->p_lateral_active = false;
     pstate->p_expr_kind = EXPR_KIND_NONE;
 
+    note_cypher_stat(NameStr(*graph_name), graph_oid, query_str, parse_time,
+                     analyze_time);
+
     // check the number of attributes first
     if (list_length(subquery->targetList) != rtfunc->funccolcount)
     {
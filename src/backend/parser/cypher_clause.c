@@ -16,6 +16,8 @@
 
 #include "postgres.h"
 
+#include "access/heapam.h"
+#include "catalog/pg_class_d.h"
 #include "catalog/pg_type_d.h"
 #include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
@@ -23,6 +25,7 @@
 #include "nodes/parsenodes.h"
 #include "nodes/pg_list.h"
 #include "nodes/primnodes.h"
+#include "optimizer/clauses.h"
 #include "optimizer/var.h"
 #include "parser/parse_agg.h"
 #include "parser/parse_clause.h"
@@ -35,6 +38,7 @@
 #include "parser/parse_target.h"
 #include "parser/parsetree.h"
 #include "rewrite/rewriteHandler.h"
+#include "rewrite/rewriteManip.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
 
@@ -93,6 +97,11 @@ typedef Query *(*transform_method)(cypher_parsestate *cpstate,
 // projection
 static Query *transform_cypher_return(cypher_parsestate *cpstate,
                                       cypher_clause *clause);
+static Query *transform_cypher_label_count(cypher_parsestate *cpstate,
+                                           cypher_clause *clause);
+static label_cache_data *get_counted_label(cypher_parsestate *cpstate,
+                                           cypher_clause *clause,
+                                           char **var_name);
 static List *transform_cypher_order_by(cypher_parsestate *cpstate,
                                        List *sort_items, List **target_list,
                                        ParseExprKind expr_kind);
@@ -131,16 +140,21 @@ static Node *make_edge_expr(cypher_parsestate *cpstate, RangeTblEntry *rte,
                             char *label);
 static FuncCall *make_qual(cypher_parsestate *cpstate,
                            transform_entity *entity, char *name);
+static ColumnRef *make_id_column_ref(transform_entity *entity, char *col_name);
+static bool has_graphid_join_key(transform_entity *entity);
+static Node *make_join_key(cypher_parsestate *cpstate, transform_entity *entity,
+                           char *col_name, bool graphid_keys);
 static TargetEntry *
 transform_match_create_path_variable(cypher_parsestate *cpstate,
                                      cypher_path *path, List *entities);
 static List *make_path_join_quals(cypher_parsestate *cpstate, List *entities);
 static List *make_directed_edge_join_conditions(
     cypher_parsestate *cpstate, transform_entity *prev_entity,
-    transform_entity *next_entity, FuncCall *prev_qual, FuncCall *next_qual,
-    char *prev_node_label, char *next_node_label);
+    transform_entity *edge, transform_entity *next_entity, char *prev_col_name,
+    char *next_col_name, char *prev_node_label, char *next_node_label);
 static List *join_to_entity(cypher_parsestate *cpstate,
-                            transform_entity *entity, FuncCall *qual,
+                            transform_entity *entity, transform_entity *edge,
+                            char *col_name,
                             enum transform_entity_join_side side);
 static List *make_join_condition_for_edge(cypher_parsestate *cpstate,
                                           transform_entity *prev_edge,
@@ -150,9 +164,12 @@ static List *make_join_condition_for_edge(cypher_parsestate *cpstate,
                                           transform_entity *next_edge);
 static List *make_edge_quals(cypher_parsestate *cpstate,
                              transform_entity *edge,
-                             enum transform_entity_join_side side);
-static A_Expr *filter_vertices_on_label_id(cypher_parsestate *cpstate,
-                                           FuncCall *id_field, char *label);
+                             enum transform_entity_join_side side,
+                             bool graphid_keys);
+static List *filter_vertices_on_label_id(cypher_parsestate *cpstate,
+                                         transform_entity *edge,
+                                         char *col_name, char *label);
+static TypeCast *make_graphid_const(graphid gid, char *type_name);
 static transform_entity *
 make_transform_entity(cypher_parsestate *cpstate,
                       enum transform_entity_type type, Node *node, Expr *expr,
@@ -179,6 +196,8 @@ static cypher_target_node *transform_create_cypher_existing_node(
 static cypher_target_node *
 transform_create_cypher_edge(cypher_parsestate *cpstate, List **target_list,
                              cypher_relationship *edge);
+static Relation open_label_relation_for_insert(cypher_parsestate *cpstate,
+                                               char *label);
 static Expr *cypher_create_id_access_function(cypher_parsestate *cpstate,
                                               RangeTblEntry *rte,
                                               enum transform_entity_type type,
@@ -191,6 +210,7 @@ static Expr *cypher_create_properties(cypher_parsestate *cpstate,
                                       Relation label_relation, Node *props,
                                       enum transform_entity_type type);
 static Expr *add_volatile_wrapper(Expr *node);
+static bool is_volatile_wrapper(Expr *node);
 static bool variable_exists(cypher_parsestate *cpstate, char *name);
 static int get_target_entry_resno(List *target_list, char *name);
 static TargetEntry *placeholder_target_entry(cypher_parsestate *cpstate,
@@ -217,6 +237,13 @@ static ParseNamespaceItem *makeNamespaceItem(RangeTblEntry *rte,
                                              bool cols_visible,
                                              bool lateral_only,
                                              bool lateral_ok);
+static void flatten_prev_cypher_clauses(Query *query);
+static bool is_simple_cypher_clause(Query *query, RangeTblEntry *rte);
+static void pull_up_cypher_clause(Query *query, int rtindex);
+static void remove_pulled_up_rtes(Query *query, Bitmapset *pulled_up);
+
+// age.approximate_count
+bool approximate_label_count = false;
 
 /*
  * transform a cypher_clause
@@ -245,6 +272,8 @@ Query *transform_cypher_clause(cypher_parsestate *cpstate,
     else
         ereport(ERROR, (errmsg_internal("unexpected Node for cypher_clause")));
 
+    flatten_prev_cypher_clauses(result);
+
     result->querySource = QSRC_ORIGINAL;
     result->canSetTag = true;
 
@@ -258,6 +287,10 @@ static Query *transform_cypher_return(cypher_parsestate *cpstate,
     cypher_return *self = (cypher_return *)clause->self;
     Query *query;
 
+    query = transform_cypher_label_count(cpstate, clause);
+    if (query)
+        return query;
+
     query = makeNode(Query);
     query->commandType = CMD_SELECT;
 
@@ -302,6 +335,197 @@ static Query *transform_cypher_return(cypher_parsestate *cpstate,
     return query;
 }
 
+/*
+ * MATCH (n:label) RETURN count(n) and MATCH ()-[e:label]->() RETURN count(e)
+ * only need the number of rows in the label table. Instead of building an
+ * entity for every row and counting those, count the rows of the table
+ * directly so that the planner can answer it with an index-only scan on the
+ * id column. If age.approximate_count is set, the number is estimated from
+ * the statistics of the label table instead and no table is scanned at all.
+ *
+ * NULL is returned if the clause is not such a query.
+ */
+static Query *transform_cypher_label_count(cypher_parsestate *cpstate,
+                                           cypher_clause *clause)
+{
+    ParseState *pstate = (ParseState *)cpstate;
+    cypher_return *self = (cypher_return *)clause->self;
+    ResTarget *item;
+    label_cache_data *lcd;
+    char *var_name;
+    FuncCall *count;
+    Node *expr;
+    TargetEntry *te;
+    Query *query;
+
+    lcd = get_counted_label(cpstate, clause, &var_name);
+    if (!lcd)
+        return NULL;
+
+    item = linitial(self->items);
+
+    query = makeNode(Query);
+    query->commandType = CMD_SELECT;
+
+    if (approximate_label_count)
+    {
+        Oid func_oid;
+        Const *relid;
+
+        // the argument is already analyzed, so is the call
+        func_oid = get_ag_func_oid("_estimate_label_count", 1, REGCLASSOID);
+        relid = makeConst(REGCLASSOID, -1, InvalidOid, sizeof(Oid),
+                          ObjectIdGetDatum(lcd->relation), false, true);
+        expr = (Node *)makeFuncExpr(func_oid, AGTYPEOID, list_make1(relid),
+                                    InvalidOid, InvalidOid,
+                                    COERCE_EXPLICIT_CALL);
+    }
+    else
+    {
+        char *schema_name;
+        char *rel_name;
+        RangeVar *label_range_var;
+        RangeTblEntry *rte;
+
+        schema_name = get_graph_namespace_name(cpstate->graph_name);
+        rel_name = get_label_relation_name(NameStr(lcd->name),
+                                           cpstate->graph_oid);
+        label_range_var = makeRangeVar(schema_name, rel_name, -1);
+
+        rte = addRangeTableEntry(pstate, label_range_var,
+                                 makeAlias(var_name, NIL),
+                                 label_range_var->inh, true);
+        addRTEtoQuery(pstate, rte, true, true, false);
+
+        // count(*) is converted to agtype
+        count = makeFuncCall(list_make1(makeString("count")), NIL, -1);
+        count->agg_star = true;
+        count = makeFuncCall(list_make2(makeString("ag_catalog"),
+                                        makeString("int8_to_agtype")),
+                             list_make1(count), -1);
+
+        expr = transformExpr(pstate, (Node *)count, EXPR_KIND_SELECT_TARGET);
+    }
+
+    te = transform_cypher_item(cpstate, item->val, expr,
+                               EXPR_KIND_SELECT_TARGET, item->name, false);
+    query->targetList = list_make1(te);
+
+    markTargetListOrigins(pstate, query->targetList);
+
+    query->rtable = pstate->p_rtable;
+    query->jointree = makeFromExpr(pstate->p_joinlist, NULL);
+
+    query->hasAggs = pstate->p_hasAggs;
+    if (query->hasAggs)
+        parseCheckAggregates(pstate, query);
+
+    assign_query_collations(pstate, query);
+
+    return query;
+}
+
+/*
+ * Returns the label whose entities are counted if the clause is
+ * RETURN count(var) and the only previous clause matches a single vertex or a
+ * single directed edge between anonymous vertices bound to var. Otherwise,
+ * NULL is returned and the clause is transformed as usual; this includes
+ * labels that do not exist so that the usual errors are reported.
+ */
+static label_cache_data *get_counted_label(cypher_parsestate *cpstate,
+                                           cypher_clause *clause,
+                                           char **var_name)
+{
+    cypher_return *self = (cypher_return *)clause->self;
+    ResTarget *item;
+    cypher_function *func;
+    ColumnRef *cref;
+    cypher_match *match;
+    cypher_path *path;
+    char *name;
+    char *label;
+    char kind;
+    label_cache_data *lcd;
+
+    if (self->distinct || self->order_by || self->skip || self->limit ||
+        list_length(self->items) != 1)
+        return NULL;
+
+    item = linitial(self->items);
+    if (!is_ag_node(item->val, cypher_function))
+        return NULL;
+
+    func = (cypher_function *)item->val;
+    if (pg_strcasecmp(func->funcname, "count") != 0 ||
+        list_length(func->exprs) != 1 || !IsA(linitial(func->exprs), ColumnRef))
+        return NULL;
+
+    cref = linitial(func->exprs);
+    if (list_length(cref->fields) != 1 || !IsA(linitial(cref->fields), String))
+        return NULL;
+
+    // the variable must be bound by a lone MATCH with a single path
+    if (!clause->prev || clause->prev->prev ||
+        !is_ag_node(clause->prev->self, cypher_match))
+        return NULL;
+
+    match = (cypher_match *)clause->prev->self;
+    if (match->where || list_length(match->pattern) != 1)
+        return NULL;
+
+    path = linitial(match->pattern);
+    if (path->var_name)
+        return NULL;
+
+    if (list_length(path->path) == 1)
+    {
+        cypher_node *node = linitial(path->path);
+
+        if (node->props)
+            return NULL;
+
+        name = node->name;
+        label = node->label ? node->label : AG_DEFAULT_LABEL_VERTEX;
+        kind = LABEL_KIND_VERTEX;
+    }
+    else if (list_length(path->path) == 3)
+    {
+        cypher_node *start = linitial(path->path);
+        cypher_relationship *rel = lsecond(path->path);
+        cypher_node *end = lthird(path->path);
+
+        /*
+         * Undirected edges are matched twice, and the end vertices must not
+         * filter the edges.
+         */
+        if (rel->props || rel->dir == CYPHER_REL_DIR_NONE)
+            return NULL;
+
+        if (start->name || start->label || start->props ||
+            end->name || end->label || end->props)
+            return NULL;
+
+        name = rel->name;
+        label = rel->label ? rel->label : AG_DEFAULT_LABEL_EDGE;
+        kind = LABEL_KIND_EDGE;
+    }
+    else
+    {
+        return NULL;
+    }
+
+    if (!name || strcmp(name, strVal(linitial(cref->fields))) != 0)
+        return NULL;
+
+    lcd = search_label_name_graph_cache(label, cpstate->graph_oid);
+    if (!lcd || lcd->kind != kind)
+        return NULL;
+
+    *var_name = name;
+
+    return lcd;
+}
+
 // see transformSortClause()
 static List *transform_cypher_order_by(cypher_parsestate *cpstate,
                                        List *sort_items, List **target_list,
@@ -452,6 +676,8 @@ static Query *transform_cypher_clause_with_where(cypher_parsestate *cpstate,
     query->hasTargetSRFs = pstate->p_hasTargetSRFs;
     query->hasAggs = pstate->p_hasAggs;
 
+    flatten_prev_cypher_clauses(query);
+
     return query;
 }
 
@@ -500,58 +726,16 @@ static Query *transform_cypher_match_pattern(cypher_parsestate *cpstate,
     return query;
 }
 
-/*
- * Function to make a target list from an RTE. Borrowed from AgensGraph and PG
- */
-static List *makeTargetListFromRTE(ParseState *pstate, RangeTblEntry *rte)
-{
-    List *targetlist = NIL;
-    int rtindex;
-    int varattno;
-    ListCell *ln;
-    ListCell *lt;
-
-    /* right now this is only for subqueries */
-    AssertArg(rte->rtekind == RTE_SUBQUERY);
-
-    rtindex = RTERangeTablePosn(pstate, rte, NULL);
-
-    varattno = 1;
-    ln = list_head(rte->eref->colnames);
-    foreach(lt, rte->subquery->targetList)
-    {
-        TargetEntry *te = lfirst(lt);
-        Var *varnode;
-        char *resname;
-        TargetEntry *tmp;
-
-        if (te->resjunk)
-            continue;
-
-        Assert(varattno == te->resno);
-
-        /* no transform here, just use `te->expr` */
-        varnode = makeVar(rtindex, varattno, exprType((Node *) te->expr),
-                          exprTypmod((Node *) te->expr),
-                          exprCollation((Node *) te->expr), 0);
-
-        resname = strVal(lfirst(ln));
-
-        tmp = makeTargetEntry((Expr *)varnode,
-                              (AttrNumber)pstate->p_next_resno++, resname,
-                              false);
-        targetlist = lappend(targetlist, tmp);
-
-        varattno++;
-        ln = lnext(ln);
-    }
-
-    return targetlist;
-}
-
 /*
  * Transform a cypher sub pattern. This is put here because it is a sub clause.
  * This works in tandem with transform_Sublink in cypher_expr.c
+ *
+ * The pattern is transformed as a MATCH of its own, in a child parse state.
+ * The variables of the outer query it refers to become outer references in
+ * its quals, so the result is a correlated subquery. Only the existence of a
+ * match is of interest, so the target list is left empty. That lets the
+ * planner turn EXISTS into a semi-join and NOT EXISTS into an anti-join, both
+ * of which stop at the first match.
  */
 static Query *transform_cypher_sub_pattern(cypher_parsestate *cpstate,
                                            cypher_clause *clause)
@@ -559,8 +743,6 @@ static Query *transform_cypher_sub_pattern(cypher_parsestate *cpstate,
     cypher_match *match;
     cypher_clause *c;
     Query *qry;
-    RangeTblEntry *rte;
-    ParseState *pstate = (ParseState *)cpstate;
     cypher_sub_pattern *subpat = (cypher_sub_pattern*)clause->self;
 
     /* create a cypher match node and assign it the sub pattern */
@@ -573,29 +755,13 @@ static Query *transform_cypher_sub_pattern(cypher_parsestate *cpstate,
     c->prev = NULL;
     c->next = NULL;
 
-    /* set up a select query and run it as a sub query to the parent match */
-    qry = makeNode(Query);
-    qry->commandType = CMD_SELECT;
-
-    rte = transform_cypher_clause_as_subquery(cpstate, transform_cypher_clause,
-                                              c);
-
-    qry->targetList = makeTargetListFromRTE(pstate, rte);
-
-    markTargetListOrigins(pstate, qry->targetList);
+    qry = analyze_cypher_clause(transform_cypher_match_pattern, c, cpstate);
 
-    qry->rtable = pstate->p_rtable;
-    qry->jointree = makeFromExpr(pstate->p_joinlist, NULL);
-
-    /* the state will be destroyed so copy the data we need */
-    qry->hasSubLinks = pstate->p_hasSubLinks;
-    qry->hasTargetSRFs = pstate->p_hasTargetSRFs;
-    qry->hasAggs = pstate->p_hasAggs;
-
-    if (qry->hasAggs)
-        parseCheckAggregates(pstate, qry);
-
-    assign_query_collations(pstate, qry);
+    /*
+     * Nothing of the sub pattern is projected. The correlation keys are in
+     * the quals, which is where the planner looks for them.
+     */
+    qry->targetList = NIL;
 
     return qry;
 }
@@ -682,41 +848,47 @@ static FuncCall *prevent_duplicate_edges(cypher_parsestate *cpstate,
 
 /*
  * For any given edge, the previous entity is joined with the edge
- * via the prev_qual node, and the next entity is join with the
- * next_qual node. If there is a filter on the previous vertex label,
+ * via the prev_col_name column, and the next entity is join with the
+ * next_col_name column. If there is a filter on the previous vertex label,
  * create a filter, same with the next node.
  */
 static List *make_directed_edge_join_conditions(
     cypher_parsestate *cpstate, transform_entity *prev_entity,
-    transform_entity *next_entity, FuncCall *prev_qual, FuncCall *next_qual,
-    char *prev_node_filter, char *next_node_filter)
+    transform_entity *edge, transform_entity *next_entity, char *prev_col_name,
+    char *next_col_name, char *prev_node_filter, char *next_node_filter)
 {
     List *quals = NIL;
 
     if (prev_entity->in_join_tree)
-        quals = list_concat(quals, join_to_entity(cpstate, prev_entity,
-                                                  prev_qual, JOIN_SIDE_LEFT));
+    {
+        quals = list_concat(quals,
+                            join_to_entity(cpstate, prev_entity, edge,
+                                           prev_col_name, JOIN_SIDE_LEFT));
+    }
 
     if (next_entity->in_join_tree)
-        quals = list_concat(quals, join_to_entity(cpstate, next_entity,
-                                                  next_qual, JOIN_SIDE_RIGHT));
+    {
+        quals = list_concat(quals,
+                            join_to_entity(cpstate, next_entity, edge,
+                                           next_col_name, JOIN_SIDE_RIGHT));
+    }
 
     if (prev_node_filter != NULL && !IS_DEFAULT_LABEL_VERTEX(prev_node_filter))
     {
-        A_Expr *qual;
-        qual = filter_vertices_on_label_id(cpstate, prev_qual,
+        List *qual;
+        qual = filter_vertices_on_label_id(cpstate, edge, prev_col_name,
                                            prev_node_filter);
 
-        quals = lappend(quals, qual);
+        quals = list_concat(quals, qual);
     }
 
     if (next_node_filter != NULL && !IS_DEFAULT_LABEL_VERTEX(next_node_filter))
     {
-        A_Expr *qual;
-        qual = filter_vertices_on_label_id(cpstate, next_qual,
+        List *qual;
+        qual = filter_vertices_on_label_id(cpstate, edge, next_col_name,
                                            next_node_filter);
 
-        quals = lappend(quals, qual);
+        quals = list_concat(quals, qual);
     }
 
     return quals;
@@ -784,25 +956,17 @@ static List *make_join_condition_for_edge(cypher_parsestate *cpstate,
     {
     case CYPHER_REL_DIR_RIGHT:
     {
-        FuncCall *prev_qual = make_qual(cpstate, entity,
-                                        AG_EDGE_COLNAME_START_ID);
-        FuncCall *next_qual = make_qual(cpstate, entity,
-                                        AG_EDGE_COLNAME_END_ID);
-
         return make_directed_edge_join_conditions(
-            cpstate, prev_entity, next_node, prev_qual, next_qual,
-            prev_label_name_to_filter, next_label_name_to_filter);
+            cpstate, prev_entity, entity, next_node, AG_EDGE_COLNAME_START_ID,
+            AG_EDGE_COLNAME_END_ID, prev_label_name_to_filter,
+            next_label_name_to_filter);
     }
     case CYPHER_REL_DIR_LEFT:
     {
-        FuncCall *prev_qual = make_qual(cpstate, entity,
-                                        AG_EDGE_COLNAME_END_ID);
-        FuncCall *next_qual = make_qual(cpstate, entity,
-                                        AG_EDGE_COLNAME_START_ID);
-
         return make_directed_edge_join_conditions(
-            cpstate, prev_entity, next_node, prev_qual, next_qual,
-            prev_label_name_to_filter, next_label_name_to_filter);
+            cpstate, prev_entity, entity, next_node, AG_EDGE_COLNAME_END_ID,
+            AG_EDGE_COLNAME_START_ID, prev_label_name_to_filter,
+            next_label_name_to_filter);
     }
     case CYPHER_REL_DIR_NONE:
     {
@@ -810,21 +974,19 @@ static List *make_join_condition_for_edge(cypher_parsestate *cpstate,
          * For undirected relationships, we can use the left directed
          * relationship OR'd by the right directed relationship.
          */
-        FuncCall *start_id_expr = make_qual(cpstate, entity,
-                                            AG_EDGE_COLNAME_START_ID);
-        FuncCall *end_id_expr = make_qual(cpstate, entity,
-                                          AG_EDGE_COLNAME_END_ID);
         List *first_join_quals = NIL, *second_join_quals = NIL;
         Expr *first_qual, *second_qual;
         Expr *or_qual;
 
         first_join_quals = make_directed_edge_join_conditions(
-            cpstate, prev_entity, next_entity, start_id_expr, end_id_expr,
+            cpstate, prev_entity, entity, next_entity,
+            AG_EDGE_COLNAME_START_ID, AG_EDGE_COLNAME_END_ID,
             prev_label_name_to_filter, next_label_name_to_filter);
 
         second_join_quals = make_directed_edge_join_conditions(
-            cpstate, prev_entity, next_entity, end_id_expr, start_id_expr,
-            prev_label_name_to_filter, next_label_name_to_filter);
+            cpstate, prev_entity, entity, next_entity, AG_EDGE_COLNAME_END_ID,
+            AG_EDGE_COLNAME_START_ID, prev_label_name_to_filter,
+            next_label_name_to_filter);
 
         first_qual = makeBoolExpr(AND_EXPR, first_join_quals, -1);
         second_qual = makeBoolExpr(AND_EXPR, second_join_quals, -1);
@@ -840,37 +1002,56 @@ static List *make_join_condition_for_edge(cypher_parsestate *cpstate,
 }
 
 /*
- * For the given entity, join it to the current edge, via the passed
- * qual node. The side denotes if the entity is on the right
- * or left of the current edge. Which we will need to know if the
- * passed entity is a directed edge.
+ * For the given entity, join it to the col_name column of the current edge.
+ * The side denotes if the entity is on the right or left of the current
+ * edge. Which we will need to know if the passed entity is a directed edge.
+ *
+ * When neither side comes from a previous clause, the graphid columns are
+ * compared directly. That lets the planner use the indexes on the id columns
+ * and route the lookup to the label table the graphid belongs to. The
+ * variables of an outer query, which a sub-pattern refers to, are compared by
+ * their ids cast to graphid, so that the correlation keys of the sub-pattern
+ * can be hashed. Otherwise, both sides are compared as agtype.
  */
 static List *join_to_entity(cypher_parsestate *cpstate,
-                            transform_entity *entity, FuncCall *qual,
+                            transform_entity *entity, transform_entity *edge,
+                            char *col_name,
                             enum transform_entity_join_side side)
 {
     A_Expr *expr;
     List *quals = NIL;
+    List *eq_op;
+    Node *qual;
+    bool graphid_keys;
+
+    graphid_keys = has_graphid_join_key(entity) && has_graphid_join_key(edge);
+
+    if (graphid_keys)
+        eq_op = list_make2(makeString("ag_catalog"), makeString("="));
+    else
+        eq_op = list_make1(makeString("="));
+
+    qual = make_join_key(cpstate, edge, col_name, graphid_keys);
 
     if (entity->type == ENT_VERTEX)
     {
-        FuncCall *id_qual = make_qual(cpstate, entity, AG_EDGE_COLNAME_ID);
+        Node *id_qual = make_join_key(cpstate, entity, AG_VERTEX_COLNAME_ID,
+                                      graphid_keys);
 
-        expr = makeSimpleA_Expr(AEXPR_OP, "=", (Node *)qual, (Node *)id_qual,
-                                -1);
+        expr = makeA_Expr(AEXPR_OP, eq_op, qual, id_qual, -1);
 
         quals = lappend(quals, expr);
     }
     else if (entity->type == ENT_EDGE)
     {
-        List *edge_quals = make_edge_quals(cpstate, entity, side);
+        List *edge_quals = make_edge_quals(cpstate, entity, side,
+                                           graphid_keys);
 
         if (list_length(edge_quals) > 1)
-            expr = makeSimpleA_Expr(AEXPR_IN, "=", (Node *)qual,
-                                    (Node *)edge_quals, -1);
+            expr = makeA_Expr(AEXPR_IN, eq_op, qual, (Node *)edge_quals, -1);
         else
-            expr = makeSimpleA_Expr(AEXPR_OP, "=", (Node *)qual,
-                                    linitial(edge_quals), -1);
+            expr = makeA_Expr(AEXPR_OP, eq_op, qual, linitial(edge_quals),
+                              -1);
 
         quals = lappend(quals, expr);
     }
@@ -884,7 +1065,8 @@ static List *join_to_entity(cypher_parsestate *cpstate,
 // makes the quals neccessary when an edge is joining to another edge.
 static List *make_edge_quals(cypher_parsestate *cpstate,
                              transform_entity *edge,
-                             enum transform_entity_join_side side)
+                             enum transform_entity_join_side side,
+                             bool graphid_keys)
 {
     ParseState *pstate = (ParseState *)cpstate;
     char *left_dir;
@@ -923,16 +1105,19 @@ static List *make_edge_quals(cypher_parsestate *cpstate,
     {
     case CYPHER_REL_DIR_LEFT:
     {
-        return list_make1(make_qual(cpstate, edge, left_dir));
+        return list_make1(
+            make_join_key(cpstate, edge, left_dir, graphid_keys));
     }
     case CYPHER_REL_DIR_RIGHT:
     {
-        return list_make1(make_qual(cpstate, edge, right_dir));
+        return list_make1(
+            make_join_key(cpstate, edge, right_dir, graphid_keys));
     }
     case CYPHER_REL_DIR_NONE:
     {
-        return list_make2(make_qual(cpstate, edge, left_dir),
-                          make_qual(cpstate, edge, right_dir));
+        return list_make2(
+            make_join_key(cpstate, edge, left_dir, graphid_keys),
+            make_join_key(cpstate, edge, right_dir, graphid_keys));
     }
     default:
         ereport(ERROR,
@@ -944,31 +1129,75 @@ static List *make_edge_quals(cypher_parsestate *cpstate,
 }
 
 /*
- * Creates a node that will create a filter on the passed field node
- * that removes all labels that do not have the same label_id
+ * Creates the quals that remove all vertices that do not have the given label
+ * from the passed column of the edge.
+ *
+ * make_graphid() stores the label id in the upper bits of a graphid, so all
+ * graphids of a label fall into a single range. The range is used instead of
+ * comparing the extracted label id because the planner can use it with the
+ * indexes and statistics of the column.
  */
-static A_Expr *filter_vertices_on_label_id(cypher_parsestate *cpstate,
-                                           FuncCall *id_field, char *label)
+static List *filter_vertices_on_label_id(cypher_parsestate *cpstate,
+                                         transform_entity *edge,
+                                         char *col_name, char *label)
 {
     label_cache_data *lcd = search_label_name_graph_cache(label,
                                                           cpstate->graph_oid);
+    List *ge_op, *le_op;
+    Node *id_field;
+    char *const_type;
+    A_Expr *lower_bound, *upper_bound;
+    graphid min_id, max_id;
+
+    min_id = make_graphid(lcd->id, ENTRY_ID_MIN);
+    max_id = make_graphid(lcd->id, ENTRY_ID_MAX);
+
+    /*
+     * An edge from a previous clause is only available as an agtype, so the
+     * range is applied to its agtype accessor instead of the graphid column.
+     */
+    if (IsA(edge->expr, Var))
+    {
+        id_field = (Node *)make_qual(cpstate, edge, col_name);
+        const_type = "agtype";
+    }
+    else
+    {
+        id_field = (Node *)make_id_column_ref(edge, col_name);
+        const_type = "graphid";
+    }
+
+    ge_op = list_make2(makeString("ag_catalog"), makeString(">="));
+    le_op = list_make2(makeString("ag_catalog"), makeString("<="));
+
+    lower_bound = makeA_Expr(AEXPR_OP, ge_op, id_field,
+                             (Node *)make_graphid_const(min_id, const_type),
+                             -1);
+    upper_bound = makeA_Expr(AEXPR_OP, le_op, copyObject(id_field),
+                             (Node *)make_graphid_const(max_id, const_type),
+                             -1);
+
+    return list_make2(lower_bound, upper_bound);
+}
+
+// 'gid'::"ag_catalog".`type_name`
+static TypeCast *make_graphid_const(graphid gid, char *type_name)
+{
     A_Const *n;
-    FuncCall *fc;
-    Value *ag_catalog, *extract_label_id;
-    int32 label_id = lcd->id;
+    TypeCast *tc;
 
     n = makeNode(A_Const);
-    n->val.type = T_Integer;
-    n->val.val.ival = label_id;
+    n->val.type = T_String;
+    n->val.val.str = psprintf(INT64_FORMAT, gid);
     n->location = -1;
 
-    ag_catalog = makeString("ag_catalog");
-    extract_label_id = makeString("_extract_label_id");
-
-    fc = makeFuncCall(list_make2(ag_catalog, extract_label_id),
-                      list_make1(id_field), -1);
+    tc = makeNode(TypeCast);
+    tc->typeName = makeTypeNameFromNameList(
+        list_make2(makeString("ag_catalog"), makeString(type_name)));
+    tc->arg = (Node *)n;
+    tc->location = -1;
 
-    return makeSimpleA_Expr(AEXPR_OP, "=", (Node *)fc, (Node *)n, -1);
+    return tc;
 }
 
 static transform_entity *make_transform_entity(cypher_parsestate *cpstate,
@@ -1279,27 +1508,72 @@ static FuncCall *make_qual(cypher_parsestate *cpstate,
     }
     else
     {
-        char *entity_name;
-        ColumnRef *cr = makeNode(ColumnRef);
-
         // cast graphid to agtype
         qualified_name = list_make2(makeString("ag_catalog"),
                                     makeString("graphid_to_agtype"));
 
-        if (entity->type == ENT_EDGE)
-            entity_name = entity->entity.node->name;
-        else if (entity->type == ENT_VERTEX)
-            entity_name = entity->entity.rel->name;
-        else
-            ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-                            errmsg("unknown entity type")));
+        args = list_make1(make_id_column_ref(entity, col_name));
+    }
+
+    return makeFuncCall(qualified_name, args, -1);
+}
 
-        cr->fields = list_make2(makeString(entity_name), makeString(col_name));
+/*
+ * For the given entity that is not a variable, construct a reference to the
+ * graphid column col_name of its relation.
+ */
+static ColumnRef *make_id_column_ref(transform_entity *entity, char *col_name)
+{
+    char *entity_name;
+    ColumnRef *cr = makeNode(ColumnRef);
+
+    if (entity->type == ENT_EDGE)
+        entity_name = entity->entity.rel->name;
+    else if (entity->type == ENT_VERTEX)
+        entity_name = entity->entity.node->name;
+    else
+        ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                        errmsg("unknown entity type")));
+
+    cr->fields = list_make2(makeString(entity_name), makeString(col_name));
+    cr->location = -1;
+
+    return cr;
+}
+
+/*
+ * Returns whether the entity can be joined on a graphid. That is the case for
+ * entities scanned in the current query and for variables of an outer query.
+ */
+static bool has_graphid_join_key(transform_entity *entity)
+{
+    if (!IsA(entity->expr, Var))
+        return true;
+
+    return ((Var *)entity->expr)->varlevelsup > 0;
+}
+
+/*
+ * Returns the key used to join the entity on col_name. That is the graphid
+ * column itself, or the id of a variable cast to graphid, when graphid_keys is
+ * set, and its agtype value otherwise.
+ */
+static Node *make_join_key(cypher_parsestate *cpstate, transform_entity *entity,
+                           char *col_name, bool graphid_keys)
+{
+    if (graphid_keys && IsA(entity->expr, Var))
+    {
+        List *qualified_name = list_make2(makeString("ag_catalog"),
+                                          makeString("agtype_to_graphid"));
+        List *args = list_make1(make_qual(cpstate, entity, col_name));
 
-        args = list_make1(cr);
+        return (Node *)makeFuncCall(qualified_name, args, -1);
     }
 
-    return makeFuncCall(qualified_name, args, -1);
+    if (graphid_keys)
+        return (Node *)make_id_column_ref(entity, col_name);
+
+    return (Node *)make_qual(cpstate, entity, col_name);
 }
 
 static Expr *transform_cypher_edge(cypher_parsestate *cpstate,
@@ -1813,6 +2087,29 @@ transform_cypher_create_path(cypher_parsestate *cpstate, List **target_list,
     return ccp;
 }
 
+/*
+ * Opens and locks the relation the entities of the label are inserted into.
+ * That is the table of the label, unless it is partitioned.
+ */
+static Relation open_label_relation_for_insert(cypher_parsestate *cpstate,
+                                               char *label)
+{
+    RangeVar *rv;
+    Relation label_relation;
+    Oid relid;
+
+    rv = makeRangeVar(cpstate->graph_name, label, -1);
+    label_relation = parserOpenTable(&cpstate->pstate, rv, RowExclusiveLock);
+
+    if (label_relation->rd_rel->relkind != RELKIND_PARTITIONED_TABLE)
+        return label_relation;
+
+    relid = get_label_storage_relation(RelationGetRelid(label_relation));
+    heap_close(label_relation, NoLock);
+
+    return heap_open(relid, RowExclusiveLock);
+}
+
 static cypher_target_node *
 transform_create_cypher_edge(cypher_parsestate *cpstate, List **target_list,
                              cypher_relationship *edge)
@@ -1822,7 +2119,6 @@ transform_create_cypher_edge(cypher_parsestate *cpstate, List **target_list,
     List *targetList = NIL;
     Expr *id, *props;
     Relation label_relation;
-    RangeVar *rv;
     RangeTblEntry *rte;
     TargetEntry *te;
     char *alias;
@@ -1883,8 +2179,7 @@ transform_create_cypher_edge(cypher_parsestate *cpstate, List **target_list,
     }
 
     // lock the relation of the label
-    rv = makeRangeVar(cpstate->graph_name, edge->label, -1);
-    label_relation = parserOpenTable(&cpstate->pstate, rv, RowExclusiveLock);
+    label_relation = open_label_relation_for_insert(cpstate, edge->label);
 
     // Store the relid
     rel->relid = RelationGetRelid(label_relation);
@@ -2000,7 +2295,9 @@ static int get_target_entry_resno(List *target_list, char *name)
         TargetEntry *te = (TargetEntry *)lfirst(lc);
         if (!strcmp(te->resname, name))
         {
-            te->expr = add_volatile_wrapper(te->expr);
+            // the variable may be referred to more than once
+            if (!is_volatile_wrapper(te->expr))
+                te->expr = add_volatile_wrapper(te->expr);
             return te->resno;
         }
     }
@@ -2094,7 +2391,6 @@ transform_create_cypher_new_node(cypher_parsestate *cpstate,
     cypher_target_node *rel = palloc(sizeof(cypher_target_node));
     Node *id;
     Relation label_relation;
-    RangeVar *rv;
     RangeTblEntry *rte;
     TargetEntry *te;
     Expr *props;
@@ -2130,8 +2426,7 @@ transform_create_cypher_new_node(cypher_parsestate *cpstate,
 
     rel->flags = CYPHER_TARGET_NODE_FLAG_INSERT;
 
-    rv = makeRangeVar(cpstate->graph_name, node->label, -1);
-    label_relation = parserOpenTable(&cpstate->pstate, rv, RowExclusiveLock);
+    label_relation = open_label_relation_for_insert(cpstate, node->label);
 
     // Store the relid
     rel->relid = RelationGetRelid(label_relation);
@@ -2362,6 +2657,208 @@ transform_cypher_clause_as_subquery(cypher_parsestate *cpstate,
     return rte;
 }
 
+/*
+ * Every clause is transformed into a query over the subquery of the previous
+ * clause. The planner pulls simple subqueries up, but it keeps the join tree
+ * of each of them as a separate join list once more than from_collapse_limit
+ * relations would have to be merged. The relations of a long chain of clauses
+ * are then joined clause by clause, and quals and join orders cannot cross
+ * the boundaries of the clauses.
+ *
+ * To avoid that, the subqueries of the previous clauses are pulled up into
+ * the query here, as long as they are simple enough, so that the query is
+ * left with a single flat join tree.
+ */
+static void flatten_prev_cypher_clauses(Query *query)
+{
+    List *fromlist;
+    Bitmapset *pulled_up = NULL;
+    ListCell *lc;
+
+    if (query->jointree == NULL || query->setOperations != NULL)
+        return;
+
+    // only a plain list of relations and subqueries can be flattened
+    foreach (lc, query->jointree->fromlist)
+    {
+        if (!IsA(lfirst(lc), RangeTblRef))
+            return;
+    }
+
+    foreach (lc, query->rtable)
+    {
+        RangeTblEntry *rte = lfirst(lc);
+
+        if (rte->lateral)
+            return;
+    }
+
+    /*
+     * The fromlist of a subquery that is pulled up replaces its reference in
+     * the fromlist. It may refer to the subquery of another previous clause,
+     * so it is examined as well.
+     */
+    fromlist = query->jointree->fromlist;
+    query->jointree->fromlist = NIL;
+
+    while (fromlist != NIL)
+    {
+        RangeTblRef *rtr = linitial(fromlist);
+        RangeTblEntry *rte = rt_fetch(rtr->rtindex, query->rtable);
+        Query *subquery;
+
+        fromlist = list_delete_first(fromlist);
+
+        if (!is_simple_cypher_clause(query, rte))
+        {
+            query->jointree->fromlist = lappend(query->jointree->fromlist,
+                                                rtr);
+            continue;
+        }
+
+        subquery = rte->subquery;
+
+        pull_up_cypher_clause(query, rtr->rtindex);
+
+        fromlist = list_concat(list_copy(subquery->jointree->fromlist),
+                               fromlist);
+
+        pulled_up = bms_add_member(pulled_up, rtr->rtindex);
+    }
+
+    remove_pulled_up_rtes(query, pulled_up);
+}
+
+/*
+ * The subqueries that have been pulled up are not referred to anymore. Their
+ * entries are removed from the range table, so that the planner does not
+ * process their parts, which are now shared with the query, twice. The
+ * references to the entries after them are renumbered.
+ */
+static void remove_pulled_up_rtes(Query *query, Bitmapset *pulled_up)
+{
+    List *rtable = NIL;
+    ListCell *lc;
+    int rtindex = 0;
+    int removed = 0;
+
+    if (bms_is_empty(pulled_up))
+        return;
+
+    foreach (lc, query->rtable)
+    {
+        rtindex++;
+
+        if (bms_is_member(rtindex, pulled_up))
+        {
+            removed++;
+            continue;
+        }
+
+        /*
+         * No entry refers to rtindex - removed at this point. The ones before
+         * it have been renumbered to smaller indexes already.
+         */
+        if (removed > 0)
+            ChangeVarNodes((Node *)query, rtindex, rtindex - removed, 0);
+
+        rtable = lappend(rtable, lfirst(lc));
+    }
+
+    query->rtable = rtable;
+}
+
+/*
+ * Returns true if the given range table entry is the subquery of a previous
+ * clause that can be merged into the query without changing its semantics.
+ *
+ * Aggregation, DISTINCT, ORDER BY, SKIP, and LIMIT of a WITH clause must be
+ * done before the following clauses see the result. The target list of a
+ * CREATE clause has volatile functions in it, which must not be evaluated
+ * more or less often than the clause itself is. This is the ordering fence
+ * that keeps the following clauses after the CREATE clause.
+ */
+static bool is_simple_cypher_clause(Query *query, RangeTblEntry *rte)
+{
+    Query *subquery;
+    ListCell *lc;
+
+    if (rte->rtekind != RTE_SUBQUERY || rte->alias == NULL ||
+        strcmp(rte->alias->aliasname, PREV_CYPHER_CLAUSE_ALIAS) != 0)
+        return false;
+
+    subquery = rte->subquery;
+
+    if (subquery->commandType != CMD_SELECT ||
+        subquery->setOperations != NULL || subquery->cteList != NIL ||
+        subquery->hasAggs || subquery->hasWindowFuncs ||
+        subquery->hasTargetSRFs || subquery->hasForUpdate ||
+        subquery->groupClause != NIL || subquery->groupingSets != NIL ||
+        subquery->havingQual != NULL || subquery->sortClause != NIL ||
+        subquery->distinctClause != NIL || subquery->limitOffset != NULL ||
+        subquery->limitCount != NULL || subquery->rowMarks != NIL)
+        return false;
+
+    if (subquery->jointree == NULL ||
+        expression_returns_set((Node *)subquery->targetList) ||
+        contain_volatile_functions((Node *)subquery->targetList))
+        return false;
+
+    foreach (lc, subquery->jointree->fromlist)
+    {
+        if (!IsA(lfirst(lc), RangeTblRef))
+            return false;
+    }
+
+    foreach (lc, subquery->rtable)
+    {
+        RangeTblEntry *sub_rte = lfirst(lc);
+
+        if (sub_rte->lateral)
+            return false;
+    }
+
+    return true;
+}
+
+/*
+ * Merge the range table and the quals of the subquery at rtindex into the
+ * query, and replace the references to the subquery with the expressions of
+ * its target list. This is what pull_up_simple_subquery() does for a query
+ * whose join tree is a plain list. The caller takes care of the fromlist.
+ */
+static void pull_up_cypher_clause(Query *query, int rtindex)
+{
+    RangeTblEntry *rte = rt_fetch(rtindex, query->rtable);
+    Query *subquery = rte->subquery;
+    Node *quals;
+
+    OffsetVarNodes((Node *)subquery, list_length(query->rtable), 0);
+
+    query->rtable = list_concat(query->rtable, subquery->rtable);
+
+    quals = subquery->jointree->quals;
+    if (quals != NULL && query->jointree->quals != NULL)
+    {
+        quals = (Node *)makeBoolExpr(
+            AND_EXPR, list_make2(quals, query->jointree->quals), -1);
+    }
+    else if (quals == NULL)
+    {
+        quals = query->jointree->quals;
+    }
+
+    query->targetList = (List *)ReplaceVarsFromTargetList(
+        (Node *)query->targetList, rtindex, 0, rte, subquery->targetList,
+        REPLACEVARS_REPORT_ERROR, 0, &query->hasSubLinks);
+    query->jointree->quals = ReplaceVarsFromTargetList(
+        quals, rtindex, 0, rte, subquery->targetList,
+        REPLACEVARS_REPORT_ERROR, 0, &query->hasSubLinks);
+
+    if (subquery->hasSubLinks)
+        query->hasSubLinks = true;
+}
+
 static Query *analyze_cypher_clause(transform_method transform,
                                     cypher_clause *clause,
                                     cypher_parsestate *parent_cpstate)
@@ -2422,6 +2919,13 @@ static Expr *add_volatile_wrapper(Expr *node)
                                 InvalidOid, COERCE_EXPLICIT_CALL);
 }
 
+static bool is_volatile_wrapper(Expr *node)
+{
+    return IsA(node, FuncExpr) &&
+           is_oid_ag_func(((FuncExpr *)node)->funcid,
+                          "agtype_volatile_wrapper");
+}
+
 /*
  * from postgresql parse_sub_analyze
  * Entry point for recursively analyzing a sub-statement.
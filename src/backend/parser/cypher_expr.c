@@ -51,6 +51,8 @@
 #define FUNC_PROPERTIES {"properties", "properties", AGTYPEOID, 0, 0, AGTYPEOID, 1, 1, false}
 #define FUNC_SIZE       {"size",       "size",       ANYOID,    0, 0, AGTYPEOID, 1, 1, false}
 #define FUNC_STARTNODE  {"startNode",  "startnode",  AGTYPEOID, AGTYPEOID, 0, AGTYPEOID, 1, 2, true}
+#define FUNC_OUTDEGREE  {"outDegree",  "out_degree", AGTYPEOID, AGTYPEOID, 0, AGTYPEOID, 1, 2, true}
+#define FUNC_INDEGREE   {"inDegree",   "in_degree",  AGTYPEOID, AGTYPEOID, 0, AGTYPEOID, 1, 2, true}
 #define FUNC_TOBOOLEAN  {"toBoolean",  "toboolean",  ANYOID,    0, 0, AGTYPEOID, 1, 1, false}
 #define FUNC_TOFLOAT    {"toFloat",    "tofloat",    ANYOID,    0, 0, AGTYPEOID, 1, 1, false}
 #define FUNC_TOINTEGER  {"toInteger",  "tointeger",  ANYOID,    0, 0, AGTYPEOID, 1, 1, false}
@@ -67,7 +69,8 @@
                              FUNC_PROPERTIES, FUNC_SIZE, FUNC_STARTNODE, \
                              FUNC_TOINTEGER, FUNC_TOBOOLEAN, FUNC_TOFLOAT, \
                              FUNC_EXISTS, FUNC_TOSTRING, FUNC_REVERSE, \
-                             FUNC_TOUPPER, FUNC_TOLOWER}
+                             FUNC_TOUPPER, FUNC_TOLOWER, FUNC_OUTDEGREE, \
+                             FUNC_INDEGREE}
 
 /* structure for supported function signatures */
 typedef struct function_signature
@@ -16,7 +16,9 @@
 
 #include "postgres.h"
 
+#include "access/hash.h"
 #include "common/keywords.h"
+#include "lib/stringinfo.h"
 #include "nodes/pg_list.h"
 #include "parser/scansup.h"
 
@@ -139,3 +141,84 @@ List *parse_cypher(const char *s)
 
     return extra.result;
 }
+
+/*
+ * Returns a fingerprint of the tokens of the query string without the values
+ * of its literals, so that the queries that differ only in their literals,
+ * spacing, comments and the case of their keywords have the same one. The
+ * query string is appended to normalized with its literals replaced by "?".
+ */
+uint64 fingerprint_cypher(const char *s, StringInfo normalized)
+{
+    ag_scanner_t scanner;
+    StringInfoData jumble;
+    ag_token token;
+    // the end of the part of the query string appended so far
+    int copied = 0;
+    // the location of the last literal, until the end of it is known
+    int literal = -1;
+    uint64 fingerprint;
+
+    initStringInfo(&jumble);
+    scanner = ag_scanner_create(s);
+
+    do
+    {
+        token = ag_scanner_next_token(scanner);
+
+        // a literal ends with the spaces before the next token
+        if (literal >= 0)
+        {
+            int end = token.location;
+
+            while (end > literal && scanner_isspace(s[end - 1]))
+                end--;
+
+            appendBinaryStringInfo(normalized, s + copied, literal - copied);
+            appendStringInfoChar(normalized, '?');
+            copied = end;
+            literal = -1;
+        }
+
+        appendStringInfoChar(&jumble, (char)token.type);
+
+        switch (token.type)
+        {
+        case AG_TOKEN_INTEGER:
+        case AG_TOKEN_DECIMAL:
+        case AG_TOKEN_STRING:
+            literal = token.location;
+            break;
+        case AG_TOKEN_IDENTIFIER:
+        {
+            const ScanKeyword *keyword;
+
+            keyword = ScanKeywordLookup(token.value.s, cypher_keywords,
+                                        num_cypher_keywords);
+            appendStringInfoString(&jumble,
+                                   keyword ? keyword->name : token.value.s);
+            appendStringInfoChar(&jumble, '\0');
+            break;
+        }
+        case AG_TOKEN_PARAMETER:
+            appendStringInfoString(&jumble, token.value.s);
+            appendStringInfoChar(&jumble, '\0');
+            break;
+        case AG_TOKEN_CHAR:
+            appendStringInfoChar(&jumble, token.value.c);
+            break;
+        default:
+            break;
+        }
+    } while (token.type != AG_TOKEN_NULL);
+
+    appendStringInfoString(normalized, s + copied);
+
+    ag_scanner_destroy(scanner);
+
+    fingerprint = DatumGetUInt64(hash_any_extended(
+        (unsigned char *)jumble.data, jumble.len, 0));
+    pfree(jumble.data);
+
+    return fingerprint;
+}
@@ -44,6 +44,7 @@
 #include "utils/ag_float8_supp.h"
 #include "catalog/ag_graph.h"
 #include "catalog/ag_label.h"
+#include "commands/degree_commands.h"
 #include "utils/graphid.h"
 
 typedef struct agtype_in_state
@@ -128,6 +129,8 @@ static Datum get_vertex(const char *graph, const char *vertex_label,
 static Datum column_get_datum(TupleDesc tupdesc, HeapTuple tuple, int column,
                         const char *attname, Oid typid, bool isnull);
 static char *get_label_name(const char *graph_name, int64 graph_id);
+static Datum vertex_degree(FunctionCallInfo fcinfo, const char *func_name,
+                           bool outgoing);
 
 PG_FUNCTION_INFO_V1(agtype_in);
 
@@ -2166,6 +2169,16 @@ Datum bool_to_agtype(PG_FUNCTION_ARGS)
     return boolean_to_agtype(PG_GETARG_BOOL(0));
 }
 
+PG_FUNCTION_INFO_V1(int8_to_agtype);
+
+/*
+ * Cast bigint to agtype.
+ */
+Datum int8_to_agtype(PG_FUNCTION_ARGS)
+{
+    return integer_to_agtype(PG_GETARG_INT64(0));
+}
+
 /*
  * Helper function for agtype_access_operator map access.
  * Note: This function expects that a map and a scalar key are being passed.
@@ -3533,6 +3546,79 @@ Datum endnode(PG_FUNCTION_ARGS)
     return result;
 }
 
+PG_FUNCTION_INFO_V1(out_degree);
+
+Datum out_degree(PG_FUNCTION_ARGS)
+{
+    return vertex_degree(fcinfo, "outDegree", true);
+}
+
+PG_FUNCTION_INFO_V1(in_degree);
+
+Datum in_degree(PG_FUNCTION_ARGS)
+{
+    return vertex_degree(fcinfo, "inDegree", false);
+}
+
+/*
+ * Returns the number of outgoing or incoming edges of the vertex. It is read
+ * from the degree counters of the graph, if it has them.
+ */
+static Datum vertex_degree(FunctionCallInfo fcinfo, const char *func_name,
+                           bool outgoing)
+{
+    agtype *agt_arg = NULL;
+    agtype_value *agtv_object = NULL;
+    agtype_value *agtv_value = NULL;
+    char *graph_name = NULL;
+    int64 degree;
+
+    /* we need the graph name */
+    Assert(PG_ARGISNULL(0) == false);
+
+    /* get the graph name */
+    agt_arg = AG_GET_ARG_AGTYPE_P(0);
+    /* it must be a scalar and must be a string */
+    Assert(AGT_ROOT_IS_SCALAR(agt_arg));
+    agtv_object = get_ith_agtype_value_from_container(&agt_arg->root, 0);
+    Assert(agtv_object->type == AGTV_STRING);
+    graph_name = pnstrdup(agtv_object->val.string.val,
+                          agtv_object->val.string.len);
+
+    /* get the vertex */
+    agt_arg = AG_GET_ARG_AGTYPE_P(1);
+    /* check for a scalar object */
+    if (!AGT_ROOT_IS_SCALAR(agt_arg))
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                        errmsg("%s() argument must resolve to a scalar value",
+                               func_name)));
+    /* get the object */
+    agtv_object = get_ith_agtype_value_from_container(&agt_arg->root, 0);
+
+    /* is it an agtype null, return null if it is */
+    if (agtv_object->type == AGTV_NULL)
+        PG_RETURN_NULL();
+
+    /* check for proper agtype */
+    if (agtv_object->type != AGTV_VERTEX)
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                        errmsg("%s() argument must be a vertex or null",
+                               func_name)));
+
+    /* get the graphid of the vertex */
+    agtv_value = get_agtype_value_object_value(agtv_object, "id");
+    /* it must not be null and must be an integer */
+    Assert(agtv_value != NULL);
+    Assert(agtv_value->type == AGTV_INTEGER);
+
+    degree = get_vertex_degree(graph_name, agtv_value->val.int_value,
+                               outgoing);
+
+    pfree(graph_name);
+
+    return integer_to_agtype(degree);
+}
+
 PG_FUNCTION_INFO_V1(head);
 
 Datum head(PG_FUNCTION_ARGS)
@@ -4186,6 +4272,30 @@ Datum graphid_to_agtype(PG_FUNCTION_ARGS)
     PG_RETURN_POINTER(integer_to_agtype(AG_GETARG_GRAPHID(0)));
 }
 
+PG_FUNCTION_INFO_V1(agtype_to_graphid);
+
+/*
+ * Cast an agtype integer, such as the result of id(), to graphid. This lets
+ * the ids of variables be compared with the graphid columns of label tables.
+ */
+Datum agtype_to_graphid(PG_FUNCTION_ARGS)
+{
+    agtype *agtype_in = AG_GET_ARG_AGTYPE_P(0);
+    agtype_value agtv;
+
+    if (!agtype_extract_scalar(&agtype_in->root, &agtv))
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("cannot cast non-scalar agtype to type graphid")));
+
+    if (agtv.type != AGTV_INTEGER)
+        cannot_cast_agtype_value(agtv.type, "graphid");
+
+    PG_FREE_IF_COPY(agtype_in, 0);
+
+    AG_RETURN_GRAPHID(agtv.val.int_value);
+}
+
 PG_FUNCTION_INFO_V1(type);
 
 Datum type(PG_FUNCTION_ARGS)
@@ -0,0 +1,529 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * ANALYZE support for agtype
+ *
+ * The standard statistics of the column are computed first. Besides them,
+ * the most common top-level keys of the objects in the column are collected
+ * along with the statistics of their values. See utils/agtype_stats.h.
+ */
+
+#include "postgres.h"
+
+#include <math.h>
+
+#include "commands/vacuum.h"
+#include "fmgr.h"
+#include "utils/datum.h"
+
+#include "utils/agtype.h"
+#include "utils/agtype_stats.h"
+
+/*
+ * Values wider than this are not kept for MCVs and histograms, see
+ * WIDTH_THRESHOLD in analyze.c
+ */
+#define AGTYPE_STATS_WIDTH_THRESHOLD 1024
+
+// a non-null value of a top-level key in a sampled object
+typedef struct key_value
+{
+    char *key;
+    int key_len;
+    agtype *value; // NULL if the value is too wide
+} key_value;
+
+// the values of a top-level key in the sample
+typedef struct key_values
+{
+    key_value *values;
+    int count;
+} key_values;
+
+// a distinct value of a key and the number of times it appears in the sample
+typedef struct value_track
+{
+    agtype *value;
+    int count;
+    bool is_mcv;
+} value_track;
+
+// what std_typanalyze() has chosen to compute the standard statistics
+typedef struct agtype_analyze_data
+{
+    AnalyzeAttrComputeStatsFunc std_compute_stats;
+    void *std_extra_data;
+} agtype_analyze_data;
+
+static void compute_agtype_stats(VacAttrStats *stats,
+                                 AnalyzeAttrFetchFunc fetchfunc,
+                                 int samplerows, double totalrows);
+static agtype *compute_key_stats(VacAttrStats *stats, key_values *kv,
+                                 int samplerows, double totalrows);
+static int compare_key_values(const void *a, const void *b);
+static int compare_key_counts(const void *a, const void *b);
+static int compare_track_counts(const void *a, const void *b);
+static void push_string(agtype_parse_state **state, agtype_iterator_token seq,
+                        char *str, int len);
+static void push_float(agtype_parse_state **state, float8 f);
+static void push_agtype(agtype_parse_state **state, agtype *agt);
+
+PG_FUNCTION_INFO_V1(agtype_typanalyze);
+
+// see std_typanalyze()
+Datum agtype_typanalyze(PG_FUNCTION_ARGS)
+{
+    VacAttrStats *stats = (VacAttrStats *)PG_GETARG_POINTER(0);
+    agtype_analyze_data *data;
+
+    // std_typanalyze() sets attstattarget and minrows
+    if (!std_typanalyze(stats))
+        PG_RETURN_BOOL(false);
+
+    data = palloc(sizeof(*data));
+    data->std_compute_stats = stats->compute_stats;
+    data->std_extra_data = stats->extra_data;
+
+    stats->compute_stats = compute_agtype_stats;
+    stats->extra_data = data;
+
+    PG_RETURN_BOOL(true);
+}
+
+static void compute_agtype_stats(VacAttrStats *stats,
+                                 AnalyzeAttrFetchFunc fetchfunc,
+                                 int samplerows, double totalrows)
+{
+    agtype_analyze_data *data = stats->extra_data;
+    key_value *pairs;
+    int npairs = 0;
+    int max_pairs = 64;
+    key_values *keys;
+    int nkeys = 0;
+    int slot;
+    int i;
+
+    // the null fraction, the average width, MCVs, histogram and so on
+    stats->extra_data = data->std_extra_data;
+    data->std_compute_stats(stats, fetchfunc, samplerows, totalrows);
+    stats->extra_data = data;
+
+    // the per-key statistics go in the first slot that is left
+    for (slot = 0; slot < STATISTIC_NUM_SLOTS; slot++)
+    {
+        if (stats->stakind[slot] == 0)
+            break;
+    }
+    if (!stats->stats_valid || slot == STATISTIC_NUM_SLOTS)
+        return;
+
+    pairs = palloc(max_pairs * sizeof(*pairs));
+
+    for (i = 0; i < samplerows; i++)
+    {
+        Datum value;
+        bool isnull;
+        agtype *agt;
+        agtype_iterator *it;
+        agtype_iterator_token tok;
+        agtype_value v;
+        char *key = NULL;
+        int key_len = 0;
+
+        vacuum_delay_point();
+
+        value = fetchfunc(stats, i, &isnull);
+        if (isnull)
+            continue;
+
+        agt = DATUM_GET_AGTYPE_P(value);
+        if (!AGT_ROOT_IS_OBJECT(agt))
+            continue;
+
+        it = agtype_iterator_init(&agt->root);
+        while ((tok = agtype_iterator_next(&it, &v, true)) != WAGT_DONE)
+        {
+            if (tok == WAGT_KEY)
+            {
+                key = v.val.string.val;
+                key_len = v.val.string.len;
+                continue;
+            }
+
+            // a key with null is the same as a missing key
+            if (tok != WAGT_VALUE || v.type == AGTV_NULL)
+                continue;
+
+            if (npairs == max_pairs)
+            {
+                max_pairs *= 2;
+                pairs = repalloc(pairs, max_pairs * sizeof(*pairs));
+            }
+
+            pairs[npairs].key = key;
+            pairs[npairs].key_len = key_len;
+            if ((v.type == AGTV_STRING &&
+                 v.val.string.len > AGTYPE_STATS_WIDTH_THRESHOLD) ||
+                (v.type == AGTV_BINARY &&
+                 v.val.binary.len > AGTYPE_STATS_WIDTH_THRESHOLD))
+                pairs[npairs].value = NULL;
+            else
+                pairs[npairs].value = agtype_value_to_agtype(&v);
+            npairs++;
+        }
+    }
+
+    if (npairs == 0)
+        return;
+
+    // group the values by key, with the values of each key in order
+    qsort(pairs, npairs, sizeof(*pairs), compare_key_values);
+
+    keys = palloc(npairs * sizeof(*keys));
+    for (i = 0; i < npairs; i++)
+    {
+        if (nkeys > 0 &&
+            pairs[i].key_len == keys[nkeys - 1].values->key_len &&
+            memcmp(pairs[i].key, keys[nkeys - 1].values->key,
+                   pairs[i].key_len) == 0)
+        {
+            keys[nkeys - 1].count++;
+            continue;
+        }
+
+        keys[nkeys].values = &pairs[i];
+        keys[nkeys].count = 1;
+        nkeys++;
+    }
+
+    // keep the most common keys only
+    qsort(keys, nkeys, sizeof(*keys), compare_key_counts);
+    nkeys = Min(nkeys, stats->attr->attstattarget);
+
+    if (nkeys > 0)
+    {
+        Datum *key_stats;
+        MemoryContext old_mcxt;
+
+        key_stats = palloc(nkeys * sizeof(*key_stats));
+        for (i = 0; i < nkeys; i++)
+        {
+            agtype *s = compute_key_stats(stats, &keys[i], samplerows,
+                                          totalrows);
+
+            key_stats[i] = AGTYPE_P_GET_DATUM(s);
+        }
+
+        // the results must be in anl_context to survive
+        old_mcxt = MemoryContextSwitchTo(stats->anl_context);
+
+        stats->stakind[slot] = STATISTIC_KIND_AGTYPE_KEYS;
+        stats->staop[slot] = InvalidOid;
+        stats->stavalues[slot] = palloc(nkeys * sizeof(Datum));
+        for (i = 0; i < nkeys; i++)
+            stats->stavalues[slot][i] = datumCopy(key_stats[i], false, -1);
+        stats->numvalues[slot] = nkeys;
+
+        MemoryContextSwitchTo(old_mcxt);
+    }
+}
+
+/*
+ * Computes the statistics of the given key from its sorted values. This
+ * follows compute_scalar_stats() in analyze.c.
+ */
+static agtype *compute_key_stats(VacAttrStats *stats, key_values *kv,
+                                 int samplerows, double totalrows)
+{
+    int num_mcv = stats->attr->attstattarget;
+    int num_hist = stats->attr->attstattarget + 1;
+    value_track *tracks;
+    value_track **by_count;
+    int ntracks = 0;
+    int nwide = 0;
+    int nmcv = 0;
+    int f1 = 0;
+    int d;
+    double null_frac;
+    double n_distinct;
+    int nrest = 0;
+    int nrest_values = 0;
+    agtype_parse_state *state = NULL;
+    agtype_value *res;
+    int i;
+
+    tracks = palloc(kv->count * sizeof(*tracks));
+    for (i = 0; i < kv->count; i++)
+    {
+        agtype *value = kv->values[i].value;
+
+        if (!value)
+        {
+            nwide++;
+            continue;
+        }
+
+        if (ntracks > 0 &&
+            compare_agtype_containers_orderability(
+                &tracks[ntracks - 1].value->root, &value->root) == 0)
+        {
+            tracks[ntracks - 1].count++;
+            continue;
+        }
+
+        tracks[ntracks].value = value;
+        tracks[ntracks].count = 1;
+        tracks[ntracks].is_mcv = false;
+        ntracks++;
+    }
+
+    for (i = 0; i < ntracks; i++)
+    {
+        if (tracks[i].count == 1)
+            f1++;
+    }
+    // too wide values are assumed to be unique
+    f1 += nwide;
+    d = ntracks + nwide;
+
+    null_frac = 1.0 - (double)kv->count / samplerows;
+
+    // see the comments about the estimator in compute_scalar_stats()
+    if (f1 == d)
+    {
+        // every value is unique
+        n_distinct = -(double)kv->count / samplerows;
+    }
+    else if (f1 == 0)
+    {
+        // every value has been seen at least twice
+        n_distinct = d;
+    }
+    else
+    {
+        double n = kv->count;
+        double N = totalrows * n / samplerows;
+        double est = (n * d) / ((n - f1) + f1 * n / N);
+
+        if (est < d)
+            est = d;
+        if (est > N)
+            est = N;
+        n_distinct = floor(est + 0.5);
+    }
+
+    if (n_distinct > 0.1 * totalrows)
+        n_distinct = -(n_distinct / totalrows);
+
+    // the most common values
+    by_count = palloc(ntracks * sizeof(*by_count));
+    for (i = 0; i < ntracks; i++)
+        by_count[i] = &tracks[i];
+    qsort(by_count, ntracks, sizeof(*by_count), compare_track_counts);
+
+    if (nwide == 0 && n_distinct == ntracks && ntracks <= num_mcv)
+    {
+        // every value of the key has been seen
+        nmcv = ntracks;
+    }
+    else
+    {
+        double mincount = 1.25 * kv->count / d;
+
+        if (mincount < 2)
+            mincount = 2;
+
+        while (nmcv < ntracks && nmcv < num_mcv &&
+               by_count[nmcv]->count >= mincount)
+            nmcv++;
+    }
+
+    for (i = 0; i < nmcv; i++)
+        by_count[i]->is_mcv = true;
+
+    push_agtype_value(&state, WAGT_BEGIN_OBJECT, NULL);
+
+    push_string(&state, WAGT_KEY, AGTYPE_STATS_KEY,
+                strlen(AGTYPE_STATS_KEY));
+    push_string(&state, WAGT_VALUE, kv->values->key, kv->values->key_len);
+
+    push_string(&state, WAGT_KEY, AGTYPE_STATS_NULL_FRAC,
+                strlen(AGTYPE_STATS_NULL_FRAC));
+    push_float(&state, null_frac);
+
+    push_string(&state, WAGT_KEY, AGTYPE_STATS_N_DISTINCT,
+                strlen(AGTYPE_STATS_N_DISTINCT));
+    push_float(&state, n_distinct);
+
+    push_string(&state, WAGT_KEY, AGTYPE_STATS_MCV, strlen(AGTYPE_STATS_MCV));
+    push_agtype_value(&state, WAGT_BEGIN_ARRAY, NULL);
+    for (i = 0; i < nmcv; i++)
+        push_agtype(&state, by_count[i]->value);
+    push_agtype_value(&state, WAGT_END_ARRAY, NULL);
+
+    push_string(&state, WAGT_KEY, AGTYPE_STATS_MCV_FREQS,
+                strlen(AGTYPE_STATS_MCV_FREQS));
+    push_agtype_value(&state, WAGT_BEGIN_ARRAY, NULL);
+    for (i = 0; i < nmcv; i++)
+    {
+        agtype_value v;
+
+        v.type = AGTV_FLOAT;
+        v.val.float_value = (double)by_count[i]->count / samplerows;
+        push_agtype_value(&state, WAGT_ELEM, &v);
+    }
+    push_agtype_value(&state, WAGT_END_ARRAY, NULL);
+
+    /*
+     * The histogram is made of the rest of the values. The bounds are evenly
+     * spaced over the values in order, duplicates included.
+     */
+    for (i = 0; i < ntracks; i++)
+    {
+        if (!tracks[i].is_mcv)
+        {
+            nrest++;
+            nrest_values += tracks[i].count;
+        }
+    }
+    num_hist = Min(num_hist, nrest);
+
+    push_string(&state, WAGT_KEY, AGTYPE_STATS_HISTOGRAM,
+                strlen(AGTYPE_STATS_HISTOGRAM));
+    push_agtype_value(&state, WAGT_BEGIN_ARRAY, NULL);
+    if (num_hist >= 2)
+    {
+        int t = 0;
+        int before = 0; // number of values in the tracks before t
+
+        for (i = 0; i < num_hist; i++)
+        {
+            int pos = (int)(((int64)i * (nrest_values - 1)) / (num_hist - 1));
+
+            for (;;)
+            {
+                if (!tracks[t].is_mcv)
+                {
+                    if (pos < before + tracks[t].count)
+                        break;
+                    before += tracks[t].count;
+                }
+                t++;
+            }
+
+            push_agtype(&state, tracks[t].value);
+        }
+    }
+    push_agtype_value(&state, WAGT_END_ARRAY, NULL);
+
+    res = push_agtype_value(&state, WAGT_END_OBJECT, NULL);
+
+    return agtype_value_to_agtype(res);
+}
+
+// orders key_value's by key and then by value, with too wide values last
+static int compare_key_values(const void *a, const void *b)
+{
+    const key_value *kva = a;
+    const key_value *kvb = b;
+    int cmp;
+
+    cmp = memcmp(kva->key, kvb->key, Min(kva->key_len, kvb->key_len));
+    if (cmp != 0)
+        return cmp;
+    if (kva->key_len != kvb->key_len)
+        return (kva->key_len < kvb->key_len) ? -1 : 1;
+
+    if (!kva->value || !kvb->value)
+        return (kva->value ? -1 : 0) + (kvb->value ? 1 : 0);
+
+    return compare_agtype_containers_orderability(&kva->value->root,
+                                                  &kvb->value->root);
+}
+
+// orders key_values's by the number of values, the most common key first
+static int compare_key_counts(const void *a, const void *b)
+{
+    const key_values *kva = a;
+    const key_values *kvb = b;
+
+    if (kva->count != kvb->count)
+        return (kva->count > kvb->count) ? -1 : 1;
+
+    // keep the order of the keys for the same number of values
+    if (kva->values != kvb->values)
+        return (kva->values < kvb->values) ? -1 : 1;
+
+    return 0;
+}
+
+// orders value_track's by count, the most common value first
+static int compare_track_counts(const void *a, const void *b)
+{
+    const value_track *ta = *(const value_track **)a;
+    const value_track *tb = *(const value_track **)b;
+
+    if (ta->count != tb->count)
+        return (ta->count > tb->count) ? -1 : 1;
+
+    // keep the order of the values for the same count
+    if (ta != tb)
+        return (ta < tb) ? -1 : 1;
+
+    return 0;
+}
+
+static void push_string(agtype_parse_state **state, agtype_iterator_token seq,
+                        char *str, int len)
+{
+    agtype_value v;
+
+    v.type = AGTV_STRING;
+    v.val.string.len = len;
+    v.val.string.val = str;
+
+    push_agtype_value(state, seq, &v);
+}
+
+static void push_float(agtype_parse_state **state, float8 f)
+{
+    agtype_value v;
+
+    v.type = AGTV_FLOAT;
+    v.val.float_value = f;
+
+    push_agtype_value(state, WAGT_VALUE, &v);
+}
+
+// pushes the given agtype as an element of an array
+static void push_agtype(agtype_parse_state **state, agtype *agt)
+{
+    agtype_value v;
+
+    if (AGT_ROOT_IS_SCALAR(agt))
+    {
+        v = *get_ith_agtype_value_from_container(&agt->root, 0);
+    }
+    else
+    {
+        v.type = AGTV_BINARY;
+        v.val.binary.len = VARSIZE(agt) - VARHDRSZ;
+        v.val.binary.data = &agt->root;
+    }
+
+    push_agtype_value(state, WAGT_ELEM, &v);
+}
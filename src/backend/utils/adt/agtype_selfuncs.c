@@ -0,0 +1,528 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Restriction selectivity estimation for agtype comparison operators
+ *
+ * A comparison between a property of an entity, such as n.age < 30, and a
+ * constant is estimated from the per-key statistics gathered by
+ * agtype_typanalyze(). Everything else is left to the generic estimators.
+ */
+
+#include "postgres.h"
+
+#include "access/htup_details.h"
+#include "fmgr.h"
+#include "nodes/primnodes.h"
+#include "nodes/relation.h"
+#include "optimizer/clauses.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/selfuncs.h"
+
+#include "utils/ag_func.h"
+#include "utils/agtype.h"
+#include "utils/agtype_stats.h"
+
+typedef enum agtype_sel_op
+{
+    AGTYPE_SEL_EQ,
+    AGTYPE_SEL_NE,
+    AGTYPE_SEL_LT,
+    AGTYPE_SEL_LE,
+    AGTYPE_SEL_GT,
+    AGTYPE_SEL_GE
+} agtype_sel_op;
+
+static bool property_selectivity(FunctionCallInfo fcinfo, agtype_sel_op op,
+                                 Selectivity *selec);
+static bool get_property_access(Node *node, Node **properties, agtype **key);
+static agtype *find_key_stats(AttStatsSlot *sslot, agtype *key);
+static Selectivity key_stats_selectivity(agtype *key_stats, agtype_sel_op op,
+                                         agtype *value, double ntuples);
+static double histogram_selectivity(agtype_container *hist, agtype *value,
+                                    bool inclusive);
+static agtype_value *get_key_stats_field(agtype *key_stats, char *field);
+static double get_float_value(agtype_value *v, double default_value);
+static bool get_number_value(agtype *agt, double *number);
+static bool op_matches(agtype_sel_op op, int cmp);
+
+PG_FUNCTION_INFO_V1(agtype_eqsel);
+
+Datum agtype_eqsel(PG_FUNCTION_ARGS)
+{
+    Selectivity selec;
+
+    if (property_selectivity(fcinfo, AGTYPE_SEL_EQ, &selec))
+        PG_RETURN_FLOAT8((float8)selec);
+
+    return eqsel(fcinfo);
+}
+
+PG_FUNCTION_INFO_V1(agtype_neqsel);
+
+Datum agtype_neqsel(PG_FUNCTION_ARGS)
+{
+    Selectivity selec;
+
+    if (property_selectivity(fcinfo, AGTYPE_SEL_NE, &selec))
+        PG_RETURN_FLOAT8((float8)selec);
+
+    return neqsel(fcinfo);
+}
+
+PG_FUNCTION_INFO_V1(agtype_ltsel);
+
+Datum agtype_ltsel(PG_FUNCTION_ARGS)
+{
+    Selectivity selec;
+
+    if (property_selectivity(fcinfo, AGTYPE_SEL_LT, &selec))
+        PG_RETURN_FLOAT8((float8)selec);
+
+    return scalarltsel(fcinfo);
+}
+
+PG_FUNCTION_INFO_V1(agtype_lesel);
+
+Datum agtype_lesel(PG_FUNCTION_ARGS)
+{
+    Selectivity selec;
+
+    if (property_selectivity(fcinfo, AGTYPE_SEL_LE, &selec))
+        PG_RETURN_FLOAT8((float8)selec);
+
+    return scalarlesel(fcinfo);
+}
+
+PG_FUNCTION_INFO_V1(agtype_gtsel);
+
+Datum agtype_gtsel(PG_FUNCTION_ARGS)
+{
+    Selectivity selec;
+
+    if (property_selectivity(fcinfo, AGTYPE_SEL_GT, &selec))
+        PG_RETURN_FLOAT8((float8)selec);
+
+    return scalargtsel(fcinfo);
+}
+
+PG_FUNCTION_INFO_V1(agtype_gesel);
+
+Datum agtype_gesel(PG_FUNCTION_ARGS)
+{
+    Selectivity selec;
+
+    if (property_selectivity(fcinfo, AGTYPE_SEL_GE, &selec))
+        PG_RETURN_FLOAT8((float8)selec);
+
+    return scalargesel(fcinfo);
+}
+
+/*
+ * Estimates the selectivity of "property op constant" (or the commuted form)
+ * from the per-key statistics of the properties. Returns false if the clause
+ * is not of this form or there are no statistics for the key.
+ */
+static bool property_selectivity(FunctionCallInfo fcinfo, agtype_sel_op op,
+                                 Selectivity *selec)
+{
+    PlannerInfo *root = (PlannerInfo *)PG_GETARG_POINTER(0);
+    List *args = (List *)PG_GETARG_POINTER(2);
+    int varRelid = PG_GETARG_INT32(3);
+    Node *properties;
+    agtype *key;
+    Node *other;
+    Const *c;
+    VariableStatData vardata;
+    AttStatsSlot sslot;
+    bool found = false;
+
+    if (list_length(args) != 2)
+        return false;
+
+    if (get_property_access(linitial(args), &properties, &key))
+    {
+        other = lsecond(args);
+    }
+    else if (get_property_access(lsecond(args), &properties, &key))
+    {
+        other = linitial(args);
+
+        // commute the operator
+        if (op == AGTYPE_SEL_LT)
+            op = AGTYPE_SEL_GT;
+        else if (op == AGTYPE_SEL_LE)
+            op = AGTYPE_SEL_GE;
+        else if (op == AGTYPE_SEL_GT)
+            op = AGTYPE_SEL_LT;
+        else if (op == AGTYPE_SEL_GE)
+            op = AGTYPE_SEL_LE;
+    }
+    else
+    {
+        return false;
+    }
+
+    other = estimate_expression_value(root, other);
+    if (!IsA(other, Const))
+        return false;
+
+    c = (Const *)other;
+    if (c->constisnull)
+    {
+        *selec = 0.0;
+        return true;
+    }
+
+    examine_variable(root, properties, varRelid, &vardata);
+
+    if (HeapTupleIsValid(vardata.statsTuple) &&
+        get_attstatsslot(&sslot, vardata.statsTuple,
+                         STATISTIC_KIND_AGTYPE_KEYS, InvalidOid,
+                         ATTSTATSSLOT_VALUES))
+    {
+        agtype *key_stats = find_key_stats(&sslot, key);
+
+        if (key_stats)
+        {
+            double ntuples = vardata.rel ? vardata.rel->tuples : 0;
+
+            *selec = key_stats_selectivity(key_stats, op,
+                                           DATUM_GET_AGTYPE_P(c->constvalue),
+                                           ntuples);
+            found = true;
+        }
+
+        free_attstatsslot(&sslot);
+    }
+
+    ReleaseVariableStats(vardata);
+
+    return found;
+}
+
+/*
+ * Checks whether the given node is an access to a top-level property, that is
+ * agtype_access_operator(properties, key) where properties is either an
+ * agtype column or a vertex or an edge that is built from one.
+ */
+static bool get_property_access(Node *node, Node **properties, agtype **key)
+{
+    FuncExpr *func;
+    List *args;
+    Node *base;
+    Node *key_node;
+    agtype *key_agt;
+
+    if (!IsA(node, FuncExpr))
+        return false;
+
+    func = (FuncExpr *)node;
+    if (!is_oid_ag_func(func->funcid, "agtype_access_operator"))
+        return false;
+
+    args = func->args;
+    if (list_length(args) == 1 && IsA(linitial(args), ArrayExpr))
+        args = ((ArrayExpr *)linitial(args))->elements;
+
+    if (list_length(args) != 2)
+        return false;
+
+    base = linitial(args);
+    key_node = lsecond(args);
+
+    if (!IsA(key_node, Const) || ((Const *)key_node)->constisnull)
+        return false;
+
+    key_agt = DATUM_GET_AGTYPE_P(((Const *)key_node)->constvalue);
+    if (!AGT_ROOT_IS_SCALAR(key_agt) ||
+        get_ith_agtype_value_from_container(&key_agt->root, 0)->type !=
+            AGTV_STRING)
+        return false;
+
+    // the properties are the last argument of the entity
+    if (IsA(base, FuncExpr) &&
+        (is_oid_ag_func(((FuncExpr *)base)->funcid, "_agtype_build_vertex") ||
+         is_oid_ag_func(((FuncExpr *)base)->funcid, "_agtype_build_edge")))
+        base = llast(((FuncExpr *)base)->args);
+
+    if (!IsA(base, Var))
+        return false;
+
+    *properties = base;
+    *key = key_agt;
+
+    return true;
+}
+
+static agtype *find_key_stats(AttStatsSlot *sslot, agtype *key)
+{
+    agtype_value *key_value;
+    int i;
+
+    key_value = get_ith_agtype_value_from_container(&key->root, 0);
+
+    for (i = 0; i < sslot->nvalues; i++)
+    {
+        agtype *key_stats = DATUM_GET_AGTYPE_P(sslot->values[i]);
+        agtype_value *v;
+
+        v = get_key_stats_field(key_stats, AGTYPE_STATS_KEY);
+        if (v && v->type == AGTV_STRING &&
+            v->val.string.len == key_value->val.string.len &&
+            memcmp(v->val.string.val, key_value->val.string.val,
+                   v->val.string.len) == 0)
+            return key_stats;
+    }
+
+    return NULL;
+}
+
+// see var_eq_const() and scalarineqsel()
+static Selectivity key_stats_selectivity(agtype *key_stats, agtype_sel_op op,
+                                         agtype *value, double ntuples)
+{
+    double null_frac;
+    double n_distinct;
+    agtype_value *mcv;
+    agtype_value *mcv_freqs;
+    agtype_value *hist;
+    int nmcv = 0;
+    double mcv_total = 0.0;
+    double mcv_selec = 0.0;
+    double min_mcv_freq = 1.0;
+    bool mcv_match = false;
+    double other_frac;
+    Selectivity selec;
+    int i;
+
+    null_frac = get_float_value(
+        get_key_stats_field(key_stats, AGTYPE_STATS_NULL_FRAC), 0.0);
+    n_distinct = get_float_value(
+        get_key_stats_field(key_stats, AGTYPE_STATS_N_DISTINCT), 0.0);
+    mcv = get_key_stats_field(key_stats, AGTYPE_STATS_MCV);
+    mcv_freqs = get_key_stats_field(key_stats, AGTYPE_STATS_MCV_FREQS);
+    hist = get_key_stats_field(key_stats, AGTYPE_STATS_HISTOGRAM);
+
+    if (mcv && mcv_freqs && mcv->type == AGTV_BINARY &&
+        mcv_freqs->type == AGTV_BINARY)
+        nmcv = Min(AGTYPE_CONTAINER_SIZE(mcv->val.binary.data),
+                   AGTYPE_CONTAINER_SIZE(mcv_freqs->val.binary.data));
+
+    for (i = 0; i < nmcv; i++)
+    {
+        agtype_value *elem;
+        agtype *mcv_value;
+        double freq;
+        int cmp;
+
+        elem = get_ith_agtype_value_from_container(mcv->val.binary.data, i);
+        mcv_value = agtype_value_to_agtype(elem);
+        freq = get_float_value(
+            get_ith_agtype_value_from_container(mcv_freqs->val.binary.data, i),
+            0.0);
+
+        cmp = compare_agtype_containers_orderability(&mcv_value->root,
+                                                     &value->root);
+        if (op_matches(op, cmp))
+            mcv_selec += freq;
+        if (cmp == 0)
+            mcv_match = true;
+
+        mcv_total += freq;
+        if (freq < min_mcv_freq)
+            min_mcv_freq = freq;
+    }
+
+    other_frac = 1.0 - null_frac - mcv_total;
+    CLAMP_PROBABILITY(other_frac);
+
+    if (op == AGTYPE_SEL_EQ || op == AGTYPE_SEL_NE)
+    {
+        Selectivity eq_selec;
+
+        if (mcv_match)
+        {
+            eq_selec = (op == AGTYPE_SEL_EQ) ? mcv_selec
+                                             : mcv_total - mcv_selec;
+        }
+        else
+        {
+            double nd;
+
+            // the value is one of the rest of the values
+            if (n_distinct < 0)
+                nd = -n_distinct * ntuples;
+            else
+                nd = n_distinct;
+            nd -= nmcv;
+
+            eq_selec = (nd > 1) ? other_frac / nd : other_frac;
+            if (nmcv > 0 && eq_selec > min_mcv_freq)
+                eq_selec = min_mcv_freq;
+        }
+
+        if (op == AGTYPE_SEL_EQ)
+            selec = eq_selec;
+        else
+            selec = 1.0 - null_frac - eq_selec;
+    }
+    else
+    {
+        double hist_selec;
+
+        if (hist && hist->type == AGTV_BINARY &&
+            AGTYPE_CONTAINER_SIZE(hist->val.binary.data) >= 2)
+        {
+            bool inclusive = (op == AGTYPE_SEL_LE || op == AGTYPE_SEL_GT);
+
+            // the fraction of the rest of the values below the value
+            hist_selec = histogram_selectivity(hist->val.binary.data, value,
+                                               inclusive);
+            if (op == AGTYPE_SEL_GT || op == AGTYPE_SEL_GE)
+                hist_selec = 1.0 - hist_selec;
+        }
+        else
+        {
+            hist_selec = DEFAULT_INEQ_SEL;
+        }
+
+        selec = mcv_selec + hist_selec * other_frac;
+    }
+
+    CLAMP_PROBABILITY(selec);
+
+    return selec;
+}
+
+/*
+ * Returns the fraction of the histogram that is below the given value, or
+ * below or equal to it if inclusive is true. See ineq_histogram_selectivity().
+ */
+static double histogram_selectivity(agtype_container *hist, agtype *value,
+                                    bool inclusive)
+{
+    int nbounds = AGTYPE_CONTAINER_SIZE(hist);
+    agtype *lower = NULL;
+    agtype *upper = NULL;
+    int nbelow = 0;
+    double lower_num;
+    double upper_num;
+    double value_num;
+    double binfrac = 0.5;
+    int i;
+
+    for (i = 0; i < nbounds; i++)
+    {
+        agtype *bound;
+        int cmp;
+
+        bound = agtype_value_to_agtype(
+            get_ith_agtype_value_from_container(hist, i));
+        cmp = compare_agtype_containers_orderability(&bound->root,
+                                                     &value->root);
+        if (cmp > 0 || (cmp == 0 && !inclusive))
+        {
+            upper = bound;
+            break;
+        }
+
+        lower = bound;
+        nbelow++;
+    }
+
+    if (nbelow == 0)
+        return 0.0;
+    if (nbelow == nbounds)
+        return 1.0;
+
+    // interpolate within the bin if the values are numbers
+    if (get_number_value(lower, &lower_num) &&
+        get_number_value(upper, &upper_num) &&
+        get_number_value(value, &value_num) && upper_num > lower_num)
+    {
+        binfrac = (value_num - lower_num) / (upper_num - lower_num);
+        CLAMP_PROBABILITY(binfrac);
+    }
+
+    return ((nbelow - 1) + binfrac) / (nbounds - 1);
+}
+
+static agtype_value *get_key_stats_field(agtype *key_stats, char *field)
+{
+    agtype_value key;
+
+    if (!AGT_ROOT_IS_OBJECT(key_stats))
+        return NULL;
+
+    key.type = AGTV_STRING;
+    key.val.string.len = strlen(field);
+    key.val.string.val = field;
+
+    return find_agtype_value_from_container(&key_stats->root, AGT_FOBJECT,
+                                            &key);
+}
+
+static double get_float_value(agtype_value *v, double default_value)
+{
+    if (!v)
+        return default_value;
+    if (v->type == AGTV_FLOAT)
+        return v->val.float_value;
+    if (v->type == AGTV_INTEGER)
+        return (double)v->val.int_value;
+
+    return default_value;
+}
+
+static bool get_number_value(agtype *agt, double *number)
+{
+    agtype_value *v;
+
+    if (!AGT_ROOT_IS_SCALAR(agt))
+        return false;
+
+    v = get_ith_agtype_value_from_container(&agt->root, 0);
+    if (v->type != AGTV_INTEGER && v->type != AGTV_FLOAT)
+        return false;
+
+    *number = get_float_value(v, 0.0);
+
+    return true;
+}
+
+// cmp is the result of comparing a value with the constant
+static bool op_matches(agtype_sel_op op, int cmp)
+{
+    switch (op)
+    {
+    case AGTYPE_SEL_EQ:
+        return cmp == 0;
+    case AGTYPE_SEL_NE:
+        return cmp != 0;
+    case AGTYPE_SEL_LT:
+        return cmp < 0;
+    case AGTYPE_SEL_LE:
+        return cmp <= 0;
+    case AGTYPE_SEL_GT:
+        return cmp > 0;
+    case AGTYPE_SEL_GE:
+        return cmp >= 0;
+    }
+
+    return false;
+}
@@ -158,6 +158,22 @@ static int graphid_btree_fast_cmp(Datum x, Datum y, SortSupport ssup)
         return -1;
 }
 
+PG_FUNCTION_INFO_V1(graphid_hash);
+
+// graphids are hashed the same way as bigints
+Datum graphid_hash(PG_FUNCTION_ARGS)
+{
+    return DirectFunctionCall1(hashint8, PG_GETARG_DATUM(0));
+}
+
+PG_FUNCTION_INFO_V1(graphid_hash_extended);
+
+Datum graphid_hash_extended(PG_FUNCTION_ARGS)
+{
+    return DirectFunctionCall2(hashint8extended, PG_GETARG_DATUM(0),
+                               PG_GETARG_DATUM(1));
+}
+
 graphid make_graphid(const int32 label_id, const int64 entry_id)
 {
     uint64 tmp;
@@ -0,0 +1,285 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Join selectivity estimation for graphid =
+ *
+ * The generic estimator only knows the number of distinct start_id's and
+ * end_id's of the edges, not which labels the vertices they refer to have. So
+ * the joins between edges and their vertices are estimated from the graph
+ * statistics gathered by analyze_graph() instead, if there are any.
+ *
+ * The inner joins are estimated from the number of edges between the labels,
+ * and the semi-joins and anti-joins of vertices with their edges from the
+ * number of vertices that have such edges.
+ */
+
+#include "postgres.h"
+
+#include "catalog/pg_inherits.h"
+#include "fmgr.h"
+#include "nodes/primnodes.h"
+#include "nodes/relation.h"
+#include "optimizer/pathnode.h"
+#include "parser/parsetree.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/selfuncs.h"
+
+#include "catalog/ag_label.h"
+#include "commands/graph_stats_commands.h"
+#include "utils/ag_cache.h"
+
+static bool edge_vertex_join_selectivity(PlannerInfo *root, Node *edge_side,
+                                         Node *vertex_side,
+                                         Selectivity *selec);
+static bool vertex_edge_semijoin_selectivity(PlannerInfo *root,
+                                             Node *edge_side,
+                                             Node *vertex_side,
+                                             SpecialJoinInfo *sjinfo,
+                                             Selectivity *selec);
+static bool get_edge_vertex_vars(PlannerInfo *root, Node *edge_side,
+                                 Node *vertex_side, Var **edge_var,
+                                 Var **vertex_var, bool *start);
+static label_cache_data *get_label_var(PlannerInfo *root, Node *node,
+                                       char kind, Var **var);
+static List *get_label_ids(Oid relid);
+
+PG_FUNCTION_INFO_V1(graphid_eqjoinsel);
+
+Datum graphid_eqjoinsel(PG_FUNCTION_ARGS)
+{
+    PlannerInfo *root = (PlannerInfo *)PG_GETARG_POINTER(0);
+    List *args = (List *)PG_GETARG_POINTER(2);
+    JoinType jointype = (JoinType)PG_GETARG_INT16(3);
+    SpecialJoinInfo *sjinfo = (SpecialJoinInfo *)PG_GETARG_POINTER(4);
+    Selectivity selec;
+
+    if (list_length(args) != 2)
+        return eqjoinsel(fcinfo);
+
+    if (jointype == JOIN_INNER)
+    {
+        if (edge_vertex_join_selectivity(root, linitial(args), lsecond(args),
+                                         &selec) ||
+            edge_vertex_join_selectivity(root, lsecond(args), linitial(args),
+                                         &selec))
+            PG_RETURN_FLOAT8((float8)selec);
+    }
+    else if (jointype == JOIN_SEMI || jointype == JOIN_ANTI)
+    {
+        // the caller turns the selectivity of a semi-join into an anti-join's
+        if (vertex_edge_semijoin_selectivity(root, linitial(args),
+                                             lsecond(args), sjinfo, &selec) ||
+            vertex_edge_semijoin_selectivity(root, lsecond(args),
+                                             linitial(args), sjinfo, &selec))
+            PG_RETURN_FLOAT8((float8)selec);
+    }
+
+    return eqjoinsel(fcinfo);
+}
+
+/*
+ * Estimates edge.start_id = vertex.id (or edge.end_id = vertex.id). The
+ * number of rows of the join is the number of the edges that start (or end)
+ * at a vertex of the labels of the vertex relation, and each of them matches
+ * exactly one vertex. So the selectivity is the fraction of such edges over
+ * the number of the vertices.
+ */
+static bool edge_vertex_join_selectivity(PlannerInfo *root, Node *edge_side,
+                                         Node *vertex_side, Selectivity *selec)
+{
+    Var *edge_var;
+    Var *vertex_var;
+    RangeTblEntry *edge_rte;
+    RangeTblEntry *vertex_rte;
+    RelOptInfo *vertex_rel;
+    double fraction;
+    bool start;
+
+    if (!get_edge_vertex_vars(root, edge_side, vertex_side, &edge_var,
+                              &vertex_var, &start))
+        return false;
+
+    vertex_rel = find_base_rel(root, vertex_var->varno);
+    if (vertex_rel->tuples <= 0)
+        return false;
+
+    edge_rte = planner_rt_fetch(edge_var->varno, root);
+    vertex_rte = planner_rt_fetch(vertex_var->varno, root);
+
+    if (!get_edge_label_pair_fraction(get_rel_namespace(edge_rte->relid),
+                                      get_label_ids(edge_rte->relid),
+                                      get_label_ids(vertex_rte->relid), start,
+                                      &fraction))
+        return false;
+
+    *selec = fraction / vertex_rel->tuples;
+    CLAMP_PROBABILITY(*selec);
+
+    return true;
+}
+
+/*
+ * Estimates the semi-join of vertices with their edges on vertex.id =
+ * edge.start_id (or edge.end_id), that is the fraction of the vertices that
+ * have at least one such edge. The number of distinct start_id's of the edges
+ * cannot tell it because it counts the vertices of all labels.
+ *
+ * Semi-joins of edges with their vertices are estimated as the fraction of
+ * the edges that start (or end) at a vertex of the labels.
+ */
+static bool vertex_edge_semijoin_selectivity(PlannerInfo *root,
+                                             Node *edge_side,
+                                             Node *vertex_side,
+                                             SpecialJoinInfo *sjinfo,
+                                             Selectivity *selec)
+{
+    Var *edge_var;
+    Var *vertex_var;
+    RangeTblEntry *edge_rte;
+    RangeTblEntry *vertex_rte;
+    RelOptInfo *vertex_rel;
+    Oid graph_namespace;
+    List *edge_label_ids;
+    List *vertex_label_ids;
+    bool start;
+
+    if (!sjinfo ||
+        !get_edge_vertex_vars(root, edge_side, vertex_side, &edge_var,
+                              &vertex_var, &start))
+        return false;
+
+    edge_rte = planner_rt_fetch(edge_var->varno, root);
+    vertex_rte = planner_rt_fetch(vertex_var->varno, root);
+
+    graph_namespace = get_rel_namespace(edge_rte->relid);
+    edge_label_ids = get_label_ids(edge_rte->relid);
+    vertex_label_ids = get_label_ids(vertex_rte->relid);
+
+    if (bms_is_member(vertex_var->varno, sjinfo->syn_lefthand) &&
+        bms_is_member(edge_var->varno, sjinfo->syn_righthand))
+    {
+        double vertices;
+
+        vertex_rel = find_base_rel(root, vertex_var->varno);
+        if (vertex_rel->tuples <= 0)
+            return false;
+
+        if (!get_edge_label_vertices(graph_namespace, edge_label_ids,
+                                     vertex_label_ids, start, &vertices))
+            return false;
+
+        *selec = vertices / vertex_rel->tuples;
+    }
+    else if (bms_is_member(edge_var->varno, sjinfo->syn_lefthand) &&
+             bms_is_member(vertex_var->varno, sjinfo->syn_righthand))
+    {
+        double fraction;
+
+        if (!get_edge_label_pair_fraction(graph_namespace, edge_label_ids,
+                                          vertex_label_ids, start, &fraction))
+            return false;
+
+        *selec = fraction;
+    }
+    else
+    {
+        return false;
+    }
+
+    CLAMP_PROBABILITY(*selec);
+
+    return true;
+}
+
+/*
+ * Checks to see if edge_side is the start_id or end_id column of an edge
+ * label table and vertex_side the id column of a vertex label table of the
+ * same graph.
+ */
+static bool get_edge_vertex_vars(PlannerInfo *root, Node *edge_side,
+                                 Node *vertex_side, Var **edge_var,
+                                 Var **vertex_var, bool *start)
+{
+    label_cache_data *edge_label;
+    label_cache_data *vertex_label;
+
+    edge_label = get_label_var(root, edge_side, LABEL_KIND_EDGE, edge_var);
+    if (!edge_label)
+        return false;
+
+    if ((*edge_var)->varattno == Anum_ag_label_edge_table_start_id)
+        *start = true;
+    else if ((*edge_var)->varattno == Anum_ag_label_edge_table_end_id)
+        *start = false;
+    else
+        return false;
+
+    vertex_label = get_label_var(root, vertex_side, LABEL_KIND_VERTEX,
+                                 vertex_var);
+    if (!vertex_label || vertex_label->graph != edge_label->graph ||
+        (*vertex_var)->varattno != Anum_ag_label_vertex_table_id)
+        return false;
+
+    return true;
+}
+
+// returns the label of the relation of the given Var if it is a label table
+static label_cache_data *get_label_var(PlannerInfo *root, Node *node,
+                                       char kind, Var **var)
+{
+    RangeTblEntry *rte;
+    label_cache_data *lcd;
+
+    if (!IsA(node, Var) || ((Var *)node)->varlevelsup != 0)
+        return NULL;
+
+    *var = (Var *)node;
+
+    rte = planner_rt_fetch((*var)->varno, root);
+    if (rte->rtekind != RTE_RELATION)
+        return NULL;
+
+    lcd = search_label_relation_cache(rte->relid);
+    if (!lcd || lcd->kind != kind)
+        return NULL;
+
+    return lcd;
+}
+
+/*
+ * Returns the ids of the label of the given table and of its child labels,
+ * which the table includes.
+ */
+static List *get_label_ids(Oid relid)
+{
+    List *relids;
+    List *label_ids = NIL;
+    ListCell *lc;
+
+    relids = find_all_inheritors(relid, NoLock, NULL);
+    foreach (lc, relids)
+    {
+        label_cache_data *lcd = search_label_relation_cache(lfirst_oid(lc));
+
+        // partitions that store the entities of a label are not labels
+        if (lcd)
+            label_ids = lappend_int(label_ids, lcd->id);
+    }
+
+    return label_ids;
+}
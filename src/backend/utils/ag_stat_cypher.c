@@ -0,0 +1,744 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Statistics of Cypher queries
+ *
+ * When the library is preloaded, the statistics of the queries that call
+ * cypher() are gathered in shared memory, and shown by the ag_stat_cypher
+ * view. A query is identified by the fingerprints of its Cypher queries,
+ * which leave out the values of their literals, along with the graphs they
+ * are run on. The backend that analyzes the query keeps its identifier along
+ * with the text of the statement, and the planner and the executor find its
+ * entry through that text. The queryId of the query is left to the other
+ * extensions, such as pg_stat_statements.
+ *
+ * The time spent parsing and analyzing the Cypher queries is counted when
+ * the query is analyzed, and the time spent planning it whenever it is
+ * planned as a statement sent by the client. The execution time, the number
+ * of rows and the buffer usage are counted for each call.
+ *
+ * When there is no room left for a new query, the query with the fewest
+ * calls is removed.
+ */
+
+#include "postgres.h"
+
+#include <math.h>
+
+#include "access/hash.h"
+#include "catalog/pg_authid_d.h"
+#include "executor/executor.h"
+#include "executor/instrument.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "mb/pg_wchar.h"
+#include "miscadmin.h"
+#include "nodes/execnodes.h"
+#include "optimizer/planner.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "tcop/tcopprot.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/tuplestore.h"
+
+#include "parser/cypher_parser.h"
+#include "utils/ag_stat_cypher.h"
+
+// the maximum length of the query strings kept
+#define CYPHER_STAT_QUERY_LEN 1024
+
+#define Natts_ag_stat_cypher 16
+
+typedef struct cypher_stat_key
+{
+    Oid userid;
+    Oid dbid;
+    uint64 query_id;
+} cypher_stat_key;
+
+typedef struct cypher_stat_counters
+{
+    int64 calls;
+    // the execution time of the calls, in milliseconds
+    double total_time;
+    double min_time;
+    double max_time;
+    double mean_time;
+    double sum_var_time;
+    int64 rows;
+    int64 shared_blks_hit;
+    int64 shared_blks_read;
+    double parse_time;
+    double analyze_time;
+    double plan_time;
+} cypher_stat_counters;
+
+typedef struct cypher_stat_entry
+{
+    cypher_stat_key key; // hash key
+    cypher_stat_counters counters;
+    slock_t mutex; // protects the counters
+    char query_str[CYPHER_STAT_QUERY_LEN];
+} cypher_stat_entry;
+
+// the identifier of a statement analyzed by this backend
+typedef struct cypher_stat_statement
+{
+    uint64 text_hash; // hash key
+    uint64 query_id;
+} cypher_stat_statement;
+
+typedef struct cypher_stat_shared
+{
+    /*
+     * The entries are added and removed while holding the lock exclusively.
+     * Their counters are updated while holding it shared, and their mutex.
+     */
+    LWLock *lock;
+} cypher_stat_shared;
+
+// the maximum number of queries in ag_stat_cypher
+int stat_cypher_max = 1000;
+bool track_cypher = true;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static planner_hook_type prev_planner_hook = NULL;
+static ExecutorStart_hook_type prev_executor_start_hook = NULL;
+static ExecutorRun_hook_type prev_executor_run_hook = NULL;
+static ExecutorFinish_hook_type prev_executor_finish_hook = NULL;
+static ExecutorEnd_hook_type prev_executor_end_hook = NULL;
+
+static cypher_stat_shared *cypher_stat = NULL;
+static HTAB *cypher_stat_hash = NULL;
+
+static cypher_stat_state *current_state = NULL;
+
+// the statements that call cypher(), by the hashes of their text
+static HTAB *statement_hash = NULL;
+
+// the queries that the executor runs are not planned by the client
+static int nesting_level = 0;
+
+static Size stat_cypher_shmem_size(void);
+static void stat_cypher_shmem_startup(void);
+static PlannedStmt *stat_cypher_planner(Query *parse, int cursor_options,
+                                        ParamListInfo bound_params);
+static void stat_cypher_executor_start(QueryDesc *query_desc, int eflags);
+static void stat_cypher_executor_run(QueryDesc *query_desc,
+                                     ScanDirection direction, uint64 count,
+                                     bool execute_once);
+static void stat_cypher_executor_finish(QueryDesc *query_desc);
+static void stat_cypher_executor_end(QueryDesc *query_desc);
+static bool stat_cypher_enabled(void);
+static uint64 hash_statement(const char *source_text, int location, int len);
+static void remember_statement(uint64 text_hash, uint64 query_id);
+static uint64 find_statement(const char *source_text, int location, int len);
+static void store_cypher_stat(uint64 query_id, const char *query_str,
+                              const cypher_stat_counters *counters);
+static void init_cypher_stat_key(cypher_stat_key *key, uint64 query_id);
+static cypher_stat_entry *enter_cypher_stat(cypher_stat_key *key,
+                                            const char *query_str);
+static void evict_cypher_stat(void);
+
+void stat_cypher_init(void)
+{
+    if (!process_shared_preload_libraries_in_progress || stat_cypher_max <= 0)
+        return;
+
+    RequestAddinShmemSpace(stat_cypher_shmem_size());
+    RequestNamedLWLockTranche("age_stat_cypher", 1);
+
+    prev_shmem_startup_hook = shmem_startup_hook;
+    shmem_startup_hook = stat_cypher_shmem_startup;
+
+    prev_planner_hook = planner_hook;
+    planner_hook = stat_cypher_planner;
+    prev_executor_start_hook = ExecutorStart_hook;
+    ExecutorStart_hook = stat_cypher_executor_start;
+    prev_executor_run_hook = ExecutorRun_hook;
+    ExecutorRun_hook = stat_cypher_executor_run;
+    prev_executor_finish_hook = ExecutorFinish_hook;
+    ExecutorFinish_hook = stat_cypher_executor_finish;
+    prev_executor_end_hook = ExecutorEnd_hook;
+    ExecutorEnd_hook = stat_cypher_executor_end;
+}
+
+static Size stat_cypher_shmem_size(void)
+{
+    Size size;
+
+    size = MAXALIGN(sizeof(cypher_stat_shared));
+    size = add_size(size, hash_estimate_size(stat_cypher_max,
+                                             sizeof(cypher_stat_entry)));
+
+    return size;
+}
+
+static void stat_cypher_shmem_startup(void)
+{
+    HASHCTL hash_ctl;
+    bool found;
+
+    if (prev_shmem_startup_hook)
+        prev_shmem_startup_hook();
+
+    LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+    cypher_stat = ShmemInitStruct("age stat cypher",
+                                  sizeof(cypher_stat_shared), &found);
+    if (!found)
+        cypher_stat->lock = &(GetNamedLWLockTranche("age_stat_cypher"))->lock;
+
+    MemSet(&hash_ctl, 0, sizeof(hash_ctl));
+    hash_ctl.keysize = sizeof(cypher_stat_key);
+    hash_ctl.entrysize = sizeof(cypher_stat_entry);
+    cypher_stat_hash = ShmemInitHash("age stat cypher hash", stat_cypher_max,
+                                     stat_cypher_max, &hash_ctl,
+                                     HASH_ELEM | HASH_BLOBS);
+
+    LWLockRelease(AddinShmemInitLock);
+}
+
+static bool stat_cypher_enabled(void)
+{
+    return (cypher_stat && track_cypher);
+}
+
+void begin_cypher_stat(cypher_stat_state *state)
+{
+    state->prev = current_state;
+    state->query_id = 0;
+    state->query_str = NULL;
+    state->parse_time = 0;
+    state->analyze_time = 0;
+
+    current_state = state;
+}
+
+void note_cypher_stat(const char *graph_name, Oid graph_oid,
+                      const char *query_str, instr_time parse_time,
+                      instr_time analyze_time)
+{
+    cypher_stat_state *state = current_state;
+    struct
+    {
+        Oid graph_oid;
+        uint64 fingerprint;
+    } key;
+
+    if (!state || !stat_cypher_enabled())
+        return;
+
+    if (state->query_str)
+    {
+        appendStringInfoString(state->query_str, "; ");
+    }
+    else
+    {
+        state->query_str = makeStringInfo();
+    }
+    appendStringInfo(state->query_str, "%s: ", graph_name);
+
+    // the padding of the key must be the same every time
+    MemSet(&key, 0, sizeof(key));
+    key.graph_oid = graph_oid;
+    key.fingerprint = fingerprint_cypher(query_str, state->query_str);
+    state->query_id = DatumGetUInt64(hash_any_extended(
+        (unsigned char *)&key, sizeof(key), state->query_id));
+
+    state->parse_time += INSTR_TIME_GET_MILLISEC(parse_time);
+    state->analyze_time += INSTR_TIME_GET_MILLISEC(analyze_time);
+}
+
+void end_cypher_stat(cypher_stat_state *state, const char *source_text,
+                     Query *query)
+{
+    cypher_stat_counters counters;
+
+    Assert(current_state == state);
+    current_state = state->prev;
+
+    if (!state->query_str || !source_text || !stat_cypher_enabled())
+        return;
+
+    // 0 means that the statement has no identifier
+    if (state->query_id == 0)
+        state->query_id = 1;
+    remember_statement(hash_statement(source_text, query->stmt_location,
+                                      query->stmt_len),
+                       state->query_id);
+
+    MemSet(&counters, 0, sizeof(counters));
+    counters.parse_time = state->parse_time;
+    counters.analyze_time = state->analyze_time;
+    store_cypher_stat(state->query_id, state->query_str->data, &counters);
+}
+
+void cancel_cypher_stat(cypher_stat_state *state)
+{
+    current_state = state->prev;
+}
+
+static uint64 hash_statement(const char *source_text, int location, int len)
+{
+    // the statement might be one of many in the source text
+    if (location < 0 || len <= 0)
+    {
+        location = Max(location, 0);
+        len = strlen(source_text + location);
+    }
+
+    return DatumGetUInt64(hash_any_extended(
+        (const unsigned char *)source_text + location, len, 0));
+}
+
+static void remember_statement(uint64 text_hash, uint64 query_id)
+{
+    cypher_stat_statement *statement = NULL;
+
+    if (statement_hash)
+        statement = hash_search(statement_hash, &text_hash, HASH_FIND, NULL);
+
+    // the statements are forgotten all at once when there are too many
+    if (!statement &&
+        (!statement_hash ||
+         hash_get_num_entries(statement_hash) >= stat_cypher_max))
+    {
+        HASHCTL hash_ctl;
+
+        if (statement_hash)
+            hash_destroy(statement_hash);
+
+        MemSet(&hash_ctl, 0, sizeof(hash_ctl));
+        hash_ctl.keysize = sizeof(uint64);
+        hash_ctl.entrysize = sizeof(cypher_stat_statement);
+        statement_hash = hash_create("age stat cypher statements", 64,
+                                     &hash_ctl, HASH_ELEM | HASH_BLOBS);
+    }
+
+    if (!statement)
+        statement = hash_search(statement_hash, &text_hash, HASH_ENTER, NULL);
+    statement->query_id = query_id;
+}
+
+// returns 0 if the statement does not call cypher()
+static uint64 find_statement(const char *source_text, int location, int len)
+{
+    cypher_stat_statement *statement;
+    uint64 text_hash;
+
+    if (!statement_hash || !source_text || !stat_cypher_enabled())
+        return 0;
+
+    text_hash = hash_statement(source_text, location, len);
+    statement = hash_search(statement_hash, &text_hash, HASH_FIND, NULL);
+    if (!statement)
+        return 0;
+
+    return statement->query_id;
+}
+
+static PlannedStmt *stat_cypher_planner(Query *parse, int cursor_options,
+                                        ParamListInfo bound_params)
+{
+    cypher_stat_counters counters;
+    PlannedStmt *result;
+    uint64 query_id = 0;
+    instr_time start;
+    instr_time duration;
+
+    // the text of the statements that the client sends is known here
+    if (nesting_level == 0)
+    {
+        query_id = find_statement(debug_query_string, parse->stmt_location,
+                                  parse->stmt_len);
+    }
+
+    if (query_id == 0)
+    {
+        if (prev_planner_hook)
+            return prev_planner_hook(parse, cursor_options, bound_params);
+        else
+            return standard_planner(parse, cursor_options, bound_params);
+    }
+
+    INSTR_TIME_SET_CURRENT(start);
+
+    if (prev_planner_hook)
+        result = prev_planner_hook(parse, cursor_options, bound_params);
+    else
+        result = standard_planner(parse, cursor_options, bound_params);
+
+    INSTR_TIME_SET_CURRENT(duration);
+    INSTR_TIME_SUBTRACT(duration, start);
+
+    MemSet(&counters, 0, sizeof(counters));
+    counters.plan_time = INSTR_TIME_GET_MILLISEC(duration);
+    store_cypher_stat(query_id, NULL, &counters);
+
+    return result;
+}
+
+static void stat_cypher_executor_start(QueryDesc *query_desc, int eflags)
+{
+    if (prev_executor_start_hook)
+        prev_executor_start_hook(query_desc, eflags);
+    else
+        standard_ExecutorStart(query_desc, eflags);
+
+    // the total time of the query is measured by the executor
+    if (!query_desc->totaltime &&
+        find_statement(query_desc->sourceText,
+                       query_desc->plannedstmt->stmt_location,
+                       query_desc->plannedstmt->stmt_len) != 0)
+    {
+        MemoryContext old_mem_cxt;
+
+        old_mem_cxt = MemoryContextSwitchTo(query_desc->estate->es_query_cxt);
+        query_desc->totaltime = InstrAlloc(1, INSTRUMENT_ALL);
+        MemoryContextSwitchTo(old_mem_cxt);
+    }
+}
+
+static void stat_cypher_executor_run(QueryDesc *query_desc,
+                                     ScanDirection direction, uint64 count,
+                                     bool execute_once)
+{
+    nesting_level++;
+    PG_TRY();
+    {
+        if (prev_executor_run_hook)
+            prev_executor_run_hook(query_desc, direction, count, execute_once);
+        else
+            standard_ExecutorRun(query_desc, direction, count, execute_once);
+        nesting_level--;
+    }
+    PG_CATCH();
+    {
+        nesting_level--;
+        PG_RE_THROW();
+    }
+    PG_END_TRY();
+}
+
+static void stat_cypher_executor_finish(QueryDesc *query_desc)
+{
+    nesting_level++;
+    PG_TRY();
+    {
+        if (prev_executor_finish_hook)
+            prev_executor_finish_hook(query_desc);
+        else
+            standard_ExecutorFinish(query_desc);
+        nesting_level--;
+    }
+    PG_CATCH();
+    {
+        nesting_level--;
+        PG_RE_THROW();
+    }
+    PG_END_TRY();
+}
+
+static void stat_cypher_executor_end(QueryDesc *query_desc)
+{
+    uint64 query_id = 0;
+
+    if (query_desc->totaltime)
+    {
+        query_id = find_statement(query_desc->sourceText,
+                                  query_desc->plannedstmt->stmt_location,
+                                  query_desc->plannedstmt->stmt_len);
+    }
+
+    if (query_id != 0)
+    {
+        Instrumentation *totaltime = query_desc->totaltime;
+        cypher_stat_counters counters;
+
+        InstrEndLoop(totaltime);
+
+        MemSet(&counters, 0, sizeof(counters));
+        counters.calls = 1;
+        counters.total_time = totaltime->total * 1000.0;
+        counters.rows = query_desc->estate->es_processed;
+        counters.shared_blks_hit = totaltime->bufusage.shared_blks_hit;
+        counters.shared_blks_read = totaltime->bufusage.shared_blks_read;
+        store_cypher_stat(query_id, NULL, &counters);
+    }
+
+    if (prev_executor_end_hook)
+        prev_executor_end_hook(query_desc);
+    else
+        standard_ExecutorEnd(query_desc);
+}
+
+/*
+ * Adds the counters to the entry of the query. If the query string is given,
+ * the entry is made if there is none. Otherwise, the counters of the queries
+ * that have no entries, such as the queries that are not Cypher queries, are
+ * ignored.
+ */
+static void store_cypher_stat(uint64 query_id, const char *query_str,
+                              const cypher_stat_counters *counters)
+{
+    cypher_stat_key key;
+    cypher_stat_entry *entry;
+    cypher_stat_counters *c;
+
+    init_cypher_stat_key(&key, query_id);
+
+    LWLockAcquire(cypher_stat->lock, LW_SHARED);
+
+    entry = hash_search(cypher_stat_hash, &key, HASH_FIND, NULL);
+    if (!entry && query_str)
+    {
+        LWLockRelease(cypher_stat->lock);
+        LWLockAcquire(cypher_stat->lock, LW_EXCLUSIVE);
+
+        entry = enter_cypher_stat(&key, query_str);
+    }
+    if (!entry)
+    {
+        LWLockRelease(cypher_stat->lock);
+        return;
+    }
+
+    SpinLockAcquire(&entry->mutex);
+
+    c = &entry->counters;
+    if (counters->calls > 0)
+    {
+        double time = counters->total_time;
+        double old_mean = c->mean_time;
+
+        c->calls += counters->calls;
+        c->total_time += time;
+        if (c->calls == 1)
+        {
+            c->min_time = time;
+            c->max_time = time;
+        }
+        else
+        {
+            c->min_time = Min(c->min_time, time);
+            c->max_time = Max(c->max_time, time);
+        }
+
+        // Welford's method
+        c->mean_time += (time - old_mean) / c->calls;
+        c->sum_var_time += (time - old_mean) * (time - c->mean_time);
+
+        c->rows += counters->rows;
+        c->shared_blks_hit += counters->shared_blks_hit;
+        c->shared_blks_read += counters->shared_blks_read;
+    }
+    c->parse_time += counters->parse_time;
+    c->analyze_time += counters->analyze_time;
+    c->plan_time += counters->plan_time;
+
+    SpinLockRelease(&entry->mutex);
+
+    LWLockRelease(cypher_stat->lock);
+}
+
+static void init_cypher_stat_key(cypher_stat_key *key, uint64 query_id)
+{
+    MemSet(key, 0, sizeof(*key));
+    key->userid = GetUserId();
+    key->dbid = MyDatabaseId;
+    key->query_id = query_id;
+}
+
+// the lock must be held exclusively
+static cypher_stat_entry *enter_cypher_stat(cypher_stat_key *key,
+                                            const char *query_str)
+{
+    cypher_stat_entry *entry;
+    bool found;
+    int len;
+
+    entry = hash_search(cypher_stat_hash, key, HASH_FIND, NULL);
+    if (entry)
+        return entry;
+
+    if (hash_get_num_entries(cypher_stat_hash) >= stat_cypher_max)
+        evict_cypher_stat();
+
+    entry = hash_search(cypher_stat_hash, key, HASH_ENTER_NULL, &found);
+    if (!entry)
+        return NULL;
+
+    MemSet(&entry->counters, 0, sizeof(entry->counters));
+    SpinLockInit(&entry->mutex);
+
+    len = pg_mbcliplen(query_str, strlen(query_str),
+                       CYPHER_STAT_QUERY_LEN - 1);
+    memcpy(entry->query_str, query_str, len);
+    entry->query_str[len] = '\0';
+
+    return entry;
+}
+
+// the lock must be held exclusively
+static void evict_cypher_stat(void)
+{
+    HASH_SEQ_STATUS hash_seq;
+    cypher_stat_entry *entry;
+    cypher_stat_entry *victim = NULL;
+
+    hash_seq_init(&hash_seq, cypher_stat_hash);
+    while ((entry = hash_seq_search(&hash_seq)) != NULL)
+    {
+        if (!victim || entry->counters.calls < victim->counters.calls)
+            victim = entry;
+    }
+
+    if (victim)
+        hash_search(cypher_stat_hash, &victim->key, HASH_REMOVE, NULL);
+}
+
+PG_FUNCTION_INFO_V1(ag_stat_cypher);
+
+Datum ag_stat_cypher(PG_FUNCTION_ARGS)
+{
+    ReturnSetInfo *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+    MemoryContext old_mem_cxt;
+    Tuplestorestate *tupstore;
+    TupleDesc tupdesc;
+    HASH_SEQ_STATUS hash_seq;
+    cypher_stat_entry *entry;
+    Oid userid = GetUserId();
+    bool read_all;
+
+    if (!cypher_stat)
+    {
+        ereport(ERROR,
+                (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+                 errmsg("Cypher query statistics are not collected"),
+                 errhint("Add age to shared_preload_libraries.")));
+    }
+
+    if (!rsinfo || !IsA(rsinfo, ReturnSetInfo) ||
+        !(rsinfo->allowedModes & SFRM_Materialize))
+    {
+        ereport(ERROR,
+                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                 errmsg("set-valued function called in context that cannot accept a set")));
+    }
+
+    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+        elog(ERROR, "return type must be a row type");
+
+    old_mem_cxt =
+        MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+    tupdesc = CreateTupleDescCopy(tupdesc);
+    tupstore = tuplestore_begin_heap(true, false, work_mem);
+
+    rsinfo->returnMode = SFRM_Materialize;
+    rsinfo->setResult = tupstore;
+    rsinfo->setDesc = tupdesc;
+
+    MemoryContextSwitchTo(old_mem_cxt);
+
+    // the query strings of the other users are shown only to these users
+    read_all = is_member_of_role(userid, DEFAULT_ROLE_READ_ALL_STATS);
+
+    LWLockAcquire(cypher_stat->lock, LW_SHARED);
+
+    hash_seq_init(&hash_seq, cypher_stat_hash);
+    while ((entry = hash_seq_search(&hash_seq)) != NULL)
+    {
+        Datum values[Natts_ag_stat_cypher];
+        bool nulls[Natts_ag_stat_cypher];
+        cypher_stat_counters c;
+        int i = 0;
+
+        SpinLockAcquire(&entry->mutex);
+        c = entry->counters;
+        SpinLockRelease(&entry->mutex);
+
+        MemSet(nulls, false, sizeof(nulls));
+
+        values[i++] = ObjectIdGetDatum(entry->key.userid);
+        values[i++] = ObjectIdGetDatum(entry->key.dbid);
+        if (read_all || entry->key.userid == userid)
+        {
+            values[i++] = Int64GetDatum((int64)entry->key.query_id);
+            values[i++] = CStringGetTextDatum(entry->query_str);
+        }
+        else
+        {
+            nulls[i++] = true;
+            values[i++] = CStringGetTextDatum("<insufficient privilege>");
+        }
+        values[i++] = Int64GetDatumFast(c.calls);
+        values[i++] = Float8GetDatumFast(c.total_time);
+        values[i++] = Float8GetDatumFast(c.min_time);
+        values[i++] = Float8GetDatumFast(c.max_time);
+        values[i++] = Float8GetDatumFast(c.mean_time);
+        values[i++] = Float8GetDatum(c.calls > 1 ?
+                                         sqrt(c.sum_var_time / c.calls) :
+                                         0.0);
+        values[i++] = Int64GetDatumFast(c.rows);
+        values[i++] = Int64GetDatumFast(c.shared_blks_hit);
+        values[i++] = Int64GetDatumFast(c.shared_blks_read);
+        values[i++] = Float8GetDatumFast(c.parse_time);
+        values[i++] = Float8GetDatumFast(c.analyze_time);
+        values[i++] = Float8GetDatumFast(c.plan_time);
+
+        Assert(i == Natts_ag_stat_cypher);
+
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+
+    LWLockRelease(cypher_stat->lock);
+
+    return (Datum)0;
+}
+
+PG_FUNCTION_INFO_V1(ag_stat_cypher_reset);
+
+Datum ag_stat_cypher_reset(PG_FUNCTION_ARGS)
+{
+    HASH_SEQ_STATUS hash_seq;
+    cypher_stat_entry *entry;
+
+    if (!cypher_stat)
+    {
+        ereport(ERROR,
+                (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+                 errmsg("Cypher query statistics are not collected"),
+                 errhint("Add age to shared_preload_libraries.")));
+    }
+
+    LWLockAcquire(cypher_stat->lock, LW_EXCLUSIVE);
+
+    hash_seq_init(&hash_seq, cypher_stat_hash);
+    while ((entry = hash_seq_search(&hash_seq)) != NULL)
+        hash_search(cypher_stat_hash, &entry->key, HASH_REMOVE, NULL);
+
+    LWLockRelease(cypher_stat->lock);
+
+    PG_RETURN_VOID();
+}
@@ -40,6 +40,7 @@
 #include "catalog/ag_graph.h"
 #include "catalog/ag_label.h"
 #include "utils/ag_cache.h"
+#include "utils/ag_shared_cache.h"
 #include "utils/graphid.h"
 
 typedef struct graph_name_cache_entry
@@ -78,9 +79,15 @@ typedef struct label_graph_id_cache_entry
     label_cache_data data;
 } label_graph_id_cache_entry;
 
+/*
+ * Every label in the other label caches is also in this cache, so that the
+ * label backed by a relation can be found from the relation. The relations
+ * that are known not to be labels are here, too.
+ */
 typedef struct label_relation_cache_entry
 {
     Oid relation; // hash key
+    bool is_label; // false if the relation is not a label
     label_cache_data data;
 } label_relation_cache_entry;
 
@@ -138,14 +145,12 @@ static void create_label_name_graph_cache(void);
 static void create_label_graph_id_cache(void);
 static void create_label_relation_cache(void);
 static void invalidate_label_caches(Datum arg, Oid relid);
-static void invalidate_label_oid_cache(Oid relid);
+static void remove_label_caches(Oid relid);
 static void flush_label_oid_cache(void);
-static void invalidate_label_name_graph_cache(Oid relid);
 static void flush_label_name_graph_cache(void);
-static void invalidate_label_graph_id_cache(Oid relid);
 static void flush_label_graph_id_cache(void);
-static void invalidate_label_relation_cache(Oid relid);
 static void flush_label_relation_cache(void);
+static void enter_label_caches(const label_cache_data *data);
 static label_cache_data *search_label_oid_cache_miss(Oid oid);
 static label_cache_data *search_label_name_graph_cache_miss(Name name,
                                                             Oid graph);
@@ -156,6 +161,8 @@ static label_cache_data *search_label_graph_id_cache_miss(Oid graph, int32 id);
 static void *label_graph_id_cache_hash_search(Oid graph, int32 id,
                                               HASHACTION action, bool *found);
 static label_cache_data *search_label_relation_cache_miss(Oid relation);
+static bool read_label_cache_data(Oid index_oid, ScanKey scan_keys,
+                                  int nkeys, label_cache_data *data);
 static void fill_label_cache_data(label_cache_data *cache_data,
                                   HeapTuple tuple, TupleDesc tuple_desc);
 
@@ -273,6 +280,8 @@ static void invalidate_graph_caches(Datum arg, int cache_id, uint32 hash_value)
      */
     flush_graph_name_cache();
     flush_graph_namespace_cache();
+
+    invalidate_shared_graph_cache();
 }
 
 static void flush_graph_name_cache(void)
@@ -345,6 +354,19 @@ static graph_cache_data *search_graph_name_cache_miss(Name name)
     HeapTuple tuple;
     bool found;
     graph_name_cache_entry *entry;
+    graph_cache_data data;
+    uint64 generation;
+
+    // another backend might have read the graph already
+    if (search_shared_graph_name_cache(name, &data))
+    {
+        entry = hash_search(graph_name_cache_hash, name, HASH_ENTER, &found);
+        Assert(!found);
+        entry->data = data;
+
+        return &entry->data;
+    }
+    generation = get_shared_cache_generation();
 
     memcpy(scan_keys, graph_name_scan_keys, sizeof(graph_name_scan_keys));
     scan_keys[0].sk_argument = NameGetDatum(name);
@@ -374,6 +396,7 @@ static graph_cache_data *search_graph_name_cache_miss(Name name)
 
     // fill the new entry with the retrieved tuple
     fill_graph_cache_data(&entry->data, tuple, RelationGetDescr(ag_graph));
+    store_shared_graph_cache(generation, &entry->data);
 
     systable_endscan(scan_desc);
     heap_close(ag_graph, AccessShareLock);
@@ -403,6 +426,20 @@ static graph_cache_data *search_graph_namespace_cache_miss(Oid namespace)
     HeapTuple tuple;
     bool found;
     graph_namespace_cache_entry *entry;
+    graph_cache_data data;
+    uint64 generation;
+
+    // another backend might have read the graph already
+    if (search_shared_graph_namespace_cache(namespace, &data))
+    {
+        entry = hash_search(graph_namespace_cache_hash, &namespace,
+                            HASH_ENTER, &found);
+        Assert(!found);
+        entry->data = data;
+
+        return &entry->data;
+    }
+    generation = get_shared_cache_generation();
 
     memcpy(scan_keys, graph_namespace_scan_keys,
            sizeof(graph_namespace_scan_keys));
@@ -435,6 +472,7 @@ static graph_cache_data *search_graph_namespace_cache_miss(Oid namespace)
 
     // fill the new entry with the retrieved tuple
     fill_graph_cache_data(&entry->data, tuple, RelationGetDescr(ag_graph));
+    store_shared_graph_cache(generation, &entry->data);
 
     systable_endscan(scan_desc);
     heap_close(ag_graph, AccessShareLock);
@@ -577,14 +615,11 @@ static void create_label_relation_cache(void)
 
 static void invalidate_label_caches(Datum arg, Oid relid)
 {
-    Assert(label_name_graph_cache_hash);
+    Assert(label_relation_cache_hash);
 
     if (OidIsValid(relid))
     {
-        invalidate_label_oid_cache(relid);
-        invalidate_label_name_graph_cache(relid);
-        invalidate_label_graph_id_cache(relid);
-        invalidate_label_relation_cache(relid);
+        remove_label_caches(relid);
     }
     else
     {
@@ -593,44 +628,72 @@ static void invalidate_label_caches(Datum arg, Oid relid)
         flush_label_graph_id_cache();
         flush_label_relation_cache();
     }
+
+    invalidate_shared_label_cache(relid);
 }
 
-static void invalidate_label_oid_cache(Oid relid)
+/*
+ * Removes the label backed by the relation from all the label caches. Most
+ * invalidation events are for relations that are not labels, so the entry
+ * of the relation is looked up first, and the label is removed from the
+ * other caches by its keys.
+ */
+static void remove_label_caches(Oid relid)
 {
-    HASH_SEQ_STATUS hash_seq;
-
-    hash_seq_init(&hash_seq, label_oid_cache_hash);
-    for (;;)
-    {
-        label_cache_data *entry;
-        void *removed;
-
-        entry = hash_seq_search(&hash_seq);
-        if (!entry)
-            break;
+    label_relation_cache_entry *entry;
+    label_cache_data *data;
+    label_cache_data *oid_entry;
+    label_name_graph_cache_entry *name_graph_entry;
+    label_graph_id_cache_entry *graph_id_entry;
+    void *removed;
 
-        if (entry->relation != relid)
-            continue;
+    entry = hash_search(label_relation_cache_hash, &relid, HASH_FIND, NULL);
+    if (!entry)
+        return;
 
-        removed = hash_search(label_oid_cache_hash, &entry->oid, HASH_REMOVE,
-                              NULL);
-        hash_seq_term(&hash_seq);
+    /*
+     * The keys might have been taken over by another label since, if the
+     * invalidation of this one has not been received yet.
+     */
+    data = &entry->data;
+    if (entry->is_label)
+    {
+        oid_entry = hash_search(label_oid_cache_hash, &data->oid, HASH_FIND,
+                                NULL);
+        if (oid_entry && oid_entry->relation == relid)
+        {
+            hash_search(label_oid_cache_hash, &data->oid, HASH_REMOVE,
+                        NULL);
+        }
 
-        if (!removed)
+        name_graph_entry = label_name_graph_cache_hash_search(
+            &data->name, data->graph, HASH_FIND, NULL);
+        if (name_graph_entry && name_graph_entry->data.relation == relid)
         {
-            ereport(ERROR,
-                    (errmsg_internal("label (oid) cache corrupted")));
+            hash_search(label_name_graph_cache_hash, &name_graph_entry->key,
+                        HASH_REMOVE, NULL);
         }
 
-        break;
+        graph_id_entry = label_graph_id_cache_hash_search(
+            data->graph, data->id, HASH_FIND, NULL);
+        if (graph_id_entry && graph_id_entry->data.relation == relid)
+        {
+            hash_search(label_graph_id_cache_hash, &graph_id_entry->key,
+                        HASH_REMOVE, NULL);
+        }
     }
+
+    removed = hash_search(label_relation_cache_hash, &relid, HASH_REMOVE,
+                          NULL);
+    if (!removed)
+        ereport(ERROR, (errmsg_internal("label (relation) cache corrupted")));
 }
 
 static void flush_label_oid_cache(void)
 {
     HASH_SEQ_STATUS hash_seq;
 
-    hash_seq_init(&hash_seq, label_name_graph_cache_hash);
+    hash_seq_init(&hash_seq, label_oid_cache_hash);
     for (;;)
     {
         label_cache_data *entry;
@@ -650,37 +713,6 @@ static void flush_label_oid_cache(void)
     }
 }
 
-static void invalidate_label_name_graph_cache(Oid relid)
-{
-    HASH_SEQ_STATUS hash_seq;
-
-    hash_seq_init(&hash_seq, label_name_graph_cache_hash);
-    for (;;)
-    {
-        label_name_graph_cache_entry *entry;
-        void *removed;
-
-        entry = hash_seq_search(&hash_seq);
-        if (!entry)
-            break;
-
-        if (entry->data.relation != relid)
-            continue;
-
-        removed = hash_search(label_name_graph_cache_hash, &entry->key,
-                              HASH_REMOVE, NULL);
-        hash_seq_term(&hash_seq);
-
-        if (!removed)
-        {
-            ereport(ERROR,
-                    (errmsg_internal("label (name, graph) cache corrupted")));
-        }
-
-        break;
-    }
-}
-
 static void flush_label_name_graph_cache(void)
 {
     HASH_SEQ_STATUS hash_seq;
@@ -705,37 +737,6 @@ static void flush_label_name_graph_cache(void)
     }
 }
 
-static void invalidate_label_graph_id_cache(Oid relid)
-{
-    HASH_SEQ_STATUS hash_seq;
-
-    hash_seq_init(&hash_seq, label_graph_id_cache_hash);
-    for (;;)
-    {
-        label_graph_id_cache_entry *entry;
-        void *removed;
-
-        entry = hash_seq_search(&hash_seq);
-        if (!entry)
-            break;
-
-        if (entry->data.relation != relid)
-            continue;
-
-        removed = hash_search(label_graph_id_cache_hash, &entry->key,
-                              HASH_REMOVE, NULL);
-        hash_seq_term(&hash_seq);
-
-        if (!removed)
-        {
-            ereport(ERROR,
-                    (errmsg_internal("label (graph, id) cache corrupted")));
-        }
-
-        break;
-    }
-}
-
 static void flush_label_graph_id_cache(void)
 {
     HASH_SEQ_STATUS hash_seq;
@@ -760,21 +761,6 @@ static void flush_label_graph_id_cache(void)
     }
 }
 
-static void invalidate_label_relation_cache(Oid relid)
-{
-    label_relation_cache_entry *entry;
-    void *removed;
-
-    entry = hash_search(label_relation_cache_hash, &relid, HASH_FIND, NULL);
-    if (!entry)
-        return;
-
-    removed = hash_search(label_relation_cache_hash, &relid, HASH_REMOVE,
-                          NULL);
-    if (!removed)
-        ereport(ERROR, (errmsg_internal("label (namespace) cache corrupted")));
-}
-
 static void flush_label_relation_cache(void)
 {
     HASH_SEQ_STATUS hash_seq;
@@ -799,6 +785,38 @@ static void flush_label_relation_cache(void)
     }
 }
 
+/*
+ * Enters the label in all the label caches at once, so that it can be removed
+ * from all of them by its relation.
+ */
+static void enter_label_caches(const label_cache_data *data)
+{
+    label_cache_data *oid_entry;
+    label_name_graph_cache_entry *name_graph_entry;
+    label_graph_id_cache_entry *graph_id_entry;
+    label_relation_cache_entry *relation_entry;
+
+    // the relation might be cached as a label with other keys, or no label
+    remove_label_caches(data->relation);
+
+    oid_entry = hash_search(label_oid_cache_hash, &data->oid, HASH_ENTER,
+                            NULL);
+    *oid_entry = *data;
+
+    name_graph_entry = label_name_graph_cache_hash_search(
+        (Name)&data->name, data->graph, HASH_ENTER, NULL);
+    name_graph_entry->data = *data;
+
+    graph_id_entry = label_graph_id_cache_hash_search(data->graph, data->id,
+                                                      HASH_ENTER, NULL);
+    graph_id_entry->data = *data;
+
+    relation_entry = hash_search(label_relation_cache_hash, &data->relation,
+                                 HASH_ENTER, NULL);
+    relation_entry->is_label = true;
+    relation_entry->data = *data;
+}
+
 label_cache_data *search_label_oid_cache(Oid oid)
 {
     label_cache_data *entry;
@@ -815,47 +833,22 @@ label_cache_data *search_label_oid_cache(Oid oid)
 static label_cache_data *search_label_oid_cache_miss(Oid oid)
 {
     ScanKeyData scan_keys[1];
-    Relation ag_label;
-    SysScanDesc scan_desc;
-    HeapTuple tuple;
-    bool found;
-    label_cache_data *entry;
+    label_cache_data data;
 
     memcpy(scan_keys, label_oid_scan_keys, sizeof(label_oid_scan_keys));
     scan_keys[0].sk_argument = ObjectIdGetDatum(oid);
 
-    /*
-     * Calling heap_open() might call AcceptInvalidationMessage() and that
-     * might invalidate the label caches. This is OK because this function is
-     * called when the desired entry is not in the cache.
-     */
-    ag_label = heap_open(ag_label_relation_id(), AccessShareLock);
-    scan_desc = systable_beginscan(ag_label, ag_label_oid_index_id(), true,
-                                   NULL, 1, scan_keys);
-
-    // don't need to loop over scan_desc because ag_label_oid_index is UNIQUE
-    tuple = systable_getnext(scan_desc);
-    if (!HeapTupleIsValid(tuple))
-    {
-        systable_endscan(scan_desc);
-        heap_close(ag_label, AccessShareLock);
-
+    // another backend might have read the label already
+    if (!search_shared_label_oid_cache(oid, &data) &&
+        !read_label_cache_data(ag_label_oid_index_id(), scan_keys, 1, &data))
         return NULL;
-    }
 
-    // get a new entry
-    entry = hash_search(label_oid_cache_hash, &oid, HASH_ENTER, &found);
-    Assert(!found); // no concurrent update on label_oid_cache_hash
-
-    // fill the new entry with the retrieved tuple
-    fill_label_cache_data(entry, tuple, RelationGetDescr(ag_label));
     // make sure that the oid field is the same with the hash key(oid)
-    Assert(entry->oid == oid);
+    Assert(data.oid == oid);
 
-    systable_endscan(scan_desc);
-    heap_close(ag_label, AccessShareLock);
+    enter_label_caches(&data);
 
-    return entry;
+    return hash_search(label_oid_cache_hash, &oid, HASH_FIND, NULL);
 }
 
 label_cache_data *search_label_name_graph_cache(const char *name, Oid graph)
@@ -881,10 +874,7 @@ static label_cache_data *search_label_name_graph_cache_miss(Name name,
                                                             Oid graph)
 {
     ScanKeyData scan_keys[2];
-    Relation ag_label;
-    SysScanDesc scan_desc;
-    HeapTuple tuple;
-    bool found;
+    label_cache_data data;
     label_name_graph_cache_entry *entry;
 
     memcpy(scan_keys, label_name_graph_scan_keys,
@@ -892,38 +882,16 @@ static label_cache_data *search_label_name_graph_cache_miss(Name name,
     scan_keys[0].sk_argument = NameGetDatum(name);
     scan_keys[1].sk_argument = ObjectIdGetDatum(graph);
 
-    /*
-     * Calling heap_open() might call AcceptInvalidationMessage() and that
-     * might invalidate the label caches. This is OK because this function is
-     * called when the desired entry is not in the cache.
-     */
-    ag_label = heap_open(ag_label_relation_id(), AccessShareLock);
-    scan_desc = systable_beginscan(ag_label, ag_label_name_graph_index_id(),
-                                   true, NULL, 2, scan_keys);
-
-    /*
-     * don't need to loop over scan_desc because ag_label_name_graph_index is
-     * UNIQUE
-     */
-    tuple = systable_getnext(scan_desc);
-    if (!HeapTupleIsValid(tuple))
-    {
-        systable_endscan(scan_desc);
-        heap_close(ag_label, AccessShareLock);
-
+    // another backend might have read the label already
+    if (!search_shared_label_name_graph_cache(name, graph, &data) &&
+        !read_label_cache_data(ag_label_name_graph_index_id(), scan_keys, 2,
+                               &data))
         return NULL;
-    }
-
-    // get a new entry
-    entry = label_name_graph_cache_hash_search(name, graph, HASH_ENTER,
-                                               &found);
-    Assert(!found); // no concurrent update on label_name_graph_cache_hash
 
-    // fill the new entry with the retrieved tuple
-    fill_label_cache_data(&entry->data, tuple, RelationGetDescr(ag_label));
+    enter_label_caches(&data);
 
-    systable_endscan(scan_desc);
-    heap_close(ag_label, AccessShareLock);
+    entry = label_name_graph_cache_hash_search(name, graph, HASH_FIND, NULL);
+    Assert(entry);
 
     return &entry->data;
 }
@@ -959,10 +927,7 @@ label_cache_data *search_label_graph_id_cache(Oid graph, int32 id)
 static label_cache_data *search_label_graph_id_cache_miss(Oid graph, int32 id)
 {
     ScanKeyData scan_keys[2];
-    Relation ag_label;
-    SysScanDesc scan_desc;
-    HeapTuple tuple;
-    bool found;
+    label_cache_data data;
     label_graph_id_cache_entry *entry;
 
     memcpy(scan_keys, label_graph_id_scan_keys,
@@ -970,37 +935,16 @@ static label_cache_data *search_label_graph_id_cache_miss(Oid graph, int32 id)
     scan_keys[0].sk_argument = ObjectIdGetDatum(graph);
     scan_keys[1].sk_argument = Int32GetDatum(id);
 
-    /*
-     * Calling heap_open() might call AcceptInvalidationMessage() and that
-     * might invalidate the label caches. This is OK because this function is
-     * called when the desired entry is not in the cache.
-     */
-    ag_label = heap_open(ag_label_relation_id(), AccessShareLock);
-    scan_desc = systable_beginscan(ag_label, ag_label_graph_id_index_id(),
-                                   true, NULL, 2, scan_keys);
-
-    /*
-     * don't need to loop over scan_desc because ag_label_graph_id_index is
-     * UNIQUE
-     */
-    tuple = systable_getnext(scan_desc);
-    if (!HeapTupleIsValid(tuple))
-    {
-        systable_endscan(scan_desc);
-        heap_close(ag_label, AccessShareLock);
-
+    // another backend might have read the label already
+    if (!search_shared_label_graph_id_cache(graph, id, &data) &&
+        !read_label_cache_data(ag_label_graph_id_index_id(), scan_keys, 2,
+                               &data))
         return NULL;
-    }
-
-    // get a new entry
-    entry = label_graph_id_cache_hash_search(graph, id, HASH_ENTER, &found);
-    Assert(!found); // no concurrent update on label_graph_id_cache_hash
 
-    // fill the new entry with the retrieved tuple
-    fill_label_cache_data(&entry->data, tuple, RelationGetDescr(ag_label));
+    enter_label_caches(&data);
 
-    systable_endscan(scan_desc);
-    heap_close(ag_label, AccessShareLock);
+    entry = label_graph_id_cache_hash_search(graph, id, HASH_FIND, NULL);
+    Assert(entry);
 
     return &entry->data;
 }
@@ -1025,7 +969,7 @@ label_cache_data *search_label_relation_cache(Oid relation)
 
     entry = hash_search(label_relation_cache_hash, &relation, HASH_FIND, NULL);
     if (entry)
-        return &entry->data;
+        return (entry->is_label ? &entry->data : NULL);
 
     return search_label_relation_cache_miss(relation);
 }
@@ -1033,48 +977,77 @@ label_cache_data *search_label_relation_cache(Oid relation)
 static label_cache_data *search_label_relation_cache_miss(Oid relation)
 {
     ScanKeyData scan_keys[1];
-    Relation ag_label;
-    SysScanDesc scan_desc;
-    HeapTuple tuple;
-    bool found;
-    label_cache_data *entry;
+    label_cache_data data;
+    label_relation_cache_entry *entry;
 
     memcpy(scan_keys, label_relation_scan_keys,
            sizeof(label_relation_scan_keys));
     scan_keys[0].sk_argument = ObjectIdGetDatum(relation);
 
+    // another backend might have read the label already
+    if (!search_shared_label_relation_cache(relation, &data) &&
+        !read_label_cache_data(ag_label_relation_index_id(), scan_keys, 1,
+                               &data))
+    {
+        /*
+         * Remember that the relation is not a label. If it becomes one, the
+         * relation cache of it is invalidated by insert_label().
+         */
+        entry = hash_search(label_relation_cache_hash, &relation, HASH_ENTER,
+                            NULL);
+        entry->is_label = false;
+
+        return NULL;
+    }
+
+    enter_label_caches(&data);
+
+    entry = hash_search(label_relation_cache_hash, &relation, HASH_FIND, NULL);
+    Assert(entry);
+
+    return &entry->data;
+}
+
+/*
+ * Reads the label found by the scan keys on the given UNIQUE index of
+ * ag_label, and shares it with the other backends.
+ */
+static bool read_label_cache_data(Oid index_oid, ScanKey scan_keys,
+                                  int nkeys, label_cache_data *data)
+{
+    uint64 generation;
+    Relation ag_label;
+    SysScanDesc scan_desc;
+    HeapTuple tuple;
+
+    generation = get_shared_cache_generation();
+
     /*
      * Calling heap_open() might call AcceptInvalidationMessage() and that
-     * might invalidate the label caches. This is OK because this function is
-     * called when the desired entry is not in the cache.
+     * might invalidate the label caches. This is OK because the label is
+     * entered in the caches after the scan.
      */
     ag_label = heap_open(ag_label_relation_id(), AccessShareLock);
-    scan_desc = systable_beginscan(ag_label, ag_label_relation_index_id(),
-                                   true, NULL, 1, scan_keys);
+    scan_desc = systable_beginscan(ag_label, index_oid, true, NULL, nkeys,
+                                   scan_keys);
 
-    // don't need to loop over scan_desc because ag_label_relation_index is
-    // UNIQUE
+    // don't need to loop over scan_desc because the index is UNIQUE
     tuple = systable_getnext(scan_desc);
     if (!HeapTupleIsValid(tuple))
     {
         systable_endscan(scan_desc);
         heap_close(ag_label, AccessShareLock);
 
-        return NULL;
+        return false;
     }
 
-    // get a new entry
-    entry = hash_search(label_relation_cache_hash, &relation, HASH_ENTER,
-                        &found);
-    Assert(!found); // no concurrent update on label_relation_cache_hash
-
-    // fill the new entry with the retrieved tuple
-    fill_label_cache_data(entry, tuple, RelationGetDescr(ag_label));
+    fill_label_cache_data(data, tuple, RelationGetDescr(ag_label));
+    store_shared_label_cache(generation, data);
 
     systable_endscan(scan_desc);
     heap_close(ag_label, AccessShareLock);
 
-    return entry;
+    return true;
 }
 
 static void fill_label_cache_data(label_cache_data *cache_data,
@@ -1107,4 +1080,9 @@ static void fill_label_cache_data(label_cache_data *cache_data,
     value = heap_getattr(tuple, Anum_ag_label_relation, tuple_desc, &is_null);
     Assert(!is_null);
     cache_data->relation = DatumGetObjectId(value);
+    // ag_label.hash_partitions
+    value = heap_getattr(tuple, Anum_ag_label_hash_partitions, tuple_desc,
+                         &is_null);
+    Assert(!is_null);
+    cache_data->hash_partitions = DatumGetInt32(value);
 }
@@ -0,0 +1,282 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Caches of the OIDs of the objects in ag_catalog
+ *
+ * The namespace, the types and the functions of ag_catalog are looked up by
+ * name in many places, some of them per row or per relation. Their OIDs are
+ * looked up in the system caches once, and kept until the system caches are
+ * invalidated for namespaces, types or functions, such as when the extension
+ * is dropped and created again.
+ */
+
+#include "postgres.h"
+
+#include "access/htup.h"
+#include "access/htup_details.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_proc.h"
+#include "fmgr.h"
+#include "utils/builtins.h"
+#include "utils/catcache.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/memutils.h"
+#include "utils/syscache.h"
+
+#include "utils/ag_oid_cache.h"
+
+typedef struct func_name_args_cache_key
+{
+    NameData name;
+    int32 nargs;
+    Oid arg_types[FUNC_MAX_ARGS];
+} func_name_args_cache_key;
+
+typedef struct func_name_args_cache_entry
+{
+    func_name_args_cache_key key; // hash key
+    Oid oid;
+} func_name_args_cache_entry;
+
+typedef struct func_oid_cache_entry
+{
+    Oid oid; // hash key
+    bool in_ag_catalog;
+    NameData name;
+} func_oid_cache_entry;
+
+static const char *const type_names[NUM_AG_TYPES] = {"agtype", "_agtype",
+                                                     "graphid", "_graphid"};
+
+// ag_catalog
+static Oid namespace_oid = InvalidOid;
+
+// the types in ag_catalog
+static Oid type_oids[NUM_AG_TYPES];
+
+// the functions in ag_catalog, by name and argument types
+static HTAB *func_name_args_cache_hash = NULL;
+
+// all the functions, by OID
+static HTAB *func_oid_cache_hash = NULL;
+
+static void initialize_oid_caches(void);
+static void invalidate_namespace_oid_cache(Datum arg, int cache_id,
+                                           uint32 hash_value);
+static void invalidate_type_oid_cache(Datum arg, int cache_id,
+                                      uint32 hash_value);
+static void invalidate_func_caches(Datum arg, int cache_id,
+                                   uint32 hash_value);
+static void flush_oid_cache(HTAB *hash);
+static Oid lookup_namespace_oid(bool missing_ok);
+
+static void initialize_oid_caches(void)
+{
+    static bool initialized = false;
+    HASHCTL hash_ctl;
+
+    if (initialized)
+        return;
+
+    if (!CacheMemoryContext)
+        CreateCacheMemoryContext();
+
+    MemSet(type_oids, 0, sizeof(type_oids));
+
+    MemSet(&hash_ctl, 0, sizeof(hash_ctl));
+    hash_ctl.keysize = sizeof(func_name_args_cache_key);
+    hash_ctl.entrysize = sizeof(func_name_args_cache_entry);
+    func_name_args_cache_hash = hash_create("function (name, args) cache", 64,
+                                            &hash_ctl, HASH_ELEM | HASH_BLOBS);
+
+    MemSet(&hash_ctl, 0, sizeof(hash_ctl));
+    hash_ctl.keysize = sizeof(Oid);
+    hash_ctl.entrysize = sizeof(func_oid_cache_entry);
+    func_oid_cache_hash = hash_create("function (oid) cache", 64, &hash_ctl,
+                                      HASH_ELEM | HASH_BLOBS);
+
+    /*
+     * The types and the functions are looked up in the namespace, and the
+     * functions by their argument types. So, the caches are flushed along
+     * with the caches they depend on.
+     */
+    CacheRegisterSyscacheCallback(NAMESPACEOID, invalidate_namespace_oid_cache,
+                                  (Datum)0);
+    CacheRegisterSyscacheCallback(TYPEOID, invalidate_type_oid_cache,
+                                  (Datum)0);
+    CacheRegisterSyscacheCallback(PROCOID, invalidate_func_caches, (Datum)0);
+
+    initialized = true;
+}
+
+static void invalidate_namespace_oid_cache(Datum arg, int cache_id,
+                                           uint32 hash_value)
+{
+    namespace_oid = InvalidOid;
+
+    invalidate_type_oid_cache(arg, cache_id, hash_value);
+}
+
+static void invalidate_type_oid_cache(Datum arg, int cache_id,
+                                      uint32 hash_value)
+{
+    MemSet(type_oids, 0, sizeof(type_oids));
+
+    invalidate_func_caches(arg, cache_id, hash_value);
+}
+
+static void invalidate_func_caches(Datum arg, int cache_id, uint32 hash_value)
+{
+    Assert(func_oid_cache_hash);
+
+    flush_oid_cache(func_name_args_cache_hash);
+    flush_oid_cache(func_oid_cache_hash);
+}
+
+// the key of the entries must be their first field
+static void flush_oid_cache(HTAB *hash)
+{
+    HASH_SEQ_STATUS hash_seq;
+    void *entry;
+
+    hash_seq_init(&hash_seq, hash);
+    while ((entry = hash_seq_search(&hash_seq)) != NULL)
+    {
+        if (!hash_search(hash, entry, HASH_REMOVE, NULL))
+            ereport(ERROR, (errmsg_internal("OID cache corrupted")));
+    }
+}
+
+Oid search_namespace_oid_cache(void)
+{
+    initialize_oid_caches();
+
+    return lookup_namespace_oid(false);
+}
+
+static Oid lookup_namespace_oid(bool missing_ok)
+{
+    Oid oid;
+
+    if (OidIsValid(namespace_oid))
+        return namespace_oid;
+
+    /*
+     * The lookup might flush the caches, so the OID is kept after it. It is
+     * up to date because it has been looked up after the invalidation.
+     */
+    oid = get_namespace_oid("ag_catalog", missing_ok);
+    namespace_oid = oid;
+
+    return oid;
+}
+
+Oid search_type_oid_cache(ag_type type)
+{
+    Oid nsp_oid;
+    Oid oid;
+
+    AssertArg(type >= 0 && type < NUM_AG_TYPES);
+
+    initialize_oid_caches();
+
+    if (OidIsValid(type_oids[type]))
+        return type_oids[type];
+
+    nsp_oid = search_namespace_oid_cache();
+    oid = GetSysCacheOid2(TYPENAMENSP, CStringGetDatum(type_names[type]),
+                          ObjectIdGetDatum(nsp_oid));
+    type_oids[type] = oid;
+
+    return oid;
+}
+
+Oid search_func_name_args_cache(const char *name, int nargs,
+                                const Oid *arg_types)
+{
+    func_name_args_cache_key key;
+    func_name_args_cache_entry *entry;
+    oidvector *arg_vector;
+    Oid nsp_oid;
+    Oid oid;
+
+    AssertArg(name);
+    AssertArg(nargs >= 0 && nargs <= FUNC_MAX_ARGS);
+
+    initialize_oid_caches();
+
+    // the unused argument types are a part of the key, too
+    MemSet(&key, 0, sizeof(key));
+    namestrcpy(&key.name, name);
+    key.nargs = nargs;
+    memcpy(key.arg_types, arg_types, sizeof(Oid) * nargs);
+
+    entry = hash_search(func_name_args_cache_hash, &key, HASH_FIND, NULL);
+    if (entry)
+        return entry->oid;
+
+    nsp_oid = search_namespace_oid_cache();
+    arg_vector = buildoidvector(arg_types, nargs);
+    oid = GetSysCacheOid3(PROCNAMEARGSNSP, CStringGetDatum(name),
+                          PointerGetDatum(arg_vector),
+                          ObjectIdGetDatum(nsp_oid));
+    pfree(arg_vector);
+
+    if (!OidIsValid(oid))
+        return InvalidOid;
+
+    entry = hash_search(func_name_args_cache_hash, &key, HASH_ENTER, NULL);
+    entry->oid = oid;
+
+    return oid;
+}
+
+const char *search_func_oid_cache(Oid func_oid)
+{
+    func_oid_cache_entry *entry;
+    HeapTuple proctup;
+    Form_pg_proc proc;
+    Oid nsp_oid;
+    NameData name;
+    Oid pronamespace;
+
+    AssertArg(OidIsValid(func_oid));
+
+    initialize_oid_caches();
+
+    entry = hash_search(func_oid_cache_hash, &func_oid, HASH_FIND, NULL);
+    if (entry)
+        return (entry->in_ag_catalog ? NameStr(entry->name) : NULL);
+
+    // this is called for any function, even if the extension is not created
+    nsp_oid = lookup_namespace_oid(true);
+
+    proctup = SearchSysCache1(PROCOID, ObjectIdGetDatum(func_oid));
+    if (!HeapTupleIsValid(proctup))
+        return NULL;
+    proc = (Form_pg_proc)GETSTRUCT(proctup);
+    namecpy(&name, &proc->proname);
+    pronamespace = proc->pronamespace;
+    ReleaseSysCache(proctup);
+
+    entry = hash_search(func_oid_cache_hash, &func_oid, HASH_ENTER, NULL);
+    entry->in_ag_catalog = (OidIsValid(nsp_oid) && pronamespace == nsp_oid);
+    namecpy(&entry->name, &name);
+
+    return (entry->in_ag_catalog ? NameStr(entry->name) : NULL);
+}
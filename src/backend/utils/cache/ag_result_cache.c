@@ -0,0 +1,1162 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Result cache
+ *
+ * When the library is preloaded, the results of read-only queries that read
+ * label tables are kept in shared memory, so that the same query with the
+ * same parameters is answered without being executed. A result is keyed by
+ * the database, the user, search_path, the text of the statement and the
+ * values of its parameters, and it is kept in the slot that its key hashes
+ * to, replacing the result that was there. Results larger than a slot are
+ * not cached.
+ *
+ * Each relation has a modification counter (relations may share one), and a
+ * result remembers the counters of the relations it read. Transactions that
+ * modify a relation advance its counter just before they commit, so the
+ * results that read it are no longer found. The counters are also advanced
+ * by the relcache invalidations of the relations, which cover DDL.
+ *
+ * A result is stored only if it is certain to include the last modifications
+ * of the relations it read. It is not if their counters changed during the
+ * query, or if any transaction that advanced them might not be visible to the
+ * snapshot of the query. Transactions that have modified anything and
+ * transaction snapshots neither store nor find results.
+ *
+ * Only the queries whose expressions call immutable functions are cached,
+ * along with the functions of ag_catalog that are known to depend on nothing
+ * but their arguments, even though they are declared stable.
+ */
+
+#include "postgres.h"
+
+#include "access/hash.h"
+#include "access/transam.h"
+#include "access/xact.h"
+#include "access/xlog.h"
+#include "catalog/catalog.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_class_d.h"
+#include "catalog/pg_proc_d.h"
+#include "executor/executor.h"
+#include "executor/tuptable.h"
+#include "lib/stringinfo.h"
+#include "miscadmin.h"
+#include "nodes/execnodes.h"
+#include "nodes/extensible.h"
+#include "nodes/nodeFuncs.h"
+#include "nodes/params.h"
+#include "nodes/parsenodes.h"
+#include "nodes/pg_list.h"
+#include "nodes/plannodes.h"
+#include "optimizer/clauses.h"
+#include "parser/parsetree.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "tcop/dest.h"
+#include "utils/datum.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/snapshot.h"
+
+#include "catalog/ag_namespace.h"
+#include "executor/cypher_executor.h"
+#include "utils/ag_cache.h"
+#include "utils/ag_oid_cache.h"
+#include "utils/ag_result_cache.h"
+
+#define RESULT_CACHE_PARTITIONS 64
+#define RESULT_CACHE_COUNTERS 4096
+
+typedef struct result_cache_header
+{
+    LWLockPadded *locks;
+    /*
+     * the modification counters, and the newest transactions that advanced
+     * them, with the epochs of their IDs
+     */
+    pg_atomic_uint64 counters[RESULT_CACHE_COUNTERS];
+    pg_atomic_uint64 writers[RESULT_CACHE_COUNTERS];
+} result_cache_header;
+
+// the counter of a relation read by a query, and its value
+typedef struct relation_tag
+{
+    uint32 counter;
+    uint64 value;
+} relation_tag;
+
+/*
+ * A slot holds a result: its key, the tags of the relations it read and its
+ * tuples, one after another.
+ */
+typedef struct result_cache_slot
+{
+    bool used;
+    uint32 hash;
+    Size key_len;
+    int ntags;
+    uint64 ntuples;
+    Size tuples_len;
+    char data[FLEXIBLE_ARRAY_MEMBER];
+} result_cache_slot;
+
+#define SLOT_DATA_SIZE \
+    (RESULT_CACHE_SLOT_SIZE - offsetof(result_cache_slot, data))
+
+// a top-level query whose result can be cached
+typedef struct result_cache_query
+{
+    QueryDesc *query_desc;
+    StringInfo key;
+    uint32 hash;
+    relation_tag *tags;
+    int ntags;
+    // the cached result, if one is found
+    bool found;
+    uint64 ntuples;
+    char *tuples;
+} result_cache_query;
+
+// passes the tuples on to the original receiver, keeping a copy of them
+typedef struct capture_receiver
+{
+    DestReceiver pub;
+    DestReceiver *dest;
+    StringInfo tuples;
+    uint64 ntuples;
+    Size limit;
+    bool overflowed;
+} capture_receiver;
+
+/*
+ * The functions of ag_catalog that may be called by the queries that are
+ * cached, sorted. _label_name() reads the labels of ag_catalog, but the label
+ * of an ID only changes when its label table is dropped, which advances the
+ * counter of the table.
+ */
+static const char *const pure_ag_funcs[] = {
+    "_ag_enforce_edge_uniqueness",
+    "_agtype_build_edge",
+    "_agtype_build_path",
+    "_agtype_build_vertex",
+    "_extract_label_id",
+    "_label_name",
+    "agtype_access_operator",
+    "agtype_access_slice",
+    "agtype_add",
+    "agtype_build_list",
+    "agtype_build_map",
+    "agtype_div",
+    "agtype_eq",
+    "agtype_ge",
+    "agtype_gt",
+    "agtype_in",
+    "agtype_in_operator",
+    "agtype_le",
+    "agtype_lt",
+    "agtype_mod",
+    "agtype_mul",
+    "agtype_ne",
+    "agtype_neg",
+    "agtype_out",
+    "agtype_pow",
+    "agtype_string_match_contains",
+    "agtype_string_match_ends_with",
+    "agtype_string_match_starts_with",
+    "agtype_sub",
+    "agtype_to_bool",
+    "agtype_typecast_edge",
+    "agtype_typecast_float",
+    "agtype_typecast_numeric",
+    "agtype_typecast_path",
+    "agtype_typecast_vertex",
+    "bool_to_agtype",
+    "end_id",
+    "exists_property",
+    "graphid_btree_cmp",
+    "graphid_eq",
+    "graphid_ge",
+    "graphid_gt",
+    "graphid_in",
+    "graphid_le",
+    "graphid_lt",
+    "graphid_ne",
+    "graphid_out",
+    "graphid_to_agtype",
+    "head",
+    "id",
+    "int8_to_agtype",
+    "last",
+    "length",
+    "properties",
+    "reverse",
+    "size",
+    "start_id",
+    "toboolean",
+    "tofloat",
+    "tointeger",
+    "tolowercase",
+    "tostring",
+    "touppercase",
+    "type"
+};
+
+// the maximum number of results in the result cache
+int result_cache_size = 0;
+bool enable_result_cache = true;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static ExecutorStart_hook_type prev_executor_start_hook = NULL;
+static ExecutorRun_hook_type prev_executor_run_hook = NULL;
+static ExecutorFinish_hook_type prev_executor_finish_hook = NULL;
+static ExecutorEnd_hook_type prev_executor_end_hook = NULL;
+
+static result_cache_header *result_cache = NULL;
+static char *result_cache_slots = NULL;
+
+// the queries of the functions that the top-level queries call are not cached
+static int nesting_level = 0;
+
+static List *cached_queries = NIL;
+
+// the counters of the relations this transaction has modified
+static Bitmapset *pending_writes = NULL;
+
+static Size result_cache_shmem_size(void);
+static void result_cache_shmem_startup(void);
+static void result_cache_executor_start(QueryDesc *query_desc, int eflags);
+static void result_cache_executor_run(QueryDesc *query_desc,
+                                      ScanDirection direction, uint64 count,
+                                      bool execute_once);
+static void result_cache_executor_finish(QueryDesc *query_desc);
+static void result_cache_executor_end(QueryDesc *query_desc);
+static void result_cache_xact_callback(XactEvent event, void *arg);
+static void result_cache_relcache_callback(Datum arg, Oid relid);
+static uint32 get_counter(Oid relid);
+static void note_query_writes(PlannedStmt *stmt);
+static void publish_writes(void);
+static uint64 get_full_xid(TransactionId xid);
+static bool is_query_cacheable(QueryDesc *query_desc);
+static bool mutable_planstate_walker(PlanState *planstate, void *context);
+static bool contain_mutable_calls(Node *node);
+static bool contain_mutable_calls_walker(Node *node, void *context);
+static bool is_mutable_func(Oid func_oid, void *context);
+static int compare_func_names(const void *a, const void *b);
+static void begin_cached_query(QueryDesc *query_desc);
+static StringInfo make_key(QueryDesc *query_desc);
+static result_cache_query *find_cached_query(QueryDesc *query_desc);
+static void forget_cached_query(result_cache_query *query);
+static result_cache_slot *get_slot(uint32 hash, LWLock **lock);
+static void search_result(result_cache_query *query);
+static void send_result(QueryDesc *query_desc, result_cache_query *query);
+static void store_result(result_cache_query *query,
+                         capture_receiver *receiver);
+static Size get_tuples_offset(Size key_len, int ntags);
+static capture_receiver *make_capture_receiver(DestReceiver *dest,
+                                               Size limit);
+static void capture_startup(DestReceiver *self, int operation,
+                            TupleDesc typeinfo);
+static bool capture_receive_slot(TupleTableSlot *slot, DestReceiver *self);
+static void capture_shutdown(DestReceiver *self);
+static void capture_destroy(DestReceiver *self);
+
+void result_cache_init(void)
+{
+    if (!process_shared_preload_libraries_in_progress ||
+        result_cache_size <= 0)
+        return;
+
+    RequestAddinShmemSpace(result_cache_shmem_size());
+    RequestNamedLWLockTranche("age_result_cache", RESULT_CACHE_PARTITIONS);
+
+    prev_shmem_startup_hook = shmem_startup_hook;
+    shmem_startup_hook = result_cache_shmem_startup;
+
+    prev_executor_start_hook = ExecutorStart_hook;
+    ExecutorStart_hook = result_cache_executor_start;
+    prev_executor_run_hook = ExecutorRun_hook;
+    ExecutorRun_hook = result_cache_executor_run;
+    prev_executor_finish_hook = ExecutorFinish_hook;
+    ExecutorFinish_hook = result_cache_executor_finish;
+    prev_executor_end_hook = ExecutorEnd_hook;
+    ExecutorEnd_hook = result_cache_executor_end;
+
+    RegisterXactCallback(result_cache_xact_callback, NULL);
+    CacheRegisterRelcacheCallback(result_cache_relcache_callback, (Datum)0);
+}
+
+static Size result_cache_shmem_size(void)
+{
+    Size size;
+
+    size = MAXALIGN(sizeof(result_cache_header));
+    size = add_size(size, mul_size(result_cache_size,
+                                   MAXALIGN(RESULT_CACHE_SLOT_SIZE)));
+
+    return size;
+}
+
+static void result_cache_shmem_startup(void)
+{
+    bool found;
+    int i;
+
+    if (prev_shmem_startup_hook)
+        prev_shmem_startup_hook();
+
+    LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+    result_cache = ShmemInitStruct("age result cache",
+                                   result_cache_shmem_size(), &found);
+    result_cache_slots = (char *)result_cache +
+                         MAXALIGN(sizeof(result_cache_header));
+    if (!found)
+    {
+        result_cache->locks = GetNamedLWLockTranche("age_result_cache");
+        for (i = 0; i < RESULT_CACHE_COUNTERS; i++)
+        {
+            pg_atomic_init_u64(&result_cache->counters[i], 0);
+            pg_atomic_init_u64(&result_cache->writers[i], 0);
+        }
+        for (i = 0; i < result_cache_size; i++)
+        {
+            result_cache_slot *slot;
+
+            slot = (result_cache_slot *)(result_cache_slots +
+                                         i * MAXALIGN(RESULT_CACHE_SLOT_SIZE));
+            slot->used = false;
+        }
+    }
+
+    LWLockRelease(AddinShmemInitLock);
+}
+
+static void result_cache_executor_start(QueryDesc *query_desc, int eflags)
+{
+    if (prev_executor_start_hook)
+        prev_executor_start_hook(query_desc, eflags);
+    else
+        standard_ExecutorStart(query_desc, eflags);
+
+    note_query_writes(query_desc->plannedstmt);
+
+    if (nesting_level == 0 && enable_result_cache &&
+        !(eflags & EXEC_FLAG_EXPLAIN_ONLY) && is_query_cacheable(query_desc))
+        begin_cached_query(query_desc);
+}
+
+static void result_cache_executor_run(QueryDesc *query_desc,
+                                      ScanDirection direction, uint64 count,
+                                      bool execute_once)
+{
+    result_cache_query *query;
+    capture_receiver *receiver = NULL;
+
+    /*
+     * Only the queries that run to completion at once can be answered from
+     * the cache, or have their results stored, unlike cursors.
+     */
+    query = find_cached_query(query_desc);
+    if (query && (count != 0 || !ScanDirectionIsForward(direction) ||
+                  query_desc->already_executed))
+    {
+        forget_cached_query(query);
+        query = NULL;
+    }
+
+    if (query && query->found)
+    {
+        send_result(query_desc, query);
+        forget_cached_query(query);
+
+        return;
+    }
+
+    if (query)
+    {
+        Size limit;
+
+        limit = SLOT_DATA_SIZE - get_tuples_offset(query->key->len,
+                                                   query->ntags);
+        receiver = make_capture_receiver(query_desc->dest, limit);
+        query_desc->dest = (DestReceiver *)receiver;
+    }
+
+    nesting_level++;
+    PG_TRY();
+    {
+        if (prev_executor_run_hook)
+            prev_executor_run_hook(query_desc, direction, count, execute_once);
+        else
+            standard_ExecutorRun(query_desc, direction, count, execute_once);
+        nesting_level--;
+    }
+    PG_CATCH();
+    {
+        nesting_level--;
+        PG_RE_THROW();
+    }
+    PG_END_TRY();
+
+    if (query)
+    {
+        query_desc->dest = receiver->dest;
+
+        if (!receiver->overflowed)
+            store_result(query, receiver);
+        forget_cached_query(query);
+    }
+}
+
+static void result_cache_executor_finish(QueryDesc *query_desc)
+{
+    nesting_level++;
+    PG_TRY();
+    {
+        if (prev_executor_finish_hook)
+            prev_executor_finish_hook(query_desc);
+        else
+            standard_ExecutorFinish(query_desc);
+        nesting_level--;
+    }
+    PG_CATCH();
+    {
+        nesting_level--;
+        PG_RE_THROW();
+    }
+    PG_END_TRY();
+}
+
+static void result_cache_executor_end(QueryDesc *query_desc)
+{
+    result_cache_query *query;
+
+    query = find_cached_query(query_desc);
+    if (query)
+        forget_cached_query(query);
+
+    if (prev_executor_end_hook)
+        prev_executor_end_hook(query_desc);
+    else
+        standard_ExecutorEnd(query_desc);
+}
+
+static void result_cache_xact_callback(XactEvent event, void *arg)
+{
+    switch (event)
+    {
+    case XACT_EVENT_PRE_COMMIT:
+    case XACT_EVENT_PRE_PREPARE:
+        publish_writes();
+        break;
+    case XACT_EVENT_COMMIT:
+    case XACT_EVENT_PARALLEL_COMMIT:
+    case XACT_EVENT_ABORT:
+    case XACT_EVENT_PARALLEL_ABORT:
+    case XACT_EVENT_PREPARE:
+        // the queries are freed along with their portals
+        list_free(cached_queries);
+        cached_queries = NIL;
+        bms_free(pending_writes);
+        pending_writes = NULL;
+        break;
+    default:
+        break;
+    }
+}
+
+static void result_cache_relcache_callback(Datum arg, Oid relid)
+{
+    int i;
+
+    if (!result_cache)
+        return;
+
+    if (OidIsValid(relid))
+    {
+        pg_atomic_fetch_add_u64(&result_cache->counters[get_counter(relid)],
+                                1);
+        return;
+    }
+
+    for (i = 0; i < RESULT_CACHE_COUNTERS; i++)
+        pg_atomic_fetch_add_u64(&result_cache->counters[i], 1);
+}
+
+static uint32 get_counter(Oid relid)
+{
+    Oid ids[2];
+
+    ids[0] = MyDatabaseId;
+    ids[1] = relid;
+
+    return (DatumGetUInt32(hash_any((unsigned char *)ids, sizeof(ids))) %
+            RESULT_CACHE_COUNTERS);
+}
+
+void result_cache_note_write(Oid relid)
+{
+    MemoryContext old_mem_cxt;
+
+    if (!result_cache || !OidIsValid(relid))
+        return;
+
+    old_mem_cxt = MemoryContextSwitchTo(TopMemoryContext);
+    pending_writes = bms_add_member(pending_writes, get_counter(relid));
+    MemoryContextSwitchTo(old_mem_cxt);
+}
+
+// COPY FROM and TRUNCATE do not go through the executor
+void result_cache_note_utility(Node *utility_stmt)
+{
+    ListCell *lc;
+
+    if (!result_cache || !utility_stmt)
+        return;
+
+    if (IsA(utility_stmt, CopyStmt))
+    {
+        CopyStmt *stmt = (CopyStmt *)utility_stmt;
+
+        if (stmt->is_from && stmt->relation)
+            result_cache_note_write(
+                RangeVarGetRelid(stmt->relation, NoLock, true));
+    }
+    else if (IsA(utility_stmt, TruncateStmt))
+    {
+        TruncateStmt *stmt = (TruncateStmt *)utility_stmt;
+
+        foreach (lc, stmt->relations)
+        {
+            result_cache_note_write(
+                RangeVarGetRelid(lfirst(lc), NoLock, true));
+        }
+    }
+}
+
+static void note_query_writes(PlannedStmt *stmt)
+{
+    ListCell *lc;
+
+    if (!result_cache)
+        return;
+
+    if (stmt->commandType == CMD_SELECT && !stmt->hasModifyingCTE)
+        return;
+
+    foreach (lc, stmt->resultRelations)
+        result_cache_note_write(rt_fetch(lfirst_int(lc), stmt->rtable)->relid);
+    foreach (lc, stmt->rootResultRelations)
+        result_cache_note_write(rt_fetch(lfirst_int(lc), stmt->rtable)->relid);
+}
+
+/*
+ * Advances the counters of the relations that this transaction has modified,
+ * after recording it as their writer unless a newer transaction is recorded.
+ * This is done before the transaction becomes visible, so any query that
+ * reads the counters after this either sees the transaction, or the newest
+ * writer, as in progress, or it is a query that can see the modifications.
+ */
+static void publish_writes(void)
+{
+    TransactionId xid;
+    uint64 full_xid;
+    int i;
+
+    xid = GetTopTransactionIdIfAny();
+    if (!TransactionIdIsValid(xid))
+        return;
+
+    full_xid = get_full_xid(xid);
+
+    i = -1;
+    while ((i = bms_next_member(pending_writes, i)) >= 0)
+    {
+        pg_atomic_uint64 *writer = &result_cache->writers[i];
+        uint64 old_xid;
+
+        old_xid = pg_atomic_read_u64(writer);
+        while (old_xid < full_xid &&
+               !pg_atomic_compare_exchange_u64(writer, &old_xid, full_xid))
+            ;
+
+        pg_atomic_fetch_add_u64(&result_cache->counters[i], 1);
+    }
+}
+
+// extends an ID that is not newer than the next one with its epoch
+static uint64 get_full_xid(TransactionId xid)
+{
+    TransactionId next_xid;
+    uint32 epoch;
+
+    GetNextXidAndEpoch(&next_xid, &epoch);
+    if (xid > next_xid)
+        epoch--;
+
+    return ((uint64)epoch << 32) | xid;
+}
+
+static bool is_query_cacheable(QueryDesc *query_desc)
+{
+    PlannedStmt *stmt = query_desc->plannedstmt;
+    ParamListInfo params = query_desc->params;
+    bool reads_label = false;
+    ListCell *lc;
+
+    if (!result_cache)
+        return false;
+
+    if (query_desc->operation != CMD_SELECT || stmt->hasModifyingCTE ||
+        stmt->rowMarks != NIL || query_desc->instrument_options != 0 ||
+        !query_desc->sourceText)
+        return false;
+
+    if (IsolationUsesXactSnapshot() ||
+        TransactionIdIsValid(GetTopTransactionIdIfAny()))
+        return false;
+
+    // the values of the parameters must all be known
+    if (params && (params->paramFetch || params->paramCompile))
+        return false;
+
+    foreach (lc, stmt->rtable)
+    {
+        RangeTblEntry *rte = lfirst(lc);
+
+        if (rte->rtekind != RTE_RELATION)
+            continue;
+
+        // their modifications are not tracked
+        if (rte->relkind == RELKIND_FOREIGN_TABLE ||
+            IsCatalogRelationOid(rte->relid))
+            return false;
+
+        if (search_label_relation_cache(rte->relid))
+            reads_label = true;
+    }
+    if (!reads_label)
+        return false;
+
+    // neither are the modifications of ag_catalog
+    foreach (lc, stmt->rtable)
+    {
+        RangeTblEntry *rte = lfirst(lc);
+
+        if (rte->rtekind == RTE_RELATION &&
+            get_rel_namespace(rte->relid) == ag_catalog_namespace_id())
+            return false;
+    }
+
+    return !mutable_planstate_walker(query_desc->planstate, NULL);
+}
+
+// finds the expressions that may not return the same result again
+static bool mutable_planstate_walker(PlanState *planstate, void *context)
+{
+    Plan *plan = planstate->plan;
+
+    // the subqueries are run by the expressions that they are part of
+    if (planstate->initPlan != NIL || planstate->subPlan != NIL)
+        return true;
+
+    if (contain_mutable_calls((Node *)plan->targetlist) ||
+        contain_mutable_calls((Node *)plan->qual))
+        return true;
+
+    switch (nodeTag(plan))
+    {
+    case T_IndexScan:
+        if (contain_mutable_calls((Node *)((IndexScan *)plan)->indexqual) ||
+            contain_mutable_calls((Node *)((IndexScan *)plan)->indexorderby))
+            return true;
+        break;
+    case T_IndexOnlyScan:
+        if (contain_mutable_calls(
+                (Node *)((IndexOnlyScan *)plan)->indexqual) ||
+            contain_mutable_calls(
+                (Node *)((IndexOnlyScan *)plan)->indexorderby))
+            return true;
+        break;
+    case T_BitmapIndexScan:
+        if (contain_mutable_calls(
+                (Node *)((BitmapIndexScan *)plan)->indexqual))
+            return true;
+        break;
+    case T_BitmapHeapScan:
+        if (contain_mutable_calls(
+                (Node *)((BitmapHeapScan *)plan)->bitmapqualorig))
+            return true;
+        break;
+    case T_TidScan:
+        if (contain_mutable_calls((Node *)((TidScan *)plan)->tidquals))
+            return true;
+        break;
+    case T_NestLoop:
+        if (contain_mutable_calls((Node *)((Join *)plan)->joinqual))
+            return true;
+        break;
+    case T_MergeJoin:
+        if (contain_mutable_calls((Node *)((Join *)plan)->joinqual) ||
+            contain_mutable_calls((Node *)((MergeJoin *)plan)->mergeclauses))
+            return true;
+        break;
+    case T_HashJoin:
+        if (contain_mutable_calls((Node *)((Join *)plan)->joinqual) ||
+            contain_mutable_calls((Node *)((HashJoin *)plan)->hashclauses))
+            return true;
+        break;
+    case T_Result:
+        if (contain_mutable_calls(((Result *)plan)->resconstantqual))
+            return true;
+        break;
+    case T_ValuesScan:
+        if (contain_mutable_calls((Node *)((ValuesScan *)plan)->values_lists))
+            return true;
+        break;
+    case T_Limit:
+        if (contain_mutable_calls(((Limit *)plan)->limitOffset) ||
+            contain_mutable_calls(((Limit *)plan)->limitCount))
+            return true;
+        break;
+    case T_WindowAgg:
+        if (contain_mutable_calls(((WindowAgg *)plan)->startOffset) ||
+            contain_mutable_calls(((WindowAgg *)plan)->endOffset))
+            return true;
+        break;
+    case T_CustomScan:
+        // Cypher CREATE modifies the graph
+        if (((CustomScanState *)planstate)->methods ==
+            &cypher_create_exec_methods)
+            return true;
+        if (contain_mutable_calls((Node *)((CustomScan *)plan)->custom_exprs))
+            return true;
+        break;
+    case T_ModifyTable:
+    case T_SampleScan:
+    case T_FunctionScan:
+    case T_TableFuncScan:
+    case T_ForeignScan:
+        return true;
+    default:
+        break;
+    }
+
+    return planstate_tree_walker(planstate, mutable_planstate_walker,
+                                 context);
+}
+
+static bool contain_mutable_calls(Node *node)
+{
+    return contain_mutable_calls_walker(node, NULL);
+}
+
+// does what contain_mutable_functions() does, allowing pure_ag_funcs
+static bool contain_mutable_calls_walker(Node *node, void *context)
+{
+    if (!node)
+        return false;
+
+    if (check_functions_in_node(node, is_mutable_func, context))
+        return true;
+
+    if (IsA(node, SQLValueFunction) || IsA(node, NextValueExpr) ||
+        IsA(node, SubPlan) || IsA(node, AlternativeSubPlan))
+        return true;
+
+    if (IsA(node, Query))
+    {
+        return query_tree_walker((Query *)node, contain_mutable_calls_walker,
+                                 context, 0);
+    }
+
+    return expression_tree_walker(node, contain_mutable_calls_walker,
+                                  context);
+}
+
+static bool is_mutable_func(Oid func_oid, void *context)
+{
+    const char *name;
+
+    if (func_volatile(func_oid) == PROVOLATILE_IMMUTABLE)
+        return false;
+
+    name = search_func_oid_cache(func_oid);
+    if (!name)
+        return true;
+
+    return !bsearch(&name, pure_ag_funcs, lengthof(pure_ag_funcs),
+                    sizeof(pure_ag_funcs[0]), compare_func_names);
+}
+
+static int compare_func_names(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+static void begin_cached_query(QueryDesc *query_desc)
+{
+    PlannedStmt *stmt = query_desc->plannedstmt;
+    MemoryContext old_mem_cxt;
+    result_cache_query *query;
+    ListCell *lc;
+
+    old_mem_cxt = MemoryContextSwitchTo(query_desc->estate->es_query_cxt);
+
+    query = palloc0(sizeof(*query));
+    query->query_desc = query_desc;
+    query->key = make_key(query_desc);
+    query->hash = DatumGetUInt32(hash_any((unsigned char *)query->key->data,
+                                          query->key->len));
+
+    // the counters are read after the snapshot of the query was taken
+    query->tags = palloc(sizeof(relation_tag) * list_length(stmt->rtable));
+    foreach (lc, stmt->rtable)
+    {
+        RangeTblEntry *rte = lfirst(lc);
+        relation_tag *tag;
+
+        if (rte->rtekind != RTE_RELATION)
+            continue;
+
+        tag = &query->tags[query->ntags++];
+        tag->counter = get_counter(rte->relid);
+        tag->value = pg_atomic_read_u64(&result_cache->counters[tag->counter]);
+    }
+
+    search_result(query);
+
+    MemoryContextSwitchTo(TopMemoryContext);
+    cached_queries = lappend(cached_queries, query);
+
+    MemoryContextSwitchTo(old_mem_cxt);
+}
+
+static StringInfo make_key(QueryDesc *query_desc)
+{
+    PlannedStmt *stmt = query_desc->plannedstmt;
+    ParamListInfo params = query_desc->params;
+    StringInfo key;
+    Oid ids[2];
+    int location;
+    int len;
+
+    key = makeStringInfo();
+
+    ids[0] = MyDatabaseId;
+    ids[1] = GetUserId();
+    appendBinaryStringInfo(key, (char *)ids, sizeof(ids));
+
+    appendStringInfoString(key, namespace_search_path);
+    appendStringInfoChar(key, '\0');
+
+    // the statement might be one of many in the query string
+    location = Max(stmt->stmt_location, 0);
+    len = stmt->stmt_len;
+    if (stmt->stmt_location < 0 || len <= 0)
+        len = strlen(query_desc->sourceText + location);
+    appendBinaryStringInfo(key, query_desc->sourceText + location, len);
+    appendStringInfoChar(key, '\0');
+
+    if (params)
+    {
+        int i;
+
+        for (i = 0; i < params->numParams; i++)
+        {
+            ParamExternData *param = &params->params[i];
+            int16 typlen;
+            bool typbyval;
+            Size size;
+            char *start;
+
+            appendBinaryStringInfo(key, (char *)&param->ptype, sizeof(Oid));
+
+            if (OidIsValid(param->ptype))
+            {
+                get_typlenbyval(param->ptype, &typlen, &typbyval);
+            }
+            else
+            {
+                typlen = sizeof(Datum);
+                typbyval = true;
+            }
+
+            size = datumEstimateSpace(param->value, param->isnull, typbyval,
+                                      typlen);
+            enlargeStringInfo(key, size);
+            start = key->data + key->len;
+            datumSerialize(param->value, param->isnull, typbyval, typlen,
+                           &start);
+            key->len += size;
+        }
+    }
+
+    return key;
+}
+
+static result_cache_query *find_cached_query(QueryDesc *query_desc)
+{
+    ListCell *lc;
+
+    foreach (lc, cached_queries)
+    {
+        result_cache_query *query = lfirst(lc);
+
+        if (query->query_desc == query_desc)
+            return query;
+    }
+
+    return NULL;
+}
+
+static void forget_cached_query(result_cache_query *query)
+{
+    cached_queries = list_delete_ptr(cached_queries, query);
+}
+
+static result_cache_slot *get_slot(uint32 hash, LWLock **lock)
+{
+    int i = hash % result_cache_size;
+
+    *lock = &result_cache->locks[i % RESULT_CACHE_PARTITIONS].lock;
+
+    return (result_cache_slot *)(result_cache_slots +
+                                 i * MAXALIGN(RESULT_CACHE_SLOT_SIZE));
+}
+
+static void search_result(result_cache_query *query)
+{
+    result_cache_slot *slot;
+    LWLock *lock;
+    relation_tag *tags;
+    int i;
+
+    slot = get_slot(query->hash, &lock);
+
+    LWLockAcquire(lock, LW_SHARED);
+
+    if (!slot->used || slot->hash != query->hash ||
+        slot->key_len != query->key->len ||
+        memcmp(slot->data, query->key->data, slot->key_len) != 0)
+    {
+        LWLockRelease(lock);
+        return;
+    }
+
+    // the relations the result read must not have been modified since
+    tags = (relation_tag *)(slot->data + MAXALIGN(slot->key_len));
+    for (i = 0; i < slot->ntags; i++)
+    {
+        if (pg_atomic_read_u64(&result_cache->counters[tags[i].counter]) !=
+            tags[i].value)
+        {
+            LWLockRelease(lock);
+            return;
+        }
+    }
+
+    query->found = true;
+    query->ntuples = slot->ntuples;
+    query->tuples = palloc(Max(slot->tuples_len, 1));
+    memcpy(query->tuples,
+           slot->data + get_tuples_offset(slot->key_len, slot->ntags),
+           slot->tuples_len);
+
+    LWLockRelease(lock);
+}
+
+// does what standard_ExecutorRun() does with the tuples of the plan
+static void send_result(QueryDesc *query_desc, result_cache_query *query)
+{
+    EState *estate = query_desc->estate;
+    DestReceiver *dest = query_desc->dest;
+    MemoryContext old_mem_cxt;
+    TupleTableSlot *slot;
+    char *tuple;
+    uint64 i;
+
+    old_mem_cxt = MemoryContextSwitchTo(estate->es_query_cxt);
+
+    query_desc->already_executed = true;
+    estate->es_processed = 0;
+    estate->es_lastoid = InvalidOid;
+
+    dest->rStartup(dest, query_desc->operation, query_desc->tupDesc);
+
+    slot = MakeSingleTupleTableSlot(query_desc->tupDesc);
+    tuple = query->tuples;
+    for (i = 0; i < query->ntuples; i++)
+    {
+        MinimalTuple mtuple = (MinimalTuple)tuple;
+
+        ExecStoreMinimalTuple(mtuple, slot, false);
+        if (!dest->receiveSlot(slot, dest))
+            break;
+        estate->es_processed++;
+
+        tuple += MAXALIGN(mtuple->t_len);
+    }
+    ExecDropSingleTupleTableSlot(slot);
+
+    dest->rShutdown(dest);
+
+    MemoryContextSwitchTo(old_mem_cxt);
+}
+
+static void store_result(result_cache_query *query,
+                         capture_receiver *receiver)
+{
+    Snapshot snapshot = query->query_desc->snapshot;
+    result_cache_slot *slot;
+    LWLock *lock;
+    Size tuples_offset;
+    uint64 xmin;
+    int i;
+
+    if (TransactionIdIsValid(GetTopTransactionIdIfAny()))
+        return;
+
+    for (i = 0; i < query->ntags; i++)
+    {
+        relation_tag *tag = &query->tags[i];
+
+        if (pg_atomic_read_u64(&result_cache->counters[tag->counter]) !=
+            tag->value)
+            return;
+    }
+
+    // the writers are recorded before the counters are advanced
+    pg_read_barrier();
+
+    /*
+     * The transactions older than the xmin of the snapshot had all ended when
+     * it was taken, and any other writer might be in progress in it.
+     */
+    xmin = get_full_xid(snapshot->xmin);
+    for (i = 0; i < query->ntags; i++)
+    {
+        uint32 counter = query->tags[i].counter;
+
+        if (pg_atomic_read_u64(&result_cache->writers[counter]) >= xmin)
+            return;
+    }
+
+    tuples_offset = get_tuples_offset(query->key->len, query->ntags);
+    Assert(tuples_offset + receiver->tuples->len <= SLOT_DATA_SIZE);
+
+    slot = get_slot(query->hash, &lock);
+
+    LWLockAcquire(lock, LW_EXCLUSIVE);
+
+    slot->used = true;
+    slot->hash = query->hash;
+    slot->key_len = query->key->len;
+    slot->ntags = query->ntags;
+    slot->ntuples = receiver->ntuples;
+    slot->tuples_len = receiver->tuples->len;
+    memcpy(slot->data, query->key->data, query->key->len);
+    memcpy(slot->data + MAXALIGN(query->key->len), query->tags,
+           sizeof(relation_tag) * query->ntags);
+    memcpy(slot->data + tuples_offset, receiver->tuples->data,
+           receiver->tuples->len);
+
+    LWLockRelease(lock);
+}
+
+static Size get_tuples_offset(Size key_len, int ntags)
+{
+    return MAXALIGN(key_len) + MAXALIGN(sizeof(relation_tag) * ntags);
+}
+
+static capture_receiver *make_capture_receiver(DestReceiver *dest,
+                                               Size limit)
+{
+    capture_receiver *receiver;
+
+    receiver = palloc0(sizeof(*receiver));
+    receiver->pub.receiveSlot = capture_receive_slot;
+    receiver->pub.rStartup = capture_startup;
+    receiver->pub.rShutdown = capture_shutdown;
+    receiver->pub.rDestroy = capture_destroy;
+    receiver->pub.mydest = dest->mydest;
+    receiver->dest = dest;
+    receiver->tuples = makeStringInfo();
+    receiver->limit = limit;
+
+    // a key too large leaves no room for the tuples
+    receiver->overflowed = (limit > SLOT_DATA_SIZE);
+
+    return receiver;
+}
+
+static void capture_startup(DestReceiver *self, int operation,
+                            TupleDesc typeinfo)
+{
+    capture_receiver *receiver = (capture_receiver *)self;
+
+    receiver->dest->rStartup(receiver->dest, operation, typeinfo);
+}
+
+static bool capture_receive_slot(TupleTableSlot *slot, DestReceiver *self)
+{
+    capture_receiver *receiver = (capture_receiver *)self;
+
+    if (!receiver->overflowed)
+    {
+        MinimalTuple tuple;
+        Size len;
+
+        tuple = ExecCopySlotMinimalTuple(slot);
+        len = MAXALIGN(tuple->t_len);
+
+        if (receiver->tuples->len + len > receiver->limit)
+        {
+            receiver->overflowed = true;
+        }
+        else
+        {
+            StringInfo tuples = receiver->tuples;
+
+            enlargeStringInfo(tuples, len);
+            memset(tuples->data + tuples->len, 0, len);
+            memcpy(tuples->data + tuples->len, tuple, tuple->t_len);
+            tuples->len += len;
+            receiver->ntuples++;
+        }
+
+        pfree(tuple);
+    }
+
+    return receiver->dest->receiveSlot(slot, receiver->dest);
+}
+
+static void capture_shutdown(DestReceiver *self)
+{
+    capture_receiver *receiver = (capture_receiver *)self;
+
+    receiver->dest->rShutdown(receiver->dest);
+}
+
+// the original receiver is destroyed by its owner
+static void capture_destroy(DestReceiver *self)
+{
+}
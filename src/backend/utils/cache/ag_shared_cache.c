@@ -0,0 +1,619 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Shared catalog cache
+ *
+ * When the library is preloaded, the graph and label caches of the backends
+ * are backed by a hash table in shared memory, so that a new backend finds
+ * most of the graphs and the labels there instead of scanning the catalog.
+ * The table holds a copy of the data under each of the keys the data can be
+ * searched by, and the keys include the database.
+ *
+ * The table is partitioned. A search locks the partition of its key, and a
+ * store or a removal locks all the partitions so that all the keys of a graph
+ * or a label are changed at once. The backends remove the entries through the
+ * same invalidation callbacks that flush their own caches, so an entry is
+ * removed as soon as any backend learns that it is stale. Every invalidation
+ * also advances the generation of the cache, and data read from the catalog
+ * is stored only if the generation has not changed since it was read, so data
+ * invalidated during the read is never stored.
+ *
+ * A backend learns of its own changes before they are committed, and another
+ * backend could read the catalog as it was before them, and store it, after
+ * the invalidation. So, the invalidations made by a transaction that has
+ * written anything are made again once it has committed. The catalog is read
+ * with a snapshot taken after the generation, so data read from then on
+ * either has the changes or is stored before the generation is advanced
+ * again, and removed.
+ *
+ * The table has a fixed size. When it is full, new data is kept in the caches
+ * of the backends only.
+ */
+
+#include "postgres.h"
+
+#include "access/transam.h"
+#include "access/xact.h"
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/snapmgr.h"
+
+#include "utils/ag_cache.h"
+#include "utils/ag_shared_cache.h"
+
+#define SHARED_CACHE_PARTITIONS 16
+
+// the number of the keys of a graph and of a label
+#define GRAPH_KEYS 2
+#define LABEL_KEYS 4
+
+typedef enum shared_cache_kind
+{
+    SHARED_GRAPH_NAME,
+    SHARED_GRAPH_NAMESPACE,
+    SHARED_LABEL_OID,
+    SHARED_LABEL_NAME_GRAPH,
+    SHARED_LABEL_GRAPH_ID,
+    SHARED_LABEL_RELATION
+} shared_cache_kind;
+
+#define IS_GRAPH_KIND(kind) \
+    ((kind) == SHARED_GRAPH_NAME || (kind) == SHARED_GRAPH_NAMESPACE)
+
+// the fields that are not a part of the key are zero
+typedef struct shared_cache_key
+{
+    Oid database;
+    int32 kind;
+    Oid oid;
+    int32 id;
+    NameData name;
+} shared_cache_key;
+
+typedef struct shared_cache_entry
+{
+    shared_cache_key key; // hash key
+    union
+    {
+        graph_cache_data graph;
+        label_cache_data label;
+    } data;
+} shared_cache_entry;
+
+typedef struct shared_cache_header
+{
+    LWLockPadded *locks;
+    pg_atomic_uint64 generation;
+    // protected by all the locks
+    int64 nentries;
+} shared_cache_header;
+
+// the maximum number of graphs and labels in the shared cache
+int shared_cache_size = 1024;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+/*
+ * The invalidations to make again when the current transaction commits. The
+ * relations are in TopMemoryContext.
+ */
+static bool pending_graphs = false;
+static bool pending_all_labels = false;
+static List *pending_label_relids = NIL;
+static bool xact_callback_registered = false;
+
+static shared_cache_header *shared_cache = NULL;
+static HTAB *shared_cache_hash = NULL;
+
+static int64 shared_cache_max_entries(void);
+static Size shared_cache_shmem_size(void);
+static void shared_cache_shmem_startup(void);
+static bool shared_cache_usable(void);
+static void init_shared_cache_key(shared_cache_key *key,
+                                  shared_cache_kind kind, Oid oid, int32 id,
+                                  const char *name);
+static bool search_shared_cache(shared_cache_key *key, void *data, Size size);
+static void store_shared_cache(uint64 generation, shared_cache_key *keys,
+                               int nkeys, const void *data, Size size);
+static void remove_shared_cache_entry(shared_cache_key *key);
+static void remove_shared_graphs(void);
+static void remove_shared_labels(Oid relid);
+static void invalidate_at_commit(bool graphs, Oid relid);
+static void shared_cache_xact_callback(XactEvent event, void *arg);
+static void advance_shared_cache_generation(void);
+static void lock_shared_cache(LWLockMode mode);
+static void unlock_shared_cache(void);
+
+void shared_cache_init(void)
+{
+    if (!process_shared_preload_libraries_in_progress ||
+        shared_cache_size <= 0)
+        return;
+
+    RequestAddinShmemSpace(shared_cache_shmem_size());
+    RequestNamedLWLockTranche("age_shared_cache", SHARED_CACHE_PARTITIONS);
+
+    prev_shmem_startup_hook = shmem_startup_hook;
+    shmem_startup_hook = shared_cache_shmem_startup;
+}
+
+static int64 shared_cache_max_entries(void)
+{
+    return (int64)shared_cache_size * LABEL_KEYS;
+}
+
+static Size shared_cache_shmem_size(void)
+{
+    Size size;
+
+    size = MAXALIGN(sizeof(shared_cache_header));
+    size = add_size(size, hash_estimate_size(shared_cache_max_entries(),
+                                             sizeof(shared_cache_entry)));
+
+    return size;
+}
+
+static void shared_cache_shmem_startup(void)
+{
+    bool found;
+    HASHCTL hash_ctl;
+
+    if (prev_shmem_startup_hook)
+        prev_shmem_startup_hook();
+
+    LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+    shared_cache = ShmemInitStruct("age shared catalog cache",
+                                   sizeof(shared_cache_header), &found);
+    if (!found)
+    {
+        shared_cache->locks = GetNamedLWLockTranche("age_shared_cache");
+        pg_atomic_init_u64(&shared_cache->generation, 0);
+        shared_cache->nentries = 0;
+    }
+
+    MemSet(&hash_ctl, 0, sizeof(hash_ctl));
+    hash_ctl.keysize = sizeof(shared_cache_key);
+    hash_ctl.entrysize = sizeof(shared_cache_entry);
+    hash_ctl.num_partitions = SHARED_CACHE_PARTITIONS;
+
+    // all the entries are allocated up front, so storing never runs out
+    shared_cache_hash = ShmemInitHash("age shared catalog cache hash",
+                                      shared_cache_max_entries(),
+                                      shared_cache_max_entries(), &hash_ctl,
+                                      HASH_ELEM | HASH_BLOBS | HASH_PARTITION);
+
+    LWLockRelease(AddinShmemInitLock);
+}
+
+bool shared_cache_enabled(void)
+{
+    return shared_cache_hash != NULL;
+}
+
+/*
+ * A transaction that has written anything might have changed the catalog, and
+ * it must neither see the shared data that its changes made stale nor share
+ * the data that only it can see. So, it uses its own caches only.
+ */
+static bool shared_cache_usable(void)
+{
+    return (shared_cache_enabled() &&
+            !TransactionIdIsValid(GetTopTransactionIdIfAny()));
+}
+
+uint64 get_shared_cache_generation(void)
+{
+    uint64 generation;
+
+    if (!shared_cache_enabled())
+        return 0;
+
+    generation = pg_atomic_read_u64(&shared_cache->generation);
+
+    // the catalog is read with a snapshot taken after this
+    InvalidateCatalogSnapshot();
+
+    return generation;
+}
+
+bool search_shared_graph_name_cache(Name name, graph_cache_data *data)
+{
+    shared_cache_key key;
+
+    if (!shared_cache_usable())
+        return false;
+
+    init_shared_cache_key(&key, SHARED_GRAPH_NAME, InvalidOid, 0,
+                          NameStr(*name));
+
+    return search_shared_cache(&key, data, sizeof(*data));
+}
+
+bool search_shared_graph_namespace_cache(Oid namespace, graph_cache_data *data)
+{
+    shared_cache_key key;
+
+    if (!shared_cache_usable())
+        return false;
+
+    init_shared_cache_key(&key, SHARED_GRAPH_NAMESPACE, namespace, 0, NULL);
+
+    return search_shared_cache(&key, data, sizeof(*data));
+}
+
+void store_shared_graph_cache(uint64 generation, const graph_cache_data *data)
+{
+    shared_cache_key keys[GRAPH_KEYS];
+
+    if (!shared_cache_usable())
+        return;
+
+    init_shared_cache_key(&keys[0], SHARED_GRAPH_NAME, InvalidOid, 0,
+                          NameStr(data->name));
+    init_shared_cache_key(&keys[1], SHARED_GRAPH_NAMESPACE, data->namespace, 0,
+                          NULL);
+
+    store_shared_cache(generation, keys, GRAPH_KEYS, data, sizeof(*data));
+}
+
+/*
+ * Removes all the graphs of the database, the same as the backends do with
+ * their own graph caches.
+ */
+void invalidate_shared_graph_cache(void)
+{
+    if (!shared_cache_enabled())
+        return;
+
+    remove_shared_graphs();
+    invalidate_at_commit(true, InvalidOid);
+}
+
+bool search_shared_label_oid_cache(Oid oid, label_cache_data *data)
+{
+    shared_cache_key key;
+
+    if (!shared_cache_usable())
+        return false;
+
+    init_shared_cache_key(&key, SHARED_LABEL_OID, oid, 0, NULL);
+
+    return search_shared_cache(&key, data, sizeof(*data));
+}
+
+bool search_shared_label_name_graph_cache(Name name, Oid graph,
+                                          label_cache_data *data)
+{
+    shared_cache_key key;
+
+    if (!shared_cache_usable())
+        return false;
+
+    init_shared_cache_key(&key, SHARED_LABEL_NAME_GRAPH, graph, 0,
+                          NameStr(*name));
+
+    return search_shared_cache(&key, data, sizeof(*data));
+}
+
+bool search_shared_label_graph_id_cache(Oid graph, int32 id,
+                                        label_cache_data *data)
+{
+    shared_cache_key key;
+
+    if (!shared_cache_usable())
+        return false;
+
+    init_shared_cache_key(&key, SHARED_LABEL_GRAPH_ID, graph, id, NULL);
+
+    return search_shared_cache(&key, data, sizeof(*data));
+}
+
+bool search_shared_label_relation_cache(Oid relation, label_cache_data *data)
+{
+    shared_cache_key key;
+
+    if (!shared_cache_usable())
+        return false;
+
+    init_shared_cache_key(&key, SHARED_LABEL_RELATION, relation, 0, NULL);
+
+    return search_shared_cache(&key, data, sizeof(*data));
+}
+
+void store_shared_label_cache(uint64 generation, const label_cache_data *data)
+{
+    shared_cache_key keys[LABEL_KEYS];
+
+    if (!shared_cache_usable())
+        return;
+
+    init_shared_cache_key(&keys[0], SHARED_LABEL_OID, data->oid, 0, NULL);
+    init_shared_cache_key(&keys[1], SHARED_LABEL_NAME_GRAPH, data->graph, 0,
+                          NameStr(data->name));
+    init_shared_cache_key(&keys[2], SHARED_LABEL_GRAPH_ID, data->graph,
+                          data->id, NULL);
+    init_shared_cache_key(&keys[3], SHARED_LABEL_RELATION, data->relation, 0,
+                          NULL);
+
+    store_shared_cache(generation, keys, LABEL_KEYS, data, sizeof(*data));
+}
+
+/*
+ * Removes the label backed by the given relation, or all the labels of the
+ * database if relid is InvalidOid.
+ */
+void invalidate_shared_label_cache(Oid relid)
+{
+    if (!shared_cache_enabled())
+        return;
+
+    remove_shared_labels(relid);
+    invalidate_at_commit(false, relid);
+}
+
+static void remove_shared_graphs(void)
+{
+    HASH_SEQ_STATUS hash_seq;
+    shared_cache_entry *entry;
+
+    advance_shared_cache_generation();
+
+    lock_shared_cache(LW_EXCLUSIVE);
+
+    // only the entry just returned may be removed during the scan
+    hash_seq_init(&hash_seq, shared_cache_hash);
+    while ((entry = hash_seq_search(&hash_seq)) != NULL)
+    {
+        if (entry->key.database == MyDatabaseId &&
+            IS_GRAPH_KIND(entry->key.kind))
+            remove_shared_cache_entry(&entry->key);
+    }
+
+    unlock_shared_cache();
+}
+
+static void remove_shared_labels(Oid relid)
+{
+    shared_cache_key key;
+    label_cache_data data;
+
+    advance_shared_cache_generation();
+
+    if (!OidIsValid(relid))
+    {
+        HASH_SEQ_STATUS hash_seq;
+        shared_cache_entry *entry;
+
+        lock_shared_cache(LW_EXCLUSIVE);
+
+        hash_seq_init(&hash_seq, shared_cache_hash);
+        while ((entry = hash_seq_search(&hash_seq)) != NULL)
+        {
+            if (entry->key.database == MyDatabaseId &&
+                !IS_GRAPH_KIND(entry->key.kind))
+                remove_shared_cache_entry(&entry->key);
+        }
+
+        unlock_shared_cache();
+
+        return;
+    }
+
+    /*
+     * Most relations are not labels, so look the relation up first without
+     * blocking the other backends. A label stored after this has been read
+     * after the generation was advanced, so it cannot be stale.
+     */
+    init_shared_cache_key(&key, SHARED_LABEL_RELATION, relid, 0, NULL);
+    if (!search_shared_cache(&key, &data, sizeof(data)))
+        return;
+
+    lock_shared_cache(LW_EXCLUSIVE);
+
+    // the label might have been removed by another backend in the meantime
+    if (hash_search(shared_cache_hash, &key, HASH_FIND, NULL))
+    {
+        shared_cache_key keys[LABEL_KEYS];
+        int i;
+
+        init_shared_cache_key(&keys[0], SHARED_LABEL_OID, data.oid, 0, NULL);
+        init_shared_cache_key(&keys[1], SHARED_LABEL_NAME_GRAPH, data.graph, 0,
+                              NameStr(data.name));
+        init_shared_cache_key(&keys[2], SHARED_LABEL_GRAPH_ID, data.graph,
+                              data.id, NULL);
+        keys[3] = key;
+
+        for (i = 0; i < LABEL_KEYS; i++)
+            remove_shared_cache_entry(&keys[i]);
+    }
+
+    unlock_shared_cache();
+}
+
+/*
+ * Remembers the invalidation to make it again after the current transaction
+ * commits, if the transaction has written anything. Invalidations that are
+ * made again for nothing only cost a search of the shared cache. A prepared
+ * transaction is left to the backends that process its invalidations when it
+ * is committed.
+ */
+static void invalidate_at_commit(bool graphs, Oid relid)
+{
+    MemoryContext old_mcxt;
+
+    if (!TransactionIdIsValid(GetTopTransactionIdIfAny()))
+        return;
+
+    if (!xact_callback_registered)
+    {
+        RegisterXactCallback(shared_cache_xact_callback, NULL);
+        xact_callback_registered = true;
+    }
+
+    if (graphs)
+    {
+        pending_graphs = true;
+        return;
+    }
+
+    if (!OidIsValid(relid))
+    {
+        pending_all_labels = true;
+        return;
+    }
+
+    if (pending_all_labels || list_member_oid(pending_label_relids, relid))
+        return;
+
+    old_mcxt = MemoryContextSwitchTo(TopMemoryContext);
+    pending_label_relids = lappend_oid(pending_label_relids, relid);
+    MemoryContextSwitchTo(old_mcxt);
+}
+
+/*
+ * XACT_EVENT_COMMIT comes after the transaction has become visible to the
+ * other backends, so the data they read from then on has its changes.
+ */
+static void shared_cache_xact_callback(XactEvent event, void *arg)
+{
+    ListCell *lc;
+
+    switch (event)
+    {
+    case XACT_EVENT_COMMIT:
+        if (pending_graphs)
+            remove_shared_graphs();
+        if (pending_all_labels)
+        {
+            remove_shared_labels(InvalidOid);
+        }
+        else
+        {
+            foreach (lc, pending_label_relids)
+                remove_shared_labels(lfirst_oid(lc));
+        }
+        break;
+    case XACT_EVENT_ABORT:
+    case XACT_EVENT_PREPARE:
+        break;
+    default:
+        return;
+    }
+
+    pending_graphs = false;
+    pending_all_labels = false;
+    list_free(pending_label_relids);
+    pending_label_relids = NIL;
+}
+
+static void init_shared_cache_key(shared_cache_key *key,
+                                  shared_cache_kind kind, Oid oid, int32 id,
+                                  const char *name)
+{
+    // the padding and the unused bytes of the name are hashed, too
+    MemSet(key, 0, sizeof(*key));
+    key->database = MyDatabaseId;
+    key->kind = kind;
+    key->oid = oid;
+    key->id = id;
+    if (name)
+        namestrcpy(&key->name, name);
+}
+
+static bool search_shared_cache(shared_cache_key *key, void *data, Size size)
+{
+    uint32 hash_value;
+    LWLock *lock;
+    shared_cache_entry *entry;
+
+    hash_value = get_hash_value(shared_cache_hash, key);
+    lock = &shared_cache->locks[hash_value % SHARED_CACHE_PARTITIONS].lock;
+
+    LWLockAcquire(lock, LW_SHARED);
+
+    entry = hash_search_with_hash_value(shared_cache_hash, key, hash_value,
+                                        HASH_FIND, NULL);
+    if (entry)
+        memcpy(data, &entry->data, size);
+
+    LWLockRelease(lock);
+
+    return entry != NULL;
+}
+
+static void store_shared_cache(uint64 generation, shared_cache_key *keys,
+                               int nkeys, const void *data, Size size)
+{
+    int i;
+
+    lock_shared_cache(LW_EXCLUSIVE);
+
+    if (pg_atomic_read_u64(&shared_cache->generation) != generation ||
+        shared_cache->nentries + nkeys > shared_cache_max_entries())
+    {
+        unlock_shared_cache();
+        return;
+    }
+
+    for (i = 0; i < nkeys; i++)
+    {
+        shared_cache_entry *entry;
+        bool found;
+
+        entry = hash_search(shared_cache_hash, &keys[i], HASH_ENTER, &found);
+        if (!found)
+            shared_cache->nentries++;
+        memcpy(&entry->data, data, size);
+    }
+
+    unlock_shared_cache();
+}
+
+// the caller must hold all the locks
+static void remove_shared_cache_entry(shared_cache_key *key)
+{
+    if (hash_search(shared_cache_hash, key, HASH_REMOVE, NULL))
+        shared_cache->nentries--;
+}
+
+static void advance_shared_cache_generation(void)
+{
+    pg_atomic_fetch_add_u64(&shared_cache->generation, 1);
+}
+
+// the locks are always taken in the same order, so there are no deadlocks
+static void lock_shared_cache(LWLockMode mode)
+{
+    int i;
+
+    for (i = 0; i < SHARED_CACHE_PARTITIONS; i++)
+        LWLockAcquire(&shared_cache->locks[i].lock, mode);
+}
+
+static void unlock_shared_cache(void)
+{
+    int i;
+
+    for (i = SHARED_CACHE_PARTITIONS - 1; i >= 0; i--)
+        LWLockRelease(&shared_cache->locks[i].lock);
+}
@@ -0,0 +1,435 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Centrality functions
+ *
+ * They run on the CSR graph of the edge labels given (see csr_graph.c), so the
+ * edges are read from dense arrays instead of the label tables, and return a
+ * row for every vertex of the graph. PageRank and betweenness centrality run
+ * as jobs (see csr_traversal.c), so on large graphs the traversal workers
+ * share their work with the backend.
+ */
+
+#include "postgres.h"
+
+#include <math.h>
+
+#include "fmgr.h"
+#include "miscadmin.h"
+
+#include "utils/csr_graph.h"
+#include "utils/csr_traversal.h"
+#include "utils/graphid.h"
+
+// the phases of an iteration of PageRank
+#define PAGERANK_CONTRIB 0
+#define PAGERANK_PULL 1
+
+typedef struct pagerank_args
+{
+    double damping;
+    // the rank every vertex gets in the current iteration before its edges
+    double base;
+    Size rank_offset;
+    Size contrib_offset;
+    // the sum of each morsel of a step, added up in order by the backend
+    Size partial_offset;
+} pagerank_args;
+
+typedef struct betweenness_args
+{
+    // the scores each participant adds to, nvertices of them per participant
+    Size score_offset;
+} betweenness_args;
+
+// the arrays of the searches of a participant, made on its first morsel
+typedef struct betweenness_local
+{
+    double *sigma;
+    double *delta;
+    int64 *dist;
+    csr_vertex *order;
+} betweenness_local;
+
+static double sum_partials(const double *partial, uint64 n);
+
+PG_FUNCTION_INFO_V1(pagerank);
+
+/*
+ * The ranks are pulled along the incoming edges of each vertex, so every
+ * iteration writes each rank once and reads the ranks of the neighbors, which
+ * are stored in ascending order, instead of scattering writes over the array.
+ * The rank of the vertices without outgoing edges is spread over all the
+ * vertices. The iterations stop early once the ranks change by less than the
+ * tolerance in total.
+ *
+ * An iteration is two steps over the vertices, one that computes what each
+ * vertex passes along its edges and one that pulls it. Neither writes what
+ * another morsel reads, and the sums that decide the next iteration are kept
+ * per morsel and added up in order, so the ranks do not depend on how the
+ * morsels were shared out.
+ */
+Datum pagerank(PG_FUNCTION_ARGS)
+{
+    csr_graph *csr;
+    int32 iterations;
+    double damping;
+    double tolerance;
+    csr_job *job;
+    pagerank_args *args;
+    Size rank_offset;
+    Size contrib_offset;
+    Size partial_offset;
+    double *rank;
+    double *partial;
+    Tuplestorestate *tupstore;
+    TupleDesc tupdesc;
+    uint64 n;
+    uint64 nmorsels;
+    uint64 v;
+    int32 i;
+
+    iterations = PG_ARGISNULL(2) ? 20 : PG_GETARG_INT32(2);
+    damping = PG_ARGISNULL(3) ? 0.85 : PG_GETARG_FLOAT8(3);
+    tolerance = PG_ARGISNULL(4) ? 0.000001 : PG_GETARG_FLOAT8(4);
+
+    if (iterations < 1)
+    {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                        errmsg("iterations must be greater than 0")));
+    }
+    if (damping < 0 || damping > 1)
+    {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                        errmsg("damping must be between 0 and 1")));
+    }
+    if (tolerance < 0)
+    {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                        errmsg("tolerance must not be negative")));
+    }
+
+    tupstore = begin_csr_result(fcinfo, &tupdesc);
+    csr = get_csr_graph_arg(fcinfo, 0, 1);
+
+    n = csr->nvertices;
+    nmorsels = (n + CSR_MORSEL_SIZE - 1) / CSR_MORSEL_SIZE;
+
+    job = begin_csr_job(csr, CSR_KERNEL_PAGERANK, sizeof(pagerank_args));
+    rank_offset = reserve_csr_job_space(job, sizeof(double) * Max(n, 1));
+    contrib_offset = reserve_csr_job_space(job, sizeof(double) * Max(n, 1));
+    partial_offset = reserve_csr_job_space(job,
+                                           sizeof(double) * Max(nmorsels, 1));
+    start_csr_job(job);
+
+    args = job->args;
+    args->damping = damping;
+    args->base = 0;
+    args->rank_offset = rank_offset;
+    args->contrib_offset = contrib_offset;
+    args->partial_offset = partial_offset;
+
+    rank = csr_job_space(job, rank_offset);
+    partial = csr_job_space(job, partial_offset);
+
+    for (v = 0; v < n; v++)
+        rank[v] = 1.0 / n;
+
+    for (i = 0; i < iterations && n > 0; i++)
+    {
+        double dangling;
+
+        run_csr_job_step(job, PAGERANK_CONTRIB, n, CSR_MORSEL_SIZE);
+        dangling = sum_partials(partial, nmorsels);
+
+        args->base = (1 - damping + damping * dangling) / n;
+
+        run_csr_job_step(job, PAGERANK_PULL, n, CSR_MORSEL_SIZE);
+        if (sum_partials(partial, nmorsels) < tolerance)
+            break;
+    }
+
+    for (v = 0; v < n; v++)
+    {
+        Datum values[2];
+        bool nulls[2] = {false, false};
+
+        values[0] = GRAPHID_GET_DATUM(csr->vertex_ids[v]);
+        values[1] = Float8GetDatum(rank[v]);
+
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+
+    end_csr_job(job);
+    release_csr_graph(csr);
+
+    return (Datum)0;
+}
+
+/*
+ * PAGERANK_CONTRIB sums the ranks of the vertices without outgoing edges, and
+ * PAGERANK_PULL sums how much the ranks changed.
+ */
+void pagerank_morsel(csr_job *job, uint32 phase, uint64 begin, uint64 end)
+{
+    pagerank_args *args = job->args;
+    const csr_graph *csr = job->csr;
+    double *rank = csr_job_space(job, args->rank_offset);
+    double *contrib = csr_job_space(job, args->contrib_offset);
+    double *partial = csr_job_space(job, args->partial_offset);
+    double sum = 0;
+    uint64 v;
+
+    for (v = begin; v < end; v++)
+    {
+        if (phase == PAGERANK_CONTRIB)
+        {
+            uint64 degree = csr_degree(&csr->out, v);
+
+            if (degree == 0)
+            {
+                sum += rank[v];
+                contrib[v] = 0;
+            }
+            else
+            {
+                contrib[v] = rank[v] / degree;
+            }
+        }
+        else
+        {
+            csr_neighbor_iterator it;
+            csr_vertex u;
+            double pulled = 0;
+            double new_rank;
+
+            csr_begin_neighbors(&csr->in, v, &it);
+            while (csr_next_neighbor(&it, &u))
+                pulled += contrib[u];
+
+            new_rank = args->base + args->damping * pulled;
+            sum += fabs(new_rank - rank[v]);
+            rank[v] = new_rank;
+        }
+    }
+
+    partial[begin / CSR_MORSEL_SIZE] = sum;
+}
+
+PG_FUNCTION_INFO_V1(degree_centrality);
+
+// the centrality is the number of the edges of a vertex over n - 1
+Datum degree_centrality(PG_FUNCTION_ARGS)
+{
+    csr_graph *csr;
+    Tuplestorestate *tupstore;
+    TupleDesc tupdesc;
+    uint64 v;
+
+    tupstore = begin_csr_result(fcinfo, &tupdesc);
+    csr = get_csr_graph_arg(fcinfo, 0, 1);
+
+    for (v = 0; v < csr->nvertices; v++)
+    {
+        Datum values[4];
+        bool nulls[4] = {false, false, false, false};
+        uint64 out_degree = csr_degree(&csr->out, v);
+        uint64 in_degree = csr_degree(&csr->in, v);
+
+        values[0] = GRAPHID_GET_DATUM(csr->vertex_ids[v]);
+        values[1] = Int64GetDatum(out_degree);
+        values[2] = Int64GetDatum(in_degree);
+        if (csr->nvertices > 1)
+        {
+            values[3] = Float8GetDatum((double)(out_degree + in_degree) /
+                                       (csr->nvertices - 1));
+        }
+        else
+        {
+            values[3] = Float8GetDatum(0);
+        }
+
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+
+    release_csr_graph(csr);
+
+    return (Datum)0;
+}
+
+PG_FUNCTION_INFO_V1(betweenness_centrality);
+
+/*
+ * Brandes' algorithm along the directed edges. A breadth-first search from
+ * each vertex counts the shortest paths to every other vertex, and the
+ * dependencies are accumulated back in the reverse order of the search. The
+ * predecessors of a vertex on the shortest paths are found again among its
+ * incoming edges instead of being kept in lists.
+ *
+ * The searches are independent of each other, so the sources are the items
+ * of a single step, one per morsel since each one takes time proportional to
+ * the size of the graph. Each participant adds the dependencies it finds to
+ * scores of its own, which the backend adds up at the end.
+ */
+Datum betweenness_centrality(PG_FUNCTION_ARGS)
+{
+    csr_graph *csr;
+    Tuplestorestate *tupstore;
+    TupleDesc tupdesc;
+    csr_job *job;
+    betweenness_args *args;
+    Size score_offset;
+    double *score;
+    uint64 n;
+    uint64 v;
+    int p;
+
+    tupstore = begin_csr_result(fcinfo, &tupdesc);
+    csr = get_csr_graph_arg(fcinfo, 0, 1);
+
+    n = csr->nvertices;
+
+    job = begin_csr_job(csr, CSR_KERNEL_BETWEENNESS, sizeof(betweenness_args));
+    score_offset = reserve_csr_job_space(
+        job, sizeof(double) * Max(n, 1) * job->nparticipants);
+    start_csr_job(job);
+
+    args = job->args;
+    args->score_offset = score_offset;
+
+    score = csr_job_space(job, score_offset);
+    for (v = 0; v < n * job->nparticipants; v++)
+        score[v] = 0;
+
+    run_csr_job_step(job, 0, n, 1);
+
+    for (p = 1; p < job->nparticipants; p++)
+    {
+        for (v = 0; v < n; v++)
+            score[v] += score[p * n + v];
+    }
+
+    for (v = 0; v < n; v++)
+    {
+        Datum values[2];
+        bool nulls[2] = {false, false};
+
+        values[0] = GRAPHID_GET_DATUM(csr->vertex_ids[v]);
+        values[1] = Float8GetDatum(score[v]);
+
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+
+    end_csr_job(job);
+    release_csr_graph(csr);
+
+    return (Datum)0;
+}
+
+// runs the searches from the sources from begin to end
+void betweenness_morsel(csr_job *job, uint32 phase, uint64 begin, uint64 end)
+{
+    betweenness_args *args = job->args;
+    const csr_graph *csr = job->csr;
+    uint64 n = csr->nvertices;
+    betweenness_local *local = job->local;
+    double *score;
+    uint64 s;
+    uint64 v;
+
+    if (!local)
+    {
+        local = palloc(sizeof(betweenness_local));
+        local->sigma = alloc_csr_array(n, sizeof(double));
+        local->delta = alloc_csr_array(n, sizeof(double));
+        local->dist = alloc_csr_array(n, sizeof(int64));
+        local->order = alloc_csr_array(n, sizeof(csr_vertex));
+        job->local = local;
+    }
+
+    score = (double *)csr_job_space(job, args->score_offset) +
+            job->participant * n;
+
+    for (s = begin; s < end; s++)
+    {
+        double *sigma = local->sigma;
+        double *delta = local->delta;
+        int64 *dist = local->dist;
+        csr_vertex *order = local->order;
+        uint64 head = 0;
+        uint64 tail = 0;
+
+        for (v = 0; v < n; v++)
+        {
+            sigma[v] = 0;
+            delta[v] = 0;
+            dist[v] = -1;
+        }
+
+        sigma[s] = 1;
+        dist[s] = 0;
+        order[tail++] = s;
+
+        // the queue of the search is also the order the vertices are found in
+        while (head < tail)
+        {
+            csr_vertex u = order[head++];
+            csr_neighbor_iterator it;
+            csr_vertex w;
+
+            csr_begin_neighbors(&csr->out, u, &it);
+            while (csr_next_neighbor(&it, &w))
+            {
+                if (dist[w] < 0)
+                {
+                    dist[w] = dist[u] + 1;
+                    order[tail++] = w;
+                }
+                if (dist[w] == dist[u] + 1)
+                    sigma[w] += sigma[u];
+            }
+        }
+
+        while (tail > 1)
+        {
+            csr_vertex w = order[--tail];
+            csr_neighbor_iterator it;
+            csr_vertex u;
+
+            csr_begin_neighbors(&csr->in, w, &it);
+            while (csr_next_neighbor(&it, &u))
+            {
+                if (dist[u] >= 0 && dist[u] == dist[w] - 1)
+                    delta[u] += sigma[u] / sigma[w] * (1 + delta[w]);
+            }
+
+            score[w] += delta[w];
+        }
+    }
+}
+
+// adds up the sums of the morsels of a step in order
+static double sum_partials(const double *partial, uint64 n)
+{
+    double sum = 0;
+    uint64 i;
+
+    for (i = 0; i < n; i++)
+        sum += partial[i];
+
+    return sum;
+}
@@ -0,0 +1,825 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Community detection
+ *
+ * Both functions ignore the direction of the edges. Louvain needs the weights
+ * of the edges, which the CSR graph does not have, so it reads the edges from
+ * the label tables and keeps them in an adjacency of its own. Label
+ * propagation runs on the CSR graph. Either way, the communities are numbered
+ * from 1 in the order of the smallest graphid in them.
+ *
+ * The sweeps over the vertices of both run as jobs (see csr_traversal.c), in
+ * which the vertices see the moves made before them, by any participant. In
+ * the backend alone, that is the order of the vertices, so the result only
+ * depends on the graph; with traversal workers, it also depends on how the
+ * moves interleave.
+ */
+
+#include "postgres.h"
+
+#include "fmgr.h"
+#include "miscadmin.h"
+#include "utils/builtins.h"
+
+#include "utils/csr_graph.h"
+#include "utils/csr_traversal.h"
+#include "utils/graphid.h"
+
+// the phases of the local moving of Louvain
+#define LOUVAIN_MOVE 0
+#define LOUVAIN_MODULARITY 1
+
+/*
+ * With traversal workers, the local moving stops once a sweep raises the
+ * modularity by less than this, since concurrent moves can keep swapping
+ * vertices between two communities.
+ */
+#define LOUVAIN_MIN_GAIN 0.0000001
+
+typedef struct weighted_edge
+{
+    csr_vertex vertex;
+    double weight;
+} weighted_edge;
+
+/*
+ * An undirected graph with the edges of each vertex sorted by their other
+ * vertex, and parallel edges merged. Each edge is in the lists of both its
+ * vertices, and a self-loop is in the list of its vertex once, with twice its
+ * weight, so the degree of a vertex is the sum of the weights in its list.
+ */
+typedef struct weighted_graph
+{
+    uint64 nvertices;
+    uint64 *offsets;
+    weighted_edge *edges;
+    double *degrees;
+    // the sum of the degrees, twice the weight of all the edges
+    double total;
+} weighted_graph;
+
+typedef struct louvain_args
+{
+    uint64 nvertices;
+    double total;
+    // the number of the vertices moved in the current sweep
+    pg_atomic_uint64 nmoved;
+    // the weighted graph, copied from the backend
+    Size offsets_offset;
+    Size edges_offset;
+    Size degrees_offset;
+    // the community of each vertex, and the total degree of each community
+    Size community_offset;
+    Size tot_offset;
+    // the modularity of the vertices of each morsel of LOUVAIN_MODULARITY
+    Size partial_offset;
+} louvain_args;
+
+// the weight of the edges of a vertex to each community, -1 if none
+typedef struct louvain_local
+{
+    double *link;
+    csr_vertex *touched;
+} louvain_local;
+
+typedef struct label_propagation_args
+{
+    uint64 max_degree;
+    // set when a vertex changes its label in the current iteration
+    pg_atomic_uint32 changed;
+    Size label_offset;
+} label_propagation_args;
+
+static weighted_graph *build_weighted_graph(csr_edge_list *edges);
+static weighted_graph *aggregate_communities(weighted_graph *wg,
+                                             const csr_vertex *community,
+                                             uint64 ncommunities);
+static weighted_graph *make_weighted_graph(uint64 nvertices, uint64 *offsets,
+                                           weighted_edge *edges);
+static void free_weighted_graph(weighted_graph *wg);
+static bool move_vertices(weighted_graph *wg, csr_vertex *community);
+static uint64 renumber_communities(csr_vertex *community, uint64 n);
+static int compare_weighted_edges(const void *a, const void *b);
+static int compare_csr_vertices(const void *a, const void *b);
+static double get_modularity(csr_job *job, uint64 nmorsels);
+static double read_double(pg_atomic_uint64 *ptr);
+static void add_double(pg_atomic_uint64 *ptr, double value);
+
+PG_FUNCTION_INFO_V1(louvain);
+
+/*
+ * Each level moves the vertices, one at a time, to the community of a
+ * neighbor that increases the modularity the most, until no move does. The
+ * communities found then become the vertices of the graph of the next level.
+ * It stops at the first level that moves no vertex.
+ */
+Datum louvain(PG_FUNCTION_ARGS)
+{
+    graph_cache_data *cache;
+    List *label_ids;
+    char *weight_key;
+    csr_edge_list *edges;
+    weighted_graph *wg;
+    csr_vertex *community;
+    csr_vertex *level_community;
+    Tuplestorestate *tupstore;
+    TupleDesc tupdesc;
+    uint64 v;
+
+    tupstore = begin_csr_result(fcinfo, &tupdesc);
+
+    cache = get_graph_cache_arg(fcinfo, 0);
+    label_ids = get_csr_label_ids(
+        cache, PG_ARGISNULL(1) ? NULL : PG_GETARG_ARRAYTYPE_P(1));
+    weight_key = PG_ARGISNULL(2) ? NULL : text_to_cstring(PG_GETARG_TEXT_PP(2));
+
+    edges = read_csr_edges(cache, label_ids, weight_key);
+    wg = build_weighted_graph(edges);
+
+    // the community of each vertex among the vertices of the current level
+    community = alloc_csr_array(edges->nvertices, sizeof(csr_vertex));
+    for (v = 0; v < edges->nvertices; v++)
+        community[v] = v;
+
+    for (;;)
+    {
+        weighted_graph *next;
+        uint64 ncommunities;
+
+        level_community = alloc_csr_array(wg->nvertices, sizeof(csr_vertex));
+        for (v = 0; v < wg->nvertices; v++)
+            level_community[v] = v;
+
+        if (!move_vertices(wg, level_community))
+            break;
+
+        ncommunities = renumber_communities(level_community, wg->nvertices);
+
+        for (v = 0; v < edges->nvertices; v++)
+            community[v] = level_community[community[v]];
+
+        // the vertices have only swapped communities
+        if (ncommunities == wg->nvertices)
+            break;
+
+        next = aggregate_communities(wg, level_community, ncommunities);
+        free_weighted_graph(wg);
+        pfree(level_community);
+        wg = next;
+    }
+
+    /*
+     * The communities are renumbered in the order of their first vertex at
+     * every level, so they already are in the order of their smallest graphid.
+     */
+    for (v = 0; v < edges->nvertices; v++)
+    {
+        Datum values[2];
+        bool nulls[2] = {false, false};
+
+        values[0] = GRAPHID_GET_DATUM(edges->vertex_ids[v]);
+        values[1] = Int64GetDatum((int64)community[v] + 1);
+
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+
+    return (Datum)0;
+}
+
+PG_FUNCTION_INFO_V1(label_propagation);
+
+/*
+ * Every vertex starts in a community of its own and takes the community most
+ * of its neighbors are in, counting an edge in either direction as one vote.
+ * The vertices are visited in order and see the moves made before them in the
+ * same iteration. A vertex stays in its community if that is one of the most
+ * common ones, otherwise ties go to the smallest community, so the result
+ * does not depend on anything but the graph and, with traversal workers, the
+ * interleaving of the moves.
+ */
+Datum label_propagation(PG_FUNCTION_ARGS)
+{
+    csr_graph *csr;
+    int32 iterations;
+    csr_job *job;
+    label_propagation_args *args;
+    Size label_offset;
+    pg_atomic_uint32 *label;
+    int64 *number;
+    int64 ncommunities = 0;
+    uint64 max_degree = 0;
+    Tuplestorestate *tupstore;
+    TupleDesc tupdesc;
+    uint64 v;
+    int32 i;
+
+    iterations = PG_ARGISNULL(2) ? 20 : PG_GETARG_INT32(2);
+    if (iterations < 1)
+    {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                        errmsg("iterations must be greater than 0")));
+    }
+
+    tupstore = begin_csr_result(fcinfo, &tupdesc);
+    csr = get_csr_graph_arg(fcinfo, 0, 1);
+
+    job = begin_csr_job(csr, CSR_KERNEL_LABEL_PROPAGATION,
+                        sizeof(label_propagation_args));
+    label_offset = reserve_csr_job_space(
+        job, sizeof(pg_atomic_uint32) * Max(csr->nvertices, 1));
+    start_csr_job(job);
+
+    label = csr_job_space(job, label_offset);
+    for (v = 0; v < csr->nvertices; v++)
+    {
+        uint64 degree = csr_degree(&csr->out, v) + csr_degree(&csr->in, v);
+
+        pg_atomic_init_u32(&label[v], v);
+        max_degree = Max(max_degree, degree);
+    }
+
+    args = job->args;
+    args->max_degree = max_degree;
+    pg_atomic_init_u32(&args->changed, 0);
+    args->label_offset = label_offset;
+
+    for (i = 0; i < iterations; i++)
+    {
+        pg_atomic_write_u32(&args->changed, 0);
+        run_csr_job_step(job, 0, csr->nvertices, CSR_MORSEL_SIZE);
+
+        if (!pg_atomic_read_u32(&args->changed))
+            break;
+    }
+
+    number = alloc_csr_array(csr->nvertices, sizeof(int64));
+    for (v = 0; v < csr->nvertices; v++)
+        number[v] = 0;
+
+    for (v = 0; v < csr->nvertices; v++)
+    {
+        Datum values[2];
+        bool nulls[2] = {false, false};
+        csr_vertex l = pg_atomic_read_u32(&label[v]);
+
+        if (number[l] == 0)
+            number[l] = ++ncommunities;
+
+        values[0] = GRAPHID_GET_DATUM(csr->vertex_ids[v]);
+        values[1] = Int64GetDatum(number[l]);
+
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+
+    end_csr_job(job);
+    release_csr_graph(csr);
+
+    return (Datum)0;
+}
+
+// moves the vertices from begin to end to the community most neighbors are in
+void label_propagation_morsel(csr_job *job, uint32 phase, uint64 begin,
+                              uint64 end)
+{
+    label_propagation_args *args = job->args;
+    const csr_graph *csr = job->csr;
+    pg_atomic_uint32 *label = csr_job_space(job, args->label_offset);
+    csr_vertex *buf = job->local;
+    uint64 v;
+
+    // the labels of the neighbors of a vertex
+    if (!buf)
+    {
+        buf = alloc_csr_array(Max(args->max_degree, 1), sizeof(csr_vertex));
+        job->local = buf;
+    }
+
+    for (v = begin; v < end; v++)
+    {
+        csr_neighbor_iterator it;
+        csr_vertex w;
+        uint64 len = 0;
+        csr_vertex own = pg_atomic_read_u32(&label[v]);
+        csr_vertex best = own;
+        uint64 best_count = 0;
+        uint64 own_count = 0;
+        uint64 j;
+
+        csr_begin_neighbors(&csr->out, v, &it);
+        while (csr_next_neighbor(&it, &w))
+        {
+            if (w != v)
+                buf[len++] = pg_atomic_read_u32(&label[w]);
+        }
+        csr_begin_neighbors(&csr->in, v, &it);
+        while (csr_next_neighbor(&it, &w))
+        {
+            if (w != v)
+                buf[len++] = pg_atomic_read_u32(&label[w]);
+        }
+
+        if (len == 0)
+            continue;
+
+        // count the votes for each community in runs of the sorted labels
+        qsort(buf, len, sizeof(csr_vertex), compare_csr_vertices);
+        for (j = 0; j < len;)
+        {
+            uint64 start = j;
+
+            while (j < len && buf[j] == buf[start])
+                j++;
+
+            if (buf[start] == own)
+                own_count = j - start;
+            if (j - start > best_count)
+            {
+                best = buf[start];
+                best_count = j - start;
+            }
+        }
+
+        if (own_count == best_count || best == own)
+            continue;
+
+        pg_atomic_write_u32(&label[v], best);
+        pg_atomic_write_u32(&args->changed, 1);
+    }
+}
+
+// edges without weights weigh 1
+static weighted_graph *build_weighted_graph(csr_edge_list *edges)
+{
+    uint64 n = edges->nvertices;
+    uint64 *offsets;
+    uint64 *next;
+    weighted_edge *list;
+    uint64 v;
+    uint64 i;
+
+    offsets = alloc_csr_array(n + 1, sizeof(uint64));
+    memset(offsets, 0, sizeof(uint64) * (n + 1));
+    for (i = 0; i < edges->nedges; i++)
+    {
+        offsets[edges->starts[i] + 1]++;
+        if (edges->ends[i] != edges->starts[i])
+            offsets[edges->ends[i] + 1]++;
+    }
+    for (v = 0; v < n; v++)
+        offsets[v + 1] += offsets[v];
+
+    next = alloc_csr_array(n + 1, sizeof(uint64));
+    memcpy(next, offsets, sizeof(uint64) * (n + 1));
+
+    list = alloc_csr_array(offsets[n], sizeof(weighted_edge));
+    for (i = 0; i < edges->nedges; i++)
+    {
+        csr_vertex start = edges->starts[i];
+        csr_vertex end = edges->ends[i];
+        double weight = edges->weights ? edges->weights[i] : 1;
+
+        if (start == end)
+        {
+            list[next[start]].vertex = start;
+            list[next[start]++].weight = 2 * weight;
+        }
+        else
+        {
+            list[next[start]].vertex = end;
+            list[next[start]++].weight = weight;
+            list[next[end]].vertex = start;
+            list[next[end]++].weight = weight;
+        }
+    }
+
+    pfree(next);
+
+    return make_weighted_graph(n, offsets, list);
+}
+
+/*
+ * Returns the graph of the communities, in which the weight of the edge
+ * between two communities is the sum of the weights of the edges between
+ * their vertices, and the edges within a community become its self-loop.
+ */
+static weighted_graph *aggregate_communities(weighted_graph *wg,
+                                             const csr_vertex *community,
+                                             uint64 ncommunities)
+{
+    uint64 *offsets;
+    uint64 *next;
+    weighted_edge *list;
+    uint64 v;
+    uint64 c;
+    uint64 i;
+
+    offsets = alloc_csr_array(ncommunities + 1, sizeof(uint64));
+    memset(offsets, 0, sizeof(uint64) * (ncommunities + 1));
+    for (v = 0; v < wg->nvertices; v++)
+        offsets[community[v] + 1] += wg->offsets[v + 1] - wg->offsets[v];
+    for (c = 0; c < ncommunities; c++)
+        offsets[c + 1] += offsets[c];
+
+    next = alloc_csr_array(ncommunities + 1, sizeof(uint64));
+    memcpy(next, offsets, sizeof(uint64) * (ncommunities + 1));
+
+    list = alloc_csr_array(offsets[ncommunities], sizeof(weighted_edge));
+    for (v = 0; v < wg->nvertices; v++)
+    {
+        for (i = wg->offsets[v]; i < wg->offsets[v + 1]; i++)
+        {
+            list[next[community[v]]].vertex = community[wg->edges[i].vertex];
+            list[next[community[v]]++].weight = wg->edges[i].weight;
+        }
+    }
+
+    pfree(next);
+
+    return make_weighted_graph(ncommunities, offsets, list);
+}
+
+/*
+ * Sorts the edges of each vertex and merges the parallel ones, in place, and
+ * computes the degrees of the vertices.
+ */
+static weighted_graph *make_weighted_graph(uint64 nvertices, uint64 *offsets,
+                                           weighted_edge *edges)
+{
+    weighted_graph *wg;
+    uint64 start = 0;
+    uint64 len = 0;
+    uint64 v;
+    uint64 i;
+
+    wg = palloc0(sizeof(weighted_graph));
+    wg->nvertices = nvertices;
+    wg->offsets = offsets;
+    wg->edges = edges;
+    wg->degrees = alloc_csr_array(nvertices, sizeof(double));
+
+    for (v = 0; v < nvertices; v++)
+    {
+        uint64 end = offsets[v + 1];
+        uint64 first = len;
+        double degree = 0;
+
+        CHECK_FOR_INTERRUPTS();
+
+        if (end - start > 1)
+        {
+            qsort(edges + start, end - start, sizeof(weighted_edge),
+                  compare_weighted_edges);
+        }
+
+        for (i = start; i < end; i++)
+        {
+            if (len > first && edges[len - 1].vertex == edges[i].vertex)
+                edges[len - 1].weight += edges[i].weight;
+            else
+                edges[len++] = edges[i];
+
+            degree += edges[i].weight;
+        }
+
+        wg->degrees[v] = degree;
+        wg->total += degree;
+
+        offsets[v + 1] = len;
+        start = end;
+    }
+
+    return wg;
+}
+
+static void free_weighted_graph(weighted_graph *wg)
+{
+    pfree(wg->offsets);
+    pfree(wg->edges);
+    pfree(wg->degrees);
+    pfree(wg);
+}
+
+/*
+ * The local moving phase of Louvain. community must have every vertex in a
+ * community of its own. Returns whether any vertex was moved.
+ *
+ * Each step of the job is a sweep over the vertices, and the sweeps go on
+ * until one moves no vertex or, with traversal workers, raises the modularity
+ * by less than LOUVAIN_MIN_GAIN. The graph is copied to the job, so that the
+ * workers can read it.
+ */
+static bool move_vertices(weighted_graph *wg, csr_vertex *community)
+{
+    uint64 n = wg->nvertices;
+    uint64 nmorsels = (n + CSR_MORSEL_SIZE - 1) / CSR_MORSEL_SIZE;
+    csr_job *job;
+    louvain_args *args;
+    Size offsets[6];
+    pg_atomic_uint32 *shared_community;
+    pg_atomic_uint64 *tot;
+    double modularity = 0;
+    bool moved_any = false;
+    uint64 v;
+
+    if (wg->total <= 0)
+        return false;
+
+    // each edge is in the lists of both its vertices
+    job = begin_graph_job(wg->offsets[n] / 2, CSR_KERNEL_LOUVAIN,
+                          sizeof(louvain_args));
+    offsets[0] = reserve_csr_job_space(job, sizeof(uint64) * (n + 1));
+    offsets[1] = reserve_csr_job_space(
+        job, sizeof(weighted_edge) * Max(wg->offsets[n], 1));
+    offsets[2] = reserve_csr_job_space(job, sizeof(double) * Max(n, 1));
+    offsets[3] = reserve_csr_job_space(job,
+                                       sizeof(pg_atomic_uint32) * Max(n, 1));
+    offsets[4] = reserve_csr_job_space(job,
+                                       sizeof(pg_atomic_uint64) * Max(n, 1));
+    offsets[5] = reserve_csr_job_space(job, sizeof(double) * Max(nmorsels, 1));
+    start_csr_job(job);
+
+    args = job->args;
+    args->nvertices = n;
+    args->total = wg->total;
+    pg_atomic_init_u64(&args->nmoved, 0);
+    args->offsets_offset = offsets[0];
+    args->edges_offset = offsets[1];
+    args->degrees_offset = offsets[2];
+    args->community_offset = offsets[3];
+    args->tot_offset = offsets[4];
+    args->partial_offset = offsets[5];
+
+    memcpy(csr_job_space(job, offsets[0]), wg->offsets,
+           sizeof(uint64) * (n + 1));
+    memcpy(csr_job_space(job, offsets[1]), wg->edges,
+           sizeof(weighted_edge) * wg->offsets[n]);
+    memcpy(csr_job_space(job, offsets[2]), wg->degrees, sizeof(double) * n);
+
+    shared_community = csr_job_space(job, offsets[3]);
+    tot = csr_job_space(job, offsets[4]);
+    for (v = 0; v < n; v++)
+    {
+        pg_atomic_init_u32(&shared_community[v], community[v]);
+        pg_atomic_init_u64(&tot[v], 0);
+        add_double(&tot[v], wg->degrees[v]);
+    }
+
+    if (job->nlaunched > 0)
+        modularity = get_modularity(job, nmorsels);
+
+    for (;;)
+    {
+        pg_atomic_write_u64(&args->nmoved, 0);
+        run_csr_job_step(job, LOUVAIN_MOVE, n, CSR_MORSEL_SIZE);
+
+        if (pg_atomic_read_u64(&args->nmoved) == 0)
+            break;
+
+        moved_any = true;
+
+        if (job->nlaunched > 0)
+        {
+            double new_modularity = get_modularity(job, nmorsels);
+
+            if (new_modularity - modularity < LOUVAIN_MIN_GAIN)
+                break;
+
+            modularity = new_modularity;
+        }
+    }
+
+    for (v = 0; v < n; v++)
+        community[v] = pg_atomic_read_u32(&shared_community[v]);
+
+    end_csr_job(job);
+
+    return moved_any;
+}
+
+/*
+ * LOUVAIN_MOVE moves each vertex from begin to end to the community of a
+ * neighbor that increases the modularity the most, if any does.
+ *
+ * Moving vertex v with degree k into community C, whose vertices have the
+ * total degree tot(C) without v, and to which v has edges of the total weight
+ * k(C), changes the modularity by (k(C) - tot(C) * k / total) * 2 / total, so
+ * only the first factor is compared.
+ *
+ * LOUVAIN_MODULARITY adds up the share of the modularity of the vertices and
+ * the communities from begin to end (communities are numbered by a vertex).
+ */
+void louvain_morsel(csr_job *job, uint32 phase, uint64 begin, uint64 end)
+{
+    louvain_args *args = job->args;
+    uint64 *offsets = csr_job_space(job, args->offsets_offset);
+    weighted_edge *edges = csr_job_space(job, args->edges_offset);
+    double *degrees = csr_job_space(job, args->degrees_offset);
+    pg_atomic_uint32 *community = csr_job_space(job, args->community_offset);
+    pg_atomic_uint64 *tot = csr_job_space(job, args->tot_offset);
+    double *partial = csr_job_space(job, args->partial_offset);
+    louvain_local *local = job->local;
+    double total = args->total;
+    uint64 v;
+    uint64 i;
+
+    if (phase == LOUVAIN_MODULARITY)
+    {
+        double sum = 0;
+
+        for (v = begin; v < end; v++)
+        {
+            csr_vertex own = pg_atomic_read_u32(&community[v]);
+            double t = read_double(&tot[v]) / total;
+            double inside = 0;
+
+            for (i = offsets[v]; i < offsets[v + 1]; i++)
+            {
+                if (pg_atomic_read_u32(&community[edges[i].vertex]) == own)
+                    inside += edges[i].weight;
+            }
+
+            sum += inside / total - t * t;
+        }
+
+        partial[begin / CSR_MORSEL_SIZE] = sum;
+        return;
+    }
+
+    if (!local)
+    {
+        local = palloc(sizeof(louvain_local));
+        local->link = alloc_csr_array(args->nvertices, sizeof(double));
+        local->touched = alloc_csr_array(args->nvertices, sizeof(csr_vertex));
+        for (v = 0; v < args->nvertices; v++)
+            local->link[v] = -1;
+        job->local = local;
+    }
+
+    for (v = begin; v < end; v++)
+    {
+        double *link = local->link;
+        csr_vertex *touched = local->touched;
+        csr_vertex own = pg_atomic_read_u32(&community[v]);
+        double k = degrees[v];
+        csr_vertex best = own;
+        double best_gain;
+        uint64 ntouched = 0;
+
+        // the own community comes first, so it wins ties
+        link[own] = 0;
+        touched[ntouched++] = own;
+        for (i = offsets[v]; i < offsets[v + 1]; i++)
+        {
+            csr_vertex c;
+
+            if (edges[i].vertex == v)
+                continue;
+
+            c = pg_atomic_read_u32(&community[edges[i].vertex]);
+            if (link[c] < 0)
+            {
+                link[c] = 0;
+                touched[ntouched++] = c;
+            }
+            link[c] += edges[i].weight;
+        }
+
+        add_double(&tot[own], -k);
+        best_gain = link[own] - read_double(&tot[own]) * k / total;
+        for (i = 1; i < ntouched; i++)
+        {
+            csr_vertex c = touched[i];
+            double gain = link[c] - read_double(&tot[c]) * k / total;
+
+            if (gain > best_gain)
+            {
+                best = c;
+                best_gain = gain;
+            }
+        }
+        add_double(&tot[best], k);
+
+        for (i = 0; i < ntouched; i++)
+            link[touched[i]] = -1;
+
+        if (best != own)
+        {
+            pg_atomic_write_u32(&community[v], best);
+            pg_atomic_fetch_add_u64(&args->nmoved, 1);
+        }
+    }
+}
+
+// returns the modularity of the communities of the vertices of the job
+static double get_modularity(csr_job *job, uint64 nmorsels)
+{
+    louvain_args *args = job->args;
+    double *partial = csr_job_space(job, args->partial_offset);
+    double sum = 0;
+    uint64 i;
+
+    run_csr_job_step(job, LOUVAIN_MODULARITY, args->nvertices,
+                     CSR_MORSEL_SIZE);
+
+    // in order, so that the same moves give the same modularity
+    for (i = 0; i < nmorsels; i++)
+        sum += partial[i];
+
+    return sum;
+}
+
+// the total degrees of the communities are doubles kept in atomic integers
+static double read_double(pg_atomic_uint64 *ptr)
+{
+    uint64 bits = pg_atomic_read_u64(ptr);
+    double value;
+
+    memcpy(&value, &bits, sizeof(double));
+
+    return value;
+}
+
+static void add_double(pg_atomic_uint64 *ptr, double value)
+{
+    uint64 old_bits = pg_atomic_read_u64(ptr);
+
+    for (;;)
+    {
+        double sum;
+        uint64 new_bits;
+
+        memcpy(&sum, &old_bits, sizeof(double));
+        sum += value;
+        memcpy(&new_bits, &sum, sizeof(double));
+
+        // old_bits is updated if another participant got in first
+        if (pg_atomic_compare_exchange_u64(ptr, &old_bits, new_bits))
+            break;
+    }
+}
+
+/*
+ * Numbers the communities densely from 0 in the order of their first vertex.
+ * Returns the number of the communities.
+ */
+static uint64 renumber_communities(csr_vertex *community, uint64 n)
+{
+    csr_vertex *number;
+    uint64 ncommunities = 0;
+    uint64 v;
+
+    number = alloc_csr_array(n, sizeof(csr_vertex));
+    for (v = 0; v < n; v++)
+        number[v] = PG_UINT32_MAX;
+
+    for (v = 0; v < n; v++)
+    {
+        if (number[community[v]] == PG_UINT32_MAX)
+            number[community[v]] = ncommunities++;
+
+        community[v] = number[community[v]];
+    }
+
+    pfree(number);
+
+    return ncommunities;
+}
+
+static int compare_weighted_edges(const void *a, const void *b)
+{
+    csr_vertex va = ((const weighted_edge *)a)->vertex;
+    csr_vertex vb = ((const weighted_edge *)b)->vertex;
+
+    if (va < vb)
+        return -1;
+    if (va > vb)
+        return 1;
+    return 0;
+}
+
+static int compare_csr_vertices(const void *a, const void *b)
+{
+    csr_vertex va = *(const csr_vertex *)a;
+    csr_vertex vb = *(const csr_vertex *)b;
+
+    if (va < vb)
+        return -1;
+    if (va > vb)
+        return 1;
+    return 0;
+}
@@ -0,0 +1,396 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Connected components
+ *
+ * Weakly connected components are found by union-find over the edges of the
+ * CSR graph and strongly connected ones by Tarjan's algorithm, without
+ * recursion. Either way, the components are numbered from 1 in the order of
+ * the smallest graphid in them, so the numbers do not depend on the order
+ * the edges are visited in.
+ *
+ * The union-find is a job (see csr_traversal.c) whose participants link the
+ * trees of the ends of the edges with compare-and-swap. Tarjan's algorithm is
+ * inherently sequential, so on large graphs the strongly connected component
+ * of a well-connected vertex, which in most graphs holds most of the
+ * vertices, is first found by two parallel searches, and Tarjan's algorithm
+ * only visits the rest.
+ */
+
+#include "postgres.h"
+
+#include "fmgr.h"
+#include "miscadmin.h"
+#include "utils/builtins.h"
+
+#include "utils/csr_graph.h"
+#include "utils/csr_traversal.h"
+#include "utils/graphid.h"
+
+// the phases of the union-find
+#define WEAK_LINK 0
+#define WEAK_FLATTEN 1
+
+typedef struct weak_components_args
+{
+    // the parent of each vertex in the union-find forest
+    Size parent_offset;
+} weak_components_args;
+
+static void find_weak_components(csr_graph *csr, csr_vertex *component);
+static csr_vertex find_root(pg_atomic_uint32 *parent, csr_vertex v);
+static void find_strong_components(csr_graph *csr, csr_vertex *component);
+static uint64 find_pivot_component(csr_graph *csr, csr_vertex *component,
+                                   csr_vertex *pivot);
+
+PG_FUNCTION_INFO_V1(connected_components);
+
+Datum connected_components(PG_FUNCTION_ARGS)
+{
+    csr_graph *csr;
+    char *mode;
+    bool strong;
+    csr_vertex *component;
+    int64 *number;
+    int64 ncomponents = 0;
+    Tuplestorestate *tupstore;
+    TupleDesc tupdesc;
+    uint64 v;
+
+    mode = PG_ARGISNULL(2) ? "weak" : text_to_cstring(PG_GETARG_TEXT_PP(2));
+    if (pg_strcasecmp(mode, "weak") == 0)
+    {
+        strong = false;
+    }
+    else if (pg_strcasecmp(mode, "strong") == 0)
+    {
+        strong = true;
+    }
+    else
+    {
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("mode must be \"weak\" or \"strong\", not \"%s\"",
+                        mode)));
+    }
+
+    tupstore = begin_csr_result(fcinfo, &tupdesc);
+    csr = get_csr_graph_arg(fcinfo, 0, 1);
+
+    // the vertex each vertex is in the component of
+    component = alloc_csr_array(csr->nvertices, sizeof(csr_vertex));
+    if (strong)
+        find_strong_components(csr, component);
+    else
+        find_weak_components(csr, component);
+
+    number = alloc_csr_array(csr->nvertices, sizeof(int64));
+    for (v = 0; v < csr->nvertices; v++)
+        number[v] = 0;
+
+    for (v = 0; v < csr->nvertices; v++)
+    {
+        Datum values[2];
+        bool nulls[2] = {false, false};
+
+        if (number[component[v]] == 0)
+            number[component[v]] = ++ncomponents;
+
+        values[0] = GRAPHID_GET_DATUM(csr->vertex_ids[v]);
+        values[1] = Int64GetDatum(number[component[v]]);
+
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+
+    release_csr_graph(csr);
+
+    return (Datum)0;
+}
+
+/*
+ * Union by index with path halving. A root is only ever linked under a
+ * smaller one, so the participants can link the trees concurrently, and a
+ * link that loses a race is retried from the new roots. The direction of the
+ * edges does not matter, so only the outgoing ones are visited.
+ */
+static void find_weak_components(csr_graph *csr, csr_vertex *component)
+{
+    csr_job *job;
+    weak_components_args *args;
+    Size parent_offset;
+    pg_atomic_uint32 *parent;
+    uint64 n = csr->nvertices;
+    uint64 v;
+
+    job = begin_csr_job(csr, CSR_KERNEL_WEAK_COMPONENTS,
+                        sizeof(weak_components_args));
+    parent_offset = reserve_csr_job_space(
+        job, sizeof(pg_atomic_uint32) * Max(n, 1));
+    start_csr_job(job);
+
+    args = job->args;
+    args->parent_offset = parent_offset;
+
+    parent = csr_job_space(job, parent_offset);
+    for (v = 0; v < n; v++)
+        pg_atomic_init_u32(&parent[v], v);
+
+    run_csr_job_step(job, WEAK_LINK, n, CSR_MORSEL_SIZE);
+    run_csr_job_step(job, WEAK_FLATTEN, n, CSR_MORSEL_SIZE);
+
+    for (v = 0; v < n; v++)
+        component[v] = pg_atomic_read_u32(&parent[v]);
+
+    end_csr_job(job);
+}
+
+/*
+ * WEAK_LINK joins the trees of the ends of the edges of the vertices, and
+ * WEAK_FLATTEN then points each vertex at its root.
+ */
+void weak_components_morsel(csr_job *job, uint32 phase, uint64 begin,
+                            uint64 end)
+{
+    weak_components_args *args = job->args;
+    pg_atomic_uint32 *parent = csr_job_space(job, args->parent_offset);
+    uint64 v;
+
+    for (v = begin; v < end; v++)
+    {
+        csr_neighbor_iterator it;
+        csr_vertex w;
+
+        if (phase == WEAK_FLATTEN)
+        {
+            pg_atomic_write_u32(&parent[v], find_root(parent, v));
+            continue;
+        }
+
+        csr_begin_neighbors(&job->csr->out, v, &it);
+        while (csr_next_neighbor(&it, &w))
+        {
+            for (;;)
+            {
+                uint32 a = find_root(parent, v);
+                uint32 b = find_root(parent, w);
+
+                if (a == b)
+                    break;
+
+                if (a < b)
+                {
+                    uint32 tmp = a;
+
+                    a = b;
+                    b = tmp;
+                }
+
+                // fails if a is no longer a root
+                if (pg_atomic_compare_exchange_u32(&parent[a], &a, b))
+                    break;
+            }
+        }
+    }
+}
+
+static csr_vertex find_root(pg_atomic_uint32 *parent, csr_vertex v)
+{
+    for (;;)
+    {
+        uint32 p = pg_atomic_read_u32(&parent[v]);
+        uint32 gp;
+
+        if (p == v)
+            return v;
+
+        // the grandparent is an ancestor even if the swap fails
+        gp = pg_atomic_read_u32(&parent[p]);
+        if (gp != p)
+            pg_atomic_compare_exchange_u32(&parent[v], &p, gp);
+
+        v = gp;
+    }
+}
+
+/*
+ * Tarjan's algorithm with an explicit stack of the vertices being visited,
+ * each with the iterator over the edges it has yet to follow. A component is
+ * represented by its root, the first of its vertices the search visited.
+ *
+ * The vertices of the component of the pivot, if it was found beforehand,
+ * are treated as visited and off the stack, so the search does not enter
+ * them. No other component can contain them.
+ */
+static void find_strong_components(csr_graph *csr, csr_vertex *component)
+{
+    uint64 n = csr->nvertices;
+    uint64 *index;
+    uint64 *lowlink;
+    bool *on_stack;
+    csr_vertex *stack;
+    uint64 stack_len = 0;
+    csr_vertex *call_stack;
+    csr_neighbor_iterator *iters;
+    uint64 call_len;
+    uint64 next_index = 1;
+    csr_vertex pivot;
+    uint64 npivot;
+    uint64 s;
+
+    // index 0 means not visited yet
+    index = alloc_csr_array(n, sizeof(uint64));
+    lowlink = alloc_csr_array(n, sizeof(uint64));
+    on_stack = alloc_csr_array(n, sizeof(bool));
+    stack = alloc_csr_array(n, sizeof(csr_vertex));
+    call_stack = alloc_csr_array(n, sizeof(csr_vertex));
+    iters = alloc_csr_array(n, sizeof(csr_neighbor_iterator));
+
+    npivot = find_pivot_component(csr, component, &pivot);
+
+    for (s = 0; s < n; s++)
+    {
+        index[s] = (npivot > 0 && component[s] == pivot) ? next_index++ : 0;
+        on_stack[s] = false;
+    }
+
+    for (s = 0; s < n; s++)
+    {
+        if (index[s] != 0)
+            continue;
+
+        CHECK_FOR_INTERRUPTS();
+
+        index[s] = lowlink[s] = next_index++;
+        stack[stack_len++] = s;
+        on_stack[s] = true;
+        call_stack[0] = s;
+        csr_begin_neighbors(&csr->out, s, &iters[0]);
+        call_len = 1;
+
+        while (call_len > 0)
+        {
+            csr_vertex v = call_stack[call_len - 1];
+            csr_vertex w;
+
+            if (csr_next_neighbor(&iters[call_len - 1], &w))
+            {
+                if (index[w] == 0)
+                {
+                    index[w] = lowlink[w] = next_index++;
+                    stack[stack_len++] = w;
+                    on_stack[w] = true;
+                    call_stack[call_len] = w;
+                    csr_begin_neighbors(&csr->out, w, &iters[call_len]);
+                    call_len++;
+                }
+                else if (on_stack[w])
+                {
+                    lowlink[v] = Min(lowlink[v], index[w]);
+                }
+
+                continue;
+            }
+
+            // all the edges of v have been followed
+            if (lowlink[v] == index[v])
+            {
+                csr_vertex u;
+
+                do
+                {
+                    u = stack[--stack_len];
+                    on_stack[u] = false;
+                    component[u] = v;
+                } while (u != v);
+            }
+
+            call_len--;
+            if (call_len > 0)
+            {
+                csr_vertex parent = call_stack[call_len - 1];
+
+                lowlink[parent] = Min(lowlink[parent], lowlink[v]);
+            }
+        }
+    }
+
+    pfree(index);
+    pfree(lowlink);
+    pfree(on_stack);
+    pfree(stack);
+    pfree(call_stack);
+    pfree(iters);
+}
+
+/*
+ * On graphs that are large enough for the traversal workers, sets the
+ * component of the vertices in the strongly connected component of the
+ * vertex with the most paths through it, as far as its degrees tell, to that
+ * vertex: they are the vertices that it both reaches and is reached from.
+ * The component of the other vertices is set to themselves. Returns the
+ * number of the vertices in the component, or 0 if it was not looked for.
+ */
+static uint64 find_pivot_component(csr_graph *csr, csr_vertex *component,
+                                   csr_vertex *pivot)
+{
+    uint64 n = csr->nvertices;
+    uint64 best = 0;
+    int32 *forward;
+    int32 *backward;
+    uint64 npivot = 0;
+    uint64 v;
+
+    if (n == 0 || max_traversal_workers == 0 ||
+        csr->nedges < (uint64)traversal_parallel_threshold)
+        return 0;
+
+    for (v = 0; v < n; v++)
+    {
+        uint64 paths = csr_degree(&csr->out, v) * csr_degree(&csr->in, v);
+
+        if (paths > best)
+        {
+            *pivot = v;
+            best = paths;
+        }
+    }
+
+    // a vertex without a cycle through it is a component by itself
+    if (best == 0)
+        return 0;
+
+    forward = csr_bfs(csr, pivot, 1, TRAVERSAL_OUT, -1);
+    backward = csr_bfs(csr, pivot, 1, TRAVERSAL_IN, -1);
+
+    for (v = 0; v < n; v++)
+    {
+        if (forward[v] >= 0 && backward[v] >= 0)
+        {
+            component[v] = *pivot;
+            npivot++;
+        }
+        else
+        {
+            component[v] = v;
+        }
+    }
+
+    pfree(forward);
+    pfree(backward);
+
+    return npivot;
+}
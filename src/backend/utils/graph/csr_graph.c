@@ -0,0 +1,1271 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compressed sparse row (CSR) graphs
+ *
+ * Analytics over a whole graph visit every edge many times, and reading them
+ * from the heap and the indexes of the label tables each time costs far more
+ * than the work done per edge. A CSR graph numbers the vertices densely, in
+ * the order of their graphids, and keeps the edges of each vertex packed
+ * together as varint-encoded deltas of the numbers of their other vertices,
+ * in both directions.
+ *
+ * A CSR graph can be written to a snapshot file under the data directory.
+ * Backends map the file read-only, so the snapshot is shared through the page
+ * cache instead of being built again. A snapshot is not updated as the graph
+ * changes; it is as of the time it was built.
+ */
+
+#include "postgres.h"
+
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "access/xact.h"
+#include "catalog/pg_class_d.h"
+#include "catalog/pg_inherits.h"
+#include "catalog/pg_type.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "storage/fd.h"
+#include "utils/acl.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+
+#include "catalog/ag_label.h"
+#include "commands/label_commands.h"
+#include "utils/ag_cache.h"
+#include "utils/agtype.h"
+#include "utils/csr_graph.h"
+#include "utils/graphid.h"
+
+#define CSR_MAGIC 0x52534341 // "ACSR"
+#define CSR_VERSION 1
+
+// the initial number of the entries of the arrays that grow as tables are read
+#define CSR_INITIAL_SIZE 1024
+
+// write() is not required to write more than this at once
+#define CSR_WRITE_CHUNK_SIZE (64 * 1024 * 1024)
+
+/*
+ * A CSR graph starts with this header. The label ids follow it, and then the
+ * arrays in the order of the fields of csr_graph. The neighbors of the out
+ * direction come last but one, so all the uint64 arrays are aligned.
+ */
+typedef struct csr_header
+{
+    uint32 magic;
+    uint32 version;
+    Oid graph_oid;
+    int32 nlabels;
+    uint64 nvertices;
+    uint64 nedges;
+    uint64 out_bytes;
+    uint64 in_bytes;
+} csr_header;
+
+// a snapshot to be removed when the transaction that dropped its graph commits
+typedef struct pending_snapshot_removal
+{
+    Oid graph_oid;
+    int nest_level;
+} pending_snapshot_removal;
+
+// allocated in TopMemoryContext
+static List *pending_snapshot_removals = NIL;
+static bool snapshot_removal_callbacks_registered = false;
+
+static graphid *read_vertex_ids(graph_cache_data *cache, uint64 *nvertices);
+static List *get_vertex_relations(graph_cache_data *cache);
+static void check_csr_snapshot_privileges(graph_cache_data *cache,
+                                          List *label_ids);
+static void csr_snapshot_xact_callback(XactEvent event, void *arg);
+static void csr_snapshot_subxact_callback(SubXactEvent event,
+                                          SubTransactionId my_subid,
+                                          SubTransactionId parent_subid,
+                                          void *arg);
+static double get_edge_weight(Datum properties, agtype_value *key);
+static void build_adjacency(uint64 nvertices, uint64 nedges,
+                            const csr_vertex *from, const csr_vertex *to,
+                            uint64 **edge_offsets, uint64 **byte_offsets,
+                            uint8 **neighbors, uint64 *nbytes);
+static bool set_csr_arrays(csr_graph *csr);
+static void release_csr_graph_callback(void *arg);
+static csr_graph *map_csr_file(int fd, const char *path, struct stat *st);
+static char *get_csr_snapshot_path(Oid database_oid, Oid graph_oid);
+static int compare_csr_vertices(const void *a, const void *b);
+static int compare_label_ids(const void *a, const void *b);
+
+static inline int varint_size(uint32 value)
+{
+    int size = 1;
+
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        size++;
+    }
+
+    return size;
+}
+
+static inline uint8 *encode_varint(uint8 *pos, uint32 value)
+{
+    while (value >= 0x80)
+    {
+        *pos++ = (uint8)(value | 0x80);
+        value >>= 7;
+    }
+    *pos++ = (uint8)value;
+
+    return pos;
+}
+
+/*
+ * Returns the ids of the given edge labels in ascending order, or NIL for all
+ * the edge labels if labels is NULL.
+ */
+List *get_csr_label_ids(graph_cache_data *cache, ArrayType *labels)
+{
+    Datum *elems;
+    bool *nulls;
+    int nelems;
+    int32 *ids;
+    int nids = 0;
+    List *label_ids = NIL;
+    int i;
+
+    if (!labels)
+        return NIL;
+
+    deconstruct_array(labels, NAMEOID, NAMEDATALEN, false, 'c', &elems,
+                      &nulls, &nelems);
+
+    if (nelems == 0)
+    {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                        errmsg("edge labels must not be empty")));
+    }
+
+    ids = palloc(sizeof(int32) * nelems);
+    for (i = 0; i < nelems; i++)
+    {
+        label_cache_data *lcd;
+        char *label_name;
+
+        if (nulls[i])
+        {
+            ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                            errmsg("edge label must not be NULL")));
+        }
+        label_name = NameStr(*DatumGetName(elems[i]));
+
+        lcd = search_label_name_graph_cache(label_name, cache->oid);
+        if (!lcd)
+        {
+            ereport(ERROR, (errcode(ERRCODE_UNDEFINED_OBJECT),
+                            errmsg("label \"%s\" does not exist", label_name)));
+        }
+        if (lcd->kind != LABEL_KIND_EDGE)
+        {
+            ereport(ERROR,
+                    (errcode(ERRCODE_WRONG_OBJECT_TYPE),
+                     errmsg("label \"%s\" is not an edge label", label_name)));
+        }
+
+        ids[nids++] = lcd->id;
+    }
+
+    qsort(ids, nids, sizeof(int32), compare_label_ids);
+    for (i = 0; i < nids; i++)
+    {
+        if (i == 0 || ids[i] != ids[i - 1])
+            label_ids = lappend_int(label_ids, ids[i]);
+    }
+
+    pfree(ids);
+
+    return label_ids;
+}
+
+/*
+ * Reads all the vertices of the graph and the edges of the given labels (and
+ * their child labels) from the label tables. If weight_key is given, the
+ * weight of each edge is read from that property of it.
+ */
+csr_edge_list *read_csr_edges(graph_cache_data *cache, List *label_ids,
+                              const char *weight_key)
+{
+    csr_edge_list *edges;
+    uint64 max_edges = CSR_INITIAL_SIZE;
+    agtype_value key;
+    List *relids;
+    ListCell *lc;
+
+    edges = palloc0(sizeof(csr_edge_list));
+
+    edges->vertex_ids = read_vertex_ids(cache, &edges->nvertices);
+
+    if (edges->nvertices > PG_UINT32_MAX)
+    {
+        ereport(ERROR,
+                (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+                 errmsg("graph \"%s\" has too many vertices for a CSR graph",
+                        NameStr(cache->name))));
+    }
+
+    edges->starts = alloc_csr_array(max_edges, sizeof(csr_vertex));
+    edges->ends = alloc_csr_array(max_edges, sizeof(csr_vertex));
+    if (weight_key)
+    {
+        edges->weights = alloc_csr_array(max_edges, sizeof(double));
+
+        key.type = AGTV_STRING;
+        key.val.string.val = (char *)weight_key;
+        key.val.string.len = strlen(weight_key);
+    }
+
+    relids = get_edge_relations(cache, label_ids);
+    foreach (lc, relids)
+    {
+        Relation rel;
+        HeapScanDesc scan_desc;
+        HeapTuple tuple;
+
+        rel = heap_open(lfirst_oid(lc), AccessShareLock);
+        scan_desc = heap_beginscan(rel, GetActiveSnapshot(), 0, NULL);
+
+        while ((tuple = heap_getnext(scan_desc, ForwardScanDirection)) != NULL)
+        {
+            TupleDesc tupdesc = RelationGetDescr(rel);
+            graphid start_id;
+            graphid end_id;
+            int64 start;
+            int64 end;
+            bool is_null;
+
+            CHECK_FOR_INTERRUPTS();
+
+            start_id = DATUM_GET_GRAPHID(heap_getattr(
+                tuple, Anum_ag_label_edge_table_start_id, tupdesc, &is_null));
+            end_id = DATUM_GET_GRAPHID(heap_getattr(
+                tuple, Anum_ag_label_edge_table_end_id, tupdesc, &is_null));
+
+            start = bsearch_graphid(edges->vertex_ids, edges->nvertices,
+                                    start_id);
+            end = bsearch_graphid(edges->vertex_ids, edges->nvertices, end_id);
+
+            // the vertices of the edge have been deleted
+            if (start < 0 || end < 0)
+                continue;
+
+            if (edges->nedges == max_edges)
+            {
+                max_edges *= 2;
+                edges->starts = repalloc_huge(edges->starts,
+                                              max_edges * sizeof(csr_vertex));
+                edges->ends = repalloc_huge(edges->ends,
+                                            max_edges * sizeof(csr_vertex));
+                if (edges->weights)
+                {
+                    edges->weights = repalloc_huge(edges->weights,
+                                                   max_edges * sizeof(double));
+                }
+            }
+
+            edges->starts[edges->nedges] = (csr_vertex)start;
+            edges->ends[edges->nedges] = (csr_vertex)end;
+            if (edges->weights)
+            {
+                edges->weights[edges->nedges] = get_edge_weight(
+                    heap_getattr(tuple, Anum_ag_label_edge_table_properties,
+                                 tupdesc, &is_null),
+                    &key);
+            }
+            edges->nedges++;
+        }
+
+        heap_endscan(scan_desc);
+        heap_close(rel, AccessShareLock);
+    }
+
+    return edges;
+}
+
+/*
+ * Builds the CSR graph of all the vertices of the graph and the edges of the
+ * given labels (and their child labels) from the label tables.
+ */
+csr_graph *build_csr_graph(graph_cache_data *cache, List *label_ids)
+{
+    csr_graph *csr;
+    csr_header *header;
+    csr_edge_list *edges;
+    uint64 nvertices;
+    uint64 *out_edge_offsets;
+    uint64 *out_byte_offsets;
+    uint8 *out_neighbors;
+    uint64 out_bytes;
+    uint64 *in_edge_offsets;
+    uint64 *in_byte_offsets;
+    uint8 *in_neighbors;
+    uint64 in_bytes;
+    Size labels_size;
+    Size offsets_size;
+    char *pos;
+    ListCell *lc;
+
+    edges = read_csr_edges(cache, label_ids, NULL);
+    nvertices = edges->nvertices;
+
+    build_adjacency(nvertices, edges->nedges, edges->starts, edges->ends,
+                    &out_edge_offsets, &out_byte_offsets, &out_neighbors,
+                    &out_bytes);
+    build_adjacency(nvertices, edges->nedges, edges->ends, edges->starts,
+                    &in_edge_offsets, &in_byte_offsets, &in_neighbors,
+                    &in_bytes);
+
+    pfree(edges->starts);
+    pfree(edges->ends);
+
+    // put everything together in the layout of the snapshot file
+    csr = palloc0(sizeof(csr_graph));
+
+    labels_size = MAXALIGN(sizeof(int32) * list_length(label_ids));
+    offsets_size = sizeof(uint64) * (nvertices + 1);
+
+    csr->size = MAXALIGN(sizeof(csr_header)) + labels_size +
+                sizeof(graphid) * nvertices + offsets_size * 4 + out_bytes +
+                in_bytes;
+    csr->data = MemoryContextAllocHuge(CurrentMemoryContext, csr->size);
+
+    header = (csr_header *)csr->data;
+    header->magic = CSR_MAGIC;
+    header->version = CSR_VERSION;
+    header->graph_oid = cache->oid;
+    header->nlabels = list_length(label_ids);
+    header->nvertices = nvertices;
+    header->nedges = edges->nedges;
+    header->out_bytes = out_bytes;
+    header->in_bytes = in_bytes;
+
+    pos = csr->data + MAXALIGN(sizeof(csr_header));
+    memset(pos, 0, labels_size);
+    foreach (lc, label_ids)
+    {
+        *(int32 *)pos = lfirst_int(lc);
+        pos += sizeof(int32);
+    }
+    pos = csr->data + MAXALIGN(sizeof(csr_header)) + labels_size;
+
+    memcpy(pos, edges->vertex_ids, sizeof(graphid) * nvertices);
+    pos += sizeof(graphid) * nvertices;
+    memcpy(pos, out_edge_offsets, offsets_size);
+    pos += offsets_size;
+    memcpy(pos, out_byte_offsets, offsets_size);
+    pos += offsets_size;
+    memcpy(pos, in_edge_offsets, offsets_size);
+    pos += offsets_size;
+    memcpy(pos, in_byte_offsets, offsets_size);
+    pos += offsets_size;
+    memcpy(pos, out_neighbors, out_bytes);
+    pos += out_bytes;
+    memcpy(pos, in_neighbors, in_bytes);
+
+    pfree(edges->vertex_ids);
+    pfree(edges);
+    pfree(out_edge_offsets);
+    pfree(out_byte_offsets);
+    pfree(out_neighbors);
+    pfree(in_edge_offsets);
+    pfree(in_byte_offsets);
+    pfree(in_neighbors);
+
+    set_csr_arrays(csr);
+
+    return csr;
+}
+
+/*
+ * Maps the snapshot of the graph. NULL is returned if the graph has no
+ * snapshot.
+ */
+csr_graph *open_csr_snapshot(graph_cache_data *cache)
+{
+    char *path;
+    csr_graph *csr;
+    struct stat st;
+    int fd;
+
+    path = get_csr_snapshot_path(MyDatabaseId, cache->oid);
+
+    fd = OpenTransientFile(path, O_RDONLY | PG_BINARY);
+    if (fd < 0)
+    {
+        if (errno == ENOENT)
+            return NULL;
+
+        ereport(ERROR, (errcode_for_file_access(),
+                        errmsg("could not open file \"%s\": %m", path)));
+    }
+
+    if (fstat(fd, &st) < 0)
+    {
+        ereport(ERROR, (errcode_for_file_access(),
+                        errmsg("could not stat file \"%s\": %m", path)));
+    }
+
+    csr = map_csr_file(fd, path, &st);
+    if (csr->graph_oid != cache->oid)
+    {
+        ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+                        errmsg("CSR snapshot file \"%s\" is corrupted", path)));
+    }
+
+    // the snapshot is a copy of the label tables it was built from
+    check_csr_snapshot_privileges(cache, csr->label_ids);
+
+    return csr;
+}
+
+/*
+ * Maps the snapshot of the graph for a process that is not connected to the
+ * database, such as a traversal worker. NULL is returned unless the snapshot
+ * file is still the one with the device and inode given, since a snapshot is
+ * replaced by renaming a new file over it.
+ */
+csr_graph *attach_csr_snapshot(Oid database_oid, Oid graph_oid,
+                               uint64 file_dev, uint64 file_ino)
+{
+    char *path;
+    struct stat st;
+    int fd;
+
+    path = get_csr_snapshot_path(database_oid, graph_oid);
+
+    fd = OpenTransientFile(path, O_RDONLY | PG_BINARY);
+    if (fd < 0)
+    {
+        if (errno == ENOENT)
+            return NULL;
+
+        ereport(ERROR, (errcode_for_file_access(),
+                        errmsg("could not open file \"%s\": %m", path)));
+    }
+
+    if (fstat(fd, &st) < 0)
+    {
+        ereport(ERROR, (errcode_for_file_access(),
+                        errmsg("could not stat file \"%s\": %m", path)));
+    }
+
+    if ((uint64)st.st_dev != file_dev || (uint64)st.st_ino != file_ino)
+    {
+        CloseTransientFile(fd);
+        return NULL;
+    }
+
+    return map_csr_file(fd, path, &st);
+}
+
+// maps the open snapshot file and closes it
+static csr_graph *map_csr_file(int fd, const char *path, struct stat *st)
+{
+    csr_graph *csr;
+    MemoryContextCallback *callback;
+    void *data;
+
+    if (st->st_size < (off_t)sizeof(csr_header))
+    {
+        ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+                        errmsg("CSR snapshot file \"%s\" is corrupted", path)));
+    }
+
+    data = mmap(NULL, st->st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        ereport(ERROR, (errcode_for_file_access(),
+                        errmsg("could not map file \"%s\": %m", path)));
+    }
+
+    CloseTransientFile(fd);
+
+    csr = palloc0(sizeof(csr_graph));
+    csr->data = data;
+    csr->size = st->st_size;
+    csr->mapped = true;
+    csr->file_dev = (uint64)st->st_dev;
+    csr->file_ino = (uint64)st->st_ino;
+
+    // unmap the file if anything goes wrong from here on
+    callback = palloc(sizeof(MemoryContextCallback));
+    callback->func = release_csr_graph_callback;
+    callback->arg = csr;
+    MemoryContextRegisterResetCallback(CurrentMemoryContext, callback);
+
+    if (!set_csr_arrays(csr))
+    {
+        ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+                        errmsg("CSR snapshot file \"%s\" is corrupted", path)));
+    }
+
+    return csr;
+}
+
+/*
+ * Returns the CSR graph of the given edge labels. The snapshot of the graph
+ * is used if it was built from the same labels, otherwise the graph is built.
+ */
+csr_graph *get_csr_graph(graph_cache_data *cache, List *label_ids)
+{
+    csr_graph *csr;
+
+    csr = open_csr_snapshot(cache);
+    if (csr)
+    {
+        if (equal(csr->label_ids, label_ids))
+            return csr;
+
+        release_csr_graph(csr);
+    }
+
+    return build_csr_graph(cache, label_ids);
+}
+
+void release_csr_graph(csr_graph *csr)
+{
+    if (!csr->data)
+        return;
+
+    if (csr->mapped)
+        munmap(csr->data, csr->size);
+    else
+        pfree(csr->data);
+
+    csr->data = NULL;
+}
+
+/*
+ * Writes the CSR graph to the snapshot file of its graph. The file is written
+ * under a temporary name and renamed, so backends that have the old snapshot
+ * mapped keep reading it.
+ */
+void write_csr_snapshot(csr_graph *csr)
+{
+    char *path;
+    char *tmp_path;
+    Size written = 0;
+    int fd;
+
+    if (MakePGDirectory(CSR_SNAPSHOT_DIR) < 0 && errno != EEXIST)
+    {
+        ereport(ERROR,
+                (errcode_for_file_access(),
+                 errmsg("could not create directory \"%s\": %m",
+                        CSR_SNAPSHOT_DIR)));
+    }
+
+    path = get_csr_snapshot_path(MyDatabaseId, csr->graph_oid);
+    tmp_path = psprintf("%s.tmp", path);
+
+    fd = OpenTransientFile(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | PG_BINARY);
+    if (fd < 0)
+    {
+        ereport(ERROR, (errcode_for_file_access(),
+                        errmsg("could not create file \"%s\": %m", tmp_path)));
+    }
+
+    while (written < csr->size)
+    {
+        ssize_t ret;
+
+        CHECK_FOR_INTERRUPTS();
+
+        errno = 0;
+        ret = write(fd, csr->data + written,
+                    Min(csr->size - written, CSR_WRITE_CHUNK_SIZE));
+        if (ret <= 0)
+        {
+            // if write didn't set errno, assume problem is no disk space
+            if (errno == 0)
+                errno = ENOSPC;
+
+            ereport(ERROR,
+                    (errcode_for_file_access(),
+                     errmsg("could not write file \"%s\": %m", tmp_path)));
+        }
+
+        written += ret;
+    }
+
+    if (pg_fsync(fd) != 0)
+    {
+        ereport(ERROR, (errcode_for_file_access(),
+                        errmsg("could not fsync file \"%s\": %m", tmp_path)));
+    }
+
+    if (CloseTransientFile(fd))
+    {
+        ereport(ERROR, (errcode_for_file_access(),
+                        errmsg("could not close file \"%s\": %m", tmp_path)));
+    }
+
+    durable_rename(tmp_path, path, ERROR);
+}
+
+// removes the snapshot of the graph, if it has one
+void remove_csr_snapshot(Oid graph_oid)
+{
+    char *path;
+
+    path = get_csr_snapshot_path(MyDatabaseId, graph_oid);
+
+    if (unlink(path) < 0 && errno != ENOENT)
+    {
+        ereport(WARNING, (errcode_for_file_access(),
+                          errmsg("could not remove file \"%s\": %m", path)));
+    }
+}
+
+/*
+ * Removes the snapshot of the graph when the current transaction commits.
+ * Nothing is removed if the transaction, or the subtransaction that called
+ * this, is rolled back.
+ */
+void remove_csr_snapshot_at_commit(Oid graph_oid)
+{
+    pending_snapshot_removal *removal;
+    MemoryContext old_mcxt;
+
+    if (!snapshot_removal_callbacks_registered)
+    {
+        RegisterXactCallback(csr_snapshot_xact_callback, NULL);
+        RegisterSubXactCallback(csr_snapshot_subxact_callback, NULL);
+        snapshot_removal_callbacks_registered = true;
+    }
+
+    old_mcxt = MemoryContextSwitchTo(TopMemoryContext);
+
+    removal = palloc(sizeof(pending_snapshot_removal));
+    removal->graph_oid = graph_oid;
+    removal->nest_level = GetCurrentTransactionNestLevel();
+    pending_snapshot_removals = lappend(pending_snapshot_removals, removal);
+
+    MemoryContextSwitchTo(old_mcxt);
+}
+
+static void csr_snapshot_xact_callback(XactEvent event, void *arg)
+{
+    ListCell *lc;
+
+    switch (event)
+    {
+    case XACT_EVENT_PRE_PREPARE:
+        // the removal cannot be carried over to COMMIT PREPARED
+        if (pending_snapshot_removals != NIL)
+        {
+            ereport(ERROR,
+                    (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                     errmsg("cannot PREPARE a transaction that has dropped a graph")));
+        }
+        break;
+    case XACT_EVENT_COMMIT:
+        foreach (lc, pending_snapshot_removals)
+        {
+            pending_snapshot_removal *removal = lfirst(lc);
+
+            remove_csr_snapshot(removal->graph_oid);
+        }
+        list_free_deep(pending_snapshot_removals);
+        pending_snapshot_removals = NIL;
+        break;
+    case XACT_EVENT_ABORT:
+        list_free_deep(pending_snapshot_removals);
+        pending_snapshot_removals = NIL;
+        break;
+    default:
+        break;
+    }
+}
+
+static void csr_snapshot_subxact_callback(SubXactEvent event,
+                                          SubTransactionId my_subid,
+                                          SubTransactionId parent_subid,
+                                          void *arg)
+{
+    int nest_level = GetCurrentTransactionNestLevel();
+    List *kept = NIL;
+    MemoryContext old_mcxt;
+    ListCell *lc;
+
+    if (event != SUBXACT_EVENT_COMMIT_SUB && event != SUBXACT_EVENT_ABORT_SUB)
+        return;
+
+    old_mcxt = MemoryContextSwitchTo(TopMemoryContext);
+
+    foreach (lc, pending_snapshot_removals)
+    {
+        pending_snapshot_removal *removal = lfirst(lc);
+
+        if (removal->nest_level < nest_level)
+        {
+            kept = lappend(kept, removal);
+        }
+        else if (event == SUBXACT_EVENT_COMMIT_SUB)
+        {
+            // the parent transaction takes over the removal
+            removal->nest_level = nest_level - 1;
+            kept = lappend(kept, removal);
+        }
+        else
+        {
+            pfree(removal);
+        }
+    }
+
+    list_free(pending_snapshot_removals);
+    pending_snapshot_removals = kept;
+
+    MemoryContextSwitchTo(old_mcxt);
+}
+
+/*
+ * Returns a CSR graph of data in the layout of a CSR graph, such as a copy of
+ * one in shared memory. The graph does not own the data, so it must not be
+ * released.
+ */
+csr_graph *attach_csr_graph(char *data, Size size)
+{
+    csr_graph *csr;
+
+    csr = palloc0(sizeof(csr_graph));
+    csr->data = data;
+    csr->size = size;
+
+    if (!set_csr_arrays(csr))
+        elog(ERROR, "invalid CSR graph");
+
+    return csr;
+}
+
+// returns the index of the vertex in the CSR graph, or -1 if it is not in it
+int64 csr_vertex_index(const csr_graph *csr, graphid id)
+{
+    return bsearch_graphid(csr->vertex_ids, csr->nvertices, id);
+}
+
+// returns the index of the id in the sorted ids, or -1 if it is not in them
+int64 bsearch_graphid(const graphid *ids, uint64 n, graphid id)
+{
+    uint64 lo = 0;
+    uint64 hi = n;
+
+    while (lo < hi)
+    {
+        uint64 mid = lo + (hi - lo) / 2;
+
+        if (ids[mid] < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo < n && ids[lo] == id)
+        return (int64)lo;
+
+    return -1;
+}
+
+graph_cache_data *get_graph_cache_arg(FunctionCallInfo fcinfo, int argno)
+{
+    Name graph_name;
+    graph_cache_data *cache;
+
+    if (PG_ARGISNULL(argno))
+    {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                        errmsg("graph name must not be NULL")));
+    }
+    graph_name = PG_GETARG_NAME(argno);
+
+    cache = search_graph_name_cache(NameStr(*graph_name));
+    if (!cache)
+    {
+        ereport(ERROR,
+                (errcode(ERRCODE_UNDEFINED_SCHEMA),
+                 errmsg("graph \"%s\" does not exist", NameStr(*graph_name))));
+    }
+
+    return cache;
+}
+
+// returns the CSR graph of the graph and edge labels (NULL for all) given
+csr_graph *get_csr_graph_arg(FunctionCallInfo fcinfo, int graph_argno,
+                             int labels_argno)
+{
+    graph_cache_data *cache;
+    List *label_ids;
+
+    cache = get_graph_cache_arg(fcinfo, graph_argno);
+    label_ids = get_csr_label_ids(cache, PG_ARGISNULL(labels_argno) ?
+                                             NULL :
+                                             PG_GETARG_ARRAYTYPE_P(labels_argno));
+
+    return get_csr_graph(cache, label_ids);
+}
+
+/*
+ * Sets up the result of a set-returning function that is computed for the
+ * whole graph at once. The rows are put into the returned tuplestore.
+ */
+Tuplestorestate *begin_csr_result(FunctionCallInfo fcinfo, TupleDesc *tupdesc)
+{
+    ReturnSetInfo *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+    MemoryContext old_mcxt;
+    Tuplestorestate *tupstore;
+
+    if (!rsinfo || !IsA(rsinfo, ReturnSetInfo) ||
+        !(rsinfo->allowedModes & SFRM_Materialize))
+    {
+        ereport(ERROR,
+                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                 errmsg("set-valued function called in context that cannot accept a set")));
+    }
+
+    if (get_call_result_type(fcinfo, NULL, tupdesc) != TYPEFUNC_COMPOSITE)
+        elog(ERROR, "return type must be a row type");
+
+    old_mcxt = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+    *tupdesc = CreateTupleDescCopy(*tupdesc);
+    tupstore = tuplestore_begin_heap(true, false, work_mem);
+
+    rsinfo->returnMode = SFRM_Materialize;
+    rsinfo->setResult = tupstore;
+    rsinfo->setDesc = *tupdesc;
+
+    MemoryContextSwitchTo(old_mcxt);
+
+    return tupstore;
+}
+
+// reads the ids of all the vertices of the graph and sorts them
+static graphid *read_vertex_ids(graph_cache_data *cache, uint64 *nvertices)
+{
+    graphid *vertex_ids;
+    uint64 n = 0;
+    uint64 max_n = CSR_INITIAL_SIZE;
+    List *relids;
+    ListCell *lc;
+
+    vertex_ids = alloc_csr_array(max_n, sizeof(graphid));
+
+    relids = get_vertex_relations(cache);
+    foreach (lc, relids)
+    {
+        Relation rel;
+        HeapScanDesc scan_desc;
+        HeapTuple tuple;
+
+        rel = heap_open(lfirst_oid(lc), AccessShareLock);
+        scan_desc = heap_beginscan(rel, GetActiveSnapshot(), 0, NULL);
+
+        while ((tuple = heap_getnext(scan_desc, ForwardScanDirection)) != NULL)
+        {
+            bool is_null;
+
+            CHECK_FOR_INTERRUPTS();
+
+            if (n == max_n)
+            {
+                max_n *= 2;
+                vertex_ids = repalloc_huge(vertex_ids,
+                                           max_n * sizeof(graphid));
+            }
+
+            vertex_ids[n++] = DATUM_GET_GRAPHID(
+                heap_getattr(tuple, Anum_ag_label_vertex_table_id,
+                             RelationGetDescr(rel), &is_null));
+        }
+
+        heap_endscan(scan_desc);
+        heap_close(rel, AccessShareLock);
+    }
+
+    qsort(vertex_ids, n, sizeof(graphid), compare_graphids);
+
+    *nvertices = n;
+
+    return vertex_ids;
+}
+
+/*
+ * Returns the tables that have the vertices of the graph. The current user
+ * must be able to read all of them.
+ */
+static List *get_vertex_relations(graph_cache_data *cache)
+{
+    Oid relid;
+    List *relids = NIL;
+    ListCell *lc;
+
+    // the tables of all vertex labels inherit the default vertex label table
+    relid = get_label_relation(AG_DEFAULT_LABEL_VERTEX, cache->oid);
+    foreach (lc, find_all_inheritors(relid, AccessShareLock, NULL))
+    {
+        if (get_rel_relkind(lfirst_oid(lc)) == RELKIND_PARTITIONED_TABLE)
+            continue;
+
+        check_select_privilege(lfirst_oid(lc));
+        relids = lappend_oid(relids, lfirst_oid(lc));
+    }
+
+    return relids;
+}
+
+/*
+ * Returns the tables that have the edges of the given labels. The tables of
+ * the child labels of a label are included, but only once. The current user
+ * must be able to read all of them.
+ */
+List *get_edge_relations(graph_cache_data *cache, List *label_ids)
+{
+    List *label_relids = NIL;
+    List *relids = NIL;
+    ListCell *lc;
+
+    if (label_ids == NIL)
+    {
+        label_relids = list_make1_oid(
+            get_label_relation(AG_DEFAULT_LABEL_EDGE, cache->oid));
+    }
+    else
+    {
+        foreach (lc, label_ids)
+        {
+            label_cache_data *lcd;
+
+            lcd = search_label_graph_id_cache(cache->oid, lfirst_int(lc));
+            if (!lcd)
+            {
+                ereport(ERROR, (errcode(ERRCODE_UNDEFINED_OBJECT),
+                                errmsg("label %d does not exist",
+                                       lfirst_int(lc))));
+            }
+
+            label_relids = lappend_oid(label_relids, lcd->relation);
+        }
+    }
+
+    foreach (lc, label_relids)
+    {
+        ListCell *lc2;
+
+        foreach (lc2, find_all_inheritors(lfirst_oid(lc), AccessShareLock,
+                                          NULL))
+        {
+            if (get_rel_relkind(lfirst_oid(lc2)) == RELKIND_PARTITIONED_TABLE)
+                continue;
+
+            if (list_member_oid(relids, lfirst_oid(lc2)))
+                continue;
+
+            check_select_privilege(lfirst_oid(lc2));
+            relids = lappend_oid(relids, lfirst_oid(lc2));
+        }
+    }
+
+    return relids;
+}
+
+/*
+ * Checks that the current user can read the tables that the snapshot was
+ * built from. The labels that have been dropped since then are skipped.
+ */
+static void check_csr_snapshot_privileges(graph_cache_data *cache,
+                                          List *label_ids)
+{
+    ListCell *lc;
+
+    list_free(get_vertex_relations(cache));
+
+    if (label_ids == NIL)
+    {
+        list_free(get_edge_relations(cache, NIL));
+        return;
+    }
+
+    foreach (lc, label_ids)
+    {
+        if (!search_label_graph_id_cache(cache->oid, lfirst_int(lc)))
+            continue;
+
+        list_free(get_edge_relations(cache, list_make1_int(lfirst_int(lc))));
+    }
+}
+
+// errors out if the current user cannot read the table
+void check_select_privilege(Oid relid)
+{
+    AclResult aclresult;
+
+    aclresult = pg_class_aclcheck(relid, GetUserId(), ACL_SELECT);
+    if (aclresult != ACLCHECK_OK)
+        aclcheck_error(aclresult, OBJECT_TABLE, get_rel_name(relid));
+}
+
+/*
+ * Returns the value of the property of an edge as its weight. An edge that
+ * does not have the property, or has it set to null, weighs 1.
+ */
+static double get_edge_weight(Datum properties, agtype_value *key)
+{
+    agtype *agt = DATUM_GET_AGTYPE_P(properties);
+    agtype_value *value;
+    double weight;
+
+    value = find_agtype_value_from_container(&agt->root, AGT_FOBJECT, key);
+    if (!value || value->type == AGTV_NULL)
+        return 1;
+
+    switch (value->type)
+    {
+    case AGTV_INTEGER:
+        weight = value->val.int_value;
+        break;
+    case AGTV_FLOAT:
+        weight = value->val.float_value;
+        break;
+    case AGTV_NUMERIC:
+        weight = DatumGetFloat8(DirectFunctionCall1(
+            numeric_float8, NumericGetDatum(value->val.numeric)));
+        break;
+    default:
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("edge weight \"%.*s\" must be a number",
+                        key->val.string.len, key->val.string.val)));
+    }
+
+    if (isnan(weight) || weight < 0)
+    {
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("edge weight \"%.*s\" must not be negative or NaN",
+                        key->val.string.len, key->val.string.val)));
+    }
+
+    return weight;
+}
+
+/*
+ * Builds the adjacency of one direction, the edges from the vertices in from
+ * to the vertices in to.
+ */
+static void build_adjacency(uint64 nvertices, uint64 nedges,
+                            const csr_vertex *from, const csr_vertex *to,
+                            uint64 **edge_offsets, uint64 **byte_offsets,
+                            uint8 **neighbors, uint64 *nbytes)
+{
+    uint64 *offsets;
+    uint64 *bytes;
+    uint64 *next;
+    csr_vertex *targets;
+    uint8 *pos;
+    uint64 v;
+    uint64 i;
+
+    // count the edges of each vertex, then turn the counts into offsets
+    offsets = alloc_csr_array(nvertices + 1, sizeof(uint64));
+    memset(offsets, 0, sizeof(uint64) * (nvertices + 1));
+    for (i = 0; i < nedges; i++)
+        offsets[from[i] + 1]++;
+    for (v = 0; v < nvertices; v++)
+        offsets[v + 1] += offsets[v];
+
+    next = alloc_csr_array(nvertices + 1, sizeof(uint64));
+    memcpy(next, offsets, sizeof(uint64) * (nvertices + 1));
+
+    targets = alloc_csr_array(nedges, sizeof(csr_vertex));
+    for (i = 0; i < nedges; i++)
+        targets[next[from[i]]++] = to[i];
+
+    pfree(next);
+
+    // sort the neighbors of each vertex and size their encoding
+    bytes = alloc_csr_array(nvertices + 1, sizeof(uint64));
+    bytes[0] = 0;
+    for (v = 0; v < nvertices; v++)
+    {
+        uint64 degree = offsets[v + 1] - offsets[v];
+        csr_vertex last = 0;
+        uint64 size = 0;
+
+        CHECK_FOR_INTERRUPTS();
+
+        if (degree > 1)
+        {
+            qsort(targets + offsets[v], degree, sizeof(csr_vertex),
+                  compare_csr_vertices);
+        }
+
+        for (i = offsets[v]; i < offsets[v + 1]; i++)
+        {
+            size += varint_size(targets[i] - last);
+            last = targets[i];
+        }
+
+        bytes[v + 1] = bytes[v] + size;
+    }
+
+    *nbytes = bytes[nvertices];
+    *neighbors = alloc_csr_array(Max(*nbytes, 1), sizeof(uint8));
+
+    pos = *neighbors;
+    for (v = 0; v < nvertices; v++)
+    {
+        csr_vertex last = 0;
+
+        for (i = offsets[v]; i < offsets[v + 1]; i++)
+        {
+            pos = encode_varint(pos, targets[i] - last);
+            last = targets[i];
+        }
+    }
+
+    pfree(targets);
+
+    *edge_offsets = offsets;
+    *byte_offsets = bytes;
+}
+
+/*
+ * Points the arrays of the CSR graph into its data. Returns false if the data
+ * is not a CSR graph.
+ */
+static bool set_csr_arrays(csr_graph *csr)
+{
+    csr_header *header = (csr_header *)csr->data;
+    Size labels_size;
+    Size offsets_size;
+    const char *pos;
+    int i;
+
+    if (header->magic != CSR_MAGIC || header->version != CSR_VERSION ||
+        header->nlabels < 0 || header->nvertices > PG_UINT32_MAX)
+        return false;
+
+    labels_size = MAXALIGN(sizeof(int32) * header->nlabels);
+    offsets_size = sizeof(uint64) * (header->nvertices + 1);
+
+    if (csr->size != MAXALIGN(sizeof(csr_header)) + labels_size +
+                         sizeof(graphid) * header->nvertices +
+                         offsets_size * 4 + header->out_bytes +
+                         header->in_bytes)
+        return false;
+
+    csr->graph_oid = header->graph_oid;
+    csr->nvertices = header->nvertices;
+    csr->nedges = header->nedges;
+
+    pos = csr->data + MAXALIGN(sizeof(csr_header));
+    csr->label_ids = NIL;
+    for (i = 0; i < header->nlabels; i++)
+        csr->label_ids = lappend_int(csr->label_ids, ((int32 *)pos)[i]);
+    pos += labels_size;
+
+    csr->vertex_ids = (const graphid *)pos;
+    pos += sizeof(graphid) * header->nvertices;
+    csr->out.edge_offsets = (const uint64 *)pos;
+    pos += offsets_size;
+    csr->out.byte_offsets = (const uint64 *)pos;
+    pos += offsets_size;
+    csr->in.edge_offsets = (const uint64 *)pos;
+    pos += offsets_size;
+    csr->in.byte_offsets = (const uint64 *)pos;
+    pos += offsets_size;
+    csr->out.neighbors = (const uint8 *)pos;
+    pos += header->out_bytes;
+    csr->in.neighbors = (const uint8 *)pos;
+
+    return true;
+}
+
+static void release_csr_graph_callback(void *arg)
+{
+    release_csr_graph((csr_graph *)arg);
+}
+
+// snapshots are per database, since graphs are
+static char *get_csr_snapshot_path(Oid database_oid, Oid graph_oid)
+{
+    return psprintf("%s/csr_%u_%u", CSR_SNAPSHOT_DIR, database_oid,
+                    graph_oid);
+}
+
+// the arrays of large graphs do not fit in the limit of palloc()
+void *alloc_csr_array(uint64 nelems, Size elem_size)
+{
+    return MemoryContextAllocHuge(CurrentMemoryContext,
+                                  Max(nelems, 1) * elem_size);
+}
+
+// qsort() comparator for graphids in ascending order
+int compare_graphids(const void *a, const void *b)
+{
+    graphid ga = *(const graphid *)a;
+    graphid gb = *(const graphid *)b;
+
+    if (ga < gb)
+        return -1;
+    if (ga > gb)
+        return 1;
+    return 0;
+}
+
+static int compare_csr_vertices(const void *a, const void *b)
+{
+    csr_vertex va = *(const csr_vertex *)a;
+    csr_vertex vb = *(const csr_vertex *)b;
+
+    if (va < vb)
+        return -1;
+    if (va > vb)
+        return 1;
+    return 0;
+}
+
+static int compare_label_ids(const void *a, const void *b)
+{
+    int32 ia = *(const int32 *)a;
+    int32 ib = *(const int32 *)b;
+
+    if (ia < ib)
+        return -1;
+    if (ia > ib)
+        return 1;
+    return 0;
+}
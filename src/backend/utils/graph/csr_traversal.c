@@ -0,0 +1,846 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Parallel jobs on CSR graphs
+ *
+ * A job runs a kernel over the items of a sequence of steps, in the backend
+ * and up to age.max_traversal_workers dynamic background workers. The items
+ * of a step are split into morsels, which the participants claim one at a
+ * time from a shared atomic cursor, so a participant that gets cheap morsels
+ * simply claims more of them. The backend publishes a step, takes part in it,
+ * and waits for the workers to finish the morsels they claimed before it
+ * looks at the results and publishes the next one. The workers wait on their
+ * latches between steps.
+ *
+ * The kernel finds its arguments and arrays in a dynamic shared memory
+ * segment, so the workers need no database connection. A worker maps the
+ * snapshot file the graph was mapped from, or reads a copy of the graph in
+ * the segment if the graph was built in memory. Since the backend takes part
+ * in every step, the job completes even if no worker could be started. It
+ * runs in the backend alone, in local memory, for graphs with fewer edges
+ * than age.traversal_parallel_threshold, and if the segment cannot be made.
+ *
+ * The breadth-first search of csr_bfs() is a job whose steps expand the
+ * levels of the search. The frontier of a level is split into morsels, the
+ * vertices are marked visited in an atomic bitmap over their dense ids, and
+ * the participant that sets the bit of a vertex appends it to the next
+ * frontier, a buffer at a time. The kernels of the graph analytics are
+ * defined along with the functions that run them.
+ */
+
+#include "postgres.h"
+
+#include "access/xact.h"
+#include "catalog/pg_type.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "port/atomics.h"
+#include "postmaster/bgworker.h"
+#include "storage/dsm.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/proc.h"
+#include "tcop/tcopprot.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/memutils.h"
+#include "utils/resowner.h"
+
+#include "utils/csr_graph.h"
+#include "utils/csr_traversal.h"
+#include "utils/graphid.h"
+
+// the number of the vertices a participant adds to the next frontier at once
+#define CSR_APPEND_SIZE 256
+
+#define TRAVERSAL_WORKER_STARTING 0
+#define TRAVERSAL_WORKER_RUNNING 1
+#define TRAVERSAL_WORKER_DONE 2
+
+int max_traversal_workers = 4;
+int traversal_parallel_threshold = 65536;
+
+typedef struct traversal_worker
+{
+    PGPROC *proc;
+    pg_atomic_uint32 state;
+} traversal_worker;
+
+/*
+ * The header of the shared memory of a job. The memory reserved by the
+ * kernel follows it, at the offsets reserve_csr_job_space() returned.
+ *
+ * The backend publishes step s by setting step_info to (s << 32 | the
+ * number of the morsels of the step). The participants claim the morsels by
+ * incrementing cursor, which is (s << 32 | the next morsel), so a
+ * participant that is late for a step cannot claim a morsel of the one after
+ * it.
+ */
+struct csr_job_shared
+{
+    pg_atomic_uint64 step_info;
+    pg_atomic_uint64 cursor;
+    pg_atomic_uint64 morsels_done;
+    pg_atomic_uint32 finished;
+    csr_kernel kernel;
+    uint32 phase;
+    uint64 nitems;
+    uint64 morsel_size;
+    PGPROC *leader;
+    Size args_offset;
+    /*
+     * The graph is the snapshot file with the device and inode given, or
+     * the copy at csr_offset if csr_copied. Without has_csr, the kernel keeps
+     * a graph of its own in the space it reserved.
+     */
+    bool has_csr;
+    bool csr_copied;
+    Oid database_oid;
+    Oid graph_oid;
+    uint64 file_dev;
+    uint64 file_ino;
+    Size csr_offset;
+    Size csr_size;
+    int nworkers;
+    traversal_worker workers[FLEXIBLE_ARRAY_MEMBER];
+};
+
+typedef struct bfs_args
+{
+    traversal_direction direction;
+    pg_atomic_uint64 next_len;
+    Size visited_offset;
+    Size depth_offset;
+    Size frontier_offsets[2];
+} bfs_args;
+
+static void bfs_morsel(csr_job *job, uint32 phase, uint64 begin, uint64 end);
+
+// indexed by csr_kernel
+static const csr_kernel_func csr_kernels[] = {
+    [CSR_KERNEL_BFS] = bfs_morsel,
+    [CSR_KERNEL_PAGERANK] = pagerank_morsel,
+    [CSR_KERNEL_BETWEENNESS] = betweenness_morsel,
+    [CSR_KERNEL_WEAK_COMPONENTS] = weak_components_morsel,
+    [CSR_KERNEL_TRIANGLES] = triangles_morsel,
+    [CSR_KERNEL_LABEL_PROPAGATION] = label_propagation_morsel,
+    [CSR_KERNEL_LOUVAIN] = louvain_morsel
+};
+
+static dsm_segment *create_job_segment(Size size);
+static int launch_workers(csr_job *job);
+static void run_morsels(csr_job *job);
+static void wait_for_step(csr_job *job, uint32 nmorsels);
+static void wake_workers(csr_job_shared *shared);
+static void finish_job(dsm_segment *seg, Datum arg);
+
+/*
+ * Plans a job of the kernel on the graph. The space that the kernel needs,
+ * beyond its arguments, is to be reserved before the job is started.
+ */
+csr_job *begin_csr_job(csr_graph *csr, csr_kernel kernel, Size args_size)
+{
+    csr_job *job;
+
+    job = begin_graph_job(csr->nedges, kernel, args_size);
+    job->csr = csr;
+
+    return job;
+}
+
+/*
+ * Plans a job of the kernel on a graph of nedges edges that the kernel puts
+ * in the space it reserves, rather than on a CSR graph.
+ */
+csr_job *begin_graph_job(uint64 nedges, csr_kernel kernel, Size args_size)
+{
+    csr_job *job;
+
+    job = palloc0(sizeof(csr_job));
+    job->kernel = kernel;
+
+    if (nedges >= (uint64)traversal_parallel_threshold)
+        job->nworkers = max_traversal_workers;
+    job->nparticipants = job->nworkers + 1;
+
+    job->size = MAXALIGN(offsetof(csr_job_shared, workers) +
+                         sizeof(traversal_worker) * job->nworkers);
+
+    // the header is filled in when the job is started
+    job->args_offset = reserve_csr_job_space(job, args_size);
+
+    return job;
+}
+
+// returns the offset of the space reserved in the shared memory of the job
+Size reserve_csr_job_space(csr_job *job, Size size)
+{
+    Size offset = job->size;
+
+    Assert(!job->base);
+
+    job->size += MAXALIGN(size);
+
+    return offset;
+}
+
+/*
+ * Makes the shared memory of the job and starts the workers. If there is not
+ * enough shared memory, the backend runs the job alone, in local memory.
+ */
+void start_csr_job(csr_job *job)
+{
+    csr_graph *csr = job->csr;
+    // the workers map a snapshot themselves
+    bool copy_csr = csr && !csr->mapped;
+    Size csr_offset = job->size;
+    csr_job_shared *shared;
+    int i;
+
+    if (job->nworkers > 0)
+    {
+        job->seg = create_job_segment(
+            copy_csr ? job->size + MAXALIGN(csr->size) : job->size);
+        if (!job->seg)
+            job->nworkers = 0;
+    }
+
+    if (job->seg)
+    {
+        job->base = dsm_segment_address(job->seg);
+    }
+    else
+    {
+        job->base = MemoryContextAllocHuge(CurrentMemoryContext, job->size);
+        MemSet(job->base, 0, offsetof(csr_job_shared, workers));
+    }
+
+    shared = (csr_job_shared *)job->base;
+    pg_atomic_init_u64(&shared->step_info, 0);
+    pg_atomic_init_u64(&shared->cursor, 0);
+    pg_atomic_init_u64(&shared->morsels_done, 0);
+    pg_atomic_init_u32(&shared->finished, 0);
+    shared->kernel = job->kernel;
+    shared->phase = 0;
+    shared->nitems = 0;
+    shared->morsel_size = CSR_MORSEL_SIZE;
+    shared->leader = MyProc;
+    shared->args_offset = job->args_offset;
+    shared->has_csr = csr != NULL;
+    shared->csr_copied = copy_csr;
+    shared->database_oid = MyDatabaseId;
+    shared->graph_oid = csr ? csr->graph_oid : InvalidOid;
+    shared->file_dev = csr ? csr->file_dev : 0;
+    shared->file_ino = csr ? csr->file_ino : 0;
+    shared->csr_offset = csr_offset;
+    shared->csr_size = csr ? csr->size : 0;
+    shared->nworkers = job->nworkers;
+    for (i = 0; i < job->nworkers; i++)
+    {
+        shared->workers[i].proc = NULL;
+        pg_atomic_init_u32(&shared->workers[i].state,
+                           TRAVERSAL_WORKER_STARTING);
+    }
+
+    job->shared = shared;
+    job->args = job->base + job->args_offset;
+
+    if (job->nworkers > 0)
+    {
+        if (shared->csr_copied)
+            memcpy(job->base + csr_offset, csr->data, csr->size);
+
+        // the workers are told to finish however the job ends
+        on_dsm_detach(job->seg, finish_job, PointerGetDatum(shared));
+
+        job->handles = palloc0(sizeof(BackgroundWorkerHandle *) *
+                               job->nworkers);
+        job->nlaunched = launch_workers(job);
+    }
+}
+
+/*
+ * Runs a step of the given phase over nitems items, split into morsels of
+ * morsel_size items, and returns when all of them have been processed.
+ */
+void run_csr_job_step(csr_job *job, uint32 phase, uint64 nitems,
+                      uint64 morsel_size)
+{
+    csr_job_shared *shared = job->shared;
+    uint64 nmorsels = (nitems + morsel_size - 1) / morsel_size;
+
+    Assert(nmorsels <= PG_UINT32_MAX);
+
+    CHECK_FOR_INTERRUPTS();
+
+    if (nmorsels == 0)
+        return;
+
+    job->step++;
+
+    shared->phase = phase;
+    shared->nitems = nitems;
+    shared->morsel_size = morsel_size;
+    pg_atomic_write_u64(&shared->morsels_done, 0);
+    pg_atomic_write_u64(&shared->cursor, (uint64)job->step << 32);
+    pg_write_barrier();
+    pg_atomic_write_u64(&shared->step_info,
+                        ((uint64)job->step << 32) | nmorsels);
+
+    if (job->nlaunched > 0)
+        wake_workers(shared);
+
+    run_morsels(job);
+
+    if (job->nlaunched > 0)
+        wait_for_step(job, (uint32)nmorsels);
+
+    // what the workers wrote in the step is read from here on
+    pg_memory_barrier();
+}
+
+// tells the workers to finish and releases the shared memory
+void end_csr_job(csr_job *job)
+{
+    if (job->seg)
+    {
+        int i;
+
+        cancel_on_dsm_detach(job->seg, finish_job,
+                             PointerGetDatum(job->shared));
+        finish_job(job->seg, PointerGetDatum(job->shared));
+        for (i = 0; i < job->nworkers; i++)
+        {
+            if (job->handles[i])
+                WaitForBackgroundWorkerShutdown(job->handles[i]);
+        }
+
+        dsm_detach(job->seg);
+    }
+    else
+    {
+        pfree(job->base);
+    }
+
+    pfree(job);
+}
+
+/*
+ * Returns the depth of every vertex of the graph, the number of hops from the
+ * nearest source, or -1 for the vertices that are not reached. The search
+ * stops after max_depth hops, unless max_depth is negative.
+ */
+int32 *csr_bfs(csr_graph *csr, const csr_vertex *sources, uint64 nsources,
+               traversal_direction direction, int32 max_depth)
+{
+    uint64 n = csr->nvertices;
+    uint64 nwords = (n + 31) / 32;
+    csr_job *job;
+    bfs_args *args;
+    Size visited_offset;
+    Size depth_offset;
+    Size frontier_offsets[2];
+    pg_atomic_uint32 *visited;
+    int32 *depth;
+    csr_vertex *frontier;
+    uint64 nfrontier = 0;
+    int32 *result;
+    uint32 step;
+    uint64 i;
+
+    job = begin_csr_job(csr, CSR_KERNEL_BFS, sizeof(bfs_args));
+    visited_offset = reserve_csr_job_space(
+        job, sizeof(pg_atomic_uint32) * Max(nwords, 1));
+    depth_offset = reserve_csr_job_space(job, sizeof(int32) * Max(n, 1));
+    for (i = 0; i < 2; i++)
+    {
+        frontier_offsets[i] = reserve_csr_job_space(
+            job, sizeof(csr_vertex) * Max(n, 1));
+    }
+    start_csr_job(job);
+
+    args = job->args;
+    args->direction = direction;
+    pg_atomic_init_u64(&args->next_len, 0);
+    args->visited_offset = visited_offset;
+    args->depth_offset = depth_offset;
+    args->frontier_offsets[0] = frontier_offsets[0];
+    args->frontier_offsets[1] = frontier_offsets[1];
+
+    visited = csr_job_space(job, visited_offset);
+    depth = csr_job_space(job, depth_offset);
+    frontier = csr_job_space(job, frontier_offsets[0]);
+
+    for (i = 0; i < nwords; i++)
+        pg_atomic_init_u32(&visited[i], 0);
+    for (i = 0; i < n; i++)
+        depth[i] = -1;
+
+    for (i = 0; i < nsources; i++)
+    {
+        csr_vertex v = sources[i];
+
+        if (depth[v] == 0)
+            continue;
+
+        pg_atomic_fetch_or_u32(&visited[v / 32], 1U << (v % 32));
+        depth[v] = 0;
+        frontier[nfrontier++] = v;
+    }
+
+    // step s finds the vertices at depth s
+    for (step = 1;
+         nfrontier > 0 && (max_depth < 0 || step <= (uint32)max_depth); step++)
+    {
+        pg_atomic_write_u64(&args->next_len, 0);
+        run_csr_job_step(job, step, nfrontier, CSR_MORSEL_SIZE);
+        nfrontier = pg_atomic_read_u64(&args->next_len);
+    }
+
+    result = alloc_csr_array(n, sizeof(int32));
+    memcpy(result, depth, sizeof(int32) * n);
+
+    end_csr_job(job);
+
+    return result;
+}
+
+// expands the vertices from begin to end of the frontier of the step
+static void bfs_morsel(csr_job *job, uint32 phase, uint64 begin, uint64 end)
+{
+    bfs_args *args = job->args;
+    pg_atomic_uint32 *visited = csr_job_space(job, args->visited_offset);
+    int32 *depth = csr_job_space(job, args->depth_offset);
+    csr_vertex *frontier = csr_job_space(job,
+                                         args->frontier_offsets[(phase - 1) %
+                                                                2]);
+    csr_vertex *next = csr_job_space(job, args->frontier_offsets[phase % 2]);
+    csr_vertex found[CSR_APPEND_SIZE];
+    int nfound = 0;
+    uint64 i;
+
+    for (i = begin; i < end; i++)
+    {
+        int d;
+
+        for (d = TRAVERSAL_OUT; d <= TRAVERSAL_IN; d <<= 1)
+        {
+            csr_neighbor_iterator it;
+            csr_vertex w;
+
+            if (!(args->direction & d))
+                continue;
+
+            csr_begin_neighbors(d == TRAVERSAL_OUT ? &job->csr->out :
+                                                     &job->csr->in,
+                                frontier[i], &it);
+            while (csr_next_neighbor(&it, &w))
+            {
+                pg_atomic_uint32 *word = &visited[w / 32];
+                uint32 bit = 1U << (w % 32);
+
+                // read first, so visited vertices cost no atomic write
+                if (pg_atomic_read_u32(word) & bit)
+                    continue;
+                if (pg_atomic_fetch_or_u32(word, bit) & bit)
+                    continue;
+
+                depth[w] = phase;
+                found[nfound++] = w;
+
+                if (nfound == CSR_APPEND_SIZE)
+                {
+                    uint64 pos = pg_atomic_fetch_add_u64(&args->next_len,
+                                                         nfound);
+
+                    memcpy(&next[pos], found, sizeof(csr_vertex) * nfound);
+                    nfound = 0;
+                }
+            }
+        }
+    }
+
+    if (nfound > 0)
+    {
+        uint64 pos = pg_atomic_fetch_add_u64(&args->next_len, nfound);
+
+        memcpy(&next[pos], found, sizeof(csr_vertex) * nfound);
+    }
+}
+
+/*
+ * Creates the shared memory of a job, or returns NULL if there is not enough
+ * of it. dsm_create() only returns NULL when it runs out of segments, so the
+ * error it raises when it runs out of memory is caught, in a subtransaction
+ * that is rolled back.
+ */
+static dsm_segment *create_job_segment(Size size)
+{
+    MemoryContext mcxt = CurrentMemoryContext;
+    ResourceOwner owner = CurrentResourceOwner;
+    dsm_segment *volatile seg = NULL;
+
+    BeginInternalSubTransaction(NULL);
+    MemoryContextSwitchTo(mcxt);
+
+    PG_TRY();
+    {
+        seg = dsm_create(size, DSM_CREATE_NULL_IF_MAXSEGMENTS);
+
+        // keep the segment from being released with the subtransaction
+        if (seg)
+            dsm_pin_mapping(seg);
+
+        ReleaseCurrentSubTransaction();
+    }
+    PG_CATCH();
+    {
+        ErrorData *edata;
+
+        MemoryContextSwitchTo(mcxt);
+        edata = CopyErrorData();
+        FlushErrorState();
+
+        RollbackAndReleaseCurrentSubTransaction();
+        MemoryContextSwitchTo(mcxt);
+        CurrentResourceOwner = owner;
+
+        if (edata->sqlerrcode != ERRCODE_OUT_OF_MEMORY &&
+            edata->sqlerrcode != ERRCODE_DISK_FULL &&
+            edata->sqlerrcode != ERRCODE_INSUFFICIENT_RESOURCES)
+            ReThrowError(edata);
+
+        ereport(DEBUG1,
+                (errmsg("running CSR job without workers: %s",
+                        edata->message)));
+        FreeErrorData(edata);
+    }
+    PG_END_TRY();
+
+    MemoryContextSwitchTo(mcxt);
+    CurrentResourceOwner = owner;
+
+    // the segment is released with the resource owner of the caller
+    if (seg)
+        dsm_unpin_mapping(seg);
+
+    return seg;
+}
+
+// returns the number of the workers registered
+static int launch_workers(csr_job *job)
+{
+    BackgroundWorker worker;
+    int nlaunched = 0;
+    int i;
+
+    MemSet(&worker, 0, sizeof(worker));
+    worker.bgw_flags = BGWORKER_SHMEM_ACCESS;
+    worker.bgw_start_time = BgWorkerStart_ConsistentState;
+    worker.bgw_restart_time = BGW_NEVER_RESTART;
+    snprintf(worker.bgw_library_name, BGW_MAXLEN, "age");
+    snprintf(worker.bgw_function_name, BGW_MAXLEN,
+             "csr_traversal_worker_main");
+    snprintf(worker.bgw_name, BGW_MAXLEN, "age traversal worker for PID %d",
+             MyProcPid);
+    snprintf(worker.bgw_type, BGW_MAXLEN, "age traversal worker");
+    worker.bgw_main_arg = UInt32GetDatum(dsm_segment_handle(job->seg));
+    worker.bgw_notify_pid = MyProcPid;
+
+    for (i = 0; i < job->nworkers; i++)
+    {
+        memcpy(worker.bgw_extra, &i, sizeof(int));
+
+        // the rest of the job is done by the ones registered
+        if (!RegisterDynamicBackgroundWorker(&worker, &job->handles[i]))
+            break;
+
+        nlaunched++;
+    }
+
+    return nlaunched;
+}
+
+void csr_traversal_worker_main(Datum main_arg)
+{
+    dsm_segment *seg;
+    csr_job_shared *shared;
+    csr_job job;
+    traversal_worker *self;
+    uint32 last_step = 0;
+    int number;
+
+    pqsignal(SIGTERM, die);
+    BackgroundWorkerUnblockSignals();
+
+    CurrentResourceOwner = ResourceOwnerCreate(NULL, "age traversal worker");
+
+    seg = dsm_attach(DatumGetUInt32(main_arg));
+    if (!seg)
+    {
+        ereport(ERROR,
+                (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+                 errmsg("could not map dynamic shared memory segment")));
+    }
+    shared = dsm_segment_address(seg);
+
+    memcpy(&number, MyBgworkerEntry->bgw_extra, sizeof(int));
+    self = &shared->workers[number];
+
+    MemSet(&job, 0, sizeof(job));
+    job.shared = shared;
+    job.base = (char *)shared;
+    job.args = job.base + shared->args_offset;
+    job.participant = number + 1;
+    job.nparticipants = shared->nworkers + 1;
+
+    if (shared->csr_copied)
+    {
+        job.csr = attach_csr_graph(job.base + shared->csr_offset,
+                                   shared->csr_size);
+    }
+    else if (shared->has_csr)
+    {
+        job.csr = attach_csr_snapshot(shared->database_oid, shared->graph_oid,
+                                      shared->file_dev, shared->file_ino);
+    }
+
+    // the snapshot has been replaced, so the backend goes on without this one
+    if (shared->has_csr && !job.csr)
+    {
+        pg_atomic_write_u32(&self->state, TRAVERSAL_WORKER_DONE);
+        dsm_detach(seg);
+        return;
+    }
+
+    self->proc = MyProc;
+    pg_atomic_write_u32(&self->state, TRAVERSAL_WORKER_RUNNING);
+
+    // either the backend sees proc, or this sees the step it publishes
+    pg_memory_barrier();
+
+    for (;;)
+    {
+        uint32 step;
+        int rc;
+
+        ResetLatch(MyLatch);
+
+        if (pg_atomic_read_u32(&shared->finished))
+            break;
+
+        step = (uint32)(pg_atomic_read_u64(&shared->step_info) >> 32);
+        if (step != last_step)
+        {
+            last_step = step;
+            run_morsels(&job);
+            continue;
+        }
+
+        rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_POSTMASTER_DEATH, -1L,
+                       PG_WAIT_EXTENSION);
+        if (rc & WL_POSTMASTER_DEATH)
+            proc_exit(1);
+
+        CHECK_FOR_INTERRUPTS();
+    }
+
+    pg_atomic_write_u32(&self->state, TRAVERSAL_WORKER_DONE);
+
+    if (shared->has_csr && !shared->csr_copied)
+        release_csr_graph(job.csr);
+    dsm_detach(seg);
+}
+
+// claims and processes the morsels of the current step until there are none
+static void run_morsels(csr_job *job)
+{
+    csr_job_shared *shared = job->shared;
+    uint64 info = pg_atomic_read_u64(&shared->step_info);
+    uint32 step = (uint32)(info >> 32);
+    uint32 nmorsels = (uint32)info;
+    csr_kernel_func kernel;
+    uint32 phase;
+    uint64 nitems;
+    uint64 morsel_size;
+
+    pg_read_barrier();
+
+    kernel = csr_kernels[shared->kernel];
+    phase = shared->phase;
+    nitems = shared->nitems;
+    morsel_size = shared->morsel_size;
+
+    for (;;)
+    {
+        uint64 cursor = pg_atomic_read_u64(&shared->cursor);
+        uint64 begin;
+
+        if ((uint32)(cursor >> 32) != step || (uint32)cursor >= nmorsels)
+            break;
+        if (!pg_atomic_compare_exchange_u64(&shared->cursor, &cursor,
+                                            cursor + 1))
+            continue;
+
+        CHECK_FOR_INTERRUPTS();
+
+        // the step cannot end before this morsel is done
+        begin = (uint64)(uint32)cursor * morsel_size;
+        kernel(job, phase, begin, Min(begin + morsel_size, nitems));
+
+        if (pg_atomic_add_fetch_u64(&shared->morsels_done, 1) == nmorsels &&
+            job->participant > 0)
+            SetLatch(&shared->leader->procLatch);
+    }
+}
+
+/*
+ * Waits for the workers to finish the morsels they have claimed. A worker
+ * that exits while running could have left a morsel unfinished.
+ */
+static void wait_for_step(csr_job *job, uint32 nmorsels)
+{
+    csr_job_shared *shared = job->shared;
+
+    while (pg_atomic_read_u64(&shared->morsels_done) < nmorsels)
+    {
+        int i;
+        int rc;
+
+        for (i = 0; i < job->nlaunched; i++)
+        {
+            pid_t pid;
+
+            if (GetBackgroundWorkerPid(job->handles[i], &pid) ==
+                    BGWH_STOPPED &&
+                pg_atomic_read_u32(&shared->workers[i].state) ==
+                    TRAVERSAL_WORKER_RUNNING)
+            {
+                ereport(ERROR,
+                        (errcode(ERRCODE_INTERNAL_ERROR),
+                         errmsg("traversal worker exited unexpectedly")));
+            }
+        }
+
+        rc = WaitLatch(MyLatch,
+                       WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH, 10L,
+                       PG_WAIT_EXTENSION);
+        if (rc & WL_POSTMASTER_DEATH)
+            proc_exit(1);
+
+        ResetLatch(MyLatch);
+        CHECK_FOR_INTERRUPTS();
+    }
+}
+
+static void wake_workers(csr_job_shared *shared)
+{
+    int i;
+
+    pg_memory_barrier();
+
+    for (i = 0; i < shared->nworkers; i++)
+    {
+        volatile traversal_worker *worker = &shared->workers[i];
+        PGPROC *proc = worker->proc;
+
+        // a worker that has not started yet checks for the step once it does
+        if (proc)
+            SetLatch(&proc->procLatch);
+    }
+}
+
+// also called when the segment is detached on error
+static void finish_job(dsm_segment *seg, Datum arg)
+{
+    csr_job_shared *shared = (csr_job_shared *)DatumGetPointer(arg);
+
+    pg_atomic_write_u32(&shared->finished, 1);
+    wake_workers(shared);
+}
+
+/*
+ * Returns TRAVERSAL_OUT, TRAVERSAL_IN, or TRAVERSAL_BOTH for the "out", "in",
+ * or "both" argument, or def if it is NULL.
+ */
+traversal_direction get_traversal_direction_arg(FunctionCallInfo fcinfo,
+                                                int argno,
+                                                traversal_direction def)
+{
+    char *direction;
+
+    if (PG_ARGISNULL(argno))
+        return def;
+
+    direction = text_to_cstring(PG_GETARG_TEXT_PP(argno));
+    if (pg_strcasecmp(direction, "out") == 0)
+        return TRAVERSAL_OUT;
+    if (pg_strcasecmp(direction, "in") == 0)
+        return TRAVERSAL_IN;
+    if (pg_strcasecmp(direction, "both") == 0)
+        return TRAVERSAL_BOTH;
+
+    ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("direction must be \"out\", \"in\", or \"both\", not \"%s\"",
+                    direction)));
+}
+
+// returns the distinct seeds in ascending order
+graphid *get_seeds_arg(FunctionCallInfo fcinfo, int argno, int64 *nseeds)
+{
+    ArrayType *seeds;
+    Datum *elems;
+    bool *nulls;
+    int nelems;
+    graphid *ids;
+    int64 n = 0;
+    int i;
+
+    if (PG_ARGISNULL(argno))
+    {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                        errmsg("seeds must not be NULL")));
+    }
+    seeds = PG_GETARG_ARRAYTYPE_P(argno);
+
+    deconstruct_array(seeds, GRAPHIDOID, sizeof(graphid), true, 'd', &elems,
+                      &nulls, &nelems);
+
+    ids = palloc(sizeof(graphid) * Max(nelems, 1));
+    for (i = 0; i < nelems; i++)
+    {
+        if (nulls[i])
+        {
+            ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                            errmsg("seed must not be NULL")));
+        }
+
+        ids[i] = DATUM_GET_GRAPHID(elems[i]);
+    }
+
+    qsort(ids, nelems, sizeof(graphid), compare_graphids);
+    for (i = 0; i < nelems; i++)
+    {
+        if (n == 0 || ids[n - 1] != ids[i])
+            ids[n++] = ids[i];
+    }
+
+    *nseeds = n;
+
+    return ids;
+}
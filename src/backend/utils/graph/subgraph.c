@@ -0,0 +1,456 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * k-hop subgraph extraction
+ *
+ * The subgraph is found by a breadth-first search from the seeds that
+ * expands a whole level at once. The vertices of a level are sorted, and each
+ * edge label table is probed for them in that order through its index on
+ * start_id (or end_id), or scanned once for the level if it has no such
+ * index. The vertices and the edges found are kept in hash tables, so each of
+ * them is expanded and returned only once.
+ */
+
+#include "postgres.h"
+
+#include "access/genam.h"
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "access/relscan.h"
+#include "access/skey.h"
+#include "access/stratnum.h"
+#include "catalog/pg_class_d.h"
+#include "catalog/pg_inherits.h"
+#include "catalog/pg_type.h"
+#include "miscadmin.h"
+#include "utils/hsearch.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+
+#include "catalog/ag_label.h"
+#include "executor/cypher_executor.h"
+#include "utils/ag_cache.h"
+#include "utils/ag_func.h"
+#include "utils/csr_graph.h"
+#include "utils/csr_traversal.h"
+#include "utils/graphid.h"
+
+typedef struct subgraph_entry
+{
+    graphid id; // hash key
+} subgraph_entry;
+
+typedef struct subgraph_state
+{
+    Tuplestorestate *tupstore;
+    TupleDesc tupdesc;
+    Oid eq_func_oid;
+    // the vertices and the edges found so far
+    HTAB *vertices;
+    HTAB *edges;
+    // the vertices found in the current level, to be expanded in the next one
+    graphid *next;
+    int64 nnext;
+    int64 max_next;
+} subgraph_state;
+
+static void expand_level(subgraph_state *state, Oid relid, AttrNumber attnum,
+                         const graphid *frontier, int64 nfrontier, int depth);
+static void add_edge(subgraph_state *state, HeapTuple tuple,
+                     TupleDesc tupdesc, AttrNumber attnum, int depth);
+static bool add_vertex(subgraph_state *state, graphid id, int depth);
+static int64 filter_vertex_seeds(subgraph_state *state,
+                                 graph_cache_data *cache, graphid *seeds,
+                                 int64 nseeds);
+static void find_vertex_seeds(subgraph_state *state, Oid relid,
+                              const graphid *seeds, int64 nseeds,
+                              bool *found);
+static HTAB *create_graphid_set(const char *name);
+
+PG_FUNCTION_INFO_V1(extract_subgraph);
+
+/*
+ * Returns the vertices within k hops of the seeds and the edges that are
+ * followed to reach them. A vertex row has NULL start_id and end_id, and its
+ * depth is its distance from the seeds. An edge row has the depth of the hop
+ * it was followed in. The seeds that are not vertices of the graph are
+ * ignored.
+ */
+Datum extract_subgraph(PG_FUNCTION_ARGS)
+{
+    graph_cache_data *cache;
+    graphid *frontier;
+    int64 nfrontier;
+    int32 k;
+    List *label_ids;
+    traversal_direction direction;
+    List *relids;
+    subgraph_state state;
+    int depth;
+    int64 i;
+
+    if (PG_ARGISNULL(2))
+    {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                        errmsg("k must not be NULL")));
+    }
+    k = PG_GETARG_INT32(2);
+    if (k < 0)
+    {
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                        errmsg("k must not be negative")));
+    }
+
+    direction = get_traversal_direction_arg(fcinfo, 4, TRAVERSAL_BOTH);
+
+    state.tupstore = begin_csr_result(fcinfo, &state.tupdesc);
+
+    cache = get_graph_cache_arg(fcinfo, 0);
+    frontier = get_seeds_arg(fcinfo, 1, &nfrontier);
+    label_ids = get_csr_label_ids(
+        cache, PG_ARGISNULL(3) ? NULL : PG_GETARG_ARRAYTYPE_P(3));
+    relids = get_edge_relations(cache, label_ids);
+
+    state.eq_func_oid = get_ag_func_oid("graphid_eq", 2, GRAPHIDOID,
+                                        GRAPHIDOID);
+    state.vertices = create_graphid_set("extract_subgraph vertices");
+    state.edges = create_graphid_set("extract_subgraph edges");
+    state.max_next = Max(nfrontier, 16);
+    state.next = palloc(sizeof(graphid) * state.max_next);
+
+    nfrontier = filter_vertex_seeds(&state, cache, frontier, nfrontier);
+    for (i = 0; i < nfrontier; i++)
+        add_vertex(&state, frontier[i], 0);
+
+    for (depth = 1; depth <= k && nfrontier > 0; depth++)
+    {
+        ListCell *lc;
+
+        state.nnext = 0;
+
+        foreach (lc, relids)
+        {
+            if (direction & TRAVERSAL_OUT)
+            {
+                expand_level(&state, lfirst_oid(lc),
+                             Anum_ag_label_edge_table_start_id, frontier,
+                             nfrontier, depth);
+            }
+            if (direction & TRAVERSAL_IN)
+            {
+                expand_level(&state, lfirst_oid(lc),
+                             Anum_ag_label_edge_table_end_id, frontier,
+                             nfrontier, depth);
+            }
+        }
+
+        // the vertices of the next level have not been seen before
+        pfree(frontier);
+        frontier = state.next;
+        nfrontier = state.nnext;
+        qsort(frontier, nfrontier, sizeof(graphid), compare_graphids);
+
+        state.max_next = Max(nfrontier, 16);
+        state.next = palloc(sizeof(graphid) * state.max_next);
+    }
+
+    hash_destroy(state.vertices);
+    hash_destroy(state.edges);
+
+    return (Datum)0;
+}
+
+/*
+ * Finds the edges of the table whose attnum (start_id or end_id) is one of
+ * the vertices of the frontier, which is sorted.
+ */
+static void expand_level(subgraph_state *state, Oid relid, AttrNumber attnum,
+                         const graphid *frontier, int64 nfrontier, int depth)
+{
+    Relation rel;
+    TupleDesc tupdesc;
+    Oid index_oid;
+    HeapTuple tuple;
+
+    rel = heap_open(relid, AccessShareLock);
+    tupdesc = RelationGetDescr(rel);
+
+    index_oid = get_adjacency_index(rel, attnum);
+    if (OidIsValid(index_oid))
+    {
+        Relation index;
+        IndexScanDesc index_scan;
+        int64 i;
+
+        index = index_open(index_oid, AccessShareLock);
+        index_scan = index_beginscan(rel, index, GetActiveSnapshot(), 1, 0);
+
+        // probing in the order of the graphids walks the index forward
+        for (i = 0; i < nfrontier; i++)
+        {
+            ScanKeyData scan_key;
+
+            CHECK_FOR_INTERRUPTS();
+
+            // the column is the first one of the index
+            ScanKeyInit(&scan_key, 1, BTEqualStrategyNumber,
+                        state->eq_func_oid, GRAPHID_GET_DATUM(frontier[i]));
+            index_rescan(index_scan, &scan_key, 1, NULL, 0);
+
+            while ((tuple = index_getnext(index_scan,
+                                          ForwardScanDirection)) != NULL)
+                add_edge(state, tuple, tupdesc, attnum, depth);
+        }
+
+        index_endscan(index_scan);
+        index_close(index, AccessShareLock);
+    }
+    else
+    {
+        HeapScanDesc scan_desc;
+
+        scan_desc = heap_beginscan(rel, GetActiveSnapshot(), 0, NULL);
+
+        while ((tuple = heap_getnext(scan_desc, ForwardScanDirection)) != NULL)
+        {
+            bool is_null;
+            graphid id;
+
+            CHECK_FOR_INTERRUPTS();
+
+            id = DATUM_GET_GRAPHID(heap_getattr(tuple, attnum, tupdesc,
+                                                &is_null));
+            if (bsearch_graphid(frontier, nfrontier, id) >= 0)
+                add_edge(state, tuple, tupdesc, attnum, depth);
+        }
+
+        heap_endscan(scan_desc);
+    }
+
+    heap_close(rel, AccessShareLock);
+}
+
+// returns the edge, and the vertex at its other end, unless they were found
+static void add_edge(subgraph_state *state, HeapTuple tuple,
+                     TupleDesc tupdesc, AttrNumber attnum, int depth)
+{
+    Datum values[4];
+    bool nulls[4] = {false, false, false, false};
+    graphid id;
+    bool is_null;
+    bool found;
+
+    values[0] = heap_getattr(tuple, Anum_ag_label_edge_table_id, tupdesc,
+                             &is_null);
+
+    // the edge has been found from its other end, in both directions
+    id = DATUM_GET_GRAPHID(values[0]);
+    hash_search(state->edges, &id, HASH_ENTER, &found);
+    if (found)
+        return;
+
+    values[1] = heap_getattr(tuple, Anum_ag_label_edge_table_start_id,
+                             tupdesc, &is_null);
+    values[2] = heap_getattr(tuple, Anum_ag_label_edge_table_end_id, tupdesc,
+                             &is_null);
+    values[3] = Int32GetDatum(depth);
+
+    tuplestore_putvalues(state->tupstore, state->tupdesc, values, nulls);
+
+    if (attnum == Anum_ag_label_edge_table_start_id)
+        add_vertex(state, DATUM_GET_GRAPHID(values[2]), depth);
+    else
+        add_vertex(state, DATUM_GET_GRAPHID(values[1]), depth);
+}
+
+/*
+ * Returns the vertex and adds it to the next level, unless it was found.
+ * Returns whether it was added.
+ */
+static bool add_vertex(subgraph_state *state, graphid id, int depth)
+{
+    Datum values[4];
+    bool nulls[4] = {false, true, true, false};
+    bool found;
+
+    hash_search(state->vertices, &id, HASH_ENTER, &found);
+    if (found)
+        return false;
+
+    values[0] = GRAPHID_GET_DATUM(id);
+    values[1] = (Datum)0;
+    values[2] = (Datum)0;
+    values[3] = Int32GetDatum(depth);
+
+    tuplestore_putvalues(state->tupstore, state->tupdesc, values, nulls);
+
+    if (state->nnext == state->max_next)
+    {
+        state->max_next *= 2;
+        state->next = repalloc_huge(state->next,
+                                    sizeof(graphid) * state->max_next);
+    }
+    state->next[state->nnext++] = id;
+
+    return true;
+}
+
+/*
+ * Removes the seeds whose label is not a vertex label of the graph, and the
+ * ones that are not in the table of their label, and returns how many are
+ * left. The seeds are sorted, so the ones of a label are next to each other.
+ */
+static int64 filter_vertex_seeds(subgraph_state *state,
+                                 graph_cache_data *cache, graphid *seeds,
+                                 int64 nseeds)
+{
+    int64 n = 0;
+    int64 begin = 0;
+
+    while (begin < nseeds)
+    {
+        int32 label_id = get_graphid_label_id(seeds[begin]);
+        label_cache_data *lcd;
+        bool *found;
+        ListCell *lc;
+        int64 end;
+        int64 i;
+
+        for (end = begin + 1; end < nseeds; end++)
+        {
+            if (get_graphid_label_id(seeds[end]) != label_id)
+                break;
+        }
+
+        lcd = search_label_graph_id_cache(cache->oid, label_id);
+        if (!lcd || lcd->kind != LABEL_KIND_VERTEX)
+        {
+            begin = end;
+            continue;
+        }
+
+        // the vertices of a partitioned label are in its partitions
+        found = palloc0(sizeof(bool) * (end - begin));
+        foreach (lc, find_all_inheritors(lcd->relation, AccessShareLock,
+                                         NULL))
+        {
+            if (get_rel_relkind(lfirst_oid(lc)) == RELKIND_PARTITIONED_TABLE)
+                continue;
+
+            find_vertex_seeds(state, lfirst_oid(lc), seeds + begin,
+                              end - begin, found);
+        }
+
+        for (i = begin; i < end; i++)
+        {
+            if (found[i - begin])
+                seeds[n++] = seeds[i];
+        }
+
+        pfree(found);
+        begin = end;
+    }
+
+    return n;
+}
+
+// marks the seeds, which are sorted, that are in the vertex table
+static void find_vertex_seeds(subgraph_state *state, Oid relid,
+                              const graphid *seeds, int64 nseeds,
+                              bool *found)
+{
+    Relation rel;
+    Oid index_oid;
+
+    check_select_privilege(relid);
+
+    rel = heap_open(relid, AccessShareLock);
+
+    index_oid = get_adjacency_index(rel, Anum_ag_label_vertex_table_id);
+    if (OidIsValid(index_oid))
+    {
+        Relation index;
+        IndexScanDesc index_scan;
+        int64 i;
+
+        index = index_open(index_oid, AccessShareLock);
+        index_scan = index_beginscan(rel, index, GetActiveSnapshot(), 1, 0);
+
+        for (i = 0; i < nseeds; i++)
+        {
+            ScanKeyData scan_key;
+
+            CHECK_FOR_INTERRUPTS();
+
+            if (found[i])
+                continue;
+
+            ScanKeyInit(&scan_key, 1, BTEqualStrategyNumber,
+                        state->eq_func_oid, GRAPHID_GET_DATUM(seeds[i]));
+            index_rescan(index_scan, &scan_key, 1, NULL, 0);
+
+            if (index_getnext(index_scan, ForwardScanDirection) != NULL)
+                found[i] = true;
+        }
+
+        index_endscan(index_scan);
+        index_close(index, AccessShareLock);
+    }
+    else
+    {
+        HeapScanDesc scan_desc;
+        HeapTuple tuple;
+
+        scan_desc = heap_beginscan(rel, GetActiveSnapshot(), 0, NULL);
+
+        while ((tuple = heap_getnext(scan_desc, ForwardScanDirection)) != NULL)
+        {
+            bool is_null;
+            int64 i;
+
+            CHECK_FOR_INTERRUPTS();
+
+            i = bsearch_graphid(
+                seeds, nseeds,
+                DATUM_GET_GRAPHID(heap_getattr(tuple,
+                                               Anum_ag_label_vertex_table_id,
+                                               RelationGetDescr(rel),
+                                               &is_null)));
+            if (i >= 0)
+                found[i] = true;
+        }
+
+        heap_endscan(scan_desc);
+    }
+
+    heap_close(rel, AccessShareLock);
+}
+
+static HTAB *create_graphid_set(const char *name)
+{
+    HASHCTL hash_ctl;
+
+    MemSet(&hash_ctl, 0, sizeof(hash_ctl));
+    hash_ctl.keysize = sizeof(graphid);
+    hash_ctl.entrysize = sizeof(subgraph_entry);
+    hash_ctl.hcxt = CurrentMemoryContext;
+
+    return hash_create(name, 1024, &hash_ctl,
+                       HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+}
@@ -0,0 +1,320 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Triangle counting
+ *
+ * Triangles are counted in the undirected simple graph underlying the CSR
+ * graph: the direction of the edges is ignored, and self-loops and parallel
+ * edges are not counted. Each edge is kept only at the end with the lower
+ * degree (ties broken by the vertex), so every triangle is found exactly once,
+ * from its lowest vertex, by intersecting the sorted neighbor lists of the
+ * ends of an edge. The orientation bounds the lists by the square root of the
+ * number of edges, so vertices with many edges are cheap.
+ *
+ * The counting is a job (see csr_traversal.c) of three steps over the
+ * vertices: merging the edges of each vertex into its undirected neighbors,
+ * keeping the ones it precedes, and intersecting the lists. The lists of a
+ * vertex start where its outgoing and incoming edges would together, so each
+ * vertex is merged without knowing how long the lists before it are.
+ */
+
+#include "postgres.h"
+
+#include "fmgr.h"
+#include "miscadmin.h"
+
+#include "utils/csr_graph.h"
+#include "utils/csr_traversal.h"
+#include "utils/graphid.h"
+
+// the steps of the counting
+#define TRIANGLE_MERGE 0
+#define TRIANGLE_ORIENT 1
+#define TRIANGLE_COUNT 2
+
+typedef struct triangle_args
+{
+    // whether the triangles of each vertex are counted
+    bool per_vertex;
+    // the number of the neighbors of each vertex in the undirected graph
+    Size degree_offset;
+    Size neighbors_offset;
+    // the number of the neighbors each vertex precedes, and which they are
+    Size forward_len_offset;
+    Size forward_offset;
+    // the triangles of each vertex, if per_vertex
+    Size triangles_offset;
+    // the triangles found by each morsel of TRIANGLE_COUNT
+    Size partial_offset;
+} triangle_args;
+
+static csr_job *count_triangles(csr_graph *csr, bool per_vertex,
+                                uint64 *total);
+static uint64 merge_neighbors(const csr_adjacency *a, const csr_adjacency *b,
+                              csr_vertex v, csr_vertex *buf);
+
+PG_FUNCTION_INFO_V1(triangle_count);
+
+Datum triangle_count(PG_FUNCTION_ARGS)
+{
+    csr_graph *csr;
+    csr_job *job;
+    uint64 total;
+
+    csr = get_csr_graph_arg(fcinfo, 0, 1);
+
+    job = count_triangles(csr, false, &total);
+    end_csr_job(job);
+
+    release_csr_graph(csr);
+
+    PG_RETURN_INT64(total);
+}
+
+PG_FUNCTION_INFO_V1(clustering_coefficient);
+
+/*
+ * The local clustering coefficient of a vertex is the number of the triangles
+ * it is in over the number of the pairs of its neighbors.
+ */
+Datum clustering_coefficient(PG_FUNCTION_ARGS)
+{
+    csr_graph *csr;
+    csr_job *job;
+    triangle_args *args;
+    uint64 *degrees;
+    pg_atomic_uint64 *triangles;
+    uint64 total;
+    Tuplestorestate *tupstore;
+    TupleDesc tupdesc;
+    uint64 v;
+
+    tupstore = begin_csr_result(fcinfo, &tupdesc);
+    csr = get_csr_graph_arg(fcinfo, 0, 1);
+
+    job = count_triangles(csr, true, &total);
+    args = job->args;
+    degrees = csr_job_space(job, args->degree_offset);
+    triangles = csr_job_space(job, args->triangles_offset);
+
+    for (v = 0; v < csr->nvertices; v++)
+    {
+        Datum values[3];
+        bool nulls[3] = {false, false, false};
+        uint64 degree = degrees[v];
+        uint64 count = pg_atomic_read_u64(&triangles[v]);
+        double coefficient = 0;
+
+        if (degree > 1)
+            coefficient = 2.0 * count / ((double)degree * (degree - 1));
+
+        values[0] = GRAPHID_GET_DATUM(csr->vertex_ids[v]);
+        values[1] = Int64GetDatum(count);
+        values[2] = Float8GetDatum(coefficient);
+
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+
+    end_csr_job(job);
+    release_csr_graph(csr);
+
+    return (Datum)0;
+}
+
+/*
+ * Counts the triangles in the graph and returns the job, whose arrays have the
+ * undirected degree and, if per_vertex, the triangles of each vertex.
+ */
+static csr_job *count_triangles(csr_graph *csr, bool per_vertex,
+                                uint64 *total)
+{
+    uint64 n = csr->nvertices;
+    uint64 nslots = csr->out.edge_offsets[n] + csr->in.edge_offsets[n];
+    uint64 nmorsels = (n + CSR_MORSEL_SIZE - 1) / CSR_MORSEL_SIZE;
+    csr_job *job;
+    triangle_args *args;
+    Size offsets[6];
+    uint64 *partial;
+    uint64 i;
+
+    job = begin_csr_job(csr, CSR_KERNEL_TRIANGLES, sizeof(triangle_args));
+    offsets[0] = reserve_csr_job_space(job, sizeof(uint64) * Max(n, 1));
+    offsets[1] = reserve_csr_job_space(job,
+                                       sizeof(csr_vertex) * Max(nslots, 1));
+    offsets[2] = reserve_csr_job_space(job, sizeof(uint64) * Max(n, 1));
+    offsets[3] = reserve_csr_job_space(job,
+                                       sizeof(csr_vertex) * Max(nslots, 1));
+    offsets[4] = reserve_csr_job_space(
+        job, per_vertex ? sizeof(pg_atomic_uint64) * Max(n, 1) : 0);
+    offsets[5] = reserve_csr_job_space(job, sizeof(uint64) * Max(nmorsels, 1));
+    start_csr_job(job);
+
+    args = job->args;
+    args->per_vertex = per_vertex;
+    args->degree_offset = offsets[0];
+    args->neighbors_offset = offsets[1];
+    args->forward_len_offset = offsets[2];
+    args->forward_offset = offsets[3];
+    args->triangles_offset = offsets[4];
+    args->partial_offset = offsets[5];
+
+    if (per_vertex)
+    {
+        pg_atomic_uint64 *triangles = csr_job_space(job, offsets[4]);
+
+        for (i = 0; i < n; i++)
+            pg_atomic_init_u64(&triangles[i], 0);
+    }
+
+    run_csr_job_step(job, TRIANGLE_MERGE, n, CSR_MORSEL_SIZE);
+    run_csr_job_step(job, TRIANGLE_ORIENT, n, CSR_MORSEL_SIZE);
+    run_csr_job_step(job, TRIANGLE_COUNT, n, CSR_MORSEL_SIZE);
+
+    partial = csr_job_space(job, offsets[5]);
+    *total = 0;
+    for (i = 0; i < nmorsels; i++)
+        *total += partial[i];
+
+    return job;
+}
+
+// runs a step of the counting over the vertices from begin to end
+void triangles_morsel(csr_job *job, uint32 phase, uint64 begin, uint64 end)
+{
+    triangle_args *args = job->args;
+    const csr_graph *csr = job->csr;
+    uint64 *degrees = csr_job_space(job, args->degree_offset);
+    csr_vertex *neighbors = csr_job_space(job, args->neighbors_offset);
+    uint64 *forward_len = csr_job_space(job, args->forward_len_offset);
+    csr_vertex *forward = csr_job_space(job, args->forward_offset);
+    pg_atomic_uint64 *triangles = csr_job_space(job, args->triangles_offset);
+    uint64 *partial = csr_job_space(job, args->partial_offset);
+    uint64 total = 0;
+    uint64 v;
+    uint64 i;
+
+#define START(x) (csr->out.edge_offsets[(x)] + csr->in.edge_offsets[(x)])
+#define PRECEDES(x, y) \
+    (degrees[x] < degrees[y] || (degrees[x] == degrees[y] && (x) < (y)))
+
+    for (v = begin; v < end; v++)
+    {
+        if (phase == TRIANGLE_MERGE)
+        {
+            degrees[v] = merge_neighbors(&csr->out, &csr->in, v,
+                                         neighbors + START(v));
+        }
+        else if (phase == TRIANGLE_ORIENT)
+        {
+            // keep the edges from the lower end to the higher one
+            csr_vertex *list = neighbors + START(v);
+            uint64 len = 0;
+
+            for (i = 0; i < degrees[v]; i++)
+            {
+                if (PRECEDES(v, list[i]))
+                    forward[START(v) + len++] = list[i];
+            }
+
+            forward_len[v] = len;
+        }
+        else
+        {
+            for (i = 0; i < forward_len[v]; i++)
+            {
+                csr_vertex u = forward[START(v) + i];
+                uint64 a = START(v);
+                uint64 a_end = a + forward_len[v];
+                uint64 b = START(u);
+                uint64 b_end = b + forward_len[u];
+
+                // the lists are sorted by vertex, so a merge finds the common
+                // ones
+                while (a < a_end && b < b_end)
+                {
+                    if (forward[a] < forward[b])
+                    {
+                        a++;
+                    }
+                    else if (forward[a] > forward[b])
+                    {
+                        b++;
+                    }
+                    else
+                    {
+                        total++;
+                        if (args->per_vertex)
+                        {
+                            pg_atomic_fetch_add_u64(&triangles[v], 1);
+                            pg_atomic_fetch_add_u64(&triangles[u], 1);
+                            pg_atomic_fetch_add_u64(&triangles[forward[a]], 1);
+                        }
+                        a++;
+                        b++;
+                    }
+                }
+            }
+        }
+    }
+
+#undef PRECEDES
+#undef START
+
+    if (phase == TRIANGLE_COUNT)
+        partial[begin / CSR_MORSEL_SIZE] = total;
+}
+
+/*
+ * Writes the distinct vertices that are at the other end of the edges of v in
+ * a or b, other than v, to buf in ascending order. Returns how many there are.
+ */
+static uint64 merge_neighbors(const csr_adjacency *a, const csr_adjacency *b,
+                              csr_vertex v, csr_vertex *buf)
+{
+    csr_neighbor_iterator it_a;
+    csr_neighbor_iterator it_b;
+    csr_vertex x;
+    csr_vertex y;
+    bool has_x;
+    bool has_y;
+    uint64 len = 0;
+
+    csr_begin_neighbors(a, v, &it_a);
+    csr_begin_neighbors(b, v, &it_b);
+    has_x = csr_next_neighbor(&it_a, &x);
+    has_y = csr_next_neighbor(&it_b, &y);
+
+    while (has_x || has_y)
+    {
+        csr_vertex next;
+
+        if (has_x && (!has_y || x <= y))
+            next = x;
+        else
+            next = y;
+
+        if (has_x && x == next)
+            has_x = csr_next_neighbor(&it_a, &x);
+        if (has_y && y == next)
+            has_y = csr_next_neighbor(&it_b, &y);
+
+        if (next != v && (len == 0 || buf[len - 1] != next))
+            buf[len++] = next;
+    }
+
+    return len;
+}
@@ -44,8 +44,9 @@
 #define Anum_ag_label_id 3
 #define Anum_ag_label_kind 4
 #define Anum_ag_label_relation 5
+#define Anum_ag_label_hash_partitions 6
 
-#define Natts_ag_label 5
+#define Natts_ag_label 6
 
 #define ag_label_relation_id() ag_relation_id("ag_label", "table")
 #define ag_label_oid_index_id() ag_relation_id("ag_label_oid_index", "index")
@@ -62,7 +63,7 @@
 #define LABEL_KIND_EDGE 'e'
 
 Oid insert_label(const char *label_name, Oid label_graph, int32 label_id,
-                 char label_kind, Oid label_relation);
+                 char label_kind, Oid label_relation, int32 hash_partitions);
 void delete_label(Oid relation);
 
 Oid get_label_oid(const char *label_name, Oid label_graph);
@@ -0,0 +1,47 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AG_DEGREE_COMMANDS_H
+#define AG_DEGREE_COMMANDS_H
+
+#include "postgres.h"
+
+#include "utils/graphid.h"
+
+// the side table in the graph schema that holds the degree counters
+#define AG_DEGREE_RELATION_NAME "_ag_degree"
+
+#define Anum_ag_degree_id 1
+#define Anum_ag_degree_label_id 2
+#define Anum_ag_degree_out_degree 3
+#define Anum_ag_degree_in_degree 4
+
+typedef struct degree_counters degree_counters;
+
+Oid get_degree_relation(Oid graph_namespace);
+
+void add_degree_triggers(Oid graph_namespace, Oid relid);
+void remove_degree_counters(Oid graph_namespace, int32 label_id);
+
+degree_counters *begin_degree_counters(Oid graph_namespace);
+void increment_degree_counters(degree_counters *counters, graphid start_id,
+                               graphid end_id, int32 label_id);
+void end_degree_counters(degree_counters *counters);
+
+int64 get_vertex_degree(const char *graph_name, graphid vertex_id,
+                        bool outgoing);
+
+#endif
@@ -0,0 +1,47 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AG_GRAPH_STATS_COMMANDS_H
+#define AG_GRAPH_STATS_COMMANDS_H
+
+#include "postgres.h"
+
+#include "nodes/pg_list.h"
+
+// the side tables in the graph schema that hold the graph statistics
+#define AG_EDGE_LABEL_PAIRS_RELATION_NAME "_ag_edge_label_pairs"
+#define AG_EDGE_LABEL_DEGREES_RELATION_NAME "_ag_edge_label_degrees"
+
+#define Anum_ag_edge_label_pairs_label_id 1
+#define Anum_ag_edge_label_pairs_start_label_id 2
+#define Anum_ag_edge_label_pairs_end_label_id 3
+#define Anum_ag_edge_label_pairs_edges 4
+
+#define Anum_ag_edge_label_degrees_label_id 1
+#define Anum_ag_edge_label_degrees_start_vertices 3
+#define Anum_ag_edge_label_degrees_end_vertices 7
+
+// the number of buckets of the degree histograms
+#define AG_DEGREE_HISTOGRAM_BUCKETS 10
+
+bool get_edge_label_pair_fraction(Oid graph_namespace, List *edge_label_ids,
+                                  List *vertex_label_ids, bool start,
+                                  double *fraction);
+bool get_edge_label_vertices(Oid graph_namespace, List *edge_label_ids,
+                             List *vertex_label_ids, bool start,
+                             double *vertices);
+
+#endif
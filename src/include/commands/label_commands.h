@@ -51,5 +51,8 @@
 
 Oid create_label(char *graph_name, char *label_name, char label_type,
                  List *parents);
+Oid create_partitioned_label(char *graph_name, char *label_name,
+                             char label_type, int32 hash_partitions);
+Oid get_label_storage_relation(Oid relid);
 
 #endif
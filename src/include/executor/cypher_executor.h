@@ -20,8 +20,23 @@
 #include "nodes/extensible.h"
 #include "nodes/nodes.h"
 #include "nodes/plannodes.h"
+#include "utils/relcache.h"
+
+// the number of the outer tuples Cypher Expand sorts and probes at once
+#define CYPHER_EXPAND_BATCH_SIZE 1024
 
 Node *create_cypher_create_plan_state(CustomScan *cscan);
 extern const CustomExecMethods cypher_create_exec_methods;
 
+Node *create_cypher_label_scan_plan_state(CustomScan *cscan);
+extern const CustomExecMethods cypher_label_scan_exec_methods;
+
+Node *create_cypher_multiway_join_plan_state(CustomScan *cscan);
+extern const CustomExecMethods cypher_multiway_join_exec_methods;
+
+Node *create_cypher_expand_plan_state(CustomScan *cscan);
+extern const CustomExecMethods cypher_expand_exec_methods;
+
+Oid get_adjacency_index(Relation rel, AttrNumber attnum);
+
 #endif
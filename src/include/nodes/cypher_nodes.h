@@ -228,6 +228,8 @@ typedef struct cypher_create_path
      TargetEntry *te;
      List *expr_states;
      ResultRelInfo *resultRelInfo;
+     // set when the tuples are routed to the partitions of resultRelInfo
+     ModifyTableState *modifyTableState;
      TupleTableSlot *elemTupleSlot;
      Oid relid;
      char *label_name;
@@ -24,5 +24,14 @@
 Plan *plan_cypher_create_path(PlannerInfo *root, RelOptInfo *rel,
                               CustomPath *best_path, List *tlist,
                               List *clauses, List *custom_plans);
+Plan *plan_cypher_label_scan_path(PlannerInfo *root, RelOptInfo *rel,
+                                  CustomPath *best_path, List *tlist,
+                                  List *clauses, List *custom_plans);
+Plan *plan_cypher_multiway_join_path(PlannerInfo *root, RelOptInfo *rel,
+                                     CustomPath *best_path, List *tlist,
+                                     List *clauses, List *custom_plans);
+Plan *plan_cypher_expand_path(PlannerInfo *root, RelOptInfo *rel,
+                              CustomPath *best_path, List *tlist,
+                              List *clauses, List *custom_plans);
 
 #endif
@@ -18,9 +18,24 @@
 #define AG_CYPHER_PATHNODE_H
 
 #include "nodes/pg_list.h"
+#include "nodes/extensible.h"
 #include "nodes/relation.h"
 
+extern const CustomPathMethods cypher_multiway_join_path_methods;
+extern const CustomPathMethods cypher_expand_path_methods;
+
 CustomPath *create_cypher_create_path(PlannerInfo *root, RelOptInfo *rel,
                                       List *custom_private);
+CustomPath *create_cypher_label_scan_path(PlannerInfo *root, RelOptInfo *rel,
+                                          ParamPathInfo *param_info,
+                                          Expr *probe);
+CustomPath *create_cypher_multiway_join_path(PlannerInfo *root,
+                                             RelOptInfo *joinrel,
+                                             List *edge_rels, List *clauses,
+                                             List *edge_vars, List *var_order);
+CustomPath *create_cypher_expand_path(PlannerInfo *root, RelOptInfo *joinrel,
+                                      Path *outer_path, RelOptInfo *innerrel,
+                                      List *clauses, Var *probe,
+                                      AttrNumber probe_attno, int ntables);
 
 #endif
@@ -17,7 +17,17 @@
 #ifndef AG_CYPHER_PATHS_H
 #define AG_CYPHER_PATHS_H
 
+extern bool enable_pattern_join_search;
+extern bool enable_multiway_join;
+extern bool enable_expand;
+
 void set_rel_pathlist_init(void);
 void set_rel_pathlist_fini(void);
 
+void join_search_init(void);
+void join_search_fini(void);
+
+void set_join_pathlist_init(void);
+void set_join_pathlist_fini(void);
+
 #endif
@@ -32,6 +32,9 @@ struct cypher_clause
     cypher_clause *prev; // previous clause
 };
 
+// age.approximate_count
+extern bool approximate_label_count;
+
 Query *transform_cypher_clause(cypher_parsestate *cpstate,
                                cypher_clause *clause);
 
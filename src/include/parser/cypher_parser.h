@@ -17,8 +17,10 @@
 #ifndef AG_CYPHER_PARSER_H
 #define AG_CYPHER_PARSER_H
 
+#include "lib/stringinfo.h"
 #include "nodes/pg_list.h"
 
 List *parse_cypher(const char *s);
+uint64 fingerprint_cypher(const char *s, StringInfo normalized);
 
 #endif
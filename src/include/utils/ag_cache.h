@@ -36,6 +36,7 @@ typedef struct label_cache_data
     int32 id;
     char kind;
     Oid relation;
+    int32 hash_partitions;
 } label_cache_data;
 
 // callers of these functions must not modify the returned struct
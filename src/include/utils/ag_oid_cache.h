@@ -0,0 +1,41 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AG_AG_OID_CACHE_H
+#define AG_AG_OID_CACHE_H
+
+#include "postgres.h"
+
+// the types that ag_catalog defines
+typedef enum ag_type
+{
+    AG_TYPE_AGTYPE,
+    AG_TYPE_AGTYPE_ARRAY,
+    AG_TYPE_GRAPHID,
+    AG_TYPE_GRAPHID_ARRAY,
+    NUM_AG_TYPES
+} ag_type;
+
+Oid search_namespace_oid_cache(void);
+Oid search_type_oid_cache(ag_type type);
+
+// returns InvalidOid if there is no such function in ag_catalog
+Oid search_func_name_args_cache(const char *name, int nargs,
+                                const Oid *arg_types);
+// returns NULL if the function is not in ag_catalog
+const char *search_func_oid_cache(Oid func_oid);
+
+#endif
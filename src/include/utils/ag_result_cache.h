@@ -0,0 +1,37 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AG_AG_RESULT_CACHE_H
+#define AG_AG_RESULT_CACHE_H
+
+#include "postgres.h"
+
+#include "nodes/nodes.h"
+
+// the size of a cached result, including its key
+#define RESULT_CACHE_SLOT_SIZE (32 * 1024)
+
+extern int result_cache_size;
+extern bool enable_result_cache;
+
+// requests the shared memory if the library is being preloaded
+void result_cache_init(void);
+
+// the modifications of the relation invalidate the results that read it
+void result_cache_note_write(Oid relid);
+void result_cache_note_utility(Node *utility_stmt);
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AG_AG_SHARED_CACHE_H
+#define AG_AG_SHARED_CACHE_H
+
+#include "postgres.h"
+
+#include "utils/ag_cache.h"
+
+extern int shared_cache_size;
+
+// requests the shared memory if the library is being preloaded
+void shared_cache_init(void);
+
+bool shared_cache_enabled(void);
+
+/*
+ * The generation must be read before the catalog is scanned for the data to
+ * be stored, so that the data is not stored if it has been invalidated since.
+ * Reading it makes the scan take a new catalog snapshot.
+ */
+uint64 get_shared_cache_generation(void);
+
+bool search_shared_graph_name_cache(Name name, graph_cache_data *data);
+bool search_shared_graph_namespace_cache(Oid namespace,
+                                         graph_cache_data *data);
+void store_shared_graph_cache(uint64 generation, const graph_cache_data *data);
+void invalidate_shared_graph_cache(void);
+
+bool search_shared_label_oid_cache(Oid oid, label_cache_data *data);
+bool search_shared_label_name_graph_cache(Name name, Oid graph,
+                                          label_cache_data *data);
+bool search_shared_label_graph_id_cache(Oid graph, int32 id,
+                                        label_cache_data *data);
+bool search_shared_label_relation_cache(Oid relation, label_cache_data *data);
+void store_shared_label_cache(uint64 generation, const label_cache_data *data);
+void invalidate_shared_label_cache(Oid relid);
+
+#endif
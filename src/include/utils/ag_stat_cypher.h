@@ -0,0 +1,55 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AG_AG_STAT_CYPHER_H
+#define AG_AG_STAT_CYPHER_H
+
+#include "postgres.h"
+
+#include "lib/stringinfo.h"
+#include "nodes/parsenodes.h"
+#include "portability/instr_time.h"
+
+// the Cypher queries found while a query is analyzed
+typedef struct cypher_stat_state
+{
+    struct cypher_stat_state *prev;
+    uint64 query_id;
+    StringInfo query_str; // NULL if no Cypher query has been found
+    double parse_time;
+    double analyze_time;
+} cypher_stat_state;
+
+extern int stat_cypher_max;
+extern bool track_cypher;
+
+// requests the shared memory if the library is being preloaded
+void stat_cypher_init(void);
+
+/*
+ * The Cypher queries noted between begin_cypher_stat() and end_cypher_stat()
+ * identify the query in ag_stat_cypher, through the text of its statement.
+ * cancel_cypher_stat() ends the state instead if the query fails.
+ */
+void begin_cypher_stat(cypher_stat_state *state);
+void note_cypher_stat(const char *graph_name, Oid graph_oid,
+                      const char *query_str, instr_time parse_time,
+                      instr_time analyze_time);
+void end_cypher_stat(cypher_stat_state *state, const char *source_text,
+                     Query *query);
+void cancel_cypher_stat(cypher_stat_state *state);
+
+#endif
@@ -31,6 +31,7 @@
 #include "utils/syscache.h"
 
 #include "catalog/ag_namespace.h"
+#include "utils/ag_oid_cache.h"
 
 /* Tokens used when sequentially processing an agtype value */
 typedef enum
@@ -459,13 +460,7 @@ Datum make_edge(Datum id, Datum startid, Datum endid, Datum label,
                    Datum properties);
 Datum make_path(List *path);
 // OID of agtype and _agtype
-#define AGTYPEOID \
-    (GetSysCacheOid2(TYPENAMENSP, CStringGetDatum("agtype"), \
-                     ObjectIdGetDatum(ag_catalog_namespace_id())))
-#define AGTYPEARRAYOID \
-    (GetSysCacheOid2(TYPENAMENSP, CStringGetDatum("_agtype"), \
-                     ObjectIdGetDatum(ag_catalog_namespace_id())))
-#define GRAPHIDOID \
-    (GetSysCacheOid2(TYPENAMENSP, CStringGetDatum("graphid"), \
-                     ObjectIdGetDatum(ag_catalog_namespace_id())))
+#define AGTYPEOID (search_type_oid_cache(AG_TYPE_AGTYPE))
+#define AGTYPEARRAYOID (search_type_oid_cache(AG_TYPE_AGTYPE_ARRAY))
+#define GRAPHIDOID (search_type_oid_cache(AG_TYPE_GRAPHID))
 #endif
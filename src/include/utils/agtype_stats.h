@@ -0,0 +1,41 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AG_AGTYPE_STATS_H
+#define AG_AGTYPE_STATS_H
+
+#include "postgres.h"
+
+/*
+ * pg_statistic slot kind for the per-key statistics of an agtype column.
+ *
+ * The values of the slot are agtype maps, one for each of the most common
+ * top-level keys of the objects in the column. Each map has the key itself,
+ * the fraction of rows that do not have a value for the key, the number of
+ * distinct values of the key (negative if it is a fraction of the rows as
+ * stadistinct is), the most common values with their frequencies, and a
+ * histogram of the rest of the values.
+ */
+#define STATISTIC_KIND_AGTYPE_KEYS 8300
+
+#define AGTYPE_STATS_KEY "key"
+#define AGTYPE_STATS_NULL_FRAC "null_frac"
+#define AGTYPE_STATS_N_DISTINCT "n_distinct"
+#define AGTYPE_STATS_MCV "mcv"
+#define AGTYPE_STATS_MCV_FREQS "mcv_freqs"
+#define AGTYPE_STATS_HISTOGRAM "histogram"
+
+#endif
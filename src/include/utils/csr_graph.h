@@ -0,0 +1,165 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AG_CSR_GRAPH_H
+#define AG_CSR_GRAPH_H
+
+#include "postgres.h"
+
+#include "fmgr.h"
+#include "nodes/pg_list.h"
+#include "utils/array.h"
+#include "utils/tuplestore.h"
+
+#include "utils/ag_cache.h"
+#include "utils/graphid.h"
+
+// the directory, under the data directory, that holds the CSR snapshots
+#define CSR_SNAPSHOT_DIR "pg_age"
+
+// the index of a vertex in vertex_ids of a CSR graph
+typedef uint32 csr_vertex;
+
+/*
+ * The edges of one direction. The edges of vertex v are from edge_offsets[v]
+ * to edge_offsets[v + 1]. Their other vertices are encoded from
+ * neighbors[byte_offsets[v]] on, in ascending order, as the varints of the
+ * differences between them (the first one from 0).
+ */
+typedef struct csr_adjacency
+{
+    const uint64 *edge_offsets;
+    const uint64 *byte_offsets;
+    const uint8 *neighbors;
+} csr_adjacency;
+
+/*
+ * A graph in compressed sparse row form. It is either built in memory from
+ * the label tables or mapped from a snapshot file that has the same layout.
+ * Either way, it is released along with the memory context it was made in.
+ */
+typedef struct csr_graph
+{
+    Oid graph_oid;
+    // the ids of the edge labels in ascending order, NIL for all of them
+    List *label_ids;
+    uint64 nvertices;
+    uint64 nedges;
+    // the graphids of the vertices in ascending order
+    const graphid *vertex_ids;
+    csr_adjacency out;
+    csr_adjacency in;
+    // the memory that the arrays are in
+    char *data;
+    Size size;
+    bool mapped;
+    // the device and inode of the snapshot file, if the graph is mapped
+    uint64 file_dev;
+    uint64 file_ino;
+} csr_graph;
+
+/*
+ * The edges of a graph as they are read from the label tables, before they
+ * are put in CSR form. starts and ends are the indexes of the vertices of the
+ * edges in vertex_ids.
+ */
+typedef struct csr_edge_list
+{
+    graphid *vertex_ids;
+    uint64 nvertices;
+    csr_vertex *starts;
+    csr_vertex *ends;
+    // the weights of the edges, NULL if they were not read
+    double *weights;
+    uint64 nedges;
+} csr_edge_list;
+
+typedef struct csr_neighbor_iterator
+{
+    const uint8 *pos;
+    uint64 remaining;
+    csr_vertex last;
+} csr_neighbor_iterator;
+
+List *get_csr_label_ids(graph_cache_data *cache, ArrayType *labels);
+List *get_edge_relations(graph_cache_data *cache, List *label_ids);
+
+csr_edge_list *read_csr_edges(graph_cache_data *cache, List *label_ids,
+                              const char *weight_key);
+csr_graph *build_csr_graph(graph_cache_data *cache, List *label_ids);
+csr_graph *open_csr_snapshot(graph_cache_data *cache);
+csr_graph *get_csr_graph(graph_cache_data *cache, List *label_ids);
+csr_graph *attach_csr_snapshot(Oid database_oid, Oid graph_oid,
+                               uint64 file_dev, uint64 file_ino);
+csr_graph *attach_csr_graph(char *data, Size size);
+void release_csr_graph(csr_graph *csr);
+
+void write_csr_snapshot(csr_graph *csr);
+void remove_csr_snapshot(Oid graph_oid);
+void remove_csr_snapshot_at_commit(Oid graph_oid);
+
+int64 csr_vertex_index(const csr_graph *csr, graphid id);
+int64 bsearch_graphid(const graphid *ids, uint64 n, graphid id);
+int compare_graphids(const void *a, const void *b);
+void check_select_privilege(Oid relid);
+void *alloc_csr_array(uint64 nelems, Size elem_size);
+
+// for the functions that take a graph name and edge labels and run on a CSR
+graph_cache_data *get_graph_cache_arg(FunctionCallInfo fcinfo, int argno);
+csr_graph *get_csr_graph_arg(FunctionCallInfo fcinfo, int graph_argno,
+                             int labels_argno);
+Tuplestorestate *begin_csr_result(FunctionCallInfo fcinfo,
+                                  TupleDesc *tupdesc);
+
+static inline uint64 csr_degree(const csr_adjacency *adj, csr_vertex v)
+{
+    return adj->edge_offsets[v + 1] - adj->edge_offsets[v];
+}
+
+static inline void csr_begin_neighbors(const csr_adjacency *adj, csr_vertex v,
+                                       csr_neighbor_iterator *it)
+{
+    it->pos = adj->neighbors + adj->byte_offsets[v];
+    it->remaining = csr_degree(adj, v);
+    it->last = 0;
+}
+
+static inline bool csr_next_neighbor(csr_neighbor_iterator *it,
+                                     csr_vertex *v)
+{
+    uint32 delta = 0;
+    int shift = 0;
+    uint8 b;
+
+    if (it->remaining == 0)
+        return false;
+
+    do
+    {
+        b = *it->pos++;
+        delta |= (uint32)(b & 0x7F) << shift;
+        shift += 7;
+    } while (b & 0x80);
+
+    it->last += delta;
+    it->remaining--;
+
+    *v = it->last;
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2020 Bitnine Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AG_CSR_TRAVERSAL_H
+#define AG_CSR_TRAVERSAL_H
+
+#include "postgres.h"
+
+#include "fmgr.h"
+#include "postmaster/bgworker.h"
+#include "storage/dsm.h"
+
+#include "utils/csr_graph.h"
+#include "utils/graphid.h"
+
+// the number of the items of a step a participant claims at once by default
+#define CSR_MORSEL_SIZE 1024
+
+typedef enum traversal_direction
+{
+    TRAVERSAL_OUT = 1,
+    TRAVERSAL_IN = 2,
+    TRAVERSAL_BOTH = TRAVERSAL_OUT | TRAVERSAL_IN
+} traversal_direction;
+
+// what the participants of a job do with the items of its steps
+typedef enum csr_kernel
+{
+    CSR_KERNEL_BFS,
+    CSR_KERNEL_PAGERANK,
+    CSR_KERNEL_BETWEENNESS,
+    CSR_KERNEL_WEAK_COMPONENTS,
+    CSR_KERNEL_TRIANGLES,
+    CSR_KERNEL_LABEL_PROPAGATION,
+    CSR_KERNEL_LOUVAIN
+} csr_kernel;
+
+typedef struct csr_job_shared csr_job_shared;
+
+/*
+ * A participant's view of a job on a CSR graph. The backend is participant
+ * 0, and the workers are numbered from 1 on. The shared memory of the job is
+ * mapped at base, and args points to the arguments of the kernel in it.
+ */
+typedef struct csr_job
+{
+    csr_job_shared *shared;
+    char *base;
+    // NULL for a job begun by begin_graph_job()
+    csr_graph *csr;
+    void *args;
+    int participant;
+    // the number of the participants the job was planned for
+    int nparticipants;
+    // what the kernel keeps in the participant between morsels, if anything
+    void *local;
+    // the rest is used by the backend only
+    csr_kernel kernel;
+    Size args_offset;
+    int nworkers;
+    int nlaunched;
+    Size size;
+    dsm_segment *seg;
+    BackgroundWorkerHandle **handles;
+    uint32 step;
+} csr_job;
+
+/*
+ * Processes the items from begin to end of a step of the given phase. What
+ * the items and the phases are is up to the kernel.
+ */
+typedef void (*csr_kernel_func)(csr_job *job, uint32 phase, uint64 begin,
+                                uint64 end);
+
+extern int max_traversal_workers;
+extern int traversal_parallel_threshold;
+
+csr_job *begin_csr_job(csr_graph *csr, csr_kernel kernel, Size args_size);
+csr_job *begin_graph_job(uint64 nedges, csr_kernel kernel, Size args_size);
+Size reserve_csr_job_space(csr_job *job, Size size);
+void start_csr_job(csr_job *job);
+void run_csr_job_step(csr_job *job, uint32 phase, uint64 nitems,
+                      uint64 morsel_size);
+void end_csr_job(csr_job *job);
+
+// returns the memory that was reserved at the offset
+static inline void *csr_job_space(csr_job *job, Size offset)
+{
+    return job->base + offset;
+}
+
+int32 *csr_bfs(csr_graph *csr, const csr_vertex *sources, uint64 nsources,
+               traversal_direction direction, int32 max_depth);
+
+PGDLLEXPORT void csr_traversal_worker_main(Datum main_arg);
+
+// the kernels of the graph analytics, run by csr_kernels[] in the workers
+void pagerank_morsel(csr_job *job, uint32 phase, uint64 begin, uint64 end);
+void betweenness_morsel(csr_job *job, uint32 phase, uint64 begin,
+                        uint64 end);
+void weak_components_morsel(csr_job *job, uint32 phase, uint64 begin,
+                            uint64 end);
+void triangles_morsel(csr_job *job, uint32 phase, uint64 begin, uint64 end);
+void label_propagation_morsel(csr_job *job, uint32 phase, uint64 begin,
+                              uint64 end);
+void louvain_morsel(csr_job *job, uint32 phase, uint64 begin, uint64 end);
+
+// for the functions that traverse a graph from a set of vertices
+traversal_direction get_traversal_direction_arg(FunctionCallInfo fcinfo,
+                                                int argno,
+                                                traversal_direction def);
+graphid *get_seeds_arg(FunctionCallInfo fcinfo, int argno, int64 *nseeds);
+
+#endif
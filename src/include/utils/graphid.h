@@ -23,6 +23,7 @@
 #include "utils/syscache.h"
 
 #include "catalog/ag_namespace.h"
+#include "utils/ag_oid_cache.h"
 
 typedef int64 graphid;
 
@@ -48,12 +49,8 @@ typedef int64 graphid;
 #define AG_RETURN_GRAPHID(x) return GRAPHID_GET_DATUM(x)
 
 // OID of graphid and _graphid
-#define GRAPHIDOID \
-    (GetSysCacheOid2(TYPENAMENSP, CStringGetDatum("graphid"), \
-                     ObjectIdGetDatum(ag_catalog_namespace_id())))
-#define GRAPHIDARRAYOID \
-    (GetSysCacheOid2(TYPENAMENSP, CStringGetDatum("_graphid"), \
-                     ObjectIdGetDatum(ag_catalog_namespace_id())))
+#define GRAPHIDOID (search_type_oid_cache(AG_TYPE_GRAPHID))
+#define GRAPHIDARRAYOID (search_type_oid_cache(AG_TYPE_GRAPHID_ARRAY))
 
 graphid make_graphid(const int32 label_id, const int64 entry_id);
 int32 get_graphid_label_id(const graphid gid);